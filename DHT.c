@@ -1,4 +1,6 @@
-﻿#include "DHT.h"
+﻿#include <util/atomic.h>
+#include "DHT.h"
+#include "timebase.h"
 
 //----- Auxiliary data ----------//
 enum DHT_STATUS_t DHT_STATUS = DHT_OK;
@@ -9,18 +11,50 @@ enum DHT_STATUS_t DHT_STATUS = DHT_OK;
 	#define _DHT_HUM_MIN	20
 	#define _DHT_HUM_MAX	90
 	#define _DHT_DELAY_READ	50
+	#define _DHT_INTERVAL_US	1000000UL	//One new value per second
 #elif (DHT_TYPE == DHT22)
 	#define _DHT_TEMP_MIN	-40
 	#define _DHT_TEMP_MAX	80
 	#define _DHT_HUM_MIN	0
 	#define _DHT_HUM_MAX	100
 	#define _DHT_DELAY_READ	20
+	#define _DHT_INTERVAL_US	2000000UL	//One new value every two seconds
 #endif
+
+//Start signal lengths for DHT_readBus(), which may mix both types
+#define _DHT11_DELAY_READ		50
+#define _DHT22_DELAY_READ		20
+//Falling edges per transfer: response start, start of the first bit and one
+//ending each of the 40 bits
+#define _DHT_BUS_EDGES			42
+//Long enough for the slowest sensor to send 40 '1' bits (~5.4 ms), in
+//Timer1 counts of 1 us
+#define _DHT_BUS_TIMEOUT_US		8000
+
+//Decoder state of one sensor during DHT_readBus(), times in Timer1 counts
+struct _DHT_decoder_t
+{
+	uint8_t falls;
+	uint16_t fallTime;
+	uint16_t riseTime;
+	uint16_t lowSum;					//Low times in front of the bits
+	uint8_t high[40];					//High time of every bit, at most 255
+	uint8_t data[5];
+};
 //-------------------------------//
 
 //----- Prototypes ----------------------------//
+static void readValues(double *temp, double *hum);
+static uint8_t acquireCache(sensor_cache_t *cache);
 static double dataToTemp(uint8_t x1, uint8_t x2);
 static double dataToHum(uint8_t x1, uint8_t x2);
+static void busDecode(struct _DHT_decoder_t *d);
+static void busStore(DHT_sensor_t *sensor, const uint8_t data[5]);
+//---------------------------------------------//
+
+//----- Reading cache -------------------------//
+static double cacheTemp, cacheHum;				//Values of the cached reading
+sensor_cache_t DHT_cache = SENSOR_CACHE(acquireCache, SENSOR_SOURCE_SINGLE, 0, _DHT_INTERVAL_US);
 //---------------------------------------------//
 
 //----- Functions -----------------------------//
@@ -164,19 +198,59 @@ void DHT_readRaw(uint8_t arr[4])
 	//---------------------------------------------------
 }
 
+//Both halves of one reading; a temperature and a humidity call in a row
+//cost a single transfer
 void DHT_readTemperature(double *temp)
 {
 	double waste[1];
-	DHT_read(temp, waste);
+	DHT_readCached(temp, waste, _DHT_INTERVAL_US);
 }
 
 void DHT_readHumidity(double *hum)
 {
 	double waste[1];
-	DHT_read(waste, hum);
+	DHT_readCached(waste, hum, _DHT_INTERVAL_US);
 }
 
+//Always transfers; the reading also goes into DHT_cache
 void DHT_read(double *temp, double *hum)
+{
+	uint32_t stamp = timebase_now();
+
+	readValues(temp, hum);
+	if (DHT_STATUS == DHT_OK)
+	{
+		cacheTemp = *temp;
+		cacheHum = *hum;
+	}
+	sensor_cache_store(&DHT_cache, stamp, SENSOR_SOURCE_SINGLE, DHT_STATUS);
+}
+
+//Reading no older than maxAge us, transferring only when the cached one is
+//older and the sensor has had time for a new value. temp and hum are set
+//unless the result is SENSOR_CACHE_EMPTY; DHT_STATUS holds the result of
+//the last transfer.
+enum SENSOR_CACHE_STATUS_t DHT_readCached(double *temp, double *hum, uint32_t maxAge)
+{
+	enum SENSOR_CACHE_STATUS_t status = sensor_cache_get(&DHT_cache, maxAge);
+
+	if (DHT_cache.valid)
+	{
+		*temp = cacheTemp;
+		*hum = cacheHum;
+	}
+	DHT_STATUS = DHT_cache.status;
+	return status;
+}
+
+static uint8_t acquireCache(sensor_cache_t *cache)
+{
+	(void)cache;
+	readValues(&cacheTemp, &cacheHum);
+	return DHT_STATUS;
+}
+
+static void readValues(double *temp, double *hum)
 {
 	uint8_t data[4] = {0, 0, 0, 0};
 
@@ -208,6 +282,176 @@ double DHT_convertToKelvin(double temp)
 	return (temp + 273.15);
 }
 
+//Reads up to DHT_BUS_MAX sensors; a longer bus isn't touched and all its
+//sensors report DHT_ERROR_TIMEOUT
+void DHT_readBus(DHT_bus_t *bus)
+{
+	struct _DHT_decoder_t dec[DHT_BUS_MAX];
+	uint8_t mask = 0, done = 0, last, now, changed;
+	uint8_t i;
+	uint16_t start, time;
+
+	if (bus->count > DHT_BUS_MAX)
+	{
+		for (i = 0 ; i < bus->count ; i++)
+			bus->sensors[i].status = DHT_ERROR_TIMEOUT;
+		return;
+	}
+
+	//----- Step 1 - Start all sensors at once -----
+	uint8_t dht11 = 0;
+	for (i = 0 ; i < bus->count ; i++)
+	{
+		mask |= bus->sensors[i].mask;
+		if (bus->sensors[i].type == DHT11)
+			dht11 = 1;
+		dec[i].falls = 0;
+		dec[i].lowSum = 0;
+		dec[i].data[0] = dec[i].data[1] = dec[i].data[2] = 0;
+		dec[i].data[3] = dec[i].data[4] = 0;
+	}
+
+	*bus->port &= ~mask;					//Pins = 0
+	*bus->ddr |= mask;						//Pins = Output
+	if (dht11)								//The DHT11 needs the longer start
+		_delay_ms(_DHT11_DELAY_READ);
+	else
+		_delay_ms(_DHT22_DELAY_READ);
+
+	*bus->port |= mask;						//Pins = 1 (Pull-up resistor)
+	*bus->ddr &= ~mask;						//Pins = Input
+	bus->timestamp = timebase_now();		//The sensors answer from here on
+	//-----------------------------------------------
+
+	//----- Step 2 - Sample the whole port and time the edges -----
+	//Every sensor is timed from the same PINx samples, so the transfers run
+	//in parallel however much their timing differs. The edges are stamped
+	//with Timer1, which counts the timebase's 1 us, so the stamps are right
+	//however long a pass of the loop takes; a pass blurs every edge by its
+	//length, about 17 cycles when idle, i.e. 17 us at 1 MHz. Interrupts are
+	//held off for the ~6 ms so they add no more blur and the 16-bit TCNT1
+	//read is safe; the timebase overflow and the alarm tick stay pending.
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		start = TCNT1;
+		last = mask;						//Released, the pull-ups hold the lines high
+		for (;;)
+		{
+			//An idle pass is kept short, everything else waits for an edge
+			_delay_us(DHT_BUS_POLL_US);
+			now = *bus->pin & mask;
+			time = TCNT1 - start;
+			changed = now ^ last;
+			if (!changed)
+			{
+				if (time >= _DHT_BUS_TIMEOUT_US)
+					break;
+				continue;
+			}
+			last = now;
+
+			for (i = 0 ; i < bus->count ; i++)
+			{
+				struct _DHT_decoder_t *d = &dec[i];
+				if (!(changed & bus->sensors[i].mask) || d->falls >= _DHT_BUS_EDGES)
+					continue;
+
+				if (now & bus->sensors[i].mask)
+				{
+					//Rising edge; from the second fall on it ends the low
+					//in front of a data bit
+					d->riseTime = time;
+					if (d->falls >= 2)
+						d->lowSum += time - d->fallTime;
+				}
+				else
+				{
+					//Falling edge; from the third one on it ends a data bit
+					if (d->falls >= 2)
+					{
+						uint16_t high = time - d->riseTime;
+						d->high[d->falls - 2] = high > 255 ? 255 : high;
+					}
+					d->fallTime = time;
+					if (++d->falls == _DHT_BUS_EDGES)
+						done++;
+				}
+			}
+			if (done == bus->count)
+				break;
+		}
+	}
+	//---------------------------------------------------------------
+
+	//----- Step 3 - Decode, check checksums and store values -----
+	for (i = 0 ; i < bus->count ; i++)
+	{
+		if (dec[i].falls == _DHT_BUS_EDGES)
+			busDecode(&dec[i]);
+		if (dec[i].falls < _DHT_BUS_EDGES)
+			bus->sensors[i].status = DHT_ERROR_TIMEOUT;
+		else if (((uint8_t)(dec[i].data[0] + dec[i].data[1] + dec[i].data[2] + dec[i].data[3])) != dec[i].data[4])
+			bus->sensors[i].status = DHT_ERROR_CHECKSUM;
+		else
+			busStore(&bus->sensors[i], dec[i].data);
+	}
+	//-----------------------------------------------------
+}
+
+//A '0' is high for about half the 50 us low in front of it, a '1' for
+//about 1.4 times that. With both kinds in the transfer the highs are split
+//midway between the shortest and the longest, and the threshold is put
+//midway between the mean of each half, which averages the loop's blur out
+//and follows a sensor whose timing is off by the same factor throughout.
+//Highs that all look alike are one kind, told apart by the mean low time.
+static void busDecode(struct _DHT_decoder_t *d)
+{
+	uint8_t k, min = 255, max = 0, n = 0;
+	uint16_t threshold = d->lowSum / 40, sum[2] = {0, 0};
+
+	for (k = 0 ; k < 40 ; k++)
+	{
+		if (d->high[k] < min)
+			min = d->high[k];
+		if (d->high[k] > max)
+			max = d->high[k];
+	}
+	if (max - min > threshold / 2)
+	{
+		threshold = ((uint16_t)min + max) / 2;
+		for (k = 0 ; k < 40 ; k++)
+		{
+			if (d->high[k] > threshold)
+				n++;
+			sum[d->high[k] > threshold] += d->high[k];
+		}
+		threshold = (sum[0] / (40 - n) + sum[1] / n) / 2;
+	}
+
+	for (k = 0 ; k < 40 ; k++)
+		if (d->high[k] > threshold)
+			bitSet(d->data[k >> 3], (7 - (k & 7)));
+}
+
+static void busStore(DHT_sensor_t *sensor, const uint8_t data[5])
+{
+	sensor->status = DHT_OK;
+	if (sensor->type == DHT11)
+	{
+		//Integral and decimal bytes
+		sensor->humidity = data[0] * 10 + data[1];
+		sensor->temperature = data[2] * 10 + data[3];
+	}
+	else
+	{
+		//Tenths, sign in bit 15 of the temperature
+		sensor->humidity = ((uint16_t)data[0] << 8) | data[1];
+		sensor->temperature = (((uint16_t)(data[2] & 0x7F)) << 8) | data[3];
+		if (bitCheck(data[2], 7))
+			sensor->temperature = -sensor->temperature;
+	}
+}
+
 static double dataToTemp(uint8_t x1, uint8_t x2)
 {
 	double temp = 0.0;
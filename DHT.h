@@ -1,4 +1,4 @@
-#ifndef DHT_H_INCLUDED
+﻿#ifndef DHT_H_INCLUDED
 #define DHT_H_INCLUDED
 /*
 ||
@@ -17,6 +17,7 @@
 #include <avr/io.h> 
 #include "IO_MACROS.h"
 #include "DHT_CONFIG.h"
+#include "sensor_cache.h"
 //----------------------//
 
 //----- Auxiliary data -------------------//
@@ -35,6 +36,36 @@ enum DHT_STATUS_t
 };
 
 extern enum DHT_STATUS_t DHT_STATUS;
+
+//Last reading of the DHT_PIN sensor, see DHT_readCached()
+extern sensor_cache_t DHT_cache;
+
+//One sensor of a multi-sensor bus, values in tenths of a degree / percent
+typedef struct
+{
+	uint8_t mask;						//Bit of the sensor in its port
+	uint8_t type;						//DHT11 or DHT22
+	enum DHT_STATUS_t status;			//Result of the last read
+	int16_t temperature;				//Last good value, 0.1 degC
+	uint16_t humidity;					//Last good value, 0.1 %RH
+} DHT_sensor_t;
+
+//Sensors sharing one port, read together by DHT_readBus(); one per port bit
+#define DHT_BUS_MAX					8
+typedef struct
+{
+	volatile uint8_t *port;
+	volatile uint8_t *ddr;
+	volatile uint8_t *pin;
+	DHT_sensor_t *sensors;
+	uint8_t count;
+	uint32_t timestamp;					//timebase_now() when the sensors started sending
+} DHT_bus_t;
+
+//e.g. DHT_sensor_t s[2] = {DHT_SENSOR(DHT11, 6), DHT_SENSOR(DHT22, 7)};
+//     DHT_bus_t bus = DHT_BUS(D, s, 2);
+#define DHT_SENSOR(type, bit)		{(1 << (bit)), (type), DHT_OK, 0, 0}
+#define DHT_BUS(port, sensors, count)	{&PORT(port), &DDR(port), &PIN(port), (sensors), (count), 0}
 //-----------------------------------------//
 
 //----- Prototypes---------------------------//
@@ -43,7 +74,9 @@ void DHT_readRaw(uint8_t arr[4]);
 void DHT_readTemperature(double *temp);
 void DHT_readHumidity(double *hum);
 void DHT_read(double *temp, double *hum);
+enum SENSOR_CACHE_STATUS_t DHT_readCached(double *temp, double *hum, uint32_t maxAge);
 double DHT_convertToFahrenheit(double temp);
 double DHT_convertToKelvin(double temp);
+void DHT_readBus(DHT_bus_t *bus);
 //-------------------------------------------//
 #endif
\ No newline at end of file
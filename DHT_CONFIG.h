@@ -16,5 +16,6 @@
 //----- Configuration --------------------------//
 #define DHT_TYPE	DHT11         //DHT11 or DHT22
 #define DHT_PIN		D, 7
+#define DHT_BUS_POLL_US	1			//Pause between two samples of DHT_readBus()
 //----------------------------------------------//
 #endif
\ No newline at end of file
@@ -0,0 +1,40 @@
+﻿#ifndef MPU9250_CONFIG_H_
+#define MPU9250_CONFIG_H_
+/*
+||
+||  Filename:	 		MPU9250_CONFIG.h
+||  Title: 			    MPU-9250 Driver Settings
+||  Compiler:		 	AVR-GCC
+||	Description:
+||	Compile time settings for the MPU-9250 and AK8963.
+||	Pick a full scale range for each sensor, the
+||	magnetometer mode and the sample rate divider.
+||	Scale factors and register values are derived
+||	from these in mpu9250.h. With MPU_RUNTIME_CONFIG
+||	set the ranges become variables that
+||	mpu_configure() may change; without it
+||	only rates and bandwidths can change.
+||
+*/
+
+//----- Configuration --------------------------//
+#define MPU_GSCALE		GFS_250DPS	//GFS_250DPS, GFS_500DPS, GFS_1000DPS or GFS_2000DPS
+#define MPU_ASCALE		AFS_2G		//AFS_2G, AFS_4G, AFS_8G or AFS_16G
+#define MPU_MSCALE		MFS_16BITS	//MFS_14BITS or MFS_16BITS
+#define MPU_MMODE		M_8HZ		//M_8HZ or M_100HZ
+#define MPU_DLPF_CFG	0x03		//Gyro 41 Hz, thermometer 42 Hz bandwidth
+#define MPU_A_DLPF_CFG	0x03		//Accel 41 Hz bandwidth, 1 kHz rate
+#define MPU_SMPLRT_DIV	0x04		//1 kHz / (1 + 4) = 200 Hz
+#ifndef MPU_RUNTIME_CONFIG
+//0: mpu_configure() changes rates and bandwidths only and rejects
+//any other full scale range with MPU_ERROR_CONFIG, the conversions
+//fold into constants. 1: the full scale ranges can change at run
+//time too, at the cost of a load per conversion.
+#define MPU_RUNTIME_CONFIG	0
+#endif
+#ifndef MPU_SPI_ENABLE
+#define MPU_SPI_ENABLE	0			//1 adds the SPI transport, see mpu_spi.h
+#endif
+#define MPU_SPI_CS_PORT	B			//Port of the SPI chip select pins
+//----------------------------------------------//
+#endif
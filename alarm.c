@@ -0,0 +1,209 @@
+#ifndef  F_CPU
+#define F_CPU 1000000
+#endif
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+#include "IO_MACROS.h"
+#include "alarm.h"
+
+#define ALARM_OCR0A		(F_CPU / 1024 / ALARM_TICK_HZ - 1)
+
+#if ALARM_OCR0A < 1 || ALARM_OCR0A > 255
+#error "ALARM_TICK_HZ is out of reach of Timer0 at this F_CPU"
+#endif
+
+volatile uint8_t alarm_active;
+
+static alarm_channel_t alarm_channels[ALARM_CHANNELS];
+static volatile uint8_t alarm_pattern;
+static volatile uint8_t alarm_step;
+
+// LED and buzzer state for each pattern, bit n is the output in step n. Step
+// 0 is shown as soon as a pattern starts, so it has the LED on.
+static const uint16_t alarm_patterns[ALARM_PATTERNS][2] PROGMEM = {
+	{0x0000, 0x0000},  // ALARM_PATTERN_OFF
+	{0x00FF, 0x0000},  // ALARM_PATTERN_BLINK
+	{0x0F0F, 0x0303},  // ALARM_PATTERN_BEEP
+	{0x5555, 0xFFFF}   // ALARM_PATTERN_CRITICAL
+};
+
+static void alarm_output(void)
+{
+	uint16_t led = pgm_read_word(&alarm_patterns[alarm_pattern][0]);
+	uint16_t buzzer = pgm_read_word(&alarm_patterns[alarm_pattern][1]);
+
+	digitalWrite(ALARM_LED_PIN, (led >> alarm_step) & 1);
+	digitalWrite(ALARM_BUZZER_PIN, (buzzer >> alarm_step) & 1);
+}
+
+// Show the most severe pattern among the active channels. Runs with
+// interrupts disabled.
+static void alarm_update(void)
+{
+	uint8_t i, pattern = ALARM_PATTERN_OFF;
+
+	for (i = 0; i < ALARM_CHANNELS; i++)
+	{
+		if (alarm_channels[i].active && alarm_channels[i].limit.pattern > pattern)
+		{
+			pattern = alarm_channels[i].limit.pattern;
+		}
+	}
+	if (pattern == alarm_pattern)
+	{
+		return;
+	}
+
+	// Restart the pattern and the step timer so step 0 lasts a full tick
+	alarm_pattern = pattern;
+	alarm_step = 0;
+	TCNT0 = 0;
+	alarm_output();
+	if (pattern == ALARM_PATTERN_OFF)
+	{
+		TIMSK0 &= ~(1 << OCIE0A);
+	}
+	else
+	{
+		TIFR0 = (1 << OCF0A);
+		TIMSK0 |= (1 << OCIE0A);
+	}
+}
+
+ISR(TIMER0_COMPA_vect)
+{
+	alarm_step = (alarm_step + 1) & 15;
+	alarm_output();
+}
+
+// Outputs off, all channels disabled and Timer0 set up for the pattern
+// steps. Interrupts have to be enabled for the patterns to run.
+void alarm_init(void)
+{
+	uint8_t i;
+
+	digitalWrite(ALARM_LED_PIN, LOW);
+	digitalWrite(ALARM_BUZZER_PIN, LOW);
+	pinMode(ALARM_LED_PIN, OUTPUT);
+	pinMode(ALARM_BUZZER_PIN, OUTPUT);
+
+	for (i = 0; i < ALARM_CHANNELS; i++)
+	{
+		alarm_channels[i].limit.low = ALARM_NO_LOW;
+		alarm_channels[i].limit.high = ALARM_NO_HIGH;
+		alarm_channels[i].limit.hysteresis = 0;
+		alarm_channels[i].limit.debounce = 1;
+		alarm_channels[i].limit.pattern = ALARM_PATTERN_OFF;
+		alarm_channels[i].count = 0;
+		alarm_channels[i].active = 0;
+	}
+	alarm_active = 0;
+	alarm_pattern = ALARM_PATTERN_OFF;
+
+	// CTC mode, clk / 1024, compare interrupt enabled while a pattern runs
+	TIMSK0 &= ~(1 << OCIE0A);
+	TCCR0A = (1 << WGM01);
+	OCR0A = ALARM_OCR0A;
+	TCCR0B = (1 << CS02) | (1 << CS00);
+}
+
+void alarm_set_limit(uint8_t channel, const alarm_limit_t * limit)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		alarm_channels[channel].limit = *limit;
+		if (alarm_channels[channel].limit.debounce == 0)
+		{
+			alarm_channels[channel].limit.debounce = 1;
+		}
+		alarm_channels[channel].count = 0;
+		alarm_update();
+	}
+}
+
+// A limit moved by the hysteresis, held inside the range of int16_t
+static int16_t alarm_saturate(int32_t x)
+{
+	return x > INT16_MAX ? INT16_MAX : x < INT16_MIN ? INT16_MIN : (int16_t)x;
+}
+
+// Check one sample against its channel's limits. A channel goes into alarm
+// after debounce consecutive samples outside [low, high] and leaves it after
+// debounce consecutive samples inside [low + hysteresis, high - hysteresis].
+// The outputs change within this call. Returns whether the channel is in
+// alarm.
+uint8_t alarm_feed(uint8_t channel, int16_t value)
+{
+	alarm_channel_t * ch = &alarm_channels[channel];
+	int16_t low = ch->limit.low;
+	int16_t high = ch->limit.high;
+	uint8_t out;
+
+	// Once active the limits move inwards by the hysteresis
+	if (ch->active)
+	{
+		if (low != ALARM_NO_LOW)
+		{
+			low = alarm_saturate((int32_t)low + ch->limit.hysteresis);
+		}
+		if (high != ALARM_NO_HIGH)
+		{
+			high = alarm_saturate((int32_t)high - ch->limit.hysteresis);
+		}
+	}
+	out = value < low || value > high;
+
+	if (out == ch->active)
+	{
+		ch->count = 0;
+		return out;
+	}
+	if (++ch->count < ch->limit.debounce)
+	{
+		return ch->active;
+	}
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		ch->count = 0;
+		ch->active = out;
+		if (out)
+		{
+			alarm_active |= 1 << channel;
+		}
+		else
+		{
+			alarm_active &= ~(1 << channel);
+		}
+		alarm_update();
+	}
+	return out;
+}
+
+static uint16_t alarm_abs(int16_t x)
+{
+	return x < 0 ? -(uint16_t)x : x;
+}
+
+// Feed ALARM_ACCEL and ALARM_TILT from one accelerometer sample in mg. The
+// horizontal magnitude uses max + 3/8 min instead of a square root, which
+// reads up to 7 % high.
+void alarm_feed_accel(const int16_t * mg)
+{
+	uint16_t x = alarm_abs(mg[0]);
+	uint16_t y = alarm_abs(mg[1]);
+	uint16_t z = alarm_abs(mg[2]);
+	uint16_t peak, hi, lo;
+
+	peak = x > y ? x : y;
+	peak = peak > z ? peak : z;
+	alarm_feed(ALARM_ACCEL, peak > INT16_MAX ? INT16_MAX : peak);
+
+	hi = x > y ? x : y;
+	lo = x > y ? y : x;
+	hi = hi + (lo >> 2) + (lo >> 3);
+	alarm_feed(ALARM_TILT, hi > INT16_MAX ? INT16_MAX : hi);
+}
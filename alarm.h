@@ -0,0 +1,74 @@
+#ifndef ALARM_H_INCLUDED
+#define ALARM_H_INCLUDED
+
+#include <inttypes.h>
+
+// Threshold alarms with hysteresis and debounce. alarm_feed() is called with
+// every new sample straight from the acquisition path (it may run in an ISR,
+// it only does integer compares) and switches the LED and buzzer the moment a
+// channel trips. While an alarm is active Timer0 steps the outputs through
+// the blink/beep pattern of the most severe active channel.
+//
+// The alarm is only as quick as its feed. main.c feeds the accelerometer
+// from FIFO drains that its loop polls between LCD refreshes, not from an
+// interrupt, so a shock lights the LED about 14 ms later on average and up
+// to about 65 ms later when the once a second DHT read blocks the loop
+// (tools/alarm_test.c on the simulated sensors). Samples are not lost
+// meanwhile, they wait in the FIFO.
+
+// Outputs, IO_MACROS pin specs
+#define ALARM_LED_PIN		A, 0
+#define ALARM_BUZZER_PIN	A, 1
+
+// Pattern step rate; a pattern is 16 steps, i.e. one second at 16 Hz.
+// Timer0 runs from F_CPU / 1024 in CTC mode.
+#define ALARM_TICK_HZ		16
+
+enum ALARM_CHANNEL_t
+{
+	ALARM_ACCEL,        // largest axis in mg
+	ALARM_TILT,         // horizontal acceleration in mg, 1000 * sin(tilt) at rest
+	ALARM_TEMPERATURE,  // 0.1 °C
+	ALARM_HUMIDITY,     // 0.1 %
+	ALARM_CHANNELS
+};
+
+// Output patterns in rising severity; the most severe active one is shown
+enum ALARM_PATTERN_t
+{
+	ALARM_PATTERN_OFF,
+	ALARM_PATTERN_BLINK,     // LED blinks slowly, buzzer quiet
+	ALARM_PATTERN_BEEP,      // LED and buzzer pulse twice a second
+	ALARM_PATTERN_CRITICAL,  // LED flashes, buzzer on continuously
+	ALARM_PATTERNS
+};
+
+// Disable one side of a limit
+#define ALARM_NO_LOW	INT16_MIN
+#define ALARM_NO_HIGH	INT16_MAX
+
+typedef struct
+{
+	int16_t low;         // alarm below this, ALARM_NO_LOW to disable
+	int16_t high;        // alarm above this, ALARM_NO_HIGH to disable
+	int16_t hysteresis;  // an alarm clears this far inside the limits
+	uint8_t debounce;    // consecutive samples needed to change state, >= 1
+	uint8_t pattern;     // enum ALARM_PATTERN_t shown while active
+} alarm_limit_t;
+
+typedef struct
+{
+	alarm_limit_t limit;
+	uint8_t count;       // samples the pending state change has lasted
+	uint8_t active;
+} alarm_channel_t;
+
+// Bit n set while channel n is in alarm
+extern volatile uint8_t alarm_active;
+
+void alarm_init(void);
+void alarm_set_limit(uint8_t channel, const alarm_limit_t * limit);
+uint8_t alarm_feed(uint8_t channel, int16_t value);
+void alarm_feed_accel(const int16_t * mg);
+
+#endif
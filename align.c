@@ -0,0 +1,398 @@
+#ifndef  F_CPU
+#define F_CPU 1000000
+#endif
+
+#include <string.h>
+#include <avr/pgmspace.h>
+#include "align.h"
+
+#define ALIGN_MASK		(ALIGN_HISTORY - 1)
+
+// Catmull-Rom taps in Q14 for the samples before, at, after and two after
+// the frame time, at fractional positions i / ALIGN_PHASES; each row sums to
+// 16384. The last row is the next sample itself, for rounding up to it.
+static const int16_t align_taps[ALIGN_PHASES + 1][4] PROGMEM = {
+	{     0,  16384,      0,      0},
+	{  -240,  16345,    287,     -8},
+	{  -450,  16230,    634,    -30},
+	{  -631,  16044,   1036,    -65},
+	{  -784,  15792,   1488,   -112},
+	{  -911,  15478,   1986,   -169},
+	{ -1014,  15106,   2526,   -234},
+	{ -1094,  14681,   3103,   -306},
+	{ -1152,  14208,   3712,   -384},
+	{ -1190,  13691,   4349,   -466},
+	{ -1210,  13134,   5010,   -550},
+	{ -1213,  12542,   5690,   -635},
+	{ -1200,  11920,   6384,   -720},
+	{ -1173,  11272,   7088,   -803},
+	{ -1134,  10602,   7798,   -882},
+	{ -1084,   9915,   8509,   -956},
+	{ -1024,   9216,   9216,  -1024},
+	{  -956,   8509,   9915,  -1084},
+	{  -882,   7798,  10602,  -1134},
+	{  -803,   7088,  11272,  -1173},
+	{  -720,   6384,  11920,  -1200},
+	{  -635,   5690,  12542,  -1213},
+	{  -550,   5010,  13134,  -1210},
+	{  -466,   4349,  13691,  -1190},
+	{  -384,   3712,  14208,  -1152},
+	{  -306,   3103,  14681,  -1094},
+	{  -234,   2526,  15106,  -1014},
+	{  -169,   1986,  15478,   -911},
+	{  -112,   1488,  15792,   -784},
+	{   -65,   1036,  16044,   -631},
+	{   -30,    634,  16230,   -450},
+	{    -8,    287,  16345,   -240},
+	{     0,      0,  16384,      0}
+};
+
+void align_init(align_t * align, uint32_t period, uint32_t latency)
+{
+	memset(align, 0, sizeof(*align));
+	align->period = period;
+	align->latency = latency;
+}
+
+// Returns the stream number, or -1 when all ALIGN_STREAMS_MAX are in use
+int8_t align_add_stream(align_t * align, uint8_t channels, uint8_t mode,
+	uint32_t max_age)
+{
+	align_stream_t * s;
+
+	if (align->streams >= ALIGN_STREAMS_MAX || channels == 0 ||
+		channels > ALIGN_CHANNELS_MAX)
+	{
+		return -1;
+	}
+	s = &align->stream[align->streams];
+	s->channels = channels;
+	s->mode = mode;
+	s->max_age = max_age;
+	return align->streams++;
+}
+
+// Ring slot of the sample back samples before the newest
+static uint8_t align_slot(const align_stream_t * s, uint8_t back)
+{
+	return (s->head - 1 - back) & ALIGN_MASK;
+}
+
+// Stamps have to increase within a stream; returns 0 for a sample that does
+// not, which is dropped. Streams may be pushed in any order relative to each
+// other.
+uint8_t align_push(align_t * align, uint8_t stream, uint32_t stamp,
+	const int16_t * values)
+{
+	align_stream_t * s = &align->stream[stream];
+	uint8_t c;
+
+	if (s->count && (int32_t)(stamp - s->stamp[align_slot(s, 0)]) <= 0)
+	{
+		align->stats.rejected++;
+		return 0;
+	}
+	s->stamp[s->head] = stamp;
+	for (c = 0; c < s->channels; c++)
+	{
+		s->value[s->head][c] = values[c];
+	}
+	s->head = (s->head + 1) & ALIGN_MASK;
+	if (s->count < ALIGN_HISTORY)
+	{
+		s->count++;
+	}
+
+	if (!align->started)
+	{
+		align->started = 1;
+		align->next = stamp;
+		align->newest = stamp;
+	}
+	else if ((int32_t)(stamp - align->newest) > 0)
+	{
+		align->newest = stamp;
+	}
+	return 1;
+}
+
+// Samples newer than time, which is how far the stream can look ahead
+static uint8_t align_after(const align_stream_t * s, uint32_t time)
+{
+	uint8_t n = 0;
+
+	while (n < s->count && (int32_t)(s->stamp[align_slot(s, n)] - time) > 0)
+	{
+		n++;
+	}
+	return n;
+}
+
+static uint8_t align_ready(const align_stream_t * s, uint32_t time)
+{
+	switch (s->mode)
+	{
+		case ALIGN_LINEAR:
+			return align_after(s, time) > 0;
+		case ALIGN_POLYPHASE:
+			return align_after(s, time) > 1;
+		default:
+			// held streams take what they have
+			return 1;
+	}
+}
+
+// Position of time between the stamps t0 < t1 in Q15, below 32768
+static uint16_t align_fraction(uint32_t t0, uint32_t t1, uint32_t time)
+{
+	uint32_t span = t1 - t0, offset = time - t0;
+
+	// keep offset << 15 within 32 bits
+	while (span >> 16)
+	{
+		span >>= 1;
+		offset >>= 1;
+	}
+	return (offset << 15) / span;
+}
+
+static int16_t align_linear(int16_t a, int16_t b, uint16_t fraction)
+{
+	// |b - a| * 32767 just fits 31 bits
+	return a + (int16_t)((((int32_t)b - a) * fraction + 16384) >> 15);
+}
+
+// slot holds the ring slots of the sample before the one at or before the
+// frame time, that one, and the two after it
+static int16_t align_cubic(const align_stream_t * s, uint8_t c,
+	const uint8_t * slot, uint16_t fraction)
+{
+	uint8_t phase = (fraction + (1 << (14 - 5))) >> (15 - 5), i;
+	int32_t sum = 8192;
+
+	for (i = 0; i < 4; i++)
+	{
+		sum += (int32_t)(int16_t)pgm_read_word(&align_taps[phase][i]) *
+			s->value[slot[i]][c];
+	}
+	sum >>= 14;
+	return sum > INT16_MAX ? INT16_MAX : sum < INT16_MIN ? INT16_MIN : sum;
+}
+
+static void align_resample(align_t * align, uint8_t stream,
+	align_frame_t * frame)
+{
+	const align_stream_t * s = &align->stream[stream];
+	// frame may be packed, its values are copied in at the end
+	int16_t out[ALIGN_CHANNELS_MAX];
+	uint32_t time = frame->time;
+	uint8_t after = align_after(s, time), flags, c, slot[4];
+	uint16_t fraction;
+
+	if (after >= s->count)
+	{
+		// nothing at or before the frame time, not yet or no longer
+		for (c = 0; c < ALIGN_CHANNELS_MAX; c++)
+		{
+			frame->value[stream][c] = 0;
+		}
+		frame->age[stream] = 0;
+		frame->flags[stream] = ALIGN_FLAG_EMPTY;
+		return;
+	}
+
+	// slot[1] is the last sample at or before the frame time
+	slot[1] = align_slot(s, after);
+	frame->age[stream] = time - s->stamp[slot[1]];
+	flags = ALIGN_FLAG_HELD;
+	if (frame->age[stream] == 0)
+	{
+		// a sample right at the frame time needs no neighbours
+		flags = ALIGN_FLAG_INTERPOLATED;
+	}
+	else if (s->mode != ALIGN_HOLD)
+	{
+		if (after == 0 || (s->mode == ALIGN_POLYPHASE && after == 1))
+		{
+			flags |= ALIGN_FLAG_FALLBACK;
+			align->stats.fallbacks++;
+		}
+		else
+		{
+			flags = ALIGN_FLAG_INTERPOLATED;
+		}
+	}
+
+	if (!(flags & ALIGN_FLAG_INTERPOLATED) || frame->age[stream] == 0)
+	{
+		for (c = 0; c < s->channels; c++)
+		{
+			out[c] = s->value[slot[1]][c];
+		}
+	}
+	else
+	{
+		slot[2] = align_slot(s, after - 1);
+		fraction = align_fraction(s->stamp[slot[1]], s->stamp[slot[2]], time);
+		if (s->mode == ALIGN_POLYPHASE)
+		{
+			slot[3] = align_slot(s, after - 2);
+			// without an older sample the first one stands in for it
+			slot[0] = after + 1 < s->count ? align_slot(s, after + 1) : slot[1];
+			for (c = 0; c < s->channels; c++)
+			{
+				out[c] = align_cubic(s, c, slot, fraction);
+			}
+		}
+		else
+		{
+			for (c = 0; c < s->channels; c++)
+			{
+				out[c] = align_linear(s->value[slot[1]][c],
+					s->value[slot[2]][c], fraction);
+			}
+		}
+	}
+	for (; c < ALIGN_CHANNELS_MAX; c++)
+	{
+		out[c] = 0;
+	}
+	for (c = 0; c < ALIGN_CHANNELS_MAX; c++)
+	{
+		frame->value[stream][c] = out[c];
+	}
+
+	if (s->max_age && frame->age[stream] > s->max_age)
+	{
+		flags |= ALIGN_FLAG_STALE;
+	}
+	frame->flags[stream] = flags;
+}
+
+// Puts out the next frame if it is due; returns 0 when it has to wait for
+// more samples. Call it until it returns 0 after every align_push().
+uint8_t align_pull(align_t * align, align_frame_t * frame)
+{
+	uint32_t behind, skip;
+	uint8_t i, ready = 1;
+
+	if (!align->started || (int32_t)(align->newest - align->next) < 0)
+	{
+		return 0;
+	}
+
+	behind = align->newest - align->next;
+	if (behind > align->latency + (uint32_t)ALIGN_CATCHUP_MAX * align->period)
+	{
+		skip = (behind - align->latency) / align->period - ALIGN_CATCHUP_MAX;
+		align->next += skip * align->period;
+		align->stats.skipped += skip;
+		behind = align->newest - align->next;
+	}
+
+	if (behind < align->latency)
+	{
+		for (i = 0; i < align->streams && ready; i++)
+		{
+			ready = align_ready(&align->stream[i], align->next);
+		}
+		if (!ready)
+		{
+			return 0;
+		}
+	}
+
+	frame->time = align->next;
+	frame->latency = behind;
+	for (i = 0; i < align->streams; i++)
+	{
+		align_resample(align, i, frame);
+	}
+	align->next += align->period;
+	align->stats.frames++;
+	return 1;
+}
+
+#if ALIGN_BENCH_ENABLE
+
+#include "timebase.h"
+
+#define ALIGN_BENCH_SAMPLES	200
+
+static volatile int16_t align_sink;
+
+// Average cycles per align_push() and per frame put out by align_pull(),
+// the calls that find no frame due included, for the
+// firmware's streams: 200 Hz accelerometer and gyro interpolated linearly,
+// the magnetometer at 100 Hz through the polyphase taps and the DHT at 1 Hz
+// held, aligned to 200 Hz frames with 20 ms latency. Printed as
+// "<function> <cycles>" lines; the timebase_now() calls around each call
+// are subtracted.
+void align_bench(void (*put)(char))
+{
+	static align_t align;
+	align_frame_t frame;
+	uint32_t start, overhead, push = 0, pull = 0, now;
+	uint16_t pushes = 0, frames = 0, i;
+	int16_t v[3];
+
+	start = timebase_now();
+	overhead = timebase_now() - start;
+
+	align_init(&align, 5000, 20000);
+	align_add_stream(&align, 3, ALIGN_LINEAR, 0);
+	align_add_stream(&align, 3, ALIGN_LINEAR, 0);
+	align_add_stream(&align, 3, ALIGN_POLYPHASE, 50000);
+	align_add_stream(&align, 2, ALIGN_HOLD, 2000000);
+
+	for (i = 0; i < ALIGN_BENCH_SAMPLES; i++)
+	{
+		// the sample stamps are made up, only the calls are timed
+		now = 1000 + i * 5000UL;
+		v[0] = i * 97;
+		v[1] = 16384 - i * 31;
+		v[2] = i * 509;
+
+		start = timebase_now();
+		align_push(&align, 0, now + 40, v);
+		push += timebase_now() - start - overhead;
+		start = timebase_now();
+		align_push(&align, 1, now + 80, v);
+		push += timebase_now() - start - overhead;
+		pushes += 2;
+		if (i & 1)
+		{
+			start = timebase_now();
+			align_push(&align, 2, now + 900, v);
+			push += timebase_now() - start - overhead;
+			pushes++;
+		}
+		if (i % 200 == 0)
+		{
+			start = timebase_now();
+			align_push(&align, 3, now + 3000, v);
+			push += timebase_now() - start - overhead;
+			pushes++;
+		}
+
+		for (;;)
+		{
+			uint8_t got;
+
+			start = timebase_now();
+			got = align_pull(&align, &frame);
+			pull += timebase_now() - start - overhead;
+			if (!got)
+			{
+				break;
+			}
+			align_sink = frame.value[2][0];
+			frames++;
+		}
+	}
+
+	timebase_bench_line(put, "align_push", push, pushes);
+	timebase_bench_line(put, "align_pull", pull, frames);
+}
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef ALIGN_H_INCLUDED
+#define ALIGN_H_INCLUDED
+
+#include <inttypes.h>
+
+// Alignment of sensor streams sampled at different rates (IMU 200 Hz, AK8963
+// 8 or 100 Hz, DHT about 1 Hz) onto one timeline of output frames. Samples
+// are pushed per stream with their timebase_now() stamps as they arrive;
+// frames come out at a fixed period, each stream resampled at the frame time
+// by its own method:
+//
+//   ALIGN_HOLD        the last sample at or before the frame time
+//   ALIGN_LINEAR      linear interpolation between the samples around it
+//   ALIGN_POLYPHASE   4-tap cubic (Catmull-Rom) interpolation, the taps for
+//                     ALIGN_PHASES fractional positions in PROGMEM; assumes
+//                     evenly spaced samples
+//
+// A frame is put out once every interpolating stream has a sample past the
+// frame time (two for ALIGN_POLYPHASE), or once the newest sample of any
+// stream is latency past it; streams that are not ready by then fall back
+// to holding their last sample. Held streams never delay a frame. Each frame
+// carries the flags and the age of the newest sample used per stream and its
+// own latency, the time between the frame time and the newest input when it
+// was put out.
+//
+// Memory is fixed: ALIGN_HISTORY samples per stream. The history has to
+// reach back latency plus two sample periods of the fastest stream, else
+// frames lose samples and report ALIGN_FLAG_EMPTY.
+//
+// tools/align_log.c runs the same code over logged samples on a PC; the
+// throughput it reports is the PC's. The cycles of align_push() and
+// align_pull() on the ATmega1284P are printed by align_bench() on the board
+// (build with ALIGN_BENCH_ENABLE 1).
+
+#define ALIGN_STREAMS_MAX	4
+#define ALIGN_CHANNELS_MAX	3
+#define ALIGN_HISTORY		8		// samples per stream, a power of 2
+#define ALIGN_PHASES		32		// polyphase table resolution
+
+// Frames a single align_pull() sequence will catch up on after a gap in the
+// input; older frame times are skipped
+#define ALIGN_CATCHUP_MAX	64
+
+#ifndef ALIGN_BENCH_ENABLE
+#define ALIGN_BENCH_ENABLE	0
+#endif
+
+enum ALIGN_MODE_t
+{
+	ALIGN_HOLD,
+	ALIGN_LINEAR,
+	ALIGN_POLYPHASE
+};
+
+// Per stream and frame
+#define ALIGN_FLAG_INTERPOLATED	0x01	// from the samples around the frame time
+#define ALIGN_FLAG_HELD			0x02	// last sample before the frame time
+#define ALIGN_FLAG_FALLBACK		0x04	// held although the mode interpolates
+#define ALIGN_FLAG_STALE		0x08	// sample older than the stream's max_age
+#define ALIGN_FLAG_EMPTY		0x10	// no sample at or before the frame time
+
+typedef struct
+{
+	uint32_t stamp[ALIGN_HISTORY];
+	int16_t value[ALIGN_HISTORY][ALIGN_CHANNELS_MAX];
+	uint8_t head;                // next slot written
+	uint8_t count;
+	uint8_t channels;
+	uint8_t mode;                // enum ALIGN_MODE_t
+	uint32_t max_age;            // older samples are flagged stale, us, 0 none
+} align_stream_t;
+
+typedef struct
+{
+	uint16_t frames;
+	uint16_t skipped;            // frame times dropped by ALIGN_CATCHUP_MAX
+	uint16_t rejected;           // samples not newer than their predecessor
+	uint16_t fallbacks;          // stream values held instead of interpolated
+} align_stats_t;
+
+typedef struct
+{
+	align_stream_t stream[ALIGN_STREAMS_MAX];
+	uint8_t streams;
+	uint8_t started;
+	uint32_t period;             // frame period, us
+	uint32_t latency;            // longest wait for samples past a frame, us
+	uint32_t next;               // time of the next frame
+	uint32_t newest;             // newest stamp pushed
+	align_stats_t stats;
+} align_t;
+
+typedef struct
+{
+	uint32_t time;
+	uint32_t latency;            // newest input stamp minus time
+	int16_t value[ALIGN_STREAMS_MAX][ALIGN_CHANNELS_MAX];
+	uint32_t age[ALIGN_STREAMS_MAX];  // frame time minus newest sample used
+	uint8_t flags[ALIGN_STREAMS_MAX];
+} align_frame_t;
+
+void align_init(align_t * align, uint32_t period, uint32_t latency);
+int8_t align_add_stream(align_t * align, uint8_t channels, uint8_t mode,
+	uint32_t max_age);
+uint8_t align_push(align_t * align, uint8_t stream, uint32_t stamp,
+	const int16_t * values);
+uint8_t align_pull(align_t * align, align_frame_t * frame);
+void align_bench(void (*put)(char));
+
+#endif
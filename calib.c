@@ -0,0 +1,82 @@
+#ifndef  F_CPU
+#define F_CPU 1000000
+#endif
+
+#include <string.h>
+#include <avr/eeprom.h>
+#include "mpu9250.h"
+#include "calib.h"
+
+// Both sensors uncorrected, nothing valid
+void calib_identity(calib_blob_t * blob)
+{
+	uint8_t a;
+
+	memset(blob, 0, sizeof(*blob));
+	blob->magic = CALIB_MAGIC;
+	blob->version = CALIB_VERSION;
+	blob->ascale = MPU_ASCALE_ACTIVE;
+	blob->mscale = MPU_MSCALE;
+	for (a = 0; a < 3; a++)
+	{
+		blob->accel.matrix[a][a] = 1 << CALIB_MATRIX_FRAC;
+		blob->mag.matrix[a][a] = 1 << CALIB_MATRIX_FRAC;
+	}
+	blob->crc = calib_crc(blob);
+}
+
+// Read the blob from EEPROM. A sensor whose calibration was solved at
+// another full scale range than the one active now is left at the
+// identity, as is everything when the blob is missing or damaged. Returns
+// the valid bits.
+uint8_t calib_load(calib_blob_t * blob)
+{
+	calib_blob_t stored;
+
+	calib_identity(blob);
+	eeprom_read_block(&stored, (const void *)CALIB_EEPROM_ADDR,
+		sizeof(stored));
+	if (stored.magic != CALIB_MAGIC || stored.version != CALIB_VERSION ||
+		stored.crc != calib_crc(&stored))
+	{
+		return 0;
+	}
+	if ((stored.valid & CALIB_ACCEL) && stored.ascale == MPU_ASCALE_ACTIVE)
+	{
+		blob->accel = stored.accel;
+		blob->valid |= CALIB_ACCEL;
+	}
+	if ((stored.valid & CALIB_MAG) && stored.mscale == MPU_MSCALE)
+	{
+		blob->mag = stored.mag;
+		blob->valid |= CALIB_MAG;
+	}
+	blob->crc = calib_crc(blob);
+	return blob->valid;
+}
+
+// Correct a sample; raw and out may be the same array
+void calib_apply(const calib_sensor_t * cal, const int16_t * raw,
+	int16_t * out)
+{
+	int16_t x[3];
+	uint8_t a;
+
+	for (a = 0; a < 3; a++)
+	{
+		int32_t d = (int32_t)raw[a] - cal->offset[a];
+		x[a] = d > 32767 ? 32767 : d < -32767 ? -32767 : (int16_t)d;
+	}
+	for (a = 0; a < 3; a++)
+	{
+		// the row is copied, a pointer into a packed blob may be unaligned
+		int16_t row0 = cal->matrix[a][0], row1 = cal->matrix[a][1],
+			row2 = cal->matrix[a][2];
+		// |row| sums below 2^15 keep this below 2^30
+		int32_t y = (int32_t)row0 * x[0] + (int32_t)row1 * x[1] +
+			(int32_t)row2 * x[2];
+
+		y = (y + (1L << (CALIB_MATRIX_FRAC - 1))) >> CALIB_MATRIX_FRAC;
+		out[a] = y > 32767 ? 32767 : y < -32768 ? -32768 : (int16_t)y;
+	}
+}
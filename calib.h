@@ -0,0 +1,86 @@
+#ifndef CALIB_H_INCLUDED
+#define CALIB_H_INCLUDED
+
+#include <inttypes.h>
+
+// Accelerometer and magnetometer calibration loaded from EEPROM at boot.
+// Each sensor's samples are corrected as
+//
+//   out = matrix * (raw - offset)
+//
+// with the offset in LSB and a 3 x 3 matrix in Q14 that holds the scale
+// factors on its diagonal and the cross-axis terms off it. Corrected
+// accelerometer samples are in the LSB of the full scale range (1 g is
+// 32768 / full scale), corrected magnetometer samples lie on a sphere of
+// the mean field in LSB.
+//
+// The blob is solved on the host by tools/calib_solve.c from logged
+// multi-orientation sessions of raw samples, read as the firmware reads
+// them (after mpu_calibrate()), and written as an EEPROM image at
+// CALIB_EEPROM_ADDR (avrdude -U eeprom:w:calib.eep:i). Without a valid blob
+// both sensors keep the identity. With a valid accelerometer part main.c
+// leaves the accelerometer offset registers at their factory trim, so the
+// accelerometer sessions must be logged that way too: a firmware built with
+// CALIB_SESSION_ENABLE keeps the trim and leaves the samples uncorrected
+// whatever the EEPROM holds. The magnetometer part is for code that reads
+// the AK8963's samples; main.c doesn't.
+
+#ifndef CALIB_SESSION_ENABLE
+#define CALIB_SESSION_ENABLE	0		// 1 builds main.c for logging a session
+#endif
+
+#define CALIB_EEPROM_ADDR	0x0000
+#define CALIB_MAGIC			0xCA1B
+#define CALIB_VERSION		1
+#define CALIB_BLOB_BYTES	56
+
+#define CALIB_MATRIX_FRAC	14		// Q14, rows' absolute sums below 2
+
+// calib_blob_t.valid bits
+#define CALIB_ACCEL			0x01
+#define CALIB_MAG			0x02
+
+typedef struct
+{
+	int16_t offset[3];       // LSB
+	int16_t matrix[3][3];    // Q14, row major
+} calib_sensor_t;
+
+// The EEPROM image, 56 bytes, little endian
+typedef struct
+{
+	uint16_t magic;          // CALIB_MAGIC
+	uint8_t version;         // CALIB_VERSION
+	uint8_t valid;           // CALIB_ACCEL, CALIB_MAG
+	uint8_t ascale;          // accelerometer full scale solved at (AFS_)
+	uint8_t mscale;          // magnetometer resolution solved at (MFS_)
+	calib_sensor_t accel;
+	calib_sensor_t mag;
+	uint16_t crc;            // calib_crc() of the bytes before
+} calib_blob_t;
+
+// CRC-16/CCITT (polynomial 0x1021, initial 0xFFFF) of the blob up to crc,
+// shared with the host solver
+static inline uint16_t calib_crc(const calib_blob_t * blob)
+{
+	const uint8_t * p = (const uint8_t *)blob;
+	uint16_t crc = 0xFFFF;
+	uint8_t i, bit;
+
+	for (i = 0; i < CALIB_BLOB_BYTES - 2; i++)
+	{
+		crc ^= (uint16_t)p[i] << 8;
+		for (bit = 0; bit < 8; bit++)
+		{
+			crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+void calib_identity(calib_blob_t * blob);
+uint8_t calib_load(calib_blob_t * blob);
+void calib_apply(const calib_sensor_t * cal, const int16_t * raw,
+	int16_t * out);
+
+#endif
@@ -0,0 +1,347 @@
+#include <math.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include "filter.h"
+
+static inline int16_t filter_saturate(int32_t v)
+{
+	if (v > 32767)
+	{
+		return 32767;
+	}
+	if (v < -32768)
+	{
+		return -32768;
+	}
+	return (int16_t)v;
+}
+
+void filter_biquad_init(filter_stage_t * stage, const biquad_coef_t * coef,
+	biquad_state_t * state, uint8_t sections)
+{
+	stage->type = FILTER_BIQUAD;
+	stage->u.biquad.coef = coef;
+	stage->u.biquad.state = state;
+	stage->u.biquad.sections = sections;
+	filter_reset(stage);
+}
+
+// Boxcar average over length samples, 1 to 255. Returns 0 for a length of
+// 0; the stage is then set up to pass the samples through unchanged.
+uint8_t filter_average_init(filter_stage_t * stage, int16_t * history,
+	uint8_t length)
+{
+	if (length == 0)
+	{
+		stage->type = FILTER_BIQUAD;
+		stage->u.biquad.sections = 0;
+		return 0;
+	}
+	stage->type = FILTER_MOVING_AVERAGE;
+	stage->u.average.history = history;
+	stage->u.average.length = length;
+	filter_reset(stage);
+	return 1;
+}
+
+// CIC decimator by 2^shift; the gain of (2^shift)^FILTER_CIC_ORDER is removed
+// again by shifting the output, so the DC gain is exactly one.
+void filter_cic_init(filter_stage_t * stage, uint8_t shift)
+{
+	stage->type = FILTER_CIC;
+	stage->u.cic.shift = shift;
+	filter_reset(stage);
+}
+
+// FIR decimator; only every decimation-th output is computed
+void filter_fir_init(filter_stage_t * stage, const int16_t * taps,
+	int16_t * history, uint8_t length, uint8_t decimation)
+{
+	stage->type = FILTER_FIR_DECIMATE;
+	stage->u.fir.taps = taps;
+	stage->u.fir.history = history;
+	stage->u.fir.length = length;
+	stage->u.fir.decimation = decimation;
+	filter_reset(stage);
+}
+
+// Clear the state of a stage, e.g. after a gap in the sample stream
+void filter_reset(filter_stage_t * stage)
+{
+	switch (stage->type)
+	{
+	case FILTER_BIQUAD:
+		memset(stage->u.biquad.state, 0,
+			stage->u.biquad.sections * sizeof(biquad_state_t));
+		break;
+	case FILTER_MOVING_AVERAGE:
+		memset(stage->u.average.history, 0,
+			stage->u.average.length * sizeof(int16_t));
+		stage->u.average.sum = 0;
+		stage->u.average.pos = 0;
+		break;
+	case FILTER_CIC:
+		memset(stage->u.cic.integrator, 0, sizeof(stage->u.cic.integrator));
+		memset(stage->u.cic.comb, 0, sizeof(stage->u.cic.comb));
+		stage->u.cic.phase = 0;
+		break;
+	case FILTER_FIR_DECIMATE:
+		memset(stage->u.fir.history, 0,
+			stage->u.fir.length * sizeof(int16_t));
+		stage->u.fir.pos = 0;
+		stage->u.fir.phase = 0;
+		break;
+	}
+}
+
+// RBJ cookbook coefficients, normalised by a0 and converted to Q14. These use
+// float and are meant to be called once while setting the pipeline up.
+static void filter_biquad_store(biquad_coef_t * coef, float b0, float b1,
+	float b2, float a0, float a1, float a2)
+{
+	coef->b0 = (int16_t)lrintf(b0 / a0 * FILTER_Q14_ONE);
+	coef->b1 = (int16_t)lrintf(b1 / a0 * FILTER_Q14_ONE);
+	coef->b2 = (int16_t)lrintf(b2 / a0 * FILTER_Q14_ONE);
+	coef->a1 = (int16_t)lrintf(a1 / a0 * FILTER_Q14_ONE);
+	coef->a2 = (int16_t)lrintf(a2 / a0 * FILTER_Q14_ONE);
+}
+
+void filter_biquad_lowpass(biquad_coef_t * coef, float fc_over_fs, float q)
+{
+	float w = 2.0f * (float)M_PI * fc_over_fs;
+	float alpha = sinf(w) / (2.0f * q);
+	float c = cosf(w);
+	filter_biquad_store(coef, (1.0f - c) / 2.0f, 1.0f - c, (1.0f - c) / 2.0f,
+		1.0f + alpha, -2.0f * c, 1.0f - alpha);
+}
+
+void filter_biquad_highpass(biquad_coef_t * coef, float fc_over_fs, float q)
+{
+	float w = 2.0f * (float)M_PI * fc_over_fs;
+	float alpha = sinf(w) / (2.0f * q);
+	float c = cosf(w);
+	filter_biquad_store(coef, (1.0f + c) / 2.0f, -(1.0f + c), (1.0f + c) / 2.0f,
+		1.0f + alpha, -2.0f * c, 1.0f - alpha);
+}
+
+static uint8_t filter_biquad_run(filter_stage_t * stage, int16_t * block,
+	uint8_t n)
+{
+	uint8_t i, s;
+	for (s = 0; s < stage->u.biquad.sections; s++)
+	{
+		const biquad_coef_t * c = &stage->u.biquad.coef[s];
+		biquad_state_t * st = &stage->u.biquad.state[s];
+		for (i = 0; i < n; i++)
+		{
+			// Direct form I. Every product fits 31 bits, but their sum
+			// doesn't when the coefficients are near 2 (|a1| of a low
+			// corner frequency, b1 of a highpass), so it is taken in 64
+			// bits and saturated before the shift. The state only ever
+			// holds saturated 16-bit values.
+			int64_t acc = (int64_t)((int32_t)c->b0 * block[i]) +
+				(int32_t)c->b1 * st->x1 + (int32_t)c->b2 * st->x2 -
+				(int32_t)c->a1 * st->y1 - (int32_t)c->a2 * st->y2 +
+				(FILTER_Q14_ONE >> 1);
+			int16_t y;
+			if (acc >= (int64_t)32768 << 14)
+			{
+				y = 32767;
+			}
+			else if (acc < -((int64_t)32768 << 14))
+			{
+				y = -32768;
+			}
+			else
+			{
+				y = (int16_t)((int32_t)acc >> 14);
+			}
+			st->x2 = st->x1;
+			st->x1 = block[i];
+			st->y2 = st->y1;
+			st->y1 = y;
+			block[i] = y;
+		}
+	}
+	return n;
+}
+
+static uint8_t filter_average_run(filter_stage_t * stage, int16_t * block,
+	uint8_t n)
+{
+	uint8_t i;
+	for (i = 0; i < n; i++)
+	{
+		// Running sum, the oldest sample drops out as the new one goes in
+		stage->u.average.sum += block[i] -
+			stage->u.average.history[stage->u.average.pos];
+		stage->u.average.history[stage->u.average.pos] = block[i];
+		if (++stage->u.average.pos == stage->u.average.length)
+		{
+			stage->u.average.pos = 0;
+		}
+		block[i] = (int16_t)(stage->u.average.sum / stage->u.average.length);
+	}
+	return n;
+}
+
+static uint8_t filter_cic_run(filter_stage_t * stage, int16_t * block,
+	uint8_t n)
+{
+	uint8_t i, k, out = 0;
+	uint8_t mask = (1 << stage->u.cic.shift) - 1;
+	for (i = 0; i < n; i++)
+	{
+		// Integrators run at the input rate. Unsigned arithmetic wraps
+		// modulo 2^32, which the combs undo exactly.
+		uint32_t v = (uint32_t)(int32_t)block[i];
+		for (k = 0; k < FILTER_CIC_ORDER; k++)
+		{
+			stage->u.cic.integrator[k] += v;
+			v = stage->u.cic.integrator[k];
+		}
+
+		stage->u.cic.phase = (stage->u.cic.phase + 1) & mask;
+		if (stage->u.cic.phase != 0)
+		{
+			continue;
+		}
+
+		// Combs run at the output rate
+		for (k = 0; k < FILTER_CIC_ORDER; k++)
+		{
+			uint32_t prev = stage->u.cic.comb[k];
+			stage->u.cic.comb[k] = v;
+			v -= prev;
+		}
+		block[out++] = filter_saturate(
+			(int32_t)v >> (stage->u.cic.shift * FILTER_CIC_ORDER));
+	}
+	return out;
+}
+
+static uint8_t filter_fir_run(filter_stage_t * stage, int16_t * block,
+	uint8_t n)
+{
+	uint8_t i, k, idx, out = 0;
+	for (i = 0; i < n; i++)
+	{
+		stage->u.fir.history[stage->u.fir.pos] = block[i];
+		if (++stage->u.fir.pos == stage->u.fir.length)
+		{
+			stage->u.fir.pos = 0;
+		}
+
+		if (++stage->u.fir.phase < stage->u.fir.decimation)
+		{
+			continue;
+		}
+		stage->u.fir.phase = 0;
+
+		// Oldest sample first, pos now points at it
+		int32_t acc = 0;
+		idx = stage->u.fir.pos;
+		for (k = stage->u.fir.length; k > 0; k--)
+		{
+			acc += (int32_t)(int16_t)pgm_read_word(&stage->u.fir.taps[k - 1]) *
+				stage->u.fir.history[idx];
+			if (++idx == stage->u.fir.length)
+			{
+				idx = 0;
+			}
+		}
+		block[out++] = filter_saturate((acc + 0x4000) >> 15);
+	}
+	return out;
+}
+
+// Run one stage over n samples in place, returns the number of samples left
+uint8_t filter_stage_run(filter_stage_t * stage, int16_t * block, uint8_t n)
+{
+	switch (stage->type)
+	{
+	case FILTER_BIQUAD:
+		return filter_biquad_run(stage, block, n);
+	case FILTER_MOVING_AVERAGE:
+		return filter_average_run(stage, block, n);
+	case FILTER_CIC:
+		return filter_cic_run(stage, block, n);
+	case FILTER_FIR_DECIMATE:
+		return filter_fir_run(stage, block, n);
+	}
+	return n;
+}
+
+// Run all stages of a pipeline over n samples in place. Returns the number of
+// output samples, which are at the start of block.
+uint8_t filter_run(filter_pipeline_t * pipeline, int16_t * block, uint8_t n)
+{
+	uint8_t s;
+	for (s = 0; s < pipeline->count && n > 0; s++)
+	{
+		n = filter_stage_run(&pipeline->stages[s], block, n);
+	}
+	return n;
+}
+
+#if FILTER_BENCH_ENABLE
+
+#include "timebase.h"
+
+#define FILTER_BENCH_BLOCK	32
+#define FILTER_BENCH_TAPS	15
+
+// Halfband-like lowpass, only its length matters here
+static const int16_t filter_bench_taps[FILTER_BENCH_TAPS] PROGMEM = {
+	-160, 0, 790, 0, -2590, 0, 10140, 16384, 10140, 0, -2590, 0, 790, 0, -160
+};
+
+// Time one stage over a block of FILTER_BENCH_BLOCK samples of a ramp
+static uint32_t filter_bench_stage(filter_stage_t * stage, uint32_t overhead)
+{
+	int16_t block[FILTER_BENCH_BLOCK];
+	uint32_t start;
+	uint8_t i;
+
+	for (i = 0; i < FILTER_BENCH_BLOCK; i++)
+	{
+		block[i] = i * 1021 - 16000;
+	}
+	start = timebase_now();
+	filter_stage_run(stage, block, FILTER_BENCH_BLOCK);
+	return timebase_now() - start - overhead;
+}
+
+// Average cycles per input sample of each stage type over a block, printed
+// as "<stage> <cycles>" lines; the timebase_now() calls around each block
+// are subtracted.
+void filter_bench(void (*put)(char))
+{
+	biquad_coef_t coef;
+	biquad_state_t state;
+	int16_t history[FILTER_BENCH_TAPS];
+	filter_stage_t stage;
+	uint32_t start, overhead;
+
+	start = timebase_now();
+	overhead = timebase_now() - start;
+
+	filter_biquad_lowpass(&coef, 0.05f, 0.707f);
+	filter_biquad_init(&stage, &coef, &state, 1);
+	timebase_bench_line(put, "filter_biquad", filter_bench_stage(&stage,
+		overhead), FILTER_BENCH_BLOCK);
+
+	filter_average_init(&stage, history, 8);
+	timebase_bench_line(put, "filter_average", filter_bench_stage(&stage,
+		overhead), FILTER_BENCH_BLOCK);
+
+	filter_cic_init(&stage, 2);
+	timebase_bench_line(put, "filter_cic", filter_bench_stage(&stage,
+		overhead), FILTER_BENCH_BLOCK);
+
+	filter_fir_init(&stage, filter_bench_taps, history, FILTER_BENCH_TAPS, 2);
+	timebase_bench_line(put, "filter_fir", filter_bench_stage(&stage,
+		overhead), FILTER_BENCH_BLOCK);
+}
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef FILTER_H_INCLUDED
+#define FILTER_H_INCLUDED
+
+#include <inttypes.h>
+
+// Fixed-point filter and decimation pipeline for int16 sample streams. A
+// pipeline is an array of stages run in order over a block of samples, in
+// place. Decimating stages shrink the block, so an axis sampled at a high ODR
+// leaves the pipeline at the lower output rate. Each axis gets its own
+// pipeline and therefore its own state.
+//
+// tools/filter_test.c measures the frequency response of every stage type
+// on the host against the response of its coefficients. Cycle counts on
+// the ATmega1284P are printed by filter_bench() (build with
+// FILTER_BENCH_ENABLE 1).
+
+#ifndef FILTER_BENCH_ENABLE
+#define FILTER_BENCH_ENABLE 0
+#endif
+
+// Biquad coefficients are Q14, so |coefficient| must stay below 2
+#define FILTER_Q14_ONE  16384
+
+// Number of integrator/comb pairs in the CIC decimator. Its registers grow by
+// FILTER_CIC_ORDER * log2(decimation) bits, 32 bits allow decimation up to 32.
+#define FILTER_CIC_ORDER 3
+
+enum FILTER_TYPE_t
+{
+	FILTER_BIQUAD,          // cascade of second order IIR sections
+	FILTER_MOVING_AVERAGE,  // boxcar average, no decimation
+	FILTER_CIC,             // cascaded integrator comb decimator
+	FILTER_FIR_DECIMATE     // FIR with taps in PROGMEM, decimating
+};
+
+// y = b0*x + b1*x1 + b2*x2 - a1*y1 - a2*y2, all coefficients Q14
+typedef struct
+{
+	int16_t b0, b1, b2, a1, a2;
+} biquad_coef_t;
+
+typedef struct
+{
+	int16_t x1, x2, y1, y2;
+} biquad_state_t;
+
+typedef struct
+{
+	uint8_t type;
+	union
+	{
+		struct
+		{
+			const biquad_coef_t * coef;  // sections coefficient sets, RAM
+			biquad_state_t * state;      // sections states
+			uint8_t sections;
+		} biquad;
+		struct
+		{
+			int16_t * history;           // length samples
+			int32_t sum;
+			uint8_t length;
+			uint8_t pos;
+		} average;
+		struct
+		{
+			uint32_t integrator[FILTER_CIC_ORDER];
+			uint32_t comb[FILTER_CIC_ORDER];
+			uint8_t shift;               // log2(decimation)
+			uint8_t phase;
+		} cic;
+		struct
+		{
+			const int16_t * taps;        // length Q15 taps in PROGMEM
+			int16_t * history;           // length samples
+			uint8_t length;
+			uint8_t pos;
+			uint8_t decimation;
+			uint8_t phase;
+		} fir;
+	} u;
+} filter_stage_t;
+
+typedef struct
+{
+	filter_stage_t * stages;
+	uint8_t count;
+} filter_pipeline_t;
+
+void filter_biquad_init(filter_stage_t * stage, const biquad_coef_t * coef,
+	biquad_state_t * state, uint8_t sections);
+uint8_t filter_average_init(filter_stage_t * stage, int16_t * history,
+	uint8_t length);
+void filter_cic_init(filter_stage_t * stage, uint8_t shift);
+void filter_fir_init(filter_stage_t * stage, const int16_t * taps,
+	int16_t * history, uint8_t length, uint8_t decimation);
+void filter_reset(filter_stage_t * stage);
+
+void filter_biquad_lowpass(biquad_coef_t * coef, float fc_over_fs, float q);
+void filter_biquad_highpass(biquad_coef_t * coef, float fc_over_fs, float q);
+
+uint8_t filter_stage_run(filter_stage_t * stage, int16_t * block, uint8_t n);
+uint8_t filter_run(filter_pipeline_t * pipeline, int16_t * block, uint8_t n);
+void filter_bench(void (*put)(char));
+
+#endif
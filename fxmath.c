@@ -0,0 +1,326 @@
+#ifndef  F_CPU
+#define F_CPU 1000000
+#endif
+
+#include <avr/pgmspace.h>
+#include "fxmath.h"
+
+// sin(pi / 2 * i / 128) in Q15, a quarter period including both ends
+static const int16_t fx_sine[129] PROGMEM = {
+	     0,    402,    804,   1206,   1608,   2009,   2411,   2811,
+	  3212,   3612,   4011,   4410,   4808,   5205,   5602,   5998,
+	  6393,   6787,   7180,   7571,   7962,   8351,   8740,   9127,
+	  9512,   9896,  10279,  10660,  11039,  11417,  11793,  12167,
+	 12540,  12910,  13279,  13646,  14010,  14373,  14733,  15091,
+	 15447,  15800,  16151,  16500,  16846,  17190,  17531,  17869,
+	 18205,  18538,  18868,  19195,  19520,  19841,  20160,  20475,
+	 20788,  21097,  21403,  21706,  22006,  22302,  22595,  22884,
+	 23170,  23453,  23732,  24008,  24279,  24548,  24812,  25073,
+	 25330,  25583,  25833,  26078,  26320,  26557,  26791,  27020,
+	 27246,  27467,  27684,  27897,  28106,  28311,  28511,  28707,
+	 28899,  29086,  29269,  29448,  29622,  29792,  29957,  30118,
+	 30274,  30425,  30572,  30715,  30853,  30986,  31114,  31238,
+	 31357,  31471,  31581,  31686,  31786,  31881,  31972,  32058,
+	 32138,  32214,  32286,  32352,  32413,  32470,  32522,  32568,
+	 32610,  32647,  32679,  32706,  32729,  32746,  32758,  32766,
+	 32767
+};
+
+// atan(i / 64) in binary angle units (32768 = pi), i = 0 .. 64
+static const uint16_t fx_arctan[65] PROGMEM = {
+	    0,   163,   326,   489,   651,   813,   975,  1136,
+	 1297,  1457,  1617,  1775,  1933,  2090,  2246,  2401,
+	 2555,  2708,  2860,  3010,  3159,  3307,  3453,  3599,
+	 3742,  3884,  4025,  4164,  4302,  4438,  4572,  4705,
+	 4836,  4966,  5094,  5220,  5344,  5467,  5589,  5708,
+	 5826,  5943,  6058,  6171,  6282,  6392,  6500,  6607,
+	 6712,  6815,  6917,  7018,  7117,  7214,  7310,  7405,
+	 7498,  7589,  7679,  7768,  7856,  7942,  8026,  8110,
+	 8192
+};
+
+// 1 / sqrt((i + 64.5) / 256) in Q14 for i = 0 .. 191, seed of fx_rsqrt_q30()
+static const uint16_t fx_rsqrt_seed[192] PROGMEM = {
+	32641, 32391, 32146, 31907, 31673, 31445, 31221, 31002,
+	30787, 30577, 30371, 30169, 29972, 29778, 29587, 29401,
+	29217, 29038, 28861, 28688, 28518, 28350, 28186, 28024,
+	27866, 27709, 27556, 27405, 27256, 27110, 26966, 26825,
+	26686, 26548, 26413, 26280, 26149, 26020, 25893, 25767,
+	25644, 25522, 25402, 25283, 25167, 25051, 24938, 24826,
+	24715, 24606, 24498, 24392, 24287, 24184, 24081, 23980,
+	23881, 23782, 23685, 23589, 23494, 23400, 23307, 23216,
+	23125, 23036, 22947, 22860, 22774, 22688, 22604, 22520,
+	22437, 22356, 22275, 22195, 22116, 22037, 21960, 21883,
+	21808, 21732, 21658, 21585, 21512, 21440, 21368, 21298,
+	21228, 21159, 21090, 21022, 20955, 20888, 20822, 20757,
+	20692, 20628, 20564, 20501, 20439, 20377, 20316, 20255,
+	20195, 20135, 20076, 20017, 19959, 19902, 19845, 19788,
+	19732, 19676, 19621, 19566, 19512, 19458, 19405, 19352,
+	19299, 19247, 19196, 19144, 19093, 19043, 18993, 18943,
+	18894, 18845, 18797, 18749, 18701, 18653, 18606, 18560,
+	18513, 18467, 18422, 18376, 18331, 18287, 18242, 18198,
+	18155, 18111, 18068, 18025, 17983, 17941, 17899, 17857,
+	17816, 17775, 17734, 17694, 17654, 17614, 17574, 17535,
+	17496, 17457, 17418, 17380, 17342, 17304, 17267, 17229,
+	17192, 17155, 17119, 17082, 17046, 17010, 16974, 16939,
+	16904, 16869, 16834, 16799, 16765, 16731, 16697, 16663,
+	16629, 16596, 16563, 16530, 16497, 16465, 16432, 16400
+};
+
+// High 32 bits of the unsigned 64 bit product, from 16 x 16 bit products
+static uint32_t fx_mulhi_u32(uint32_t a, uint32_t b)
+{
+	uint16_t a0 = a, a1 = a >> 16, b0 = b, b1 = b >> 16;
+	uint32_t t, w1;
+
+	t = (uint32_t)a1 * b0 + (((uint32_t)a0 * b0) >> 16);
+	w1 = (uint32_t)a0 * b1 + (uint16_t)t;
+	return (uint32_t)a1 * b1 + (t >> 16) + (w1 >> 16);
+}
+
+q31_t fx_mul_q31(q31_t a, q31_t b)
+{
+	uint16_t a0 = a, b0 = b;
+	int16_t a1 = a >> 16, b1 = b >> 16;
+	uint32_t w0, lo;
+	int32_t t, w1, w2, hi;
+
+	if (a == INT32_MIN && b == INT32_MIN)
+	{
+		return INT32_MAX;
+	}
+
+	// Signed 64 bit product as hi:lo
+	w0 = (uint32_t)a0 * b0;
+	t = (int32_t)a1 * b0 + (int32_t)(w0 >> 16);
+	w1 = (int32_t)(uint16_t)t + (int32_t)a0 * b1;
+	w2 = t >> 16;
+	hi = (int32_t)a1 * b1 + w2 + (w1 >> 16);
+	lo = ((uint32_t)w1 << 16) | (uint16_t)w0;
+
+	// Bits 62:31, rounded with bit 30
+	return (int32_t)(((uint32_t)hi << 1) | (lo >> 31)) + ((lo >> 30) & 1);
+}
+
+// 1 / sqrt(x) for x > 0 as y / 2^30 * 2^k / 2^16, y in (2^30, 2^31]. The
+// argument is shifted by 2k into [2^30, 2^32), seeded from the table by its
+// top 8 bits and refined by two Newton steps.
+static uint32_t fx_rsqrt_q30(uint32_t x, uint8_t * k)
+{
+	uint32_t y, t;
+	uint8_t n;
+
+	for (*k = 0; x < 0x40000000UL; (*k)++)
+	{
+		x <<= 2;
+	}
+	y = (uint32_t)pgm_read_word(&fx_rsqrt_seed[(x >> 24) - 64]) << 16;
+
+	// y = y * (3 - x y^2) / 2; y^2 and x y^2 in Q28, y * t in Q26
+	for (n = 0; n < 2; n++)
+	{
+		t = 3 * (1UL << 28) - fx_mulhi_u32(x, fx_mulhi_u32(y, y));
+		y = fx_mulhi_u32(y, t) << 3;
+	}
+	return y;
+}
+
+uint32_t fx_rsqrt(uint32_t x)
+{
+	uint32_t y;
+	uint8_t k;
+
+	if (x == 0)
+	{
+		return UINT32_MAX;
+	}
+	// 2^24 / sqrt(x) = y * 2^(k - 22)
+	y = fx_rsqrt_q30(x, &k);
+	return (y + (1UL << (21 - k))) >> (22 - k);
+}
+
+q15_t fx_sin(uint16_t angle)
+{
+	uint16_t p = angle & 0x3FFF;
+	uint8_t i, frac;
+	int16_t a, b, s;
+
+	if (angle & 0x4000)
+	{
+		p = 0x4000 - p;
+	}
+	i = p >> 7;
+	frac = p & 0x7F;
+	a = pgm_read_word(&fx_sine[i]);
+	s = a;
+	if (frac)
+	{
+		b = pgm_read_word(&fx_sine[i + 1]);
+		s += ((uint16_t)(b - a) * frac + 64) >> 7;
+	}
+	return angle & 0x8000 ? -s : s;
+}
+
+q15_t fx_cos(uint16_t angle)
+{
+	return fx_sin(angle + 0x4000);
+}
+
+int16_t fx_atan2(int16_t y, int16_t x)
+{
+	uint16_t ax = x < 0 ? -(uint16_t)x : x;
+	uint16_t ay = y < 0 ? -(uint16_t)y : y;
+	uint16_t r, a, lo, hi;
+	uint8_t i, frac;
+
+	if (ax == 0 && ay == 0)
+	{
+		return 0;
+	}
+
+	// Ratio of the smaller to the larger component in 1.15, its atan
+	// interpolated from the table for the first octant
+	if (ay <= ax)
+	{
+		r = (((uint32_t)ay << 15) + (ax >> 1)) / ax;
+	}
+	else
+	{
+		r = (((uint32_t)ax << 15) + (ay >> 1)) / ay;
+	}
+	i = r >> 9;
+	frac = (r >> 1) & 0xFF;
+	lo = pgm_read_word(&fx_arctan[i]);
+	a = lo;
+	if (i < 64 && frac)
+	{
+		hi = pgm_read_word(&fx_arctan[i + 1]);
+		a += ((uint16_t)(hi - lo) * frac + 128) >> 8;
+	}
+
+	if (ay > ax)
+	{
+		a = 0x4000 - a;
+	}
+	if (x < 0)
+	{
+		a = 0x8000 - a;
+	}
+	return y < 0 ? -(int16_t)a : (int16_t)a;
+}
+
+uint8_t fx_normalize3(const int16_t * v, q15_t * out)
+{
+	uint32_t s = 0, y;
+	int32_t p;
+	uint8_t i, k, shift;
+
+	for (i = 0; i < 3; i++)
+	{
+		s += (uint32_t)((int32_t)v[i] * v[i]);
+	}
+	if (s == 0)
+	{
+		out[0] = out[1] = out[2] = 0;
+		return 0;
+	}
+
+	// v / sqrt(s) in Q15 = v * y * 2^k / 2^31
+	y = (fx_rsqrt_q30(s, &k) + (1UL << 14)) >> 15;
+	shift = 16 - k;
+	for (i = 0; i < 3; i++)
+	{
+		p = ((int32_t)v[i] * (int32_t)y + (1L << (shift - 1))) >> shift;
+		out[i] = p > INT16_MAX ? INT16_MAX : p < -INT16_MAX ? -INT16_MAX : p;
+	}
+	return 1;
+}
+
+#if FX_BENCH_ENABLE
+
+#include "timebase.h"
+
+#define FX_BENCH_CALLS	64
+
+static volatile int32_t fx_sink;
+
+// Average cycles per call of each function over FX_BENCH_CALLS arguments,
+// printed as "<function> <cycles>" lines. Interrupts should be off apart
+// from the timebase, whose overflow handler is in the loop overhead.
+void fx_bench(void (*put)(char))
+{
+	uint32_t start, overhead, t[7];
+	int16_t v[3];
+	q15_t n[3];
+	uint8_t i;
+
+	start = timebase_now();
+	for (i = 0; i < FX_BENCH_CALLS; i++)
+	{
+		fx_sink = i * 1021;
+	}
+	overhead = timebase_now() - start;
+
+	start = timebase_now();
+	for (i = 0; i < FX_BENCH_CALLS; i++)
+	{
+		fx_sink = fx_mul_q15(i * 511 - 16000, 29000 - i * 397);
+	}
+	t[0] = timebase_now() - start;
+
+	start = timebase_now();
+	for (i = 0; i < FX_BENCH_CALLS; i++)
+	{
+		fx_sink = fx_mul_q31(i * 33554393L - 1073741824L, 2000000000L - i * 11L);
+	}
+	t[1] = timebase_now() - start;
+
+	start = timebase_now();
+	for (i = 0; i < FX_BENCH_CALLS; i++)
+	{
+		fx_sink = fx_rsqrt(1 + i * 67108859UL);
+	}
+	t[2] = timebase_now() - start;
+
+	start = timebase_now();
+	for (i = 0; i < FX_BENCH_CALLS; i++)
+	{
+		fx_sink = fx_sin(i * 1021);
+	}
+	t[3] = timebase_now() - start;
+
+	start = timebase_now();
+	for (i = 0; i < FX_BENCH_CALLS; i++)
+	{
+		fx_sink = fx_cos(i * 1021);
+	}
+	t[4] = timebase_now() - start;
+
+	start = timebase_now();
+	for (i = 0; i < FX_BENCH_CALLS; i++)
+	{
+		fx_sink = fx_atan2(i * 509 - 16000, 12000 - i * 311);
+	}
+	t[5] = timebase_now() - start;
+
+	start = timebase_now();
+	for (i = 0; i < FX_BENCH_CALLS; i++)
+	{
+		v[0] = i * 509 - 16000;
+		v[1] = 12000 - i * 311;
+		v[2] = i * 97;
+		fx_normalize3(v, n);
+		fx_sink = n[0];
+	}
+	t[6] = timebase_now() - start;
+
+	timebase_bench_line(put, "fx_mul_q15", t[0] - overhead, FX_BENCH_CALLS);
+	timebase_bench_line(put, "fx_mul_q31", t[1] - overhead, FX_BENCH_CALLS);
+	timebase_bench_line(put, "fx_rsqrt", t[2] - overhead, FX_BENCH_CALLS);
+	timebase_bench_line(put, "fx_sin", t[3] - overhead, FX_BENCH_CALLS);
+	timebase_bench_line(put, "fx_cos", t[4] - overhead, FX_BENCH_CALLS);
+	timebase_bench_line(put, "fx_atan2", t[5] - overhead, FX_BENCH_CALLS);
+	timebase_bench_line(put, "fx_normalize3", t[6] - overhead, FX_BENCH_CALLS);
+}
+
+#endif
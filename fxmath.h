@@ -0,0 +1,61 @@
+#ifndef FXMATH_H_INCLUDED
+#define FXMATH_H_INCLUDED
+
+#include <inttypes.h>
+
+// Fixed-point math for attitude and unit conversion work without avr-libm's
+// soft float. Tables live in flash (PROGMEM, 772 bytes). Angles are binary
+// angle units: 65536 per turn, so int16 -32768 .. 32767 is -pi .. pi and
+// uint16 0 .. 65535 is 0 .. 2 pi, wrapping for free.
+//
+// Error bounds, checked against libm by tools/fxmath_test.c (exhaustively
+// where the input space is 32 bits or less, see there), in units of the
+// last place (LSB) of the result:
+//
+//   fx_mul_q15     exact, round half up; -1 * -1 saturates to 32767
+//   fx_mul_q31     exact, round half up; -1 * -1 saturates to INT32_MAX
+//   fx_rsqrt       <= 0.5 LSB of 2^24 / sqrt(x), correctly rounded but ties
+//   fx_sin/fx_cos  <= 1.5 LSB of 32768 sin(x), 32767 at the peaks
+//   fx_atan2       <= 1.5 units of 32768 / pi atan2(y, x), 0.008 degrees
+//   fx_normalize3  <= 1 LSB per component of 32768 v / |v|
+//
+// Cycle counts on the ATmega1284P are printed by fx_bench() (build with
+// FX_BENCH_ENABLE 1); they depend on the compiler and its options and can
+// only be taken on the board, tools/fxmath_test.c checks the accuracy alone.
+
+#ifndef FX_BENCH_ENABLE
+#define FX_BENCH_ENABLE		0
+#endif
+
+typedef int16_t q15_t;
+typedef int32_t q31_t;
+
+#define FX_Q15_ONE			32767
+#define FX_Q31_ONE			INT32_MAX
+#define FX_ANGLE_PI			32768U		// binary angle units
+
+// Q15 product, rounded
+static inline q15_t fx_mul_q15(q15_t a, q15_t b)
+{
+	int32_t p = ((int32_t)a * b + 0x4000) >> 15;
+	return p > INT16_MAX ? INT16_MAX : (q15_t)p;
+}
+
+q31_t fx_mul_q31(q31_t a, q31_t b);
+
+// 1 / sqrt(x) for x in Q16.16, result in Q16.16 (x > 0, UINT32_MAX for 0)
+uint32_t fx_rsqrt(uint32_t x);
+
+// Sine and cosine of a binary angle in Q15
+q15_t fx_sin(uint16_t angle);
+q15_t fx_cos(uint16_t angle);
+
+// Angle of (x, y) in binary angle units, 0 for (0, 0)
+int16_t fx_atan2(int16_t y, int16_t x);
+
+// v / |v| in Q15; returns 0 and a zero vector if v is zero
+uint8_t fx_normalize3(const int16_t * v, q15_t * out);
+
+void fx_bench(void (*put)(char));
+
+#endif
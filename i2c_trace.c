@@ -0,0 +1,148 @@
+#include "i2c_trace.h"
+
+#if I2C_TRACE_ENABLE
+
+#if I2C_TRACE_DATA_MAX > 255 || I2C_TRACE_HEADER + I2C_TRACE_DATA_MAX > I2C_TRACE_SIZE
+#error "I2C_TRACE_DATA_MAX doesn't fit a record or the ring"
+#endif
+
+i2c_trace_stats_t i2c_trace_stats;
+
+static uint8_t trace_ring[I2C_TRACE_SIZE];
+static uint16_t trace_head;    // next byte written
+static uint16_t trace_tail;    // first byte of the oldest record
+static uint16_t trace_used;
+static uint8_t trace_on;
+static uint32_t (*trace_clock)(void);
+
+// Record layout in the ring: count, address | read << 7, register, status,
+// time (4 bytes, LSB first), then min(count, I2C_TRACE_DATA_MAX) data bytes
+
+static uint8_t trace_kept(uint8_t count)
+{
+	return count < I2C_TRACE_DATA_MAX ? count : I2C_TRACE_DATA_MAX;
+}
+
+static uint8_t trace_peek(uint16_t pos)
+{
+	return trace_ring[pos % I2C_TRACE_SIZE];
+}
+
+static void trace_put(uint8_t byte)
+{
+	trace_ring[trace_head] = byte;
+	trace_head = (trace_head + 1) % I2C_TRACE_SIZE;
+	trace_used++;
+}
+
+// Drop the oldest record
+static void trace_drop(void)
+{
+	uint16_t size = I2C_TRACE_HEADER + trace_kept(trace_peek(trace_tail));
+	trace_tail = (trace_tail + size) % I2C_TRACE_SIZE;
+	trace_used -= size;
+	i2c_trace_stats.records--;
+	i2c_trace_stats.dropped++;
+}
+
+// Clear the ring and record from now on. clock may be 0, the records are
+// then numbered instead of timed.
+void i2c_trace_start(uint32_t (*clock)(void))
+{
+	trace_head = trace_tail = trace_used = 0;
+	i2c_trace_stats.records = 0;
+	i2c_trace_stats.dropped = 0;
+	trace_clock = clock;
+	trace_on = 1;
+}
+
+void i2c_trace_stop(void)
+{
+	trace_on = 0;
+}
+
+void i2c_trace_record(uint8_t read, uint8_t device, uint8_t reg,
+	const uint8_t * data, uint8_t count, uint8_t status)
+{
+	uint8_t i, kept = trace_kept(count);
+	uint16_t size = I2C_TRACE_HEADER + kept;
+	uint32_t time;
+
+	if (!trace_on)
+	{
+		return;
+	}
+	while (I2C_TRACE_SIZE - trace_used < size)
+	{
+		trace_drop();
+	}
+
+	time = trace_clock ? trace_clock() :
+		(uint32_t)i2c_trace_stats.records + i2c_trace_stats.dropped;
+	trace_put(count);
+	trace_put((device & 0x7F) | (read ? 0x80 : 0x00));
+	trace_put(reg);
+	trace_put(status);
+	for (i = 0; i < 4; i++)
+	{
+		trace_put(time >> (8 * i));
+	}
+	for (i = 0; i < kept; i++)
+	{
+		trace_put(data[i]);
+	}
+	i2c_trace_stats.records++;
+}
+
+static void trace_hex(void (*put)(char), uint8_t byte)
+{
+	static const char digits[] = "0123456789ABCDEF";
+	put(digits[byte >> 4]);
+	put(digits[byte & 0x0F]);
+}
+
+// Print the ring oldest record first, see i2c_trace.h for the format.
+// Recording is paused meanwhile.
+void i2c_trace_dump(void (*put)(char))
+{
+	uint16_t pos = trace_tail, left = trace_used;
+	uint8_t i, count, kept, on = trace_on;
+
+	trace_on = 0;
+	while (left)
+	{
+		count = trace_peek(pos);
+		kept = trace_kept(count);
+
+		for (i = 4; i > 0; i--)
+		{
+			trace_hex(put, trace_peek(pos + 3 + i));
+		}
+		put(' ');
+		trace_hex(put, trace_peek(pos + 1) & 0x7F);
+		put(' ');
+		put(trace_peek(pos + 1) & 0x80 ? 'R' : 'W');
+		put(' ');
+		trace_hex(put, trace_peek(pos + 2));
+		put(' ');
+		put('0' + trace_peek(pos + 3));
+		put(' ');
+		trace_hex(put, count);
+		put(' ');
+		for (i = 0; i < kept; i++)
+		{
+			trace_hex(put, trace_peek(pos + I2C_TRACE_HEADER + i));
+		}
+		if (kept < count)
+		{
+			put('+');
+		}
+		put('\n');
+
+		pos = (pos + I2C_TRACE_HEADER + kept) % I2C_TRACE_SIZE;
+		left -= I2C_TRACE_HEADER + kept;
+	}
+	trace_on = on;
+}
+
+#endif
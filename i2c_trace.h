@@ -0,0 +1,49 @@
+#ifndef I2C_TRACE_H_INCLUDED
+#define I2C_TRACE_H_INCLUDED
+
+#include <inttypes.h>
+
+// Recorder of I2C transactions for reproducing bus problems. When enabled
+// i2c_txn.c logs every attempt of a transaction into a RAM ring, so a
+// transaction that was retried leaves one record per attempt with the status
+// of that attempt; the oldest records are dropped when the ring fills.
+// i2c_trace_dump() prints the ring as text, one attempt per line:
+//
+//   TTTTTTTT AA D RR S NN data
+//
+// time (hex, from the clock passed to i2c_trace_start()), 7-bit address,
+// R or W, register, enum I2C_STATUS_t, byte count and the data bytes in hex.
+// NN is always the length of the transfer. At most I2C_TRACE_DATA_MAX data
+// bytes are kept per record; a record of a longer transfer shows the first
+// ones followed by '+'. tools/i2c_replay.c plays a dump back against the
+// host build of the driver and reports the records that were cut.
+
+#ifndef I2C_TRACE_ENABLE
+#define I2C_TRACE_ENABLE	0		// 1 builds the recorder into i2c_txn.c
+#endif
+#ifndef I2C_TRACE_SIZE
+#define I2C_TRACE_SIZE		512		// ring size in bytes
+#endif
+#ifndef I2C_TRACE_DATA_MAX
+#define I2C_TRACE_DATA_MAX	32		// data bytes kept per record, up to 255
+#endif
+
+// Ring bytes per record besides the data: time, address, register, status
+// and count
+#define I2C_TRACE_HEADER	8
+
+typedef struct
+{
+	uint16_t records;     // records currently in the ring
+	uint16_t dropped;     // records overwritten since the last start
+} i2c_trace_stats_t;
+
+extern i2c_trace_stats_t i2c_trace_stats;
+
+void i2c_trace_start(uint32_t (*clock)(void));
+void i2c_trace_stop(void);
+void i2c_trace_record(uint8_t read, uint8_t device, uint8_t reg,
+	const uint8_t * data, uint8_t count, uint8_t status);
+void i2c_trace_dump(void (*put)(char));
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef  F_CPU
+#define F_CPU 1000000
+#endif
+
+#include <util/delay.h>
+#include "IO_MACROS.h"
+#include "i2cmaster.h"
+#include "i2c_txn.h"
+#include "i2c_trace.h"
+
+enum I2C_STATUS_t I2C_STATUS = I2C_OK;
+i2c_txn_stats_t i2c_txn_stats;
+
+// Lines are driven open drain like in i2cmaster.S: PORT is kept 0 by
+// i2c_init(), an output pulls the line low and an input releases it
+
+static uint8_t i2c_bus_idle(void)
+{
+	return digitalRead(I2C_SDA_PIN) && digitalRead(I2C_SCL_PIN);
+}
+
+// Free a bus a slave is holding. A slave stuck in the middle of a read lets
+// go of SDA once it has clocked out its byte, so up to 9 SCL pulses are given
+// until SDA reads high, then a STOP resets every slave's state machine.
+enum I2C_STATUS_t i2c_bus_recover(void)
+{
+	uint8_t i;
+
+	i2c_txn_stats.recoveries++;
+	pinMode(I2C_SDA_PIN, INPUT);
+	for (i = 0; i < 9 && !digitalRead(I2C_SDA_PIN); i++)
+	{
+		pinMode(I2C_SCL_PIN, OUTPUT);
+		_delay_us(5);
+		pinMode(I2C_SCL_PIN, INPUT);
+		_delay_us(5);
+	}
+
+	// STOP: SDA rises while SCL is high
+	pinMode(I2C_SCL_PIN, OUTPUT);
+	pinMode(I2C_SDA_PIN, OUTPUT);
+	_delay_us(5);
+	pinMode(I2C_SCL_PIN, INPUT);
+	_delay_us(5);
+	pinMode(I2C_SDA_PIN, INPUT);
+	_delay_us(5);
+
+	return i2c_bus_idle() ? I2C_OK : I2C_ERROR_BUS;
+}
+
+// Map the outcome of one attempt; a timeout wins over the NAK it caused
+static enum I2C_STATUS_t i2c_txn_result(uint8_t nak)
+{
+	if (i2c_timeout)
+	{
+		return I2C_ERROR_TIMEOUT;
+	}
+	return nak ? I2C_ERROR_NAK : I2C_OK;
+}
+
+static enum I2C_STATUS_t i2c_txn_write_once(uint8_t device, uint8_t reg,
+	const uint8_t * data, uint8_t count)
+{
+	uint8_t i, nak;
+
+	i2c_timeout = 0;
+	nak = i2c_start((device << 1) | I2C_WRITE);
+	if (!nak)
+	{
+		nak = i2c_write(reg);
+	}
+	for (i = 0; i < count && !nak; i++)
+	{
+		nak = i2c_write(data[i]);
+	}
+	i2c_stop();
+	return i2c_txn_result(nak);
+}
+
+static enum I2C_STATUS_t i2c_txn_read_once(uint8_t device, uint8_t reg,
+	uint8_t * dest, uint8_t count)
+{
+	uint8_t i, nak;
+
+	i2c_timeout = 0;
+	nak = i2c_start((device << 1) | I2C_WRITE);
+	if (!nak)
+	{
+		nak = i2c_write(reg);
+	}
+	if (!nak)
+	{
+		nak = i2c_rep_start((device << 1) | I2C_READ);
+	}
+	for (i = 0; i < count && !nak && !i2c_timeout; i++)
+	{
+		dest[i] = (i + 1 < count) ? i2c_readAck() : i2c_readNak();
+	}
+	i2c_stop();
+	return i2c_txn_result(nak);
+}
+
+// Run one attempt function with up to retries retries, counting what went
+// wrong. The recorder gets every attempt with its own status.
+static enum I2C_STATUS_t i2c_txn_run(uint8_t read, uint8_t retries,
+	uint8_t device, uint8_t reg, uint8_t * data, uint8_t count)
+{
+	uint8_t attempt;
+	enum I2C_STATUS_t status = I2C_OK;
+
+	for (attempt = 0; attempt <= retries; attempt++)
+	{
+		if (attempt)
+		{
+			i2c_txn_stats.retries++;
+		}
+
+		// Don't start on a bus someone is still holding
+		if (!i2c_bus_idle() && i2c_bus_recover() != I2C_OK)
+		{
+			status = I2C_ERROR_BUS;
+		}
+		else
+		{
+			status = read ? i2c_txn_read_once(device, reg, data, count) :
+				i2c_txn_write_once(device, reg, data, count);
+		}
+#if I2C_TRACE_ENABLE
+		i2c_trace_record(read, device, reg, data, count, status);
+#endif
+		if (status == I2C_OK)
+		{
+			break;
+		}
+		if (status == I2C_ERROR_TIMEOUT)
+		{
+			i2c_txn_stats.timeouts++;
+			i2c_bus_recover();
+		}
+		else if (status == I2C_ERROR_NAK)
+		{
+			i2c_txn_stats.naks++;
+		}
+	}
+
+	if (status != I2C_OK)
+	{
+		i2c_txn_stats.failures++;
+	}
+	I2C_STATUS = status;
+	return status;
+}
+
+// Write count bytes to consecutive registers starting at reg
+enum I2C_STATUS_t i2c_txn_write(uint8_t device, uint8_t reg,
+	const uint8_t * data, uint8_t count)
+{
+	return i2c_txn_run(0, I2C_TXN_RETRIES, device, reg, (uint8_t *)data,
+		count);
+}
+
+// Read count bytes from consecutive registers starting at reg. On failure
+// dest may be partly written.
+enum I2C_STATUS_t i2c_txn_read(uint8_t device, uint8_t reg, uint8_t * dest,
+	uint8_t count)
+{
+	return i2c_txn_run(1, I2C_TXN_RETRIES, device, reg, dest, count);
+}
+
+// Read count bytes from a register that hands out the next byte on every
+// read, e.g. a FIFO. A failed attempt may have taken bytes out of it already
+// and a retry would return what follows them, so there is only one attempt.
+enum I2C_STATUS_t i2c_txn_read_stream(uint8_t device, uint8_t reg,
+	uint8_t * dest, uint8_t count)
+{
+	return i2c_txn_run(1, 0, device, reg, dest, count);
+}
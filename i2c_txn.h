@@ -0,0 +1,62 @@
+#ifndef I2C_TXN_H_INCLUDED
+#define I2C_TXN_H_INCLUDED
+
+#include <inttypes.h>
+
+// Register transactions on top of i2cmaster.S with NAK detection, bounded
+// retries and bus recovery. Every transaction ends within I2C_TXN_WORST_US()
+// whatever the slaves do: clock stretching is cut off by i2cmaster.S, a
+// failed attempt is retried at most I2C_TXN_RETRIES times and a bus that is
+// held low gets clocked free before the next attempt. Reads of a FIFO go
+// through i2c_txn_read_stream(), which doesn't retry.
+
+// Must match SDA/SCL in i2cmaster.S
+#define I2C_SDA_PIN		C, 1
+#define I2C_SCL_PIN		C, 0
+
+// Attempts after the first one before a transaction fails
+#define I2C_TXN_RETRIES	2
+
+// Estimated cost at F_CPU = 1 MHz: one byte on the wire, the stretch limit of
+// i2cmaster.S (1000 polls of 6 cycles) and one bus recovery (9 clocks and a
+// STOP)
+#define I2C_TXN_BYTE_US		500
+#define I2C_TXN_STRETCH_US	6000
+#define I2C_TXN_RECOVER_US	300
+
+// Worst case duration of a transaction moving bytes data bytes; each attempt
+// carries up to two address bytes and the register byte besides the data
+#define I2C_TXN_WORST_US(bytes) \
+	((uint32_t)(I2C_TXN_RETRIES + 1) * \
+	 (((bytes) + 3) * I2C_TXN_BYTE_US + I2C_TXN_STRETCH_US + I2C_TXN_RECOVER_US))
+
+enum I2C_STATUS_t
+{
+	I2C_OK,
+	I2C_ERROR_NAK,       // address or data byte not acknowledged
+	I2C_ERROR_TIMEOUT,   // a slave stretched SCL past the limit
+	I2C_ERROR_BUS        // SDA or SCL still held low after recovery
+};
+
+typedef struct
+{
+	uint16_t naks;
+	uint16_t timeouts;
+	uint16_t retries;
+	uint16_t recoveries;
+	uint16_t failures;   // transactions that failed after all retries
+} i2c_txn_stats_t;
+
+// Result of the last transaction and the running error counters
+extern enum I2C_STATUS_t I2C_STATUS;
+extern i2c_txn_stats_t i2c_txn_stats;
+
+enum I2C_STATUS_t i2c_txn_write(uint8_t device, uint8_t reg,
+	const uint8_t * data, uint8_t count);
+enum I2C_STATUS_t i2c_txn_read(uint8_t device, uint8_t reg, uint8_t * dest,
+	uint8_t count);
+enum I2C_STATUS_t i2c_txn_read_stream(uint8_t device, uint8_t reg,
+	uint8_t * dest, uint8_t count);
+enum I2C_STATUS_t i2c_bus_recover(void);
+
+#endif
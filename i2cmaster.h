@@ -93,6 +93,9 @@
 /** defines the data direction (writing to I2C device) in i2c_start(),i2c_rep_start() */
 #define I2C_WRITE   0
 
+/** set to 1 when a slave stretched SCL for longer than the limit in i2cmaster.S; cleared by the caller */
+extern unsigned char i2c_timeout;
+
 
 /**
  @brief initialize the I2C master interace. Need to be called only once 
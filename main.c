@@ -9,39 +9,158 @@
 
 #include <avr/io.h>
 #include <util/delay.h>
+#include <avr/interrupt.h>
 #include <stdio.h>
 #include "LCD_Controller.c"
 #include "DHT.c"
 #include "mpu9250.c"
-
-#define LED PA0
-#define BUZZER PA1
+#include "alarm.h"
+#include "timebase.h"
+#include "sensor_cache.h"
+#include "calib.h"
+#include "stack_mon.h"
 
 #define output_low(port, pin) port &= ~(1<<pin)
 #define output_high(port, pin) port |= (1<<pin)
 #define set_output(portdir, pin) portdir |= (1<<pin)
 #define set_input(portdir, pin) portdir &= ~(1<<pin)
 
+// Calibration solved by tools/calib_solve.c, loaded from EEPROM at boot.
+// main.c reads no magnetometer samples, so only the accelerometer part is
+// applied.
+static calib_blob_t calib;
+
+// Accelerometer reading behind accel_cache. The accelerometer streams
+// through the FIFO, whose drains count the MPU sample periods that passed
+// for timebase_sync(). Every packet of a drain goes to the alarms, so a
+// shock shorter than a loop pass is still seen; the reading is the last
+// packet.
+typedef struct
+{
+	mpu9250_t * imu;
+	int16_t raw[3];
+} accel_reading_t;
+
+// Packets taken per drain, the rest stays in the FIFO for the next one
+#define ACCEL_FIFO_PACKETS	16
+// acquire_accel() found no new packet
+#define ACCEL_NO_SAMPLE		0xFF
+
+static uint8_t acquire_accel(sensor_cache_t * cache)
+{
+	static uint8_t fifo[ACCEL_FIFO_PACKETS * 6];
+	accel_reading_t * reading = cache->context;
+	enum MPU_STATUS_t status;
+	uint16_t bytes, i;
+	uint8_t * packet;
+	int16_t raw[3], mg[3];
 
+	bytes = mpu_fifo_drain(reading->imu, fifo, sizeof(fifo), &status);
+	if (status != MPU_OK ||
+		reading->imu->fifo_samples == MPU_FIFO_BACKLOG_UNKNOWN)
+	{
+		// Sample periods went by uncounted
+		timebase_sync_restart();
+		if (status != MPU_OK)
+		{
+			return status;
+		}
+	}
+	else
+	{
+		timebase_sync(reading->imu->timestamp, reading->imu->fifo_samples);
+	}
+	if (bytes == 0)
+	{
+		return ACCEL_NO_SAMPLE;
+	}
+	for (i = 0; i < bytes; i += 6)
+	{
+		packet = &fifo[i];
+		raw[0] = ((int16_t)packet[0] << 8) | packet[1];
+		raw[1] = ((int16_t)packet[2] << 8) | packet[3];
+		raw[2] = ((int16_t)packet[4] << 8) | packet[5];
+		if (calib.valid & CALIB_ACCEL)
+		{
+			calib_apply(&calib.accel, raw, raw);
+		}
+		mg[0] = mpu_accel_mg(raw[0]);
+		mg[1] = mpu_accel_mg(raw[1]);
+		mg[2] = mpu_accel_mg(raw[2]);
+		alarm_feed_accel(mg);
+	}
+	reading->raw[0] = raw[0];
+	reading->raw[1] = raw[1];
+	reading->raw[2] = raw[2];
+	cache->attempt = reading->imu->timestamp;
+	return 0;
+}
+
+// Column of the next character lcd_put() writes, the second line follows
+// the first
+static uint8_t lcd_column;
+
+// Character output of stack_mon_dump() onto the LCD
+static void lcd_put(char c)
+{
+	if (c == '\n' || lcd_column >= 32)
+	{
+		return;
+	}
+	if (lcd_column == 16)
+	{
+		LCD_Command(0xC0); //Second Line
+	}
+	LCD_Char(c);
+	lcd_column++;
+}
 
 int main(void)
 {
 	float gyroBias[3]  = {0, 0, 0},
-	accelBias[3] = {0, 0, 0},
-	magBias[3]   = {0, 0, 0},
-	magScale[3]  = {0, 0, 0};
+	accelBias[3] = {0, 0, 0};
+	mpu9250_t imu = MPU9250_DEVICE(MPU9250_ADDRESS);
+	const mpu_config_t stream = {MPU_GSCALE, MPU_ASCALE, MPU_DLPF_CFG,
+		MPU_A_DLPF_CFG, MPU_SMPLRT_DIV, MPU_FIFO_ACCEL};
+	accel_reading_t accel = {&imu, {0, 0, 0}};
+	sensor_cache_t accel_cache = SENSOR_CACHE(acquire_accel, SENSOR_SOURCE_FIFO,
+		&accel, 1000000UL / MPU_SAMPLE_RATE_HZ);
 	
 	
 	LCD_Init();
 	LCD_Clear();
 	LCD_String("Booting...");
 	
-	set_output(DDRA, BUZZER);
-	set_output(DDRA, LED);
+	// LED (PA0) and buzzer (PA1) belong to the alarm engine
+	alarm_init();
+	const alarm_limit_t shock = {ALARM_NO_LOW, 1800, 200, 2, ALARM_PATTERN_CRITICAL};
+	const alarm_limit_t tilt = {ALARM_NO_LOW, 500, 50, 3, ALARM_PATTERN_BEEP};
+	const alarm_limit_t temperature = {0, 400, 10, 2, ALARM_PATTERN_BLINK};
+	const alarm_limit_t humidity = {100, 850, 20, 2, ALARM_PATTERN_BLINK};
+	alarm_set_limit(ALARM_ACCEL, &shock);
+	alarm_set_limit(ALARM_TILT, &tilt);
+	alarm_set_limit(ALARM_TEMPERATURE, &temperature);
+	alarm_set_limit(ALARM_HUMIDITY, &humidity);
+	timebase_init();
+	sei();
 	DHT_setup();
 	i2c_init();
-	mpu_calibrate(gyroBias,accelBias);
-	mpu_init();
+	// A loaded accelerometer calibration was solved against the factory
+	// trim, a bias pushed over it at every boot would shift it. A session
+	// for tools/calib_solve.c is logged against the trim too, with the
+	// identity.
+#if CALIB_SESSION_ENABLE
+	calib_identity(&calib);
+#else
+	calib_load(&calib);
+#endif
+	mpu_calibrate(&imu, gyroBias, (CALIB_SESSION_ENABLE ||
+		(calib.valid & CALIB_ACCEL)) ? NULL : accelBias);
+	mpu_init(&imu);
+	mpu_configure(&imu, &stream);
+	// The accelerometer samples of the FIFO correct the drift of the RC
+	// oscillator
+	timebase_sync_rate(MPU_SAMPLE_RATE_HZ);
 	
 	
 	
@@ -49,6 +168,7 @@ int main(void)
 	char first_line[16];
 	char second_line[16];
 	uint8_t data;
+	uint32_t shown, refresh;
 
 	temp[0] = hum[0] = 0;
 	uint8_t address = 0x00;
@@ -61,10 +181,6 @@ int main(void)
 		sprintf(first_line, "0x%02X :: 0x%02X", AK8963_ADDRESS, WHO_AM_I_AK8963);
 		sprintf(second_line, "0x%02X", data);
 		
-		output_high(PORTA, LED);
-		output_low(PORTA, BUZZER);
-		DHT_read(temp, hum);
-		
 		/*switch (DHT_STATUS)
 		{
 		case (DHT_OK):
@@ -90,19 +206,40 @@ int main(void)
 		}*/
 		
 		LCD_Clear();
-		LCD_String(first_line);
-		LCD_Command(0xC0); //Second Line
-		LCD_String(second_line);
+		if ((address & 0x0F) == 0x0F)
+		{
+			// Every 16th refresh shows the stack high water mark, the line
+			// tools/stack_check.c -w reads
+			lcd_column = 0;
+			stack_mon_dump(lcd_put);
+		}
+		else
+		{
+			LCD_String(first_line);
+			LCD_Command(0xC0); //Second Line
+			LCD_String(second_line);
+		}
 		
 		
 		/*_delay_ms(1000);
 		output_high(PORTA, BUZZER);
 		output_low(PORTA, LED);*/
-		if (data == 0xFF || data == 0x00){
-			_delay_ms(100);
-		}else{
-			_delay_ms(1000);
-		}
+		// Until the next refresh the alarms see each new sample once:
+		// acquire_accel() feeds every accelerometer sample of the FIFO, the
+		// DHT is only read again once it has a new value. The refresh is
+		// timed on the MPU's sample clock.
+		shown = timebase_correct(timebase_now());
+		refresh = (data == 0xFF || data == 0x00) ? 100000UL : 1000000UL;
+		do
+		{
+			sensor_cache_get(&accel_cache, 0);
+
+			if (DHT_readCached(temp, hum, 0) == SENSOR_CACHE_ACQUIRED)
+			{
+				alarm_feed(ALARM_TEMPERATURE, (int16_t)(temp[0] * 10));
+				alarm_feed(ALARM_HUMIDITY, (int16_t)(hum[0] * 10));
+			}
+		} while (timebase_correct(timebase_now()) - shown < refresh);
 		address ++;
 
 	}
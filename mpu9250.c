@@ -1,76 +1,329 @@
 #include "i2cmaster.h"
+#include "i2c_txn.h"
 #include "mpu9250.h"
+#include "mpu_spi.h"
+#include "timebase.h"
+#include <avr/pgmspace.h>
 #include <util/delay.h>
 
-// Function which accumulates gyro and accelerometer data after device
-// initialization. It calculates the average of the at-rest readings and then
-// loads the resulting offsets into accelerometer and gyro bias registers.
-void mpu_calibrate(float * gyroBias, float * accelBias)
-{
-	uint8_t data[12]; // data array to hold accelerometer and gyro x, y, z, data
-	uint16_t ii, packet_count, fifo_count;
-	int32_t gyro_bias[3]  = {0, 0, 0}, accel_bias[3] = {0, 0, 0};
-
+// Reset and set-up for bias calculation. Entries are ordered so neighbouring
+// registers are written together as one burst by mpu_run_sequence().
+static const mpu_reg_op_t mpu_calibrate_setup[] PROGMEM = {
 	// reset device
 	// Write a one to bit 7 reset bit; toggle reset device
-	mpu_write_byte(MPU9250_ADDRESS, PWR_MGMT_1, READ_FLAG);
-	_delay_ms(100);
-
+	{PWR_MGMT_1, READ_FLAG, 100},
 	// get stable time source; Auto select clock source to be PLL gyroscope
 	// reference if ready else use the internal oscillator, bits 2:0 = 001
-	mpu_write_byte(MPU9250_ADDRESS, PWR_MGMT_1, 0x01);
-	mpu_write_byte(MPU9250_ADDRESS, PWR_MGMT_2, 0x00);
-	_delay_ms(200);
+	{PWR_MGMT_1, 0x01, 0},
+	{PWR_MGMT_2, 0x00, 200},
 
 	// Configure device for bias calculation
 	// Disable all interrupts
-	mpu_write_byte(MPU9250_ADDRESS, INT_ENABLE, 0x00);
+	{INT_ENABLE, 0x00, 0},
 	// Disable FIFO
-	mpu_write_byte(MPU9250_ADDRESS, FIFO_EN, 0x00);
-	// Turn on internal clock source
-	mpu_write_byte(MPU9250_ADDRESS, PWR_MGMT_1, 0x00);
+	{FIFO_EN, 0x00, 0},
 	// Disable I2C master
-	mpu_write_byte(MPU9250_ADDRESS, I2C_MST_CTRL, 0x00);
+	{I2C_MST_CTRL, 0x00, 0},
 	// Disable FIFO and I2C master modes
-	mpu_write_byte(MPU9250_ADDRESS, USER_CTRL, 0x00);
+	{USER_CTRL, 0x00, 0},
+	// Turn on internal clock source
+	{PWR_MGMT_1, 0x00, 0},
 	// Reset FIFO and DMP
-	mpu_write_byte(MPU9250_ADDRESS, USER_CTRL, 0x0C);
-	_delay_ms(15);
+	{USER_CTRL, 0x0C, 15},
 
 	// Configure MPU6050 gyro and accelerometer for bias calculation
-	// Set low-pass filter to 188 Hz
-	mpu_write_byte(MPU9250_ADDRESS, CONFIG, 0x01);
 	// Set sample rate to 1 kHz
-	mpu_write_byte(MPU9250_ADDRESS, SMPLRT_DIV, 0x00);
+	{SMPLRT_DIV, 0x00, 0},
+	// Set low-pass filter to 188 Hz
+	{CONFIG, 0x01, 0},
 	// Set gyro full-scale to 250 degrees per second, maximum sensitivity
-	mpu_write_byte(MPU9250_ADDRESS, GYRO_CONFIG, 0x00);
+	{GYRO_CONFIG, 0x00, 0},
 	// Set accelerometer full-scale to 2 g, maximum sensitivity
-	mpu_write_byte(MPU9250_ADDRESS, ACCEL_CONFIG, 0x00);
-
-	uint16_t  gyrosensitivity  = 131;   // = 131 LSB/degrees/sec
-	uint16_t  accelsensitivity = 16384; // = 16384 LSB/g
+	{ACCEL_CONFIG, 0x00, 0},
 
 	// Configure FIFO to capture accelerometer and gyro data for bias calculation
-	mpu_write_byte(MPU9250_ADDRESS, USER_CTRL, 0x40);  // Enable FIFO
+	{USER_CTRL, 0x40, 0},  // Enable FIFO
 	// Enable gyro and accelerometer sensors for FIFO  (max size 512 bytes in
 	// MPU-9150)
-	mpu_write_byte(MPU9250_ADDRESS, FIFO_EN, 0x78);
-	_delay_ms(40);  // accumulate 40 samples in 40 milliseconds = 480 bytes
+	{FIFO_EN, 0x78, 40},  // accumulate 40 samples in 40 milliseconds = 480 bytes
+	{MPU_SEQ_END, 0, 0}
+};
+
+static const mpu_reg_op_t mpu_init_wake[] PROGMEM = {
+	// wake up device
+	// Clear sleep mode bit (6), enable all sensors
+	{PWR_MGMT_1, 0x00, 100}, // Wait for all registers to reset
+	// Get stable time source
+	// Auto select clock source to be PLL gyroscope reference if ready else
+	{PWR_MGMT_1, 0x01, 200},
+	{MPU_SEQ_END, 0, 0}
+};
+
+static const mpu_reg_op_t mpu_init_interrupts[] PROGMEM = {
+	// Configure Interrupts and Bypass Enable
+	// Set interrupt pin active high, push-pull, hold interrupt pin level HIGH
+	// until interrupt cleared, clear on read of INT_STATUS, and enable
+	// I2C_BYPASS_EN so additional chips can join the I2C bus and all can be
+	// controlled by the Arduino as master.
+	{INT_PIN_CFG, 0x22, 0}, // ALLOWS ACCESS TO AK
+	// Enable data ready (bit 0) interrupt
+	{INT_ENABLE, 0x01, 100},
+	{MPU_SEQ_END, 0, 0}
+};
+
+mpu_shadow_stats_t mpu_shadow_stats;
+
+// Last value written to AK8963_CNTL, 0xFF while unknown (bits 7:5 of CNTL
+// always read 0)
+static uint8_t ak8963_cntl = 0xFF;
+
+#define MPU_SHADOW_NONE    0xFF
+#define MPU_SHADOW_ALL     ((1u << MPU_SHADOW_REGS) - 1)
+
+// Slot of a register in mpu9250_t.shadow, MPU_SHADOW_NONE if not mirrored.
+// Data, status and FIFO registers change on their own and are never cached.
+static uint8_t mpu_shadow_slot(uint8_t reg)
+{
+	if (reg >= SMPLRT_DIV && reg <= ACCEL_CONFIG2)
+	{
+		return reg - SMPLRT_DIV;
+	}
+	switch (reg)
+	{
+		case FIFO_EN:     return 5;
+		case INT_PIN_CFG: return 6;
+		case INT_ENABLE:  return 7;
+		case USER_CTRL:   return 8;
+		case PWR_MGMT_1:  return 9;
+		case PWR_MGMT_2:  return 10;
+	}
+	return MPU_SHADOW_NONE;
+}
+
+// Bits that clear themselves once the device has acted on them: the FIFO,
+// I2C master, DMP and signal path resets in USER_CTRL and H_RESET
+static uint8_t mpu_shadow_self_clearing(uint8_t reg)
+{
+	if (reg == USER_CTRL)
+	{
+		return 0x0F;
+	}
+	if (reg == PWR_MGMT_1)
+	{
+		return 0x80;
+	}
+	return 0x00;
+}
+
+#if MPU_SPI_ENABLE
+// USER_CTRL: I2C slave off, SPI only
+#define MPU_I2C_IF_DIS     0x10
+#endif
+
+// Did the last register access reach the device
+static uint8_t mpu_bus_ok(uint8_t device)
+{
+#if MPU_SPI_ENABLE
+	if (device & MPU_SPI_DEVICE){
+		return 1;
+	}
+#else
+	(void)device;
+#endif
+	return I2C_STATUS == I2C_OK;
+}
+
+// The AK8963 sits behind the device's bypass, its mode is forgotten too
+void mpu_shadow_invalidate(mpu9250_t * dev)
+{
+	dev->shadow_valid = 0;
+	ak8963_cntl = 0xFF;
+}
+
+// After a reset every mirrored register is 0x00 except PWR_MGMT_1 (0x01)
+static void mpu_shadow_reset(mpu9250_t * dev)
+{
+	uint8_t i;
+	for (i = 0; i < MPU_SHADOW_REGS; i++)
+	{
+		dev->shadow[i] = 0x00;
+	}
+	dev->shadow[mpu_shadow_slot(PWR_MGMT_1)] = 0x01;
+	dev->shadow_valid = MPU_SHADOW_ALL;
+}
+
+// Record a write of count registers from reg. A failed write leaves the
+// registers unknown.
+static void mpu_shadow_store(mpu9250_t * dev, uint8_t reg, uint8_t count,
+	const uint8_t * data, uint8_t ok)
+{
+	uint8_t i, slot;
+	for (i = 0; i < count; i++, reg++)
+	{
+		slot = mpu_shadow_slot(reg);
+		if (slot == MPU_SHADOW_NONE)
+		{
+			continue;
+		}
+		if (!ok)
+		{
+			dev->shadow_valid &= ~(1u << slot);
+		}
+		else if (reg == PWR_MGMT_1 && (data[i] & 0x80))
+		{
+			mpu_shadow_reset(dev);
+		}
+		else
+		{
+			dev->shadow[slot] = data[i] & ~mpu_shadow_self_clearing(reg);
+			dev->shadow_valid |= 1u << slot;
+		}
+	}
+}
+
+static void mpu_dev_write(mpu9250_t * dev, uint8_t reg, uint8_t count,
+	const uint8_t * data)
+{
+#if MPU_SPI_ENABLE
+	// A device on SPI keeps its I2C slave off through every write of
+	// USER_CTRL, or I2C traffic to other devices could be taken for its own
+	uint8_t spi[MPU_SEQ_BURST_MAX];
+	uint8_t i;
+
+	if ((dev->address & MPU_SPI_DEVICE) && reg <= USER_CTRL &&
+		USER_CTRL - reg < count && count <= sizeof(spi))
+	{
+		for (i = 0; i < count; i++)
+		{
+			spi[i] = data[i];
+		}
+		spi[USER_CTRL - reg] |= MPU_I2C_IF_DIS;
+		data = spi;
+	}
+#endif
+	mpu_write_bytes(dev->address, reg, count, data);
+	mpu_shadow_store(dev, reg, count, data, mpu_bus_ok(dev->address));
+}
+
+uint8_t mpu_reg_read(mpu9250_t * dev, uint8_t reg)
+{
+	uint8_t slot = mpu_shadow_slot(reg);
+	uint8_t value;
+
+	if (slot != MPU_SHADOW_NONE && (dev->shadow_valid & (1u << slot)))
+	{
+		mpu_shadow_stats.reads_saved++;
+		return dev->shadow[slot];
+	}
+
+	value = mpu_read_byte(dev->address, reg);
+	if (slot != MPU_SHADOW_NONE && mpu_bus_ok(dev->address))
+	{
+		dev->shadow[slot] = value;
+		dev->shadow_valid |= 1u << slot;
+	}
+	return value;
+}
+
+void mpu_reg_write(mpu9250_t * dev, uint8_t reg, uint8_t value)
+{
+	mpu_dev_write(dev, reg, 1, &value);
+}
+
+// Replace the bits of reg selected by mask. Skipped if the register is known
+// to hold the result already.
+void mpu_reg_update(mpu9250_t * dev, uint8_t reg, uint8_t mask, uint8_t value)
+{
+	uint8_t slot = mpu_shadow_slot(reg);
+	uint8_t old = mpu_reg_read(dev, reg);
+	uint8_t c = (old & ~mask) | (value & mask);
+
+	if (c == old && slot != MPU_SHADOW_NONE &&
+		(dev->shadow_valid & (1u << slot)))
+	{
+		mpu_shadow_stats.writes_saved++;
+		return;
+	}
+	mpu_reg_write(dev, reg, c);
+}
+
+// Execute a register sequence stored in PROGMEM. Runs of entries writing
+// consecutive registers without a delay in between are coalesced into one
+// auto-increment burst write; a delay is waited out after its entry.
+void mpu_run_sequence(mpu9250_t * dev, const mpu_reg_op_t * seq)
+{
+	uint8_t burst[MPU_SEQ_BURST_MAX];
+	uint8_t start = 0, n = 0;
+	uint8_t reg, delay;
+
+	for (;; seq++)
+	{
+		reg = pgm_read_byte(&seq->reg);
+		if (reg == MPU_SEQ_END)
+		{
+			break;
+		}
+
+		// Flush the pending burst unless this register follows on from it
+		if (n && (reg != (uint8_t)(start + n) || n == MPU_SEQ_BURST_MAX))
+		{
+			mpu_dev_write(dev, start, n, burst);
+			n = 0;
+		}
+		if (n == 0)
+		{
+			start = reg;
+		}
+		burst[n++] = pgm_read_byte(&seq->value);
+
+		delay = pgm_read_byte(&seq->delay_ms);
+		if (delay)
+		{
+			mpu_dev_write(dev, start, n, burst);
+			n = 0;
+			while (delay--)
+			{
+				_delay_ms(1);
+			}
+		}
+	}
+
+	if (n)
+	{
+		mpu_dev_write(dev, start, n, burst);
+	}
+}
+
+// Function which accumulates gyro and accelerometer data after device
+// initialization. It calculates the average of the at-rest readings and then
+// loads the resulting offsets into accelerometer and gyro bias registers.
+void mpu_calibrate(mpu9250_t * dev, float * gyroBias, float * accelBias)
+{
+	uint8_t data[12]; // data array to hold accelerometer and gyro x, y, z, data
+	uint16_t ii, packet_count, fifo_count;
+	int32_t gyro_bias[3]  = {0, 0, 0}, accel_bias[3] = {0, 0, 0};
+
+	// Reset the device, configure it for bias calculation and let the FIFO
+	// accumulate 40 ms of accelerometer and gyro data
+	mpu_run_sequence(dev, mpu_calibrate_setup);
+
+	uint16_t  gyrosensitivity  = MPU_CAL_GYRO_SENSITIVITY;   // = 131 LSB/degrees/sec
+	uint16_t  accelsensitivity = MPU_CAL_ACCEL_SENSITIVITY;  // = 16384 LSB/g
 
 	// At end of sample accumulation, turn off FIFO sensor read
 	// Disable gyro and accelerometer sensors for FIFO
-	mpu_write_byte(MPU9250_ADDRESS, FIFO_EN, 0x00);
+	mpu_reg_write(dev, FIFO_EN, 0x00);
 	// Read FIFO sample count
-	mpu_read_bytes(MPU9250_ADDRESS, FIFO_COUNTH, 2, &data[0]);
+	mpu_read_bytes(dev->address, FIFO_COUNTH, 2, &data[0]);
 	fifo_count = ((uint16_t)data[0] << 8) | data[1];
 	// How many sets of full gyro and accelerometer data for averaging
-	packet_count = fifo_count/12;
+	packet_count = fifo_count/MPU_FIFO_PACKET_SIZE;
 
 	for (ii = 0; ii < packet_count; ii++)
 	{
 		int16_t accel_temp[3] = {0, 0, 0}, gyro_temp[3] = {0, 0, 0};
 		// Read data for averaging
-		mpu_read_bytes(MPU9250_ADDRESS, FIFO_R_W, 12, &data[0]);
+		mpu_read_bytes(dev->address, FIFO_R_W, MPU_FIFO_PACKET_SIZE, &data[0]);
 		// Form signed 16-bit integer for each sample in FIFO
 		accel_temp[0] = (int16_t) (((int16_t)data[0] << 8) | data[1]  );
 		accel_temp[1] = (int16_t) (((int16_t)data[2] << 8) | data[3]  );
@@ -118,19 +371,22 @@ void mpu_calibrate(float * gyroBias, float * accelBias)
 	data[4] = (-gyro_bias[2]/4  >> 8) & 0xFF;
 	data[5] = (-gyro_bias[2]/4)       & 0xFF;
 
-	// Push gyro biases to hardware registers
-	mpu_write_byte(MPU9250_ADDRESS, XG_OFFSET_H, data[0]);
-	mpu_write_byte(MPU9250_ADDRESS, XG_OFFSET_L, data[1]);
-	mpu_write_byte(MPU9250_ADDRESS, YG_OFFSET_H, data[2]);
-	mpu_write_byte(MPU9250_ADDRESS, YG_OFFSET_L, data[3]);
-	mpu_write_byte(MPU9250_ADDRESS, ZG_OFFSET_H, data[4]);
-	mpu_write_byte(MPU9250_ADDRESS, ZG_OFFSET_L, data[5]);
+	// Push gyro biases to hardware registers, XG_OFFSET_H to ZG_OFFSET_L are
+	// consecutive so they go out as one burst
+	mpu_write_bytes(dev->address, XG_OFFSET_H, 6, &data[0]);
 
 	// Output scaled gyro biases for display in the main program
 	gyroBias[0] = (float) gyro_bias[0]/(float) gyrosensitivity;
 	gyroBias[1] = (float) gyro_bias[1]/(float) gyrosensitivity;
 	gyroBias[2] = (float) gyro_bias[2]/(float) gyrosensitivity;
 
+	// Without accelBias the accelerometer offset registers keep the factory
+	// trim an EEPROM calibration was solved against
+	if (!accelBias)
+	{
+		return;
+	}
+
 	// Construct the accelerometer biases for push to the hardware accelerometer
 	// bias registers. These registers contain factory trim values which must be
 	// added to the calculated accelerometer biases; on boot up these registers
@@ -142,11 +398,11 @@ void mpu_calibrate(float * gyroBias, float * accelBias)
 	// A place to hold the factory accelerometer trim biases
 	int32_t accel_bias_reg[3] = {0, 0, 0};
 	// Read factory accelerometer trim values
-	mpu_read_bytes(MPU9250_ADDRESS, XA_OFFSET_H, 2, &data[0]);
+	mpu_read_bytes(dev->address, XA_OFFSET_H, 2, &data[0]);
 	accel_bias_reg[0] = (int32_t) (((int16_t)data[0] << 8) | data[1]);
-	mpu_read_bytes(MPU9250_ADDRESS, YA_OFFSET_H, 2, &data[0]);
+	mpu_read_bytes(dev->address, YA_OFFSET_H, 2, &data[0]);
 	accel_bias_reg[1] = (int32_t) (((int16_t)data[0] << 8) | data[1]);
-	mpu_read_bytes(MPU9250_ADDRESS, ZA_OFFSET_H, 2, &data[0]);
+	mpu_read_bytes(dev->address, ZA_OFFSET_H, 2, &data[0]);
 	accel_bias_reg[2] = (int32_t) (((int16_t)data[0] << 8) | data[1]);
 
 	// Define mask for temperature compensation bit 0 of lower byte of
@@ -190,13 +446,11 @@ void mpu_calibrate(float * gyroBias, float * accelBias)
 
 	// Apparently this is not working for the acceleration biases in the MPU-9250
 	// Are we handling the temperature correction bit properly?
-	// Push accelerometer biases to hardware registers
-	mpu_write_byte(MPU9250_ADDRESS, XA_OFFSET_H, data[0]);
-	mpu_write_byte(MPU9250_ADDRESS, XA_OFFSET_L, data[1]);
-	mpu_write_byte(MPU9250_ADDRESS, YA_OFFSET_H, data[2]);
-	mpu_write_byte(MPU9250_ADDRESS, YA_OFFSET_L, data[3]);
-	mpu_write_byte(MPU9250_ADDRESS, ZA_OFFSET_H, data[4]);
-	mpu_write_byte(MPU9250_ADDRESS, ZA_OFFSET_L, data[5]);
+	// Push accelerometer biases to hardware registers, one burst per axis as
+	// the axes are a register apart
+	mpu_write_bytes(dev->address, XA_OFFSET_H, 2, &data[0]);
+	mpu_write_bytes(dev->address, YA_OFFSET_H, 2, &data[2]);
+	mpu_write_bytes(dev->address, ZA_OFFSET_H, 2, &data[4]);
 
 	// Output scaled accelerometer biases for display in the main program
 	accelBias[0] = (float)accel_bias[0]/(float)accelsensitivity;
@@ -205,93 +459,301 @@ void mpu_calibrate(float * gyroBias, float * accelBias)
 }
 
 
-void mpu_init(void)
+void mpu_init(mpu9250_t * dev)
 {
-	// wake up device
-	// Clear sleep mode bit (6), enable all sensors
-	mpu_write_byte(MPU9250_ADDRESS, PWR_MGMT_1, 0x00);
-	_delay_ms(100); // Wait for all registers to reset
+#if MPU_SPI_ENABLE
+	// SPI only from here on, as the datasheet asks right after power up
+	if (dev->address & MPU_SPI_DEVICE)
+	{
+		mpu_reg_update(dev, USER_CTRL, MPU_I2C_IF_DIS, MPU_I2C_IF_DIS);
+	}
+#endif
 
-	// Get stable time source
-	// Auto select clock source to be PLL gyroscope reference if ready else
-	mpu_write_byte(MPU9250_ADDRESS, PWR_MGMT_1, 0x01);
-	_delay_ms(200);
+	// Wake up device and get a stable time source
+	mpu_run_sequence(dev, mpu_init_wake);
 
-	// Configure Gyro and Thermometer
-	// Disable FSYNC and set thermometer and gyro bandwidth to 41 and 42 Hz,
-	// respectively;
-	// minimum delay time for this setting is 5.9 ms, which means sensor fusion
-	// update rates cannot be higher than 1 / 0.0059 = 170 Hz
-	// DLPF_CFG = bits 2:0 = 011; this limits the sample rate to 1000 Hz for both
-	// With the MPU9250, it is possible to get gyro sample rates of 32 kHz (!),
-	// 8 kHz, or 1 kHz
-	mpu_write_byte(MPU9250_ADDRESS, CONFIG, 0x03);
+	// Configure gyro, thermometer, accelerometer and the sample rate from
+	// MPU9250_CONFIG.h; mpu_configure() can change these later on.
+	const mpu_config_t config = MPU_CONFIG_DEFAULT;
+	mpu_configure(dev, &config);
+
+	// Configure interrupts and bypass enable
+	mpu_run_sequence(dev, mpu_init_interrupts);
+}
+
+
+#if MPU_RUNTIME_CONFIG
+mpu_scale_t mpu_scale = {MPU_GYRO_RES, MPU_ACCEL_RES, MPU_GSCALE, MPU_ASCALE};
+#endif
+
+// Gyro output data rate of a configuration in Hz
+uint16_t mpu_gyro_rate_hz(const mpu_config_t * cfg)
+{
+	// Fchoice_b bypasses the DLPF and runs the gyro at 32 kHz
+	if (cfg->gyro_bw >= GBW_3600HZ_32K)
+	{
+		return 32000;
+	}
+	// DLPF_CFG 0 and 7 run at 8 kHz, the sample rate divider is not applied
+	if (cfg->gyro_bw == GBW_250HZ || cfg->gyro_bw == GBW_3600HZ_8K)
+	{
+		return 8000;
+	}
+	return 1000 / (1 + cfg->smplrt_div);
+}
+
+// Accelerometer output data rate of a configuration in Hz
+uint16_t mpu_accel_rate_hz(const mpu_config_t * cfg)
+{
+	// accel_fchoice_b bypasses the DLPF and runs the accelerometer at 4 kHz
+	if (cfg->accel_bw == ABW_1130HZ_4K)
+	{
+		return 4000;
+	}
+	return 1000 / (1 + cfg->smplrt_div);
+}
+
+// Size in bytes of one FIFO packet for a set of FIFO_EN bits
+uint8_t mpu_fifo_packet_size(uint8_t fifo_en)
+{
+	uint8_t size = 0;
+	if (fifo_en & MPU_FIFO_TEMP)   size += 2;
+	if (fifo_en & MPU_FIFO_GYRO_X) size += 2;
+	if (fifo_en & MPU_FIFO_GYRO_Y) size += 2;
+	if (fifo_en & MPU_FIFO_GYRO_Z) size += 2;
+	if (fifo_en & MPU_FIFO_ACCEL)  size += 6;
+	return size;
+}
+
+// Check a configuration without touching the device
+enum MPU_STATUS_t mpu_config_check(const mpu_config_t * cfg)
+{
+	if (cfg->gscale > GFS_2000DPS || cfg->ascale > AFS_16G ||
+		cfg->gyro_bw > GBW_8800HZ_32K || cfg->accel_bw > ABW_1130HZ_4K)
+	{
+		return MPU_ERROR_CONFIG;
+	}
+
+#if !MPU_RUNTIME_CONFIG
+	// The conversion factors are compile time constants, so the full scale
+	// ranges can't move away from MPU9250_CONFIG.h
+	if (cfg->gscale != MPU_GSCALE || cfg->ascale != MPU_ASCALE)
+	{
+		return MPU_ERROR_CONFIG;
+	}
+#endif
+
+	// SMPLRT_DIV only applies while the gyro DLPF runs at 1 kHz; anywhere else
+	// it would be silently ignored for the gyro.
+	if (cfg->smplrt_div != 0 &&
+		(cfg->gyro_bw == GBW_250HZ || cfg->gyro_bw >= GBW_3600HZ_8K))
+	{
+		return MPU_ERROR_CONFIG;
+	}
+
+	// Only reading the FIFO in bursts keeps up with the 4, 8 and 32 kHz modes
+	if (cfg->fifo_en == 0 &&
+		(mpu_gyro_rate_hz(cfg) > MPU_POLL_RATE_MAX_HZ ||
+		 mpu_accel_rate_hz(cfg) > MPU_POLL_RATE_MAX_HZ))
+	{
+		return MPU_ERROR_CONFIG;
+	}
+
+	return MPU_OK;
+}
 
+// Apply sample rate, bandwidth and full scale range for gyro and
+// accelerometer. The configuration is validated first and nothing is written
+// if it is rejected.
+enum MPU_STATUS_t mpu_configure(mpu9250_t * dev, const mpu_config_t * cfg)
+{
+	uint8_t c;
+
+	if (mpu_config_check(cfg) != MPU_OK)
+	{
+		return MPU_ERROR_CONFIG;
+	}
+
+	// Stop the FIFO while the rates change, the packet layout may differ
+	mpu_reg_update(dev, FIFO_EN, 0xFF, 0x00);
+
+	// Configure Gyro and Thermometer
+	// DLPF_CFG = bits 2:0. With DLPF_CFG 1 - 6 the gyro runs at 1 kHz; 0 and 7
+	// give 8 kHz. With the MPU9250 it is possible to get gyro sample rates of
+	// 32 kHz (!) by bypassing the DLPF through Fchoice_b below.
+	// e.g. 0x03 sets thermometer and gyro bandwidth to 41 and 42 Hz; minimum
+	// delay time for this setting is 5.9 ms, which means sensor fusion update
+	// rates cannot be higher than 1 / 0.0059 = 170 Hz
 	// Set sample rate = gyroscope output rate/(1 + SMPLRT_DIV)
-	// Use a 200 Hz rate; a rate consistent with the filter update rate
-	// determined inset in CONFIG above.
-	mpu_write_byte(MPU9250_ADDRESS, SMPLRT_DIV, 0x04);
+	// SMPLRT_DIV and CONFIG are neighbours, so both go out in one burst
+	uint8_t rate[2];
+	rate[0] = cfg->smplrt_div;
+	rate[1] = cfg->gyro_bw < GBW_3600HZ_32K ? cfg->gyro_bw : 0x00;
+	mpu_dev_write(dev, SMPLRT_DIV, 2, rate);
 
 	// Set gyroscope full scale range
 	// Range selects FS_SEL and AFS_SEL are 0 - 3, so 2-bit values are
 	// left-shifted into positions 4:3
 
-	// get current GYRO_CONFIG register value
-	uint8_t c = mpu_read_byte(MPU9250_ADDRESS, GYRO_CONFIG);
-	// c = c & ~0xE0; // Clear self-test bits [7:5]
-	c = c & ~0x02; // Clear Fchoice bits [1:0]
-	c = c & ~0x18; // Clear AFS bits [4:3]
-	c = c | Gscale << 3; // Set full scale range for the gyro
-	// Set Fchoice for the gyro to 11 by writing its inverse to bits 1:0 of
-	// GYRO_CONFIG
-	// c =| 0x00;
-	// Write new GYRO_CONFIG value to register
-	mpu_write_byte(MPU9250_ADDRESS, GYRO_CONFIG, c );
+	// Self-test bits [7:5] are left alone, the shadow copy supplies them
+	c = cfg->gscale << 3; // Set full scale range for the gyro
+	// Fchoice is written as its inverse to bits 1:0 of GYRO_CONFIG; 00 keeps
+	// the DLPF, 10 gives 3.6 kHz and x1 gives 8.8 kHz bandwidth
+	if (cfg->gyro_bw == GBW_3600HZ_32K)
+	{
+		c = c | 0x02;
+	}
+	else if (cfg->gyro_bw == GBW_8800HZ_32K)
+	{
+		c = c | 0x01;
+	}
+	// Update GYRO_CONFIG bits [4:3] and Fchoice bits [1:0]
+	mpu_reg_update(dev, GYRO_CONFIG, 0x1B, c);
 
 	// Set accelerometer full-scale range configuration
-	// Get current ACCEL_CONFIG register value
-	c = mpu_read_byte(MPU9250_ADDRESS, ACCEL_CONFIG);
-	// c = c & ~0xE0; // Clear self-test bits [7:5]
-	c = c & ~0x18;  // Clear AFS bits [4:3]
-	c = c | Ascale << 3; // Set full scale range for the accelerometer
-	// Write new ACCEL_CONFIG register value
-	mpu_write_byte(MPU9250_ADDRESS, ACCEL_CONFIG, c);
+	// Update AFS bits [4:3] of ACCEL_CONFIG
+	mpu_reg_update(dev, ACCEL_CONFIG, 0x18, cfg->ascale << 3);
 
 	// Set accelerometer sample rate configuration
 	// It is possible to get a 4 kHz sample rate from the accelerometer by
 	// choosing 1 for accel_fchoice_b bit [3]; in this case the bandwidth is
 	// 1.13 kHz
-	// Get current ACCEL_CONFIG2 register value
-	c = mpu_read_byte(MPU9250_ADDRESS, ACCEL_CONFIG2);
-	c = c & ~0x0F; // Clear accel_fchoice_b (bit 3) and A_DLPFG (bits [2:0])
-	c = c | 0x03;  // Set accelerometer rate to 1 kHz and bandwidth to 41 Hz
-	// Write new ACCEL_CONFIG2 register value
-	mpu_write_byte(MPU9250_ADDRESS, ACCEL_CONFIG2, c);
-	// The accelerometer, gyro, and thermometer are set to 1 kHz sample rates,
-	// but all these rates are further reduced by a factor of 5 to 200 Hz because
-	// of the SMPLRT_DIV setting
+	// Update accel_fchoice_b (bit 3) and A_DLPFG (bits [2:0]) of
+	// ACCEL_CONFIG2; ABW_1130HZ_4K is 0x08, i.e. accel_fchoice_b
+	mpu_reg_update(dev, ACCEL_CONFIG2, 0x0F, cfg->accel_bw);
+	// With the DLPF enabled accelerometer, gyro and thermometer run at 1 kHz,
+	// further reduced by the SMPLRT_DIV setting (a factor of 5 to 200 Hz in
+	// the default configuration)
+
+#if MPU_RUNTIME_CONFIG
+	// Update the scale factors used by the conversion helpers
+	mpu_scale.gscale = cfg->gscale;
+	mpu_scale.ascale = cfg->ascale;
+	mpu_scale.gyro_res = (float)(250 << cfg->gscale) / 32768.0f;
+	mpu_scale.accel_res = (float)(2 << cfg->ascale) / 32768.0f;
+#endif
+
+	// Restart the FIFO for the high rate modes, it has to be drained with
+	// mpu_fifo_drain() before it fills up (512 bytes last 10 ms at 8 kHz)
+	dev->fifo_en = cfg->fifo_en;
+	dev->fifo_backlog = MPU_FIFO_BACKLOG_UNKNOWN;
+	if (cfg->fifo_en)
+	{
+		mpu_reg_write(dev, USER_CTRL, 0x04); // Reset FIFO
+		mpu_reg_write(dev, USER_CTRL, 0x40); // Enable FIFO
+		mpu_reg_write(dev, FIFO_EN, cfg->fifo_en);
+	}
+	else
+	{
+		// Polled profiles leave the FIFO off
+		mpu_reg_update(dev, USER_CTRL, 0x40, 0x00);
+	}
 
-	// Configure Interrupts and Bypass Enable
-	// Set interrupt pin active high, push-pull, hold interrupt pin level HIGH
-	// until interrupt cleared, clear on read of INT_STATUS, and enable
-	// I2C_BYPASS_EN so additional chips can join the I2C bus and all can be
-	// controlled by the Arduino as master.
-	mpu_write_byte(MPU9250_ADDRESS, INT_PIN_CFG, 0x22); // ALLOWS ACCESS TO AK
-	// Enable data ready (bit 0) interrupt
-	mpu_write_byte(MPU9250_ADDRESS, INT_ENABLE, 0x01);
-	_delay_ms(100);
+	return MPU_OK;
 }
 
+// Read as many whole FIFO packets as are available and fit into max bytes.
+// Returns the number of bytes stored in dest. On overflow the FIFO is reset,
+// the packets in it are dropped and status is set to MPU_ERROR_FIFO_OVERFLOW.
+// A failed transfer sets MPU_ERROR_BUS; if it was a FIFO read the FIFO is
+// reset too and only the packets read before it are returned.
+// dev->timestamp and dev->fifo_samples can be passed to timebase_sync().
+uint16_t mpu_fifo_drain(mpu9250_t * dev, uint8_t * dest, uint16_t max,
+	enum MPU_STATUS_t * status)
+{
+	uint8_t data[2];
+	uint8_t packet = mpu_fifo_packet_size(dev->fifo_en);
+	uint16_t fifo_count, packets, total = 0;
+
+	*status = MPU_OK;
+	if (packet == 0)
+	{
+		return 0;
+	}
+
+	// FIFO_OFLOW_INT is bit 4 of INT_STATUS
+	data[0] = mpu_read_byte(dev->address, INT_STATUS);
+	if (!mpu_bus_ok(dev->address))
+	{
+		*status = MPU_ERROR_BUS;
+		return 0;
+	}
+	if (data[0] & 0x10)
+	{
+		mpu_reg_write(dev, USER_CTRL, 0x44); // Reset FIFO
+		dev->timestamp = timebase_now();
+		dev->fifo_backlog = MPU_FIFO_BACKLOG_UNKNOWN;
+		dev->fifo_samples = MPU_FIFO_BACKLOG_UNKNOWN;
+		*status = MPU_ERROR_FIFO_OVERFLOW;
+		return 0;
+	}
+
+	// The newest packet in the FIFO was sampled within one sample period
+	// before the count is read
+	dev->timestamp = timebase_now();
+	mpu_read_bytes(dev->address, FIFO_COUNTH, 2, &data[0]);
+	if (!mpu_bus_ok(dev->address))
+	{
+		*status = MPU_ERROR_BUS;
+		return 0;
+	}
+	fifo_count = ((uint16_t)(data[0] & 0x1F) << 8) | data[1];
+	// Packets sampled since the last drain: everything queued now minus
+	// what that drain left behind
+	packets = fifo_count / packet;
+	dev->fifo_samples = dev->fifo_backlog == MPU_FIFO_BACKLOG_UNKNOWN ?
+		MPU_FIFO_BACKLOG_UNKNOWN : packets - dev->fifo_backlog;
+	if (fifo_count > max)
+	{
+		fifo_count = max;
+	}
+	fifo_count -= fifo_count % packet;
+
+	// mpu_read_bytes() takes at most 255 bytes, read whole packets per burst
+	while (total < fifo_count)
+	{
+		uint16_t chunk = fifo_count - total;
+		if (chunk > 255)
+		{
+			chunk = 255 - 255 % packet;
+		}
+		mpu_read_bytes(dev->address, FIFO_R_W, (uint8_t)chunk, &dest[total]);
+		if (!mpu_bus_ok(dev->address))
+		{
+			// The failed burst has taken an unknown part of a packet out,
+			// the FIFO starts over and the packets before it are returned
+			mpu_reg_write(dev, USER_CTRL, 0x44); // Reset FIFO
+			dev->fifo_backlog = MPU_FIFO_BACKLOG_UNKNOWN;
+			*status = MPU_ERROR_BUS;
+			return total;
+		}
+		total += chunk;
+	}
+	dev->fifo_backlog = packets - total / packet;
+
+	return total;
+}
+
+// Switch the magnetometer mode, skipped if it is in that mode already
+static void ak8963_set_mode(uint8_t cntl)
+{
+	if (ak8963_cntl == cntl)
+	{
+		mpu_shadow_stats.writes_saved++;
+		return;
+	}
+	mpu_write_byte(AK8963_ADDRESS, AK8963_CNTL, cntl);
+	ak8963_cntl = mpu_bus_ok(AK8963_ADDRESS) ? cntl : 0xFF;
+	_delay_ms(10);
+}
 
 void ak8963_init(float * destination)
 {
 	// First extract the factory calibration for each magnetometer axis
 	uint8_t rawData[3];  // x/y/z gyro calibration data stored here
 	// TODO: Test this!! Likely doesn't work
-	mpu_write_byte(AK8963_ADDRESS, AK8963_CNTL, 0x00); // Power down magnetometer
-	_delay_ms(10);
-	mpu_write_byte(AK8963_ADDRESS, AK8963_CNTL, 0x0F); // Enter Fuse ROM access mode
-	_delay_ms(10);
+	ak8963_set_mode(0x00); // Power down magnetometer
+	ak8963_set_mode(0x0F); // Enter Fuse ROM access mode
 
 	// Read the x-, y-, and z-axis calibration values
 	mpu_read_bytes(AK8963_ADDRESS, AK8963_ASAX, 3, &rawData[0]);
@@ -300,8 +762,7 @@ void ak8963_init(float * destination)
 	destination[0] =  (float)(rawData[0] - 128)/256. + 1.;
 	destination[1] =  (float)(rawData[1] - 128)/256. + 1.;
 	destination[2] =  (float)(rawData[2] - 128)/256. + 1.;
-	mpu_write_byte(AK8963_ADDRESS, AK8963_CNTL, 0x00); // Power down magnetometer
-	_delay_ms(10);
+	ak8963_set_mode(0x00); // Power down magnetometer
 
 	// Configure the magnetometer for continuous read and highest resolution.
 	// Set Mscale bit 4 to 1 (0) to enable 16 (14) bit resolution in CNTL
@@ -309,51 +770,70 @@ void ak8963_init(float * destination)
 	// 0010 for 8 Hz and 0110 for 100 Hz sample rates.
 
 	// Set magnetometer data resolution and sample ODR
-	mpu_write_byte(AK8963_ADDRESS, AK8963_CNTL, Mscale << 4 | Mmode);
-	_delay_ms(10);
+	ak8963_set_mode(MPU_AK8963_CNTL_VALUE);
+}
+
+// Read the latest accelerometer sample, x/y/z as signed 16-bit values
+void mpu_read_accel(mpu9250_t * dev, int16_t * destination)
+{
+	uint8_t rawData[6];  // x/y/z accel register data stored here
+	dev->timestamp = timebase_now();
+	mpu_read_bytes(dev->address, ACCEL_XOUT_H, 6, &rawData[0]);
+	destination[0] = ((int16_t)rawData[0] << 8) | rawData[1];
+	destination[1] = ((int16_t)rawData[2] << 8) | rawData[3];
+	destination[2] = ((int16_t)rawData[4] << 8) | rawData[5];
 }
 
+// Register access. Over I2C every call is one bounded transaction with
+// retries (i2c_txn.c); its result is left in I2C_STATUS and failures are
+// counted in i2c_txn_stats. A failed read returns 0xFF like an idle bus.
 unsigned char mpu_read_byte(uint8_t device, uint8_t address){
 	unsigned char data;
-	i2c_start(device << 1);
-	
-	i2c_write(address);
-	
-	i2c_stop();
-	
-	i2c_start((device << 1) | 1);
-	
-	data = i2c_readNak();
-	
-	i2c_stop();
+#if MPU_SPI_ENABLE
+	if (device & MPU_SPI_DEVICE){
+		return mpu_spi_read_byte(device, address);
+	}
+#endif
+	if (i2c_txn_read(device, address, &data, 1) != I2C_OK){
+		data = 0xFF;
+	}
 	
 	return data;
 }
 
 void mpu_write_byte(uint8_t device, uint8_t address, unsigned char data){
+#if MPU_SPI_ENABLE
+	if (device & MPU_SPI_DEVICE){
+		mpu_spi_write_byte(device, address, data);
+		return;
+	}
+#endif
 	
-	i2c_start(device << 1);
-	
-	i2c_write(address);
-	
-	i2c_write(data);
+	i2c_txn_write(device, address, &data, 1);
+}
 
-	i2c_stop();
+// Burst write to consecutive registers starting at address
+void mpu_write_bytes(uint8_t device, uint8_t address, uint8_t count, const uint8_t * data){
+#if MPU_SPI_ENABLE
+	if (device & MPU_SPI_DEVICE){
+		mpu_spi_write_bytes(device, address, count, data);
+		return;
+	}
+#endif
+	i2c_txn_write(device, address, data, count);
 }
 
 void mpu_read_bytes(uint8_t device, uint8_t address, uint8_t count, uint8_t * dest){
-	i2c_start(device << 1);
-	
-	i2c_write(address);
-	
-	i2c_stop();
-	
-	i2c_start((device << 1) | 1);
-	
-	uint8_t i;
-	for(i = 0; i < count - 1; i++){
-		dest[i] = i2c_readAck();
+#if MPU_SPI_ENABLE
+	if (device & MPU_SPI_DEVICE){
+		mpu_spi_read_bytes(device, address, count, dest);
+		return;
+	}
+#endif
+	// A retried FIFO read would return the packets shifted
+	if (address == FIFO_R_W){
+		i2c_txn_read_stream(device, address, dest, count);
+		return;
 	}
-	dest[i] = i2c_readNak();
-	i2c_stop();
+	i2c_txn_read(device, address, dest, count);
 }
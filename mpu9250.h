@@ -1,3 +1,8 @@
+#ifndef MPU9250_H_INCLUDED
+#define MPU9250_H_INCLUDED
+
+#include <inttypes.h>
+
 //Magnetometer Registers
 #define AK8963_ADDRESS   0x0C
 #define WHO_AM_I_AK8963  0x49 // (AKA WIA) should return 0x48
@@ -149,19 +154,9 @@
 #define ZA_OFFSET_H        0x7D
 #define ZA_OFFSET_L        0x7E
 #define MPU9250_ADDRESS 0x68
+#define MPU9250_ADDRESS_AD0 0x69  // Second device on the bus, AD0 pulled high
 #define READ_FLAG 0x80
 
-
-
-unsigned char mpu_read_byte(uint8_t device, uint8_t address);
-void mpu_write_byte(uint8_t device, uint8_t address, unsigned char data);
-void mpu_calibrate(float * gyroBias, float * accelBias);
-void mpu_read_bytes(uint8_t device, uint8_t address, uint8_t count, uint8_t * dest);
-void mpu_init(void);
-void ak8963_init(float * destination)
-
-
-
  enum Ascale
  {
 	 AFS_2G = 0,
@@ -187,15 +182,240 @@ void ak8963_init(float * destination)
 	 M_100HZ = 0x06 // 100 Hz continuous magnetometer
  };
 
- // TODO: Add setter methods for this hard coded stuff
- // Specify sensor full scale
- uint8_t Gscale = GFS_250DPS;
- uint8_t Ascale = AFS_2G;
- // Choose either 14-bit or 16-bit magnetometer resolution
- uint8_t Mscale = MFS_16BITS;
+// Gyro and thermometer bandwidth. Values 0-7 are DLPF_CFG in CONFIG, the
+// last two bypass the DLPF through Fchoice_b in GYRO_CONFIG.
+enum Gbw {
+	GBW_250HZ = 0,   // 8 kHz internal rate
+	GBW_184HZ,       // 1 kHz
+	GBW_92HZ,        // 1 kHz
+	GBW_41HZ,        // 1 kHz
+	GBW_20HZ,        // 1 kHz
+	GBW_10HZ,        // 1 kHz
+	GBW_5HZ,         // 1 kHz
+	GBW_3600HZ_8K,   // 8 kHz
+	GBW_3600HZ_32K,  // 32 kHz, Fchoice_b = 10
+	GBW_8800HZ_32K   // 32 kHz, Fchoice_b = 01
+};
+
+// Accelerometer bandwidth. Values 0-7 are A_DLPFCFG in ACCEL_CONFIG2, the
+// last one sets accel_fchoice_b and runs the accelerometer at 4 kHz.
+enum Abw {
+	ABW_460HZ = 0,   // 1 kHz
+	ABW_184HZ,
+	ABW_92HZ,
+	ABW_41HZ,
+	ABW_20HZ,
+	ABW_10HZ,
+	ABW_5HZ,
+	ABW_460HZ_ALT,   // same as ABW_460HZ
+	ABW_1130HZ_4K    // 4 kHz, accel_fchoice_b = 1
+};
+
+enum MPU_STATUS_t
+{
+	MPU_OK,
+	MPU_ERROR_CONFIG,
+	MPU_ERROR_FIFO_OVERFLOW,
+	MPU_ERROR_BUS        // a register access failed, see I2C_STATUS
+};
+
+#include "MPU9250_CONFIG.h"
+
+// Everything below is derived from MPU9250_CONFIG.h at compile time. None of
+// it occupies SRAM and every use folds into an immediate operand.
+
+// Full scale range of each sensor
+#define MPU_GYRO_FS_DPS    (250 << MPU_GSCALE)
+#define MPU_ACCEL_FS_G     (2 << MPU_ASCALE)
+
+// Resolution of one LSB in physical units (dps, g and mG)
+#define MPU_GYRO_RES       ((float)MPU_GYRO_FS_DPS / 32768.0f)
+#define MPU_ACCEL_RES      ((float)MPU_ACCEL_FS_G / 32768.0f)
+#define MPU_MAG_RES        ((MPU_MSCALE == MFS_16BITS) ? \
+                            (10.0f * 4912.0f / 32760.0f) : \
+                            (10.0f * 4912.0f / 8190.0f))
+
+// Register values written by mpu_init() and ak8963_init()
+#define MPU_GYRO_CONFIG_VALUE   (MPU_GSCALE << 3)
+#define MPU_ACCEL_CONFIG_VALUE  (MPU_ASCALE << 3)
+#define MPU_AK8963_CNTL_VALUE   (MPU_MSCALE << 4 | MPU_MMODE)
+
+// Output data rate after the SMPLRT_DIV divider (internal rate is 1 kHz with
+// the DLPF enabled)
+#define MPU_SAMPLE_RATE_HZ (1000 / (1 + MPU_SMPLRT_DIV))
+
+// Sensitivities used while calibrating, mpu_calibrate() always runs at
+// 250 dps and 2 g full scale
+#define MPU_CAL_GYRO_SENSITIVITY   131    // LSB/degrees/sec
+#define MPU_CAL_ACCEL_SENSITIVITY  16384  // LSB/g
+
+// FIFO geometry; one packet holds accel and gyro x, y, z
+#define MPU_FIFO_SIZE          512
+#define MPU_FIFO_PACKET_SIZE   12
+#define MPU_FIFO_MAX_PACKETS   (MPU_FIFO_SIZE / MPU_FIFO_PACKET_SIZE)
+
+// FIFO_EN bits
+#define MPU_FIFO_TEMP      0x80
+#define MPU_FIFO_GYRO_X    0x40
+#define MPU_FIFO_GYRO_Y    0x20
+#define MPU_FIFO_GYRO_Z    0x10
+#define MPU_FIFO_GYRO      0x70
+#define MPU_FIFO_ACCEL     0x08
+
+// Fastest output rate that can still be polled register by register; above
+// this a profile has to stream through the FIFO.
+#define MPU_POLL_RATE_MAX_HZ   1000
+
+// Runtime sensor configuration applied by mpu_configure()
+typedef struct
+{
+	uint8_t gscale;      // enum Gscale
+	uint8_t ascale;      // enum Ascale
+	uint8_t gyro_bw;     // enum Gbw
+	uint8_t accel_bw;    // enum Abw
+	uint8_t smplrt_div;  // 1 kHz / (1 + smplrt_div), DLPF gyro modes only
+	uint8_t fifo_en;     // FIFO_EN bits to stream, 0 to poll registers
+} mpu_config_t;
+
+// The profile mpu_init() applies, built from MPU9250_CONFIG.h
+#define MPU_CONFIG_DEFAULT \
+	{ MPU_GSCALE, MPU_ASCALE, MPU_DLPF_CFG, MPU_A_DLPF_CFG, MPU_SMPLRT_DIV, 0 }
+
+// Configuration registers mirrored in each handle: SMPLRT_DIV to
+// ACCEL_CONFIG2, FIFO_EN, INT_PIN_CFG, INT_ENABLE, USER_CTRL and PWR_MGMT_1/2
+#define MPU_SHADOW_REGS    11
+
+// One MPU-9250 on the bus. Every mpu_* function above the raw register access
+// takes a handle, so several devices can be driven side by side.
+typedef struct
+{
+	uint8_t address;     // MPU9250_ADDRESS or MPU9250_ADDRESS_AD0
+	uint8_t fifo_en;     // FIFO_EN bits of the active configuration
+	uint8_t shadow[MPU_SHADOW_REGS];  // last known configuration registers
+	uint16_t shadow_valid;            // bit n set: shadow[n] matches the device
+	uint32_t timestamp;      // timebase_now() at the last sample read
+	// FIFO packets left behind by the last drain and packets that arrived
+	// between the last two drains (MPU_FIFO_BACKLOG_UNKNOWN if unknown), for
+	// timebase_sync()
+	uint16_t fifo_backlog;
+	uint16_t fifo_samples;
+} mpu9250_t;
+
+#define MPU_FIFO_BACKLOG_UNKNOWN 0xFFFF
+
+#define MPU9250_DEVICE(address) \
+	{ (address), 0, {0}, 0, 0, MPU_FIFO_BACKLOG_UNKNOWN, 0 }
+
+// Bus transactions the shadow registers made unnecessary
+typedef struct
+{
+	uint16_t reads_saved;
+	uint16_t writes_saved;
+} mpu_shadow_stats_t;
+
+extern mpu_shadow_stats_t mpu_shadow_stats;
+
+#if MPU_RUNTIME_CONFIG
+// Scale factors of the last applied configuration, updated by
+// mpu_configure(). They are shared, devices running side by side need the
+// same full scale ranges.
+typedef struct
+{
+	float gyro_res;
+	float accel_res;
+	uint8_t gscale;
+	uint8_t ascale;
+} mpu_scale_t;
+
+extern mpu_scale_t mpu_scale;
+
+#define MPU_GYRO_RES_ACTIVE    (mpu_scale.gyro_res)
+#define MPU_ACCEL_RES_ACTIVE   (mpu_scale.accel_res)
+#define MPU_GSCALE_ACTIVE      (mpu_scale.gscale)
+#define MPU_ASCALE_ACTIVE      (mpu_scale.ascale)
+#else
+#define MPU_GYRO_RES_ACTIVE    MPU_GYRO_RES
+#define MPU_ACCEL_RES_ACTIVE   MPU_ACCEL_RES
+#define MPU_GSCALE_ACTIVE      MPU_GSCALE
+#define MPU_ASCALE_ACTIVE      MPU_ASCALE
+#endif
+
+
+
+// One step of a register sequence kept in PROGMEM; delay_ms is waited after
+// the write. A sequence ends with an entry whose reg is MPU_SEQ_END.
+typedef struct
+{
+	uint8_t reg;
+	uint8_t value;
+	uint8_t delay_ms;
+} mpu_reg_op_t;
+
+#define MPU_SEQ_END        0xFF
+#define MPU_SEQ_BURST_MAX  16
+
+
+
+unsigned char mpu_read_byte(uint8_t device, uint8_t address);
+void mpu_write_byte(uint8_t device, uint8_t address, unsigned char data);
+void mpu_write_bytes(uint8_t device, uint8_t address, uint8_t count, const uint8_t * data);
+void mpu_run_sequence(mpu9250_t * dev, const mpu_reg_op_t * seq);
+
+// Register access through the handle. Writes keep the shadow registers up to
+// date, reads of shadowed registers are served from RAM and updates that
+// would not change a register don't reach the bus. Anything that resets the
+// device behind the driver's back must call mpu_shadow_invalidate(), which
+// also forgets the mode of the AK8963.
+uint8_t mpu_reg_read(mpu9250_t * dev, uint8_t reg);
+void mpu_reg_write(mpu9250_t * dev, uint8_t reg, uint8_t value);
+void mpu_reg_update(mpu9250_t * dev, uint8_t reg, uint8_t mask, uint8_t value);
+void mpu_shadow_invalidate(mpu9250_t * dev);
+// accelBias may be NULL to leave the accelerometer offset registers alone
+void mpu_calibrate(mpu9250_t * dev, float * gyroBias, float * accelBias);
+void mpu_read_bytes(uint8_t device, uint8_t address, uint8_t count, uint8_t * dest);
+void mpu_init(mpu9250_t * dev);
+// The AK8963 is reached over I2C through the bypass of an MPU-9250 on I2C.
+// An MPU-9250 on SPI has no magnetometer here: mpu_init() turns its I2C
+// slave off, which takes the bypass with it, and reading the AK8963 through
+// the MPU's own I2C master (SLV0) is not implemented.
+void ak8963_init(float * destination);
+void mpu_read_accel(mpu9250_t * dev, int16_t * destination);
+
+enum MPU_STATUS_t mpu_configure(mpu9250_t * dev, const mpu_config_t * cfg);
+enum MPU_STATUS_t mpu_config_check(const mpu_config_t * cfg);
+uint16_t mpu_gyro_rate_hz(const mpu_config_t * cfg);
+uint16_t mpu_accel_rate_hz(const mpu_config_t * cfg);
+uint8_t mpu_fifo_packet_size(uint8_t fifo_en);
+uint16_t mpu_fifo_drain(mpu9250_t * dev, uint8_t * dest, uint16_t max,
+	enum MPU_STATUS_t * status);
+
+// Conversions from raw samples. Unless MPU_RUNTIME_CONFIG is set the scale
+// factors are constants, so each of these compiles to a single multiply
+// (float) or multiply and shift (integer) with no load of the current range.
+static inline float mpu_gyro_dps(int16_t raw)
+{
+	return (float)raw * MPU_GYRO_RES_ACTIVE;
+}
+
+static inline float mpu_accel_g(int16_t raw)
+{
+	return (float)raw * MPU_ACCEL_RES_ACTIVE;
+}
+
+static inline float mpu_mag_mg(int16_t raw)
+{
+	return (float)raw * MPU_MAG_RES;
+}
+
+// Integer variants, gyro in 0.01 dps and accel in mg
+static inline int32_t mpu_gyro_cdps(int16_t raw)
+{
+	return ((int32_t)raw * 25000L) >> (15 - MPU_GSCALE_ACTIVE);
+}
 
- // 2 for 8 Hz, 6 for 100 Hz continuous magnetometer data read
- uint8_t Mmode = M_8HZ;
+static inline int32_t mpu_accel_mg(int16_t raw)
+{
+	return ((int32_t)raw * 1000L) >> (14 - MPU_ASCALE_ACTIVE);
+}
 
- // SPI chip select pin
- int8_t _csPin;
\ No newline at end of file
+#endif
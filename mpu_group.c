@@ -0,0 +1,207 @@
+#include <string.h>
+#include "i2cmaster.h"
+#include "mpu_group.h"
+
+static uint32_t mpu_group_now(mpu_group_t * group)
+{
+	if (group->clock)
+	{
+		return group->clock();
+	}
+	return group->counter;
+}
+
+// Apply the same configuration to every device and start their data ready or
+// FIFO streams as close together as the bus allows. Devices must have been
+// through mpu_init() already.
+enum MPU_STATUS_t mpu_group_start(mpu_group_t * group, const mpu_config_t * cfg)
+{
+	uint8_t i;
+
+	if (group->count > MPU_GROUP_MAX || mpu_config_check(cfg) != MPU_OK)
+	{
+		return MPU_ERROR_CONFIG;
+	}
+
+	// Configure with the streams stopped, mpu_configure() would otherwise
+	// start each FIFO as soon as its device is done
+	mpu_config_t quiet = *cfg;
+	quiet.fifo_en = 0;
+	for (i = 0; i < group->count; i++)
+	{
+		mpu_configure(&group->devices[i], &quiet);
+		group->devices[i].fifo_en = cfg->fifo_en;
+
+		// Only one device may bridge the AK8963 onto the bus, two of them in
+		// bypass would put two magnetometers at the same address
+		mpu_reg_update(&group->devices[i], INT_PIN_CFG, 0xFF,
+			i == 0 ? 0x22 : 0x20);
+	}
+
+	if (cfg->fifo_en)
+	{
+		// Reset all FIFOs first, then enable them back to back so the
+		// streams start within a few bus transactions of each other
+		for (i = 0; i < group->count; i++)
+		{
+			mpu_reg_write(&group->devices[i], USER_CTRL, 0x04);
+			mpu_reg_write(&group->devices[i], USER_CTRL, 0x40);
+		}
+		for (i = 0; i < group->count; i++)
+		{
+			mpu_reg_write(&group->devices[i], FIFO_EN, cfg->fifo_en);
+		}
+	}
+	else
+	{
+		// Drop any stale data ready flags so the first set is fresh
+		for (i = 0; i < group->count; i++)
+		{
+			mpu_read_byte(group->devices[i].address, INT_STATUS);
+		}
+	}
+
+	memset(&group->stats, 0, sizeof(group->stats));
+	group->counter = 0;
+	return MPU_OK;
+}
+
+// Fields of one sample in register order (accelerometer, temperature, gyro
+// axes), those missing from fifo_en read as zero
+static void mpu_group_unpack(uint8_t fifo_en, const uint8_t * raw,
+	mpu_sample_t * sample)
+{
+	uint8_t k;
+
+	memset(sample->accel, 0, sizeof(sample->accel));
+	memset(sample->gyro, 0, sizeof(sample->gyro));
+	sample->temperature = 0;
+	if (fifo_en & MPU_FIFO_ACCEL)
+	{
+		for (k = 0; k < 3; k++, raw += 2)
+		{
+			sample->accel[k] = ((int16_t)raw[0] << 8) | raw[1];
+		}
+	}
+	if (fifo_en & MPU_FIFO_TEMP)
+	{
+		sample->temperature = ((int16_t)raw[0] << 8) | raw[1];
+		raw += 2;
+	}
+	for (k = 0; k < 3; k++)
+	{
+		if (fifo_en & (MPU_FIFO_GYRO_X >> k))
+		{
+			sample->gyro[k] = ((int16_t)raw[0] << 8) | raw[1];
+			raw += 2;
+		}
+	}
+}
+
+// One sample of a device if it has one: the oldest packet of its FIFO
+// through mpu_fifo_drain(), or the data registers once its data ready flag
+// is up. Returns the bytes read, 0 if there was nothing yet.
+static uint8_t mpu_group_fetch(mpu_group_t * group, mpu9250_t * dev,
+	uint8_t * raw)
+{
+	enum MPU_STATUS_t status;
+	uint8_t bytes;
+
+	if (dev->fifo_en)
+	{
+		// INT_STATUS is left to the drain, reading it here would clear the
+		// FIFO_OFLOW_INT the drain checks
+		bytes = (uint8_t)mpu_fifo_drain(dev, raw,
+			mpu_fifo_packet_size(dev->fifo_en), &status);
+		if (status == MPU_ERROR_FIFO_OVERFLOW)
+		{
+			group->stats.overflows++;
+		}
+		return bytes;
+	}
+	// RAW_DATA_RDY_INT, cleared by reading INT_STATUS
+	if (!(mpu_read_byte(dev->address, INT_STATUS) & 0x01))
+	{
+		return 0;
+	}
+	mpu_read_bytes(dev->address, ACCEL_XOUT_H, MPU_GROUP_SAMPLE_BYTES, raw);
+	return MPU_GROUP_SAMPLE_BYTES;
+}
+
+// Collect one sample from every device, devices are visited back to back in
+// turn and each one is read as soon as it has a sample. FIFO streams give
+// their oldest packet, so a caller that keeps up with the output rate sees
+// every sample. Returns a bit mask of the devices that delivered a sample.
+uint8_t mpu_group_read(mpu_group_t * group, mpu_sample_t * samples)
+{
+	uint8_t rawData[MPU_GROUP_SAMPLE_BYTES];
+	uint8_t pending, got = 0, i, bytes;
+	uint8_t polls = 0;
+	uint32_t first = 0, last = 0;
+
+	pending = (uint8_t)((1 << group->count) - 1);
+	while (pending && polls < MPU_GROUP_POLL_LIMIT)
+	{
+		polls++;
+		for (i = 0; i < group->count; i++)
+		{
+			if (!(pending & (1 << i)))
+			{
+				continue;
+			}
+			bytes = mpu_group_fetch(group, &group->devices[i], &rawData[0]);
+			if (!bytes)
+			{
+				continue;
+			}
+
+			samples[i].timestamp = mpu_group_now(group);
+			mpu_group_unpack(group->devices[i].fifo_en ?
+				group->devices[i].fifo_en : MPU_FIFO_ACCEL | MPU_FIFO_TEMP |
+				MPU_FIFO_GYRO, &rawData[0], &samples[i]);
+			group->stats.bytes += bytes;
+
+			// Spread of the set, the devices may become ready in any order
+			if (!got || samples[i].timestamp < first)
+			{
+				first = samples[i].timestamp;
+			}
+			if (!got || samples[i].timestamp > last)
+			{
+				last = samples[i].timestamp;
+			}
+			got |= (uint8_t)(1 << i);
+			pending &= (uint8_t)~(1 << i);
+		}
+	}
+
+	for (i = 0; i < group->count; i++)
+	{
+		if (pending & (1 << i))
+		{
+			group->stats.missed++;
+		}
+	}
+	if (!pending)
+	{
+		group->stats.sets++;
+		group->stats.skew_sum += last - first;
+		if (last - first > group->stats.skew_max)
+		{
+			group->stats.skew_max = last - first;
+		}
+	}
+
+	group->counter++;
+	return got;
+}
+
+// Mean spread of timestamps within a set, in clock units
+uint32_t mpu_group_skew_mean(const mpu_group_t * group)
+{
+	if (group->stats.sets == 0)
+	{
+		return 0;
+	}
+	return group->stats.skew_sum / group->stats.sets;
+}
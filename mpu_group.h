@@ -0,0 +1,54 @@
+#ifndef MPU_GROUP_H_INCLUDED
+#define MPU_GROUP_H_INCLUDED
+
+#include <inttypes.h>
+#include "mpu9250.h"
+
+// Several MPU-9250s on one bus sampled as a set, e.g. a redundant pair at
+// MPU9250_ADDRESS and MPU9250_ADDRESS_AD0. The devices are configured alike,
+// their streams are started back to back and every read collects one sample
+// from each device with its own timestamp.
+
+#define MPU_GROUP_MAX 4
+
+// Polls per device before mpu_group_read() gives up on it
+#define MPU_GROUP_POLL_LIMIT 50
+
+// Bytes of one accel, temperature and gyro burst starting at ACCEL_XOUT_H,
+// the largest FIFO packet a sample is read from
+#define MPU_GROUP_SAMPLE_BYTES 14
+
+typedef struct
+{
+	int16_t accel[3];
+	int16_t temperature;
+	int16_t gyro[3];
+	uint32_t timestamp;   // time the data ready flag was seen
+} mpu_sample_t;
+
+typedef struct
+{
+	uint16_t sets;        // complete sets read
+	uint16_t missed;      // device samples that never became ready
+	uint16_t overflows;   // FIFO overflows the drain reported
+	uint32_t skew_sum;    // sum of per-set skew, for the mean
+	uint32_t skew_max;    // largest spread of timestamps within a set
+	uint32_t bytes;       // sample bytes moved over the bus
+} mpu_group_stats_t;
+
+typedef struct
+{
+	mpu9250_t * devices;
+	uint8_t count;
+	// Timestamp source, e.g. a microsecond clock. Without one the sample
+	// counter below is used and skew reads as zero.
+	uint32_t (*clock)(void);
+	uint32_t counter;
+	mpu_group_stats_t stats;
+} mpu_group_t;
+
+enum MPU_STATUS_t mpu_group_start(mpu_group_t * group, const mpu_config_t * cfg);
+uint8_t mpu_group_read(mpu_group_t * group, mpu_sample_t * samples);
+uint32_t mpu_group_skew_mean(const mpu_group_t * group);
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef  F_CPU
+#define F_CPU 1000000
+#endif
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "IO_MACROS.h"
+#include "mpu9250.h"
+#include "mpu_spi.h"
+
+#if MPU_SPI_ENABLE
+
+#define SPI_DDR   DDRB
+#define SPI_SS    PB4
+#define SPI_MOSI  PB5
+#define SPI_SCK   PB7
+
+// Register access is limited to 1 MHz, sensor and FIFO bursts may run at up
+// to 20 MHz. The peripheral tops out at F_CPU / 2, so bursts always use that
+// and register access uses the fastest divider that stays at or below 1 MHz.
+// SPR1:SPR0 in SPCR, SPI2X in SPSR.
+#define SPI_FAST_SPCR   0
+#define SPI_FAST_SPSR   (1 << SPI2X)
+#if F_CPU <= 2000000
+#define SPI_SLOW_SPCR   0
+#define SPI_SLOW_SPSR   (1 << SPI2X)
+#elif F_CPU <= 4000000
+#define SPI_SLOW_SPCR   0
+#define SPI_SLOW_SPSR   0
+#elif F_CPU <= 8000000
+#define SPI_SLOW_SPCR   (1 << SPR0)
+#define SPI_SLOW_SPSR   (1 << SPI2X)
+#elif F_CPU <= 16000000
+#define SPI_SLOW_SPCR   (1 << SPR0)
+#define SPI_SLOW_SPSR   0
+#else
+#define SPI_SLOW_SPCR   (1 << SPR1)
+#define SPI_SLOW_SPSR   (1 << SPI2X)
+#endif
+
+// Master, mode 3 (clock idles high, sample on the rising edge), MSB first
+#define SPI_SPCR  ((1 << SPE) | (1 << MSTR) | (1 << CPOL) | (1 << CPHA))
+
+// State of the interrupt driven burst started by mpu_spi_read_start()
+static volatile uint8_t spi_cs_mask = 0;
+static volatile uint8_t * volatile spi_dest;
+static volatile uint8_t spi_left = 0;
+static volatile uint8_t spi_busy = 0;
+
+static inline void spi_select(uint8_t device)
+{
+	PORT(MPU_SPI_CS_PORT) &= ~(1 << (device & ~MPU_SPI_DEVICE));
+}
+
+static inline void spi_deselect(uint8_t device)
+{
+	PORT(MPU_SPI_CS_PORT) |= (1 << (device & ~MPU_SPI_DEVICE));
+}
+
+static inline void spi_speed(uint8_t spcr, uint8_t spsr)
+{
+	SPCR = SPI_SPCR | spcr;
+	SPSR = spsr;
+}
+
+static uint8_t spi_transfer(uint8_t data)
+{
+	SPDR = data;
+	while (!(SPSR & (1 << SPIF)))
+		;
+	return SPDR;
+}
+
+// Set up the SPI peripheral and the chip select pin of one device. Call once
+// per device before mpu_init().
+void mpu_spi_init(uint8_t device)
+{
+	// SS must be an output or a low level on it drops the SPI out of master
+	// mode
+	SPI_DDR |= (1 << SPI_SS) | (1 << SPI_MOSI) | (1 << SPI_SCK);
+	DDR(MPU_SPI_CS_PORT) |= (1 << (device & ~MPU_SPI_DEVICE));
+	spi_deselect(device);
+	spi_speed(SPI_SLOW_SPCR, SPI_SLOW_SPSR);
+}
+
+uint8_t mpu_spi_read_byte(uint8_t device, uint8_t address)
+{
+	uint8_t data;
+	while (spi_busy)
+		;
+	spi_speed(SPI_SLOW_SPCR, SPI_SLOW_SPSR);
+	spi_select(device);
+	spi_transfer(address | READ_FLAG);
+	data = spi_transfer(0x00);
+	spi_deselect(device);
+	return data;
+}
+
+void mpu_spi_write_byte(uint8_t device, uint8_t address, uint8_t data)
+{
+	while (spi_busy)
+		;
+	spi_speed(SPI_SLOW_SPCR, SPI_SLOW_SPSR);
+	spi_select(device);
+	spi_transfer(address & ~READ_FLAG);
+	spi_transfer(data);
+	spi_deselect(device);
+}
+
+// Burst write to consecutive registers, register access speed
+void mpu_spi_write_bytes(uint8_t device, uint8_t address, uint8_t count,
+	const uint8_t * data)
+{
+	uint8_t i;
+	while (spi_busy)
+		;
+	spi_speed(SPI_SLOW_SPCR, SPI_SLOW_SPSR);
+	spi_select(device);
+	spi_transfer(address & ~READ_FLAG);
+	for (i = 0; i < count; i++)
+	{
+		spi_transfer(data[i]);
+	}
+	spi_deselect(device);
+}
+
+// Burst read; the register address auto-increments (FIFO_R_W doesn't and
+// keeps returning the next FIFO byte)
+void mpu_spi_read_bytes(uint8_t device, uint8_t address, uint8_t count,
+	uint8_t * dest)
+{
+	uint8_t i;
+	while (spi_busy)
+		;
+	spi_speed(SPI_FAST_SPCR, SPI_FAST_SPSR);
+	spi_select(device);
+	spi_transfer(address | READ_FLAG);
+	for (i = 0; i < count; i++)
+	{
+		dest[i] = spi_transfer(0x00);
+	}
+	spi_deselect(device);
+}
+
+// Start a burst read that completes in the background, byte by byte from the
+// SPI transfer complete interrupt. Global interrupts must be enabled; poll
+// mpu_spi_busy() before touching dest.
+void mpu_spi_read_start(uint8_t device, uint8_t address, uint8_t count,
+	uint8_t * dest)
+{
+	while (spi_busy)
+		;
+	if (count == 0)
+	{
+		return;
+	}
+	spi_cs_mask = (uint8_t)(1 << (device & ~MPU_SPI_DEVICE));
+	spi_dest = dest;
+	spi_left = count;
+	spi_busy = 1;
+	spi_speed(SPI_FAST_SPCR, SPI_FAST_SPSR);
+	SPCR |= (1 << SPIE);
+	spi_select(device);
+	SPDR = address | READ_FLAG;
+}
+
+uint8_t mpu_spi_busy(void)
+{
+	return spi_busy;
+}
+
+ISR(SPI_STC_vect)
+{
+	// The first interrupt follows the address byte, which clocks in nothing
+	// useful; every later one delivers a data byte
+	static uint8_t started = 0;
+	if (started)
+	{
+		*spi_dest++ = SPDR;
+		spi_left--;
+	}
+	if (spi_left)
+	{
+		started = 1;
+		SPDR = 0x00;
+		return;
+	}
+	started = 0;
+	PORT(MPU_SPI_CS_PORT) |= spi_cs_mask;
+	SPCR &= ~(1 << SPIE);
+	spi_busy = 0;
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef MPU_SPI_H_INCLUDED
+#define MPU_SPI_H_INCLUDED
+
+#include <inttypes.h>
+
+// SPI transport for the MPU-9250 on the ATmega1284p SPI peripheral. A device
+// byte with MPU_SPI_DEVICE set names an MPU-9250 on SPI instead of an I2C
+// address; its low bits are the chip select pin on MPU_SPI_CS_PORT. Passing
+// such a byte to mpu_read_byte(), mpu_write_byte() or mpu_read_bytes() (or
+// using it as the address of an mpu9250_t) routes the transfer here.
+// mpu_init() turns the I2C slave of such a device off (I2C_IF_DIS) and
+// every write of USER_CTRL through its handle keeps it off.
+//
+// The SPI pins PB4 - PB7 are the LCD data nibble in the current wiring, the
+// LCD has to move before MPU_SPI_ENABLE can be set. The AK8963 is not on the
+// SPI bus, and with the I2C slave off there is no bypass to it either: an
+// MPU-9250 on SPI has no magnetometer (see ak8963_init() in mpu9250.h).
+
+#define MPU_SPI_DEVICE 0x80
+#define MPU9250_SPI(cs_bit) (MPU_SPI_DEVICE | (cs_bit))
+
+void mpu_spi_init(uint8_t device);
+uint8_t mpu_spi_read_byte(uint8_t device, uint8_t address);
+void mpu_spi_write_byte(uint8_t device, uint8_t address, uint8_t data);
+void mpu_spi_write_bytes(uint8_t device, uint8_t address, uint8_t count,
+	const uint8_t * data);
+void mpu_spi_read_bytes(uint8_t device, uint8_t address, uint8_t count,
+	uint8_t * dest);
+void mpu_spi_read_start(uint8_t device, uint8_t address, uint8_t count,
+	uint8_t * dest);
+uint8_t mpu_spi_busy(void);
+
+#endif
@@ -0,0 +1,252 @@
+#ifndef  F_CPU
+#define F_CPU 1000000
+#endif
+
+#include <math.h>
+#include <string.h>
+#include "mpu9250.h"
+#include "preint.h"
+
+#define PREINT_PI	3.14159265f
+
+// Raw bias of an axis from mpu_calibrate()'s units, split into the rounded
+// LSB and what rounding left in 1/256 LSB
+static void preint_bias(float bias, float res, int16_t * lsb, int8_t * frac)
+{
+	int32_t q8 = lround(bias / res * 256.0f);
+
+	if (q8 > 32767L * 256)
+	{
+		q8 = 32767L * 256;
+	}
+	if (q8 < -32767L * 256)
+	{
+		q8 = -32767L * 256;
+	}
+	*lsb = (int16_t)((q8 + 128) >> 8);
+	*frac = (int8_t)(q8 - (int32_t)*lsb * 256);
+}
+
+// Set up pre-integration of samples at rate_hz (MPU_SAMPLE_RATE_HZ, or
+// mpu_gyro_rate_hz() after mpu_configure()) into one delta per decimation
+// samples, at the full scale ranges active now. gyroBias (dps) and
+// accelBias (g) are the arrays mpu_calibrate() filled in, subtracted from
+// every sample; mpu_calibrate() also loads them into the offset registers
+// (which keep them until the chip is reset), so pass NULL for a sensor
+// whose samples are already bias free.
+void preint_init(preint_t * p, uint16_t rate_hz, uint16_t decimation,
+	const float * gyroBias, const float * accelBias)
+{
+	// rad and m/s per LSB over one sample
+	float k = MPU_GYRO_RES_ACTIVE * (PREINT_PI / 180.0f) / rate_hz;
+	float c = MPU_ACCEL_RES_ACTIVE * PREINT_GRAVITY / rate_hz;
+	uint8_t a;
+
+	memset(p, 0, sizeof(*p));
+	p->decimation = decimation < 1 ? 1 : decimation > PREINT_DECIMATION_MAX ?
+		PREINT_DECIMATION_MAX : decimation;
+	// 6 alpha + the last sample is at most (6 decimation + 1) full scale
+	// samples, fit it in 16 bits with room for rounding
+	while ((1UL << p->shift) <= 6UL * p->decimation + 1)
+	{
+		p->shift++;
+	}
+	for (a = 0; a < PREINT_AXES; a++)
+	{
+		// through locals, p's members may be unaligned in a packed struct
+		int16_t lsb;
+		int8_t frac;
+
+		if (gyroBias)
+		{
+			preint_bias(gyroBias[a], MPU_GYRO_RES_ACTIVE, &lsb, &frac);
+			p->gyro_bias[a] = lsb;
+			p->gyro_frac[a] = frac;
+		}
+		if (accelBias)
+		{
+			preint_bias(accelBias[a], MPU_ACCEL_RES_ACTIVE, &lsb, &frac);
+			p->accel_bias[a] = lsb;
+			p->accel_frac[a] = frac;
+		}
+	}
+	p->angle_scale = k * (1UL << PREINT_ANGLE_FRAC);
+	p->velocity_scale = c * (1UL << PREINT_VELOCITY_FRAC);
+	p->rotation_scale = k / 2;
+	p->cross_scale = k * (1UL << p->shift) / 12;
+}
+
+static int16_t preint_sample(int16_t raw, int16_t bias)
+{
+	int32_t x = (int32_t)raw - bias;
+
+	// +-32767 keeps the products of two samples below 2^30
+	return x > 32767 ? 32767 : x < -32767 ? -32767 : (int16_t)x;
+}
+
+// 6 sum + last in 16 bits, rounded
+static int16_t preint_operand(int32_t sum, int16_t last, uint8_t shift)
+{
+	int32_t x = 6 * sum + last;
+
+	return (int16_t)((x + (1L << (shift - 1))) >> shift);
+}
+
+static void preint_cross(int64_t * acc, const int16_t * u, const int16_t * v)
+{
+	acc[0] += (int32_t)u[1] * v[2] - (int32_t)u[2] * v[1];
+	acc[1] += (int32_t)u[2] * v[0] - (int32_t)u[0] * v[2];
+	acc[2] += (int32_t)u[0] * v[1] - (int32_t)u[1] * v[0];
+}
+
+static int32_t preint_round(float x)
+{
+	if (x >= 2147483520.0f)
+	{
+		return INT32_MAX;
+	}
+	if (x <= -2147483520.0f)
+	{
+		return -INT32_MAX;
+	}
+	return lround(x);
+}
+
+// Scale the interval's sums into delta and start the next interval
+static void preint_close(preint_t * p, uint32_t stamp, preint_delta_t * delta)
+{
+	float n = p->count / 256.0f;
+	float alpha[PREINT_AXES], nu[PREINT_AXES];
+	uint8_t a;
+
+	for (a = 0; a < PREINT_AXES; a++)
+	{
+		alpha[a] = p->alpha[a] - n * p->gyro_frac[a];
+		nu[a] = p->nu[a] - n * p->accel_frac[a];
+	}
+	for (a = 0; a < PREINT_AXES; a++)
+	{
+		uint8_t b = a == 2 ? 0 : a + 1, c = b == 2 ? 0 : b + 1;
+		float phi = alpha[a] + p->cross_scale * (float)p->cone[a];
+		float v = nu[a] + p->cross_scale * (float)p->scull[a] +
+			p->rotation_scale * (alpha[b] * nu[c] - alpha[c] * nu[b]);
+
+		delta->angle[a] = preint_round(phi * p->angle_scale);
+		delta->velocity[a] = preint_round(v * p->velocity_scale);
+		p->alpha[a] = 0;
+		p->nu[a] = 0;
+		p->cone[a] = 0;
+		p->scull[a] = 0;
+	}
+	delta->sequence = p->sequence++;
+	delta->samples = p->count;
+	delta->start = p->start;
+	delta->end = stamp;
+	p->count = 0;
+}
+
+// Add a sample of both sensors (raw, as read). Returns 1 when it completes
+// an interval, whose delta is then in delta and the next interval has
+// started.
+uint8_t preint_push(preint_t * p, uint32_t stamp, const int16_t * gyro,
+	const int16_t * accel, preint_delta_t * delta)
+{
+	int16_t g[PREINT_AXES], v[PREINT_AXES], go[PREINT_AXES], vo[PREINT_AXES];
+	int64_t cone[PREINT_AXES], scull[PREINT_AXES];
+	uint8_t a;
+
+	if (p->count == 0)
+	{
+		p->start = stamp;
+	}
+	for (a = 0; a < PREINT_AXES; a++)
+	{
+		g[a] = preint_sample(gyro[a], p->gyro_bias[a]);
+		v[a] = preint_sample(accel[a], p->accel_bias[a]);
+		go[a] = preint_operand(p->alpha[a], p->gyro_last[a], p->shift);
+		vo[a] = preint_operand(p->nu[a], p->accel_last[a], p->shift);
+		cone[a] = p->cone[a];
+		scull[a] = p->scull[a];
+	}
+
+	// coning, then both halves of sculling, on copies as the sums may be
+	// unaligned in a packed struct
+	preint_cross(cone, go, g);
+	preint_cross(scull, go, v);
+	preint_cross(scull, vo, g);
+
+	for (a = 0; a < PREINT_AXES; a++)
+	{
+		p->cone[a] = cone[a];
+		p->scull[a] = scull[a];
+		p->alpha[a] += g[a];
+		p->nu[a] += v[a];
+		p->gyro_last[a] = g[a];
+		p->accel_last[a] = v[a];
+	}
+
+	if (++p->count < p->decimation)
+	{
+		return 0;
+	}
+	preint_close(p, stamp, delta);
+	return 1;
+}
+
+#if PREINT_BENCH_ENABLE
+
+#include "timebase.h"
+
+#define PREINT_BENCH_DECIMATION	20
+#define PREINT_BENCH_DELTAS		4
+
+// Average cycles per preint_push() of a sample that doesn't end an
+// interval, and per call that does (the scaling of the delta). Printed as
+// "<function> <cycles>" lines; the timebase_now() calls around each call
+// are subtracted.
+void preint_bench(void (*put)(char))
+{
+	static preint_t p;
+	const float gyroBias[PREINT_AXES] = {0.8f, -1.3f, 0.2f};
+	const float accelBias[PREINT_AXES] = {0.01f, 0.02f, -0.015f};
+	preint_delta_t delta;
+	uint32_t start, overhead, push = 0, close = 0;
+	uint16_t pushes = 0, closes = 0, i;
+	int16_t g[PREINT_AXES], v[PREINT_AXES];
+
+	start = timebase_now();
+	overhead = timebase_now() - start;
+
+	preint_init(&p, MPU_SAMPLE_RATE_HZ, PREINT_BENCH_DECIMATION, gyroBias,
+		accelBias);
+	for (i = 0; i < PREINT_BENCH_DECIMATION * PREINT_BENCH_DELTAS; i++)
+	{
+		uint8_t done;
+
+		// a wobble on all axes, gravity on z
+		g[0] = (i & 7) * 997 - 3500;
+		g[1] = 1200 - (i & 3) * 811;
+		g[2] = (i & 15) * 211 - 1600;
+		v[0] = (i & 3) * 401 - 600;
+		v[1] = 300 - (i & 7) * 97;
+		v[2] = 16384 + (i & 15) * 53 - 400;
+
+		start = timebase_now();
+		done = preint_push(&p, i * 5000UL, g, v, &delta);
+		if (done)
+		{
+			close += timebase_now() - start - overhead;
+			closes++;
+		}
+		else
+		{
+			push += timebase_now() - start - overhead;
+			pushes++;
+		}
+	}
+
+	timebase_bench_line(put, "preint_push", push, pushes);
+	timebase_bench_line(put, "preint_push_close", close, closes);
+}
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef PREINT_H_INCLUDED
+#define PREINT_H_INCLUDED
+
+#include <inttypes.h>
+
+// Pre-integration of the gyro and accelerometer streams at the full output
+// data rate, so attitude and velocity can be propagated (or sent) at a much
+// lower rate without losing what happens between the outputs. Every
+// decimation samples give one delta: the rotation vector of the body over
+// the interval and the integral of specific force over it, in the body
+// frame at the start of the interval. Downsampling the rates first and
+// integrating afterwards loses the coning (a rotation axis that moves
+// within the interval) and sculling (rotation while accelerating) terms;
+// these are accumulated here per sample with Savage's two-sample
+// algorithms:
+//
+//   alpha = sum dtheta_l      nu = sum dv_l
+//   beta  = 1/2 sum (alpha_l-1 + dtheta_l-1 / 6) x dtheta_l
+//   phi   = alpha + beta
+//   dv    = nu + 1/2 alpha x nu
+//         + 1/2 sum (alpha_l-1 + dtheta_l-1 / 6) x dv_l
+//                 + (nu_l-1 + dv_l-1 / 6) x dtheta_l
+//
+// where dtheta_l-1 and dv_l-1 of the first sample are the previous
+// interval's last. The sums are taken in raw LSB with the first operand of
+// every cross product rounded to 16 bits, so a sample costs 18 16 x 16 bit
+// multiplies; the scaling to radians and m/s is done once per delta.
+//
+// tools/preint_test.c runs this against coning and sculling motion on the
+// host and reports the drift against the decimation ratio. Cycle counts on
+// the ATmega1284P are printed by preint_bench() (build with
+// PREINT_BENCH_ENABLE 1) and have to be measured on the board.
+
+#define PREINT_AXES				3
+#define PREINT_DECIMATION_MAX	1024	// samples, keeps the sums in 32 bits
+
+// Fixed point of the deltas. The ranges bound the interval: 8 rad is 0.23 s
+// at 2000 dps, 128 m/s 0.8 s at 16 g; deltas beyond saturate.
+#define PREINT_ANGLE_FRAC		28		// rad * 2^28, +-8 rad
+#define PREINT_VELOCITY_FRAC	24		// m/s * 2^24, +-128 m/s
+
+#define PREINT_GRAVITY			9.80665f	// m/s^2 per g
+
+#ifndef PREINT_BENCH_ENABLE
+#define PREINT_BENCH_ENABLE		0
+#endif
+
+typedef struct
+{
+	uint16_t decimation;     // samples per delta
+	uint16_t count;          // samples in the current interval
+	uint16_t sequence;       // deltas given
+	uint8_t shift;           // first cross product operands are >> shift
+	uint32_t start;          // stamp of the current interval's first sample
+	int16_t gyro_bias[PREINT_AXES];     // LSB, rounded
+	int16_t accel_bias[PREINT_AXES];
+	int8_t gyro_frac[PREINT_AXES];      // and what rounding left, LSB / 256
+	int8_t accel_frac[PREINT_AXES];
+	int16_t gyro_last[PREINT_AXES];     // previous bias free sample
+	int16_t accel_last[PREINT_AXES];
+	int32_t alpha[PREINT_AXES];         // sum of gyro samples, LSB
+	int32_t nu[PREINT_AXES];            // sum of accelerometer samples, LSB
+	int64_t cone[PREINT_AXES];          // coning sum, LSB^2 >> shift
+	int64_t scull[PREINT_AXES];         // sculling sum, LSB^2 >> shift
+	float angle_scale;       // LSB to rad * 2^PREINT_ANGLE_FRAC
+	float velocity_scale;    // LSB to m/s * 2^PREINT_VELOCITY_FRAC
+	float rotation_scale;    // alpha x nu to LSB
+	float cross_scale;       // cone and scull to LSB
+} preint_t;
+
+// One interval, 36 bytes
+typedef struct
+{
+	int32_t angle[PREINT_AXES];     // rotation vector, rad * 2^PREINT_ANGLE_FRAC
+	int32_t velocity[PREINT_AXES];  // specific force integral (gravity
+	                                // included), m/s * 2^PREINT_VELOCITY_FRAC
+	uint16_t sequence;
+	uint16_t samples;
+	uint32_t start;          // stamps of the first and last sample
+	uint32_t end;
+} preint_delta_t;
+
+void preint_init(preint_t * p, uint16_t rate_hz, uint16_t decimation,
+	const float * gyroBias, const float * accelBias);
+uint8_t preint_push(preint_t * p, uint32_t stamp, const int16_t * gyro,
+	const int16_t * accel, preint_delta_t * delta);
+void preint_bench(void (*put)(char));
+
+#endif
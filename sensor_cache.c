@@ -0,0 +1,86 @@
+#include "sensor_cache.h"
+#include "timebase.h"
+
+// Whether the sensor may be read again
+static uint8_t ready(const sensor_cache_t * cache, uint32_t now)
+{
+	return !cache->tried || now - cache->attempt >= cache->interval;
+}
+
+// Get a reading no older than max_age us, reading the sensor if that is
+// needed and allowed. With SENSOR_CACHE_STALE the cached reading is the
+// newest there is but older than asked for; cache->status tells whether
+// the last read failed.
+enum SENSOR_CACHE_STATUS_t sensor_cache_get(sensor_cache_t * cache,
+	uint32_t max_age)
+{
+	uint32_t now = timebase_now();
+
+	cache->stats.requests++;
+	if (cache->valid && now - cache->stamp <= max_age)
+	{
+		return SENSOR_CACHE_FRESH;
+	}
+	if (!ready(cache, now))
+	{
+		cache->stats.throttled++;
+		return cache->valid ? SENSOR_CACHE_STALE : SENSOR_CACHE_EMPTY;
+	}
+
+	cache->attempt = now;
+	cache->tried = 1;
+	cache->stats.reads++;
+	cache->status = cache->acquire(cache);
+	if (cache->status != 0)
+	{
+		cache->stats.errors++;
+		return cache->valid ? SENSOR_CACHE_STALE : SENSOR_CACHE_EMPTY;
+	}
+	cache->stamp = cache->attempt;
+	cache->source = cache->acquire_source;
+	cache->valid = 1;
+	return SENSOR_CACHE_ACQUIRED;
+}
+
+// Record a read done outside the cache, e.g. by a shared bus transfer or a
+// FIFO drain; the caller has already updated the reading if status is 0
+void sensor_cache_store(sensor_cache_t * cache, uint32_t stamp,
+	uint8_t source, uint8_t status)
+{
+	cache->attempt = stamp;
+	cache->tried = 1;
+	cache->status = status;
+	if (status == 0)
+	{
+		cache->stamp = stamp;
+		cache->source = source;
+		cache->valid = 1;
+	}
+}
+
+// Whether sensor_cache_get() with this max_age would read the sensor now,
+// for scheduling blocking reads ahead of their consumers
+uint8_t sensor_cache_due(const sensor_cache_t * cache, uint32_t max_age)
+{
+	uint32_t now = timebase_now();
+
+	if (cache->valid && now - cache->stamp <= max_age)
+	{
+		return 0;
+	}
+	return ready(cache, now);
+}
+
+// Age of the cached reading in us, SENSOR_CACHE_ANY_AGE if there is none
+uint32_t sensor_cache_age(const sensor_cache_t * cache)
+{
+	return cache->valid ? timebase_now() - cache->stamp : SENSOR_CACHE_ANY_AGE;
+}
+
+// Forget the reading, e.g. after the sensor was reconfigured; the interval
+// since the last read still applies
+void sensor_cache_invalidate(sensor_cache_t * cache)
+{
+	cache->valid = 0;
+	cache->source = SENSOR_SOURCE_NONE;
+}
@@ -0,0 +1,84 @@
+#ifndef SENSOR_CACHE_H_INCLUDED
+#define SENSOR_CACHE_H_INCLUDED
+
+#include <inttypes.h>
+
+// Reading cache in front of a sensor. Each cache holds the last reading of
+// one sensor with the time and the way it was acquired. A consumer asks for
+// a reading no older than max_age microseconds: a cached one that is young
+// enough is returned as it is, otherwise the sensor is read through the
+// acquire function. A sensor is never read again sooner than its interval,
+// the time it needs to produce a new value (1 s for the DHT11, 2 s for the
+// DHT22, one sample period for the MPU-9250); until then the consumer gets
+// the cached reading, reported as stale if it is older than asked for.
+//
+// The reading itself lives wherever the acquire function puts it, usually
+// in the structure context points to; the cache only keeps its metadata.
+
+// Largest age, for consumers that take any reading
+#define SENSOR_CACHE_ANY_AGE	0xFFFFFFFFUL
+
+// How a reading was acquired
+enum SENSOR_SOURCE_t
+{
+	SENSOR_SOURCE_NONE,
+	SENSOR_SOURCE_SINGLE,     // transfer of this sensor alone
+	SENSOR_SOURCE_BUS,        // shared transfer, e.g. DHT_readBus()
+	SENSOR_SOURCE_REGISTER,   // data registers of a sampling device
+	SENSOR_SOURCE_FIFO        // drained from a device FIFO
+};
+
+enum SENSOR_CACHE_STATUS_t
+{
+	SENSOR_CACHE_ACQUIRED,    // the sensor was read just now
+	SENSOR_CACHE_FRESH,       // cached reading young enough
+	SENSOR_CACHE_STALE,       // cached reading older than asked for
+	SENSOR_CACHE_EMPTY        // no good reading yet
+};
+
+typedef struct sensor_cache sensor_cache_t;
+
+// Read the sensor into the reading; returns 0 when it succeeded, else the
+// driver's error status, and must leave the reading alone on failure. A good
+// reading is stamped with cache->attempt, the time the read started, which
+// the function may move to the exact sampling time.
+typedef uint8_t (*sensor_acquire_t)(sensor_cache_t * cache);
+
+typedef struct
+{
+	uint16_t requests;
+	uint16_t reads;           // acquire calls
+	uint16_t errors;          // failed acquire calls
+	uint16_t throttled;       // requests served stale inside the interval
+} sensor_cache_stats_t;
+
+struct sensor_cache
+{
+	sensor_acquire_t acquire;
+	void * context;
+	uint8_t acquire_source;   // enum SENSOR_SOURCE_t of acquire()
+	uint32_t interval;        // shortest time between reads, us
+	uint32_t stamp;           // timebase_now() of the good reading
+	uint32_t attempt;         // timebase_now() of the last read
+	uint8_t source;           // enum SENSOR_SOURCE_t of the good reading
+	uint8_t status;           // acquire result of the last read
+	uint8_t valid;            // a good reading is cached
+	uint8_t tried;            // attempt is set
+	sensor_cache_stats_t stats;
+};
+
+// e.g. sensor_cache_t c =
+//          SENSOR_CACHE(acquire_accel, SENSOR_SOURCE_REGISTER, &reading, 5000);
+#define SENSOR_CACHE(acquire, source, context, interval) \
+	{ (acquire), (context), (source), (interval), 0, 0, SENSOR_SOURCE_NONE, \
+	  0, 0, 0, {0} }
+
+enum SENSOR_CACHE_STATUS_t sensor_cache_get(sensor_cache_t * cache,
+	uint32_t max_age);
+void sensor_cache_store(sensor_cache_t * cache, uint32_t stamp,
+	uint8_t source, uint8_t status);
+uint8_t sensor_cache_due(const sensor_cache_t * cache, uint32_t max_age);
+uint32_t sensor_cache_age(const sensor_cache_t * cache);
+void sensor_cache_invalidate(sensor_cache_t * cache);
+
+#endif
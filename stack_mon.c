@@ -0,0 +1,100 @@
+#include "stack_mon.h"
+
+// Linker symbols: end of the static data and top of RAM
+extern uint8_t _end;
+extern uint8_t __stack;
+
+// Runs from .init1, before __zero_reg__ and the stack pointer are set up, so
+// it may not rely on r1 being zero or use the stack; hence assembler.
+void stack_mon_paint(void) __attribute__((naked, used, section(".init1")));
+
+void stack_mon_paint(void)
+{
+	__asm volatile (
+		"	ldi r30, lo8(_end)\n"
+		"	ldi r31, hi8(_end)\n"
+		"	ldi r24, %0\n"
+		"	ldi r25, hi8(__stack)\n"
+		"	rjmp 2f\n"
+		"1:\n"
+		"	st Z+, r24\n"
+		"2:\n"
+		"	cpi r30, lo8(__stack)\n"
+		"	cpc r31, r25\n"
+		"	brlo 1b\n"
+		"	breq 1b\n"
+		:
+		: "i" (STACK_MON_PAINT)
+	);
+}
+
+// Painted bytes from _end up to the first one the stack has overwritten
+uint16_t stack_mon_unused(void)
+{
+	const uint8_t * p = &_end;
+	uint16_t count = 0;
+
+	while (p <= &__stack && *p == STACK_MON_PAINT)
+	{
+		p++;
+		count++;
+	}
+	return count;
+}
+
+uint16_t stack_mon_high_water(void)
+{
+	return (uint16_t)(&__stack - &_end) + 1 - stack_mon_unused();
+}
+
+void stack_mon_stats(stack_mon_stats_t * stats)
+{
+	stats->size = (uint16_t)(&__stack - &_end) + 1;
+	stats->unused = stack_mon_unused();
+	stats->high_water = stats->size - stats->unused;
+}
+
+static void stack_mon_dec(void (*put)(char), uint16_t value)
+{
+	char digits[5];
+	uint8_t n = 0;
+
+	do
+	{
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	while (n)
+	{
+		put(digits[--n]);
+	}
+}
+
+// Print one line for the instrumentation log:
+//
+//   stack <high water> of <size> unused <unused>
+//
+// in decimal bytes, the form tools/stack_check.c -w compares against.
+void stack_mon_dump(void (*put)(char))
+{
+	stack_mon_stats_t stats;
+	const char * s;
+
+	stack_mon_stats(&stats);
+	for (s = "stack "; *s; s++)
+	{
+		put(*s);
+	}
+	stack_mon_dec(put, stats.high_water);
+	for (s = " of "; *s; s++)
+	{
+		put(*s);
+	}
+	stack_mon_dec(put, stats.size);
+	for (s = " unused "; *s; s++)
+	{
+		put(*s);
+	}
+	stack_mon_dec(put, stats.unused);
+	put('\n');
+}
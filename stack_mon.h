@@ -0,0 +1,28 @@
+#ifndef STACK_MON_H_INCLUDED
+#define STACK_MON_H_INCLUDED
+
+#include <inttypes.h>
+
+// Run time stack depth measurement. Before the C start-up code runs, the RAM
+// between the end of .bss/.noinit (_end) and the top of the stack (__stack)
+// is painted with STACK_MON_PAINT. The stack grows down over the paint, so
+// the painted bytes left above _end tell how close the stack ever came to
+// the static data: stack_mon_high_water() is the deepest stack use since
+// reset in bytes. tools/stack_check.c computes the static worst case the
+// measured value should stay below.
+
+#define STACK_MON_PAINT		0xC5
+
+typedef struct
+{
+	uint16_t size;        // bytes between _end and __stack
+	uint16_t high_water;  // deepest stack use since reset
+	uint16_t unused;      // painted bytes never reached
+} stack_mon_stats_t;
+
+uint16_t stack_mon_unused(void);
+uint16_t stack_mon_high_water(void);
+void stack_mon_stats(stack_mon_stats_t * stats);
+void stack_mon_dump(void (*put)(char));
+
+#endif
@@ -0,0 +1,211 @@
+#include "telem_codec.h"
+
+// Output bit position while a block is written
+typedef struct
+{
+	uint8_t * out;
+	uint16_t pos;
+	uint8_t acc;
+	uint8_t bits;
+} telem_bits_t;
+
+// Append the low count bits of value, MSB first. Shifting a mask keeps the
+// AVR away from variable shifts of the value.
+static void telem_put(telem_bits_t * b, uint16_t value, uint8_t count)
+{
+	uint16_t mask;
+
+	if (count == 0)
+	{
+		return;
+	}
+	for (mask = (uint16_t)1 << (count - 1); mask; mask >>= 1)
+	{
+		b->acc <<= 1;
+		if (value & mask)
+		{
+			b->acc |= 1;
+		}
+		if (++b->bits == 8)
+		{
+			b->out[b->pos++] = b->acc;
+			b->bits = 0;
+		}
+	}
+}
+
+static void telem_put_ones(telem_bits_t * b, uint8_t count)
+{
+	while (count--)
+	{
+		b->acc = (b->acc << 1) | 1;
+		if (++b->bits == 8)
+		{
+			b->out[b->pos++] = b->acc;
+			b->bits = 0;
+		}
+	}
+}
+
+static void telem_put_rice(telem_bits_t * b, uint32_t u, uint8_t k)
+{
+	uint32_t q = u >> k;
+
+	if (q < TELEM_ESCAPE)
+	{
+		telem_put_ones(b, (uint8_t)q);
+		telem_put(b, 0, 1);
+		telem_put(b, (uint16_t)u, k);
+	}
+	else
+	{
+		telem_put_ones(b, TELEM_ESCAPE);
+		telem_put(b, (uint16_t)(u >> 16), TELEM_RAW_BITS - 16);
+		telem_put(b, (uint16_t)u, 16);
+	}
+}
+
+// Prediction residual of sample x; order 0 (first order) predicts p1,
+// order 1 (second order) continues the slope from p2 to p1
+static int32_t telem_residual(uint8_t order, int16_t x, int16_t p1, int16_t p2)
+{
+	if (order)
+	{
+		return (int32_t)x - (2 * (int32_t)p1 - p2);
+	}
+	return (int32_t)x - p1;
+}
+
+void telem_init(telem_encoder_t * enc, uint8_t axes, uint8_t block,
+	uint8_t keyframe_interval)
+{
+	uint8_t a;
+
+	enc->axes = axes < TELEM_AXES_MAX ? axes : TELEM_AXES_MAX;
+	enc->block = block < TELEM_BLOCK_MAX ? block : TELEM_BLOCK_MAX;
+	if (enc->block == 0)
+	{
+		enc->block = 1;
+	}
+	enc->keyframe_interval = keyframe_interval ? keyframe_interval : 1;
+	enc->blocks = 0;
+	enc->seq = 0;
+	enc->fill = 0;
+	for (a = 0; a < TELEM_AXES_MAX; a++)
+	{
+		enc->prev[a] = enc->prev2[a] = 0;
+	}
+}
+
+// Encode the buffered samples as one block into out, which must hold
+// TELEM_BLOCK_BYTES_MAX(axes, block) bytes. Returns the block size in bytes.
+static uint16_t telem_encode(telem_encoder_t * enc, uint8_t * out)
+{
+	telem_bits_t b = {out, TELEM_HEADER_BYTES, 0, 0};
+	uint8_t key = enc->blocks == 0;
+	uint8_t n = enc->fill, first = key ? 1 : 0;
+	uint8_t a, i, k, order, crc;
+	uint16_t i16;
+	uint32_t sum1, sum2, sum;
+	int16_t p1, p2, q1, q2;
+
+	for (a = 0; a < enc->axes; a++)
+	{
+		// A keyframe starts from its first sample, the step into the second
+		// one is then predicted as flat by either order
+		p1 = key ? enc->buf[0][a] : enc->prev[a];
+		p2 = key ? enc->buf[0][a] : enc->prev2[a];
+
+		// Cost of both predictors over the block
+		sum1 = sum2 = 0;
+		q1 = p1;
+		q2 = p2;
+		for (i = first; i < n; i++)
+		{
+			sum1 += telem_zigzag(telem_residual(0, enc->buf[i][a], q1, q2));
+			sum2 += telem_zigzag(telem_residual(1, enc->buf[i][a], q1, q2));
+			q2 = q1;
+			q1 = enc->buf[i][a];
+		}
+		order = sum2 < sum1;
+		sum = order ? sum2 : sum1;
+
+		// Rice parameter close to log2 of the mean residual
+		for (k = 0; k < 15 && ((uint32_t)(n - first) << (k + 1)) <= sum; k++)
+			;
+
+		telem_put(&b, order, 1);
+		telem_put(&b, k, 4);
+		if (key)
+		{
+			telem_put(&b, (uint16_t)enc->buf[0][a], 16);
+		}
+		for (i = first; i < n; i++)
+		{
+			telem_put_rice(&b, telem_zigzag(
+				telem_residual(order, enc->buf[i][a], p1, p2)), k);
+			p2 = p1;
+			p1 = enc->buf[i][a];
+		}
+		enc->prev[a] = p1;
+		enc->prev2[a] = p2;
+	}
+
+	// Pad the last byte with zeros
+	if (b.bits)
+	{
+		out[b.pos++] = b.acc << (8 - b.bits);
+	}
+
+	out[0] = TELEM_SYNC;
+	out[1] = (key ? TELEM_KEYFRAME : 0) | n;
+	out[2] = enc->seq++;
+	out[3] = (uint8_t)(b.pos - TELEM_HEADER_BYTES);
+	out[4] = (uint8_t)((b.pos - TELEM_HEADER_BYTES) >> 8);
+	crc = 0;
+	for (i = 1; i < TELEM_HEADER_BYTES - 1; i++)
+	{
+		crc = telem_crc8(crc, out[i]);
+	}
+	for (i16 = TELEM_HEADER_BYTES; i16 < b.pos; i16++)
+	{
+		crc = telem_crc8(crc, out[i16]);
+	}
+	out[TELEM_HEADER_BYTES - 1] = crc;
+
+	enc->fill = 0;
+	if (++enc->blocks >= enc->keyframe_interval)
+	{
+		enc->blocks = 0;
+	}
+	return b.pos;
+}
+
+// Add one sample of axes values. When it completes a block the block is
+// encoded into out and its size returned, otherwise 0.
+uint16_t telem_push(telem_encoder_t * enc, const int16_t * sample,
+	uint8_t * out)
+{
+	uint8_t a;
+
+	for (a = 0; a < enc->axes; a++)
+	{
+		enc->buf[enc->fill][a] = sample[a];
+	}
+	if (++enc->fill < enc->block)
+	{
+		return 0;
+	}
+	return telem_encode(enc, out);
+}
+
+// Encode a partly filled block, e.g. at the end of a log. Returns 0 if no
+// samples are pending.
+uint16_t telem_flush(telem_encoder_t * enc, uint8_t * out)
+{
+	if (enc->fill == 0)
+	{
+		return 0;
+	}
+	return telem_encode(enc, out);
+}
@@ -0,0 +1,87 @@
+#ifndef TELEM_CODEC_H_INCLUDED
+#define TELEM_CODEC_H_INCLUDED
+
+#include <inttypes.h>
+
+// Lossless compression of int16 sample streams (e.g. 9-axis IMU data) for
+// the telemetry link and logs. Samples are collected into blocks; each axis
+// of a block is predicted from the previous samples with whichever of first
+// order (x[n-1]) or second order (2x[n-1] - x[n-2]) prediction fits the
+// block better, the residuals are zigzag mapped and Rice coded with a
+// parameter chosen per axis and block. Every keyframe_interval blocks a
+// keyframe restarts the predictors so a decoder can pick the stream up there.
+// The decoder is in tools/telem_decode.c.
+//
+// Block layout, byte aligned:
+//
+//   TELEM_SYNC, header, sequence, length (2 bytes, LSB first), CRC,
+//   bit packed payload
+//
+// header bit 7 is set for keyframes, bits 6:0 hold the sample count. The
+// sequence counts the blocks of the stream modulo 256, so a receiver sees
+// a lost block as a gap even when the blocks around it are intact. The
+// length counts the payload bytes, the CRC-8 (polynomial 0x07) covers
+// header, sequence, length and payload. The payload is written MSB first and
+// holds for each axis in turn: the predictor order (1 bit, 0 first order,
+// 1 second order) and Rice parameter k (4 bits), for keyframes the first
+// sample in 16 bits, then the residuals of the remaining samples. A
+// residual u >> k below TELEM_ESCAPE is coded as that many 1 bits, a 0 bit
+// and the low k bits of u; larger ones as TELEM_ESCAPE 1 bits followed by u
+// in TELEM_RAW_BITS bits.
+
+#define TELEM_AXES_MAX		9
+#define TELEM_BLOCK_MAX		32		// samples per block, at most 127
+
+#define TELEM_SYNC			0xA5
+#define TELEM_HEADER_BYTES	6
+#define TELEM_KEYFRAME		0x80
+#define TELEM_ESCAPE		16
+#define TELEM_RAW_BITS		18		// zigzag of any second order residual
+
+// Largest encoded block for a stream layout, for sizing output buffers
+#define TELEM_BLOCK_BYTES_MAX(axes, samples) \
+	(TELEM_HEADER_BYTES + \
+	 ((axes) * (5 + 16 + (uint32_t)(samples) * (TELEM_ESCAPE + TELEM_RAW_BITS)) + 7) / 8)
+
+typedef struct
+{
+	uint8_t axes;
+	uint8_t block;               // samples per block
+	uint8_t keyframe_interval;   // blocks from one keyframe to the next
+	uint8_t blocks;              // blocks since the last keyframe
+	uint8_t seq;                 // sequence of the next block
+	uint8_t fill;                // samples in buf
+	int16_t prev[TELEM_AXES_MAX];    // last two samples of the previous block
+	int16_t prev2[TELEM_AXES_MAX];
+	int16_t buf[TELEM_BLOCK_MAX][TELEM_AXES_MAX];
+} telem_encoder_t;
+
+void telem_init(telem_encoder_t * enc, uint8_t axes, uint8_t block,
+	uint8_t keyframe_interval);
+uint16_t telem_push(telem_encoder_t * enc, const int16_t * sample,
+	uint8_t * out);
+uint16_t telem_flush(telem_encoder_t * enc, uint8_t * out);
+
+static inline uint8_t telem_crc8(uint8_t crc, uint8_t data)
+{
+	uint8_t i;
+	crc ^= data;
+	for (i = 0; i < 8; i++)
+	{
+		crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+	}
+	return crc;
+}
+
+// Zigzag mapping shared with the decoder: 0, -1, 1, -2, ... to 0, 1, 2, 3
+static inline uint32_t telem_zigzag(int32_t r)
+{
+	return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+}
+
+static inline int32_t telem_unzigzag(uint32_t u)
+{
+	return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
+
+#endif
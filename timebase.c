@@ -0,0 +1,176 @@
+#ifndef  F_CPU
+#define F_CPU 1000000
+#endif
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "timebase.h"
+
+// Prescaler that gives 1 us per Timer1 tick
+#if F_CPU == 1000000
+#define TIMEBASE_CS		(1 << CS10)
+#elif F_CPU == 8000000
+#define TIMEBASE_CS		(1 << CS11)
+#else
+#error "The timebase needs F_CPU = 1 MHz or 8 MHz"
+#endif
+
+uint32_t timebase_scale = TIMEBASE_SCALE_ONE;
+
+static volatile uint16_t timebase_high;
+
+// Drift estimate state
+static uint16_t sync_rate_hz;
+static uint8_t sync_started;
+static uint32_t sync_start;
+static uint32_t sync_samples;
+// timebase_correct() is linear from this anchor on
+static uint32_t anchor_raw;
+static uint32_t anchor_corrected;
+
+ISR(TIMER1_OVF_vect)
+{
+	timebase_high++;
+}
+
+// Start Timer1 in normal mode. Interrupts have to be enabled for the clock
+// to run past 65 ms.
+void timebase_init(void)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		TCCR1A = 0;
+		TCCR1B = 0;
+		TCNT1 = 0;
+		timebase_high = 0;
+		TIFR1 = (1 << TOV1);
+		TIMSK1 = (1 << TOIE1);
+		TCCR1B = TIMEBASE_CS;
+	}
+	timebase_scale = TIMEBASE_SCALE_ONE;
+	anchor_raw = anchor_corrected = 0;
+	sync_started = 0;
+}
+
+// Current time in us. Safe to call from an ISR: with interrupts off an
+// overflow may be pending, which the flag check below accounts for.
+uint32_t timebase_now(void)
+{
+	uint16_t high, low;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		high = timebase_high;
+		low = TCNT1;
+		// Overflowed after the interrupts were disabled; a low count means
+		// TCNT1 was read after the wrap
+		if ((TIFR1 & (1 << TOV1)) && low < 0x8000)
+		{
+			high++;
+		}
+	}
+	return ((uint32_t)high << 16) | low;
+}
+
+// Nominal rate of the MPU samples passed to timebase_sync(). Restarts the
+// drift estimate, the correction found so far is kept.
+void timebase_sync_rate(uint16_t rate_hz)
+{
+	sync_rate_hz = rate_hz;
+	sync_started = 0;
+}
+
+// Start a new drift estimate window, e.g. after samples were lost
+void timebase_sync_restart(void)
+{
+	sync_started = 0;
+}
+
+// Report that samples MPU sample periods ended at stamp (a timebase_now()
+// reading), e.g. the packets of one FIFO drain. Every TIMEBASE_SYNC_SAMPLES
+// samples the scale is moved a quarter of the way towards the measured
+// ratio. The count must be exact, a drain that found no new sample reports 0
+// and changes nothing; if the count is unknown call timebase_sync_restart()
+// instead.
+void timebase_sync(uint32_t stamp, uint16_t samples)
+{
+	uint32_t measured, expected, ratio;
+
+	if (sync_rate_hz == 0)
+	{
+		return;
+	}
+	if (!sync_started)
+	{
+		sync_start = stamp;
+		sync_samples = 0;
+		sync_started = 1;
+		return;
+	}
+	if (samples == 0)
+	{
+		return;
+	}
+
+	sync_samples += samples;
+	if (sync_samples < TIMEBASE_SYNC_SAMPLES)
+	{
+		return;
+	}
+
+	measured = stamp - sync_start;
+	expected = (uint32_t)((uint64_t)sync_samples * 1000000UL / sync_rate_hz);
+	sync_start = stamp;
+	sync_samples = 0;
+	if (measured == 0)
+	{
+		return;
+	}
+	ratio = (uint32_t)(((uint64_t)expected << 16) / measured);
+	if (ratio > TIMEBASE_SCALE_ONE + TIMEBASE_SYNC_LIMIT ||
+		ratio < TIMEBASE_SCALE_ONE - TIMEBASE_SYNC_LIMIT)
+	{
+		return;
+	}
+
+	// Re-anchor at stamp before changing the slope, corrected time stays
+	// continuous and monotonic
+	anchor_corrected = timebase_correct(stamp);
+	anchor_raw = stamp;
+	timebase_scale = timebase_scale - (timebase_scale >> 2) + (ratio >> 2);
+}
+
+// Map a timebase_now() reading onto the MPU sample clock
+uint32_t timebase_correct(uint32_t stamp)
+{
+	int32_t delta = (int32_t)(stamp - anchor_raw);
+	return anchor_corrected +
+		(uint32_t)(int32_t)(((int64_t)delta * timebase_scale) >> 16);
+}
+
+// "<name> <cycles>" line of the *_bench() functions
+void timebase_bench_line(void (*put)(char), const char * name,
+	uint32_t ticks, uint16_t calls)
+{
+	// One timebase tick is F_CPU / 1 MHz cycles
+	uint32_t cycles = ticks * (F_CPU / 1000000UL) / (calls ? calls : 1);
+	char digits[10];
+	uint8_t n = 0;
+
+	while (*name)
+	{
+		put(*name++);
+	}
+	put(' ');
+	do
+	{
+		digits[n++] = '0' + cycles % 10;
+		cycles /= 10;
+	} while (cycles);
+	while (n)
+	{
+		put(digits[--n]);
+	}
+	put('\n');
+}
@@ -0,0 +1,39 @@
+#ifndef TIMEBASE_H_INCLUDED
+#define TIMEBASE_H_INCLUDED
+
+#include <inttypes.h>
+
+// Monotonic microsecond clock shared by all drivers. Timer1 counts 1 us
+// ticks and its overflow interrupt extends it to 32 bits, so timebase_now()
+// wraps after 71.6 minutes; differences of two readings are valid across
+// the wrap as unsigned arithmetic. Timer1 is reserved for the timebase.
+//
+// The MCU runs from its RC oscillator, which may be off by a few percent.
+// The MPU-9250 sample clock is used as the reference instead: timebase_sync()
+// takes the time a known number of MPU samples took, and timebase_correct()
+// maps a reading onto the MPU's time scale.
+
+// MPU samples per drift estimate and the largest deviation from the nominal
+// rate that is still believed, in 1/65536
+#define TIMEBASE_SYNC_SAMPLES	2000
+#define TIMEBASE_SYNC_LIMIT		8192	// 12.5 %
+
+// Ratio of MPU time to timer time, 16.16 fixed point
+#define TIMEBASE_SCALE_ONE		65536UL
+
+extern uint32_t timebase_scale;
+
+void timebase_init(void);
+uint32_t timebase_now(void);
+void timebase_sync_rate(uint16_t rate_hz);
+void timebase_sync(uint32_t stamp, uint16_t samples);
+void timebase_sync_restart(void);
+uint32_t timebase_correct(uint32_t stamp);
+
+// Print "<name> <cycles>" and a newline through put, the cycles being the
+// average per call of ticks timebase ticks spent over calls calls (0 counts
+// as 1). Shared by the *_bench() functions of the modules.
+void timebase_bench_line(void (*put)(char), const char * name,
+	uint32_t ticks, uint16_t calls);
+
+#endif
@@ -0,0 +1,360 @@
+// Test of alarm.c: the debounce and hysteresis of a channel, limits at the
+// ends of the int16_t range, and the time from a shock to the LED with the
+// loop of main.c running against the MPU-9250 and DHT11 models of tools/sim.
+//
+// Build and run from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -Itools/host -Itools/sim -I. -o alarm_test tools/alarm_test.c
+//       tools/sim/sim_world.c tools/sim/sim_mpu.c tools/sim/sim_dht.c
+//       alarm.c sensor_cache.c DHT.c mpu9250.c -lm
+//   ./alarm_test
+//
+// A channel must trip on the debounce-th sample outside its limits, hold
+// inside the hysteresis band and clear after debounce samples back inside
+// it. A low limit near INT16_MAX or a high limit near INT16_MIN must not
+// wrap when the hysteresis moves it. For the latency the main loop is
+// modelled twice, with the LCD refreshed once a second: feeding the alarms
+// once per refresh from the accelerometer registers as it used to, and
+// polling the sensor caches between refreshes with every accelerometer
+// sample of the FIFO fed as it does now. A 2 g shock is applied TEST_EVENTS
+// times at spread out moments and the time until the LED goes on is
+// measured; with polling the worst case must stay within TEST_LATENCY_US,
+// which is set by the DHT read that blocks the loop once a second. Then
+// TEST_SHORT_EVENTS shocks of TEST_SHORT_US, shorter than that read, are
+// applied at spread out moments and the polled loop must see every one.
+// The exit status is 1 if a check fails.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "alarm.h"
+#include "DHT.h"
+#include "i2c_txn.h"
+#include "mpu9250.h"
+#include "sensor_cache.h"
+#include "timebase.h"
+#include "sim.h"
+
+#define TEST_EVENTS		20
+#define TEST_REFRESH_US	1000000		// LCD refresh of main.c with a magnetometer
+#define TEST_LCD_US		5000		// what the refresh itself takes
+#define TEST_PASS_US	50			// one idle pass of the polling loop
+// A DHT11 read in the way (its start signal is 50 ms), the shock debounce
+// of two samples and the accelerometer's 41 Hz DLPF
+#define TEST_LATENCY_US	80000
+#define TEST_SHORT_EVENTS	50
+#define TEST_SHORT_US		25000
+
+volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, TIMSK0, TIFR0;
+
+// The next shock and its end, UINT64_MAX once they have been applied
+static uint64_t shock_us, shock_end_us = UINT64_MAX;
+
+// Set when a fed sample left the accelerometer channel in alarm
+static int tripped;
+
+// Feed only the last packet of a drain, as main.c used to
+static int last_only;
+
+typedef struct
+{
+	mpu9250_t * imu;
+	int16_t raw[3];
+} accel_reading_t;
+
+// The acquisition of main.c, every packet of a FIFO drain fed to the alarms
+// and the last one kept, without the timebase_sync() the clock of the model
+// has no use for
+static uint8_t acquire_accel(sensor_cache_t * cache)
+{
+	static uint8_t fifo[16 * 6];
+	accel_reading_t * reading = cache->context;
+	enum MPU_STATUS_t status;
+	uint16_t bytes, p;
+	int16_t mg[3];
+	uint8_t i;
+
+	bytes = mpu_fifo_drain(reading->imu, fifo, sizeof(fifo), &status);
+	if (status != MPU_OK)
+	{
+		return status;
+	}
+	if (bytes == 0)
+	{
+		return 0xFF;
+	}
+	for (p = last_only ? bytes - 6 : 0; p < bytes; p += 6)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			reading->raw[i] = ((int16_t)fifo[p + 2 * i] << 8) |
+				fifo[p + 1 + 2 * i];
+			mg[i] = mpu_accel_mg(reading->raw[i]);
+		}
+		alarm_feed_accel(mg);
+		tripped |= (alarm_active >> ALARM_ACCEL) & 1;
+	}
+	cache->attempt = reading->imu->timestamp;
+	return 0;
+}
+
+// The acquisition main.c used to have, the data registers fed to the alarms;
+// the FIFO would overflow between the refreshes of the old loop
+static uint8_t acquire_accel_registers(sensor_cache_t * cache)
+{
+	accel_reading_t * reading = cache->context;
+	int16_t raw[3], mg[3];
+	uint8_t i;
+
+	mpu_read_accel(reading->imu, raw);
+	if (I2C_STATUS != I2C_OK)
+	{
+		return I2C_STATUS;
+	}
+	for (i = 0; i < 3; i++)
+	{
+		reading->raw[i] = raw[i];
+		mg[i] = mpu_accel_mg(raw[i]);
+	}
+	alarm_feed_accel(mg);
+	cache->attempt = reading->imu->timestamp;
+	return 0;
+}
+
+static uint8_t led(void)
+{
+	return PORTA & 0x01;
+}
+
+// The feeding of main.c: each new accelerometer sample and DHT reading once,
+// the accelerometer through its acquisition
+static void feed(sensor_cache_t * accel_cache)
+{
+	double temp, hum;
+
+	sensor_cache_get(accel_cache, 0);
+	if (DHT_readCached(&temp, &hum, 0) == SENSOR_CACHE_ACQUIRED)
+	{
+		alarm_feed(ALARM_TEMPERATURE, (int16_t)(temp * 10));
+		alarm_feed(ALARM_HUMIDITY, (int16_t)(hum * 10));
+	}
+}
+
+// Let us pass, with the shock applied and ended when their moments come
+static void tick(uint64_t us)
+{
+	uint64_t end = sim.now_us + us;
+
+	if (end >= shock_us)
+	{
+		sim_advance(shock_us > sim.now_us ? shock_us - sim.now_us : 0);
+		sim_command("accel 2 0 0", "test");
+		shock_us = UINT64_MAX;
+	}
+	if (end >= shock_end_us)
+	{
+		sim_advance(shock_end_us > sim.now_us ? shock_end_us - sim.now_us : 0);
+		sim_command("accel 0 0 0", "test");
+		shock_end_us = UINT64_MAX;
+	}
+	sim_advance(end > sim.now_us ? end - sim.now_us : 0);
+}
+
+// One pass of the main loop, the LCD refresh and what follows it until the
+// next one
+static void loop_pass(sensor_cache_t * accel_cache, int polled)
+{
+	uint32_t shown;
+
+	mpu_read_byte(AK8963_ADDRESS, WHO_AM_I_AK8963);
+	tick(TEST_LCD_US);
+	if (!polled)
+	{
+		feed(accel_cache);
+		tick(TEST_REFRESH_US);
+		return;
+	}
+	shown = timebase_now();
+	do
+	{
+		feed(accel_cache);
+		tick(TEST_PASS_US);
+	} while (timebase_now() - shown < TEST_REFRESH_US && !led());
+}
+
+// The boot of main.c with the shock limit set
+static void boot(mpu9250_t * imu, int polled)
+{
+	const alarm_limit_t shock = {ALARM_NO_LOW, 1800, 200, 2,
+		ALARM_PATTERN_CRITICAL};
+	const mpu_config_t stream = {MPU_GSCALE, MPU_ASCALE, MPU_DLPF_CFG,
+		MPU_A_DLPF_CFG, MPU_SMPLRT_DIV, MPU_FIFO_ACCEL};
+	float asa[3];
+
+	sim_init(1);
+	sim_mpu_init();
+	sim_dht_add('D', 7, DHT11);
+	alarm_init();
+	alarm_set_limit(ALARM_ACCEL, &shock);
+	DHT_setup();
+	mpu_init(imu);
+	if (polled)
+	{
+		mpu_configure(imu, &stream);
+	}
+	ak8963_init(asa);
+}
+
+// Shocks at spread out moments; returns the worst latency in us
+static uint32_t run_latency(int polled)
+{
+	mpu9250_t imu = MPU9250_DEVICE(MPU9250_ADDRESS);
+	accel_reading_t accel = {&imu, {0, 0, 0}};
+	sensor_cache_t accel_cache = polled ?
+		(sensor_cache_t)SENSOR_CACHE(acquire_accel, SENSOR_SOURCE_FIFO,
+			&accel, 1000000UL / MPU_SAMPLE_RATE_HZ) :
+		(sensor_cache_t)SENSOR_CACHE(acquire_accel_registers,
+			SENSOR_SOURCE_REGISTER, &accel, 1000000UL / MPU_SAMPLE_RATE_HZ);
+	uint32_t worst = 0, took;
+	double sum = 0;
+	unsigned e;
+
+	boot(&imu, polled);
+
+	for (e = 0; e < TEST_EVENTS; e++)
+	{
+		// the shock comes after a quiet while, at a point of the loop that
+		// moves by a prime number of us every time
+		uint64_t event_us = sim.now_us + 2 * TEST_REFRESH_US +
+			(uint64_t)e * 104729 % TEST_REFRESH_US;
+
+		sim_command("accel 0 0 0", "test");
+		while (led())
+		{
+			loop_pass(&accel_cache, polled);
+		}
+		shock_us = event_us;
+		while (!led())
+		{
+			loop_pass(&accel_cache, polled);
+		}
+		took = (uint32_t)(sim.now_us - event_us);
+		sum += took;
+		worst = took > worst ? took : worst;
+	}
+	printf("%-24s mean %7.1f ms, worst %7.1f ms\n", polled ?
+		"polled between refreshes" : "fed once per refresh",
+		sum / TEST_EVENTS / 1000, worst / 1000.0);
+	return worst;
+}
+
+// Short shocks at spread out moments with the polled loop; returns how many
+// of them tripped the alarm
+static unsigned run_short(void)
+{
+	mpu9250_t imu = MPU9250_DEVICE(MPU9250_ADDRESS);
+	accel_reading_t accel = {&imu, {0, 0, 0}};
+	sensor_cache_t accel_cache = SENSOR_CACHE(acquire_accel,
+		SENSOR_SOURCE_FIFO, &accel, 1000000UL / MPU_SAMPLE_RATE_HZ);
+	unsigned e, seen = 0;
+
+	boot(&imu, 1);
+	for (e = 0; e < TEST_SHORT_EVENTS; e++)
+	{
+		uint64_t event_us = sim.now_us + 2 * TEST_REFRESH_US +
+			(uint64_t)e * 104729 % TEST_REFRESH_US;
+
+		sim_command("accel 0 0 0", "test");
+		while (led() || sim.now_us < event_us - TEST_REFRESH_US)
+		{
+			loop_pass(&accel_cache, 1);
+		}
+		tripped = 0;
+		shock_us = event_us;
+		shock_end_us = event_us + TEST_SHORT_US;
+		while (!tripped && sim.now_us < event_us + 2 * TEST_REFRESH_US)
+		{
+			loop_pass(&accel_cache, 1);
+		}
+		seen += tripped;
+	}
+	printf("%u ms shocks, %-14s %u of %u seen\n", TEST_SHORT_US / 1000,
+		last_only ? "last packets:" : "every packet:", seen,
+		TEST_SHORT_EVENTS);
+	return seen;
+}
+
+// Debounce, hysteresis and the ends of the range; returns the checks that
+// failed
+static unsigned check_limits(void)
+{
+	const alarm_limit_t band = {100, 200, 10, 3, ALARM_PATTERN_BLINK};
+	const alarm_limit_t top = {32700, ALARM_NO_HIGH, 200, 1,
+		ALARM_PATTERN_BEEP};
+	const alarm_limit_t bottom = {ALARM_NO_LOW, -32700, 200, 1,
+		ALARM_PATTERN_BEEP};
+	// samples and whether the channel is in alarm after each
+	static const int16_t samples[] = {150, 250, 250, 250, 195, 150, 150, 150};
+	static const uint8_t active[] = {0, 0, 0, 1, 1, 1, 1, 0};
+	unsigned failures = 0, i;
+
+	alarm_init();
+	alarm_set_limit(ALARM_TEMPERATURE, &band);
+	for (i = 0; i < sizeof(samples) / sizeof(samples[0]); i++)
+	{
+		if (alarm_feed(ALARM_TEMPERATURE, samples[i]) != active[i] ||
+			led() != active[i])
+		{
+			printf("sample %u (%d): FAIL, alarm %s\n", i, samples[i],
+				active[i] ? "off" : "on");
+			failures++;
+		}
+	}
+
+	// active, then a sample inside the limit but not past the hysteresis
+	alarm_set_limit(ALARM_HUMIDITY, &top);
+	alarm_feed(ALARM_HUMIDITY, 0);
+	if (!alarm_feed(ALARM_HUMIDITY, 32760))
+	{
+		printf("low limit 32700 + 200: FAIL, wrapped and cleared\n");
+		failures++;
+	}
+	alarm_set_limit(ALARM_TILT, &bottom);
+	alarm_feed(ALARM_TILT, 0);
+	if (!alarm_feed(ALARM_TILT, -32760))
+	{
+		printf("high limit -32700 - 200: FAIL, wrapped and cleared\n");
+		failures++;
+	}
+	printf("limits: %u checks failed\n", failures);
+	return failures;
+}
+
+int main(void)
+{
+	unsigned failures = check_limits();
+	uint32_t worst;
+
+	run_latency(0);
+	worst = run_latency(1);
+	if (worst > TEST_LATENCY_US)
+	{
+		printf("FAIL, the polled loop took %lu us to show a shock\n",
+			(unsigned long)worst);
+		failures++;
+	}
+	last_only = 1;
+	run_short();
+	last_only = 0;
+	if (run_short() != TEST_SHORT_EVENTS)
+	{
+		printf("FAIL, short shocks were missed\n");
+		failures++;
+	}
+
+	if (failures)
+	{
+		printf("%u checks failed\n", failures);
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,490 @@
+// Alignment of logged sensor streams with align.c on the host, and a
+// throughput and accuracy benchmark of it.
+//
+// Build from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -Itools/host -I. -o align_log tools/align_log.c align.c -lm
+//
+//   ./align_log [-p period] [-l latency] [-m stream=mode[:max_age]] log.csv
+//   ./align_log -b [-p period] [-l latency] [-m ...] [log.csv]
+//
+// The log has one sample per line, "stream,stamp,value[,value[,value]]" with
+// the stream number from 0, the timebase stamp in us and up to
+// ALIGN_CHANNELS_MAX values; lines starting with # are skipped. The number
+// of values of a stream is taken from its first line. Aligned frames are
+// written as CSV to stdout, "time,latency" followed by "flags,age,values"
+// for each stream, and a summary to stderr.
+//
+// Streams are interpolated linearly unless -m gives h (hold), l (linear) or
+// p (polyphase) and optionally the age beyond which samples are stale.
+// Period and latency default to 5000 and 20000 us, 200 Hz frames.
+//
+// The benchmark aligns the log, or without one ten minutes of synthetic
+// firmware streams: accelerometer and gyro at 200 Hz, the magnetometer at
+// 100 Hz and the DHT at 1 Hz, each with stamp jitter. The synthetic
+// magnetometer is run through every mode and compared with the signal it
+// was sampled from.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "align.h"
+
+typedef struct
+{
+	uint8_t stream;
+	uint32_t stamp;
+	int16_t value[ALIGN_CHANNELS_MAX];
+} log_sample_t;
+
+typedef struct
+{
+	uint8_t channels;
+	uint8_t mode;
+	uint32_t max_age;
+} log_stream_t;
+
+typedef struct
+{
+	unsigned long frames;
+	unsigned long flags[ALIGN_STREAMS_MAX][5];  // per ALIGN_FLAG_ bit
+	double latency_sum;
+	uint32_t latency_max;
+	double seconds;
+} log_summary_t;
+
+static const char * flag_names[5] = {"interpolated", "held", "fallback",
+	"stale", "empty"};
+
+static log_sample_t * load_log(const char * name, log_stream_t * streams,
+	uint8_t * count, size_t * samples)
+{
+	FILE * f = fopen(name, "r");
+	char line[256];
+	size_t n = 0, size = 0;
+	log_sample_t * s = NULL;
+
+	if (!f)
+	{
+		return NULL;
+	}
+	while (fgets(line, sizeof(line), f))
+	{
+		char * p = line, * end;
+		long stream, v;
+		uint8_t c;
+
+		if (line[0] == '#')
+		{
+			continue;
+		}
+		stream = strtol(p, &end, 10);
+		if (end == p || *end != ',' || stream < 0 || stream >= ALIGN_STREAMS_MAX)
+		{
+			continue;
+		}
+		if (n == size)
+		{
+			size = size ? size * 2 : 4096;
+			s = realloc(s, size * sizeof(*s));
+		}
+		s[n].stream = stream;
+		p = end + 1;
+		s[n].stamp = strtoul(p, &end, 10);
+		if (end == p)
+		{
+			continue;
+		}
+		for (c = 0; c < ALIGN_CHANNELS_MAX && *end == ','; c++)
+		{
+			p = end + 1;
+			v = strtol(p, &end, 10);
+			if (end == p)
+			{
+				break;
+			}
+			s[n].value[c] = (int16_t)v;
+		}
+		if (c == 0)
+		{
+			continue;
+		}
+		if (stream >= *count)
+		{
+			*count = stream + 1;
+		}
+		if (!streams[stream].channels)
+		{
+			streams[stream].channels = c;
+		}
+		n++;
+	}
+	fclose(f);
+	*samples = n;
+	return s;
+}
+
+static void print_frame(const align_frame_t * frame, uint8_t streams,
+	const log_stream_t * config)
+{
+	uint8_t i, c;
+
+	printf("%lu,%lu", (unsigned long)frame->time,
+		(unsigned long)frame->latency);
+	for (i = 0; i < streams; i++)
+	{
+		printf(",%u,%lu", frame->flags[i], (unsigned long)frame->age[i]);
+		for (c = 0; c < config[i].channels; c++)
+		{
+			printf(",%d", frame->value[i][c]);
+		}
+	}
+	printf("\n");
+}
+
+static void count_frame(log_summary_t * sum, const align_frame_t * frame,
+	uint8_t streams)
+{
+	uint8_t i, b;
+
+	sum->frames++;
+	sum->latency_sum += frame->latency;
+	if (frame->latency > sum->latency_max)
+	{
+		sum->latency_max = frame->latency;
+	}
+	for (i = 0; i < streams; i++)
+	{
+		for (b = 0; b < 5; b++)
+		{
+			if (frame->flags[i] & (1 << b))
+			{
+				sum->flags[i][b]++;
+			}
+		}
+	}
+}
+
+// Runs the samples through one aligner; frame, if given, is called for
+// every frame put out. Returns the number of samples rejected.
+static unsigned long run(const log_sample_t * samples, size_t count,
+	const log_stream_t * config, uint8_t streams, uint32_t period,
+	uint32_t latency, log_summary_t * sum,
+	void (*frame_out)(const align_frame_t *, void *), void * context)
+{
+	static align_t align;
+	align_frame_t frame;
+	int16_t value[ALIGN_CHANNELS_MAX];
+	unsigned long rejected = 0;
+	clock_t start;
+	size_t n;
+	uint8_t i;
+
+	memset(sum, 0, sizeof(*sum));
+	align_init(&align, period, latency);
+	for (i = 0; i < streams; i++)
+	{
+		align_add_stream(&align, config[i].channels ? config[i].channels : 1,
+			config[i].mode, config[i].max_age);
+	}
+
+	start = clock();
+	for (n = 0; n < count; n++)
+	{
+		// the samples are packed, align_push() takes an aligned copy
+		for (i = 0; i < ALIGN_CHANNELS_MAX; i++)
+		{
+			value[i] = samples[n].value[i];
+		}
+		if (!align_push(&align, samples[n].stream, samples[n].stamp, value))
+		{
+			rejected++;
+		}
+		while (align_pull(&align, &frame))
+		{
+			count_frame(sum, &frame, streams);
+			if (frame_out)
+			{
+				frame_out(&frame, context);
+			}
+		}
+	}
+	sum->seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	return rejected;
+}
+
+static void report(const log_summary_t * sum, size_t samples,
+	uint8_t streams, unsigned long rejected)
+{
+	uint8_t i, b;
+
+	fprintf(stderr, "%zu samples, %lu frames, %lu rejected, latency mean %.0f"
+		" max %lu us\n", samples, sum->frames, rejected,
+		sum->frames ? sum->latency_sum / sum->frames : 0,
+		(unsigned long)sum->latency_max);
+	for (i = 0; i < streams; i++)
+	{
+		fprintf(stderr, "stream %u:", i);
+		for (b = 0; b < 5; b++)
+		{
+			fprintf(stderr, " %s %.1f%%", flag_names[b],
+				sum->frames ? 100.0 * sum->flags[i][b] / sum->frames : 0);
+		}
+		fprintf(stderr, "\n");
+	}
+}
+
+typedef struct
+{
+	const log_stream_t * config;
+	uint8_t streams;
+} log_output_t;
+
+static void write_frame(const align_frame_t * frame, void * context)
+{
+	const log_output_t * out = context;
+
+	print_frame(frame, out->streams, out->config);
+}
+
+// Synthetic magnetometer field, the truth the aligned values are checked
+// against
+static double mag_signal(double t, uint8_t c)
+{
+	return 9000 * sin(2 * M_PI * 1.7 * t + c * 2.1) +
+		2500 * sin(2 * M_PI * 5.3 * t + c);
+}
+
+static double jitter(void)
+{
+	return (rand() % 401) - 200;
+}
+
+static log_sample_t * synthesize(double seconds, size_t * count)
+{
+	size_t n = 0, size = (size_t)(seconds * 502) + 16;
+	log_sample_t * s = malloc(size * sizeof(*s));
+	double t;
+	uint32_t k;
+	uint8_t c;
+
+	srand(1);
+	// Samples are logged in the order they arrive; the streams are read in
+	// one pass of the main loop every 5 ms.
+	for (k = 0; k * 0.005 < seconds; k++)
+	{
+		uint32_t base = 10000 + k * 5000;
+
+		for (c = 0; c < 3; c++)
+		{
+			t = k * 0.005;
+			s[n].value[c] = (int16_t)(4000 * sin(2 * M_PI * 2 * t + c));
+		}
+		s[n].stream = 0;
+		s[n++].stamp = base + 40 + jitter();
+		for (c = 0; c < 3; c++)
+		{
+			s[n].value[c] = (int16_t)(3000 * cos(2 * M_PI * 0.5 * t + c));
+		}
+		s[n].stream = 1;
+		s[n++].stamp = base + 600 + jitter();
+		if (k & 1)
+		{
+			uint32_t stamp = base + 1300 + jitter();
+			for (c = 0; c < 3; c++)
+			{
+				s[n].value[c] = (int16_t)lrint(mag_signal(stamp * 1e-6, c));
+			}
+			s[n].stream = 2;
+			s[n++].stamp = stamp;
+		}
+		if (k % 200 == 0)
+		{
+			s[n].value[0] = 2150 + k / 2000;
+			s[n].value[1] = 4500 - k / 5000;
+			s[n].stream = 3;
+			s[n++].stamp = base + 2500 + jitter();
+		}
+	}
+	*count = n;
+	return s;
+}
+
+typedef struct
+{
+	double sum, worst;
+	unsigned long count;
+} mag_error_t;
+
+static void check_mag(const align_frame_t * frame, void * context)
+{
+	mag_error_t * e = context;
+	double d;
+	uint8_t c;
+
+	// the first 100 ms fill the history; polyphase lacks its oldest tap
+	if (frame->time < 110000 || frame->flags[2] & ALIGN_FLAG_EMPTY)
+	{
+		return;
+	}
+	for (c = 0; c < 3; c++)
+	{
+		d = fabs(frame->value[2][c] - mag_signal(frame->time * 1e-6, c));
+		e->sum += d * d;
+		e->worst = d > e->worst ? d : e->worst;
+		e->count++;
+	}
+}
+
+static int bench(const char * name, log_stream_t * config, uint8_t streams,
+	uint32_t period, uint32_t latency, const uint8_t * modes_given)
+{
+	static const char * mode_names[] = {"hold", "linear", "polyphase"};
+	log_summary_t sum;
+	log_sample_t * samples;
+	unsigned long rejected;
+	size_t count;
+	uint8_t m;
+
+	if (name)
+	{
+		samples = load_log(name, config, &streams, &count);
+		if (!samples)
+		{
+			fprintf(stderr, "can't read %s\n", name);
+			return 2;
+		}
+		rejected = run(samples, count, config, streams, period, latency, &sum,
+			NULL, NULL);
+		report(&sum, count, streams, rejected);
+		printf("%.0f ns per sample, %.0f ns per frame on this host\n",
+			sum.seconds * 1e9 / count, sum.seconds * 1e9 / sum.frames);
+		return 0;
+	}
+
+	samples = synthesize(600, &count);
+	streams = 4;
+	for (m = 0; m < 4; m++)
+	{
+		config[m].channels = m == 3 ? 2 : 3;
+		if (!modes_given[m])
+		{
+			config[m].mode = m == 3 ? ALIGN_HOLD : ALIGN_LINEAR;
+			config[m].max_age = m == 3 ? 2500000 : 3 * period;
+		}
+	}
+
+	printf("%zu synthetic samples, %u us frames, %lu us latency\n", count,
+		(unsigned)period, (unsigned long)latency);
+	for (m = ALIGN_HOLD; m <= ALIGN_POLYPHASE; m++)
+	{
+		mag_error_t e = {0, 0, 0};
+
+		config[2].mode = m;
+		rejected = run(samples, count, config, streams, period, latency, &sum,
+			check_mag, &e);
+		printf("magnetometer %-9s  rms error %7.1f  max %7.1f LSB  "
+			"%5.0f ns per sample  %5.0f ns per frame\n", mode_names[m],
+			sqrt(e.sum / e.count), e.worst, sum.seconds * 1e9 / count,
+			sum.seconds * 1e9 / sum.frames);
+		if (m == ALIGN_POLYPHASE)
+		{
+			report(&sum, count, streams, rejected);
+		}
+	}
+	free(samples);
+	return 0;
+}
+
+int main(int argc, char ** argv)
+{
+	log_stream_t config[ALIGN_STREAMS_MAX];
+	uint8_t modes_given[ALIGN_STREAMS_MAX] = {0}, streams = 0;
+	uint32_t period = 5000, latency = 20000;
+	const char * name = NULL;
+	int benchmark = 0, i;
+
+	memset(config, 0, sizeof(config));
+	for (i = 0; i < ALIGN_STREAMS_MAX; i++)
+	{
+		config[i].mode = ALIGN_LINEAR;
+	}
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-b"))
+		{
+			benchmark = 1;
+		}
+		else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+		{
+			period = strtoul(argv[++i], NULL, 10);
+		}
+		else if (!strcmp(argv[i], "-l") && i + 1 < argc)
+		{
+			latency = strtoul(argv[++i], NULL, 10);
+		}
+		else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+		{
+			char * p = argv[++i], * end;
+			long s = strtol(p, &end, 10);
+			const char * modes = "hlp", * m;
+
+			if (end == p || *end != '=' || s < 0 || s >= ALIGN_STREAMS_MAX ||
+				!end[1] || !(m = strchr(modes, end[1])))
+			{
+				fprintf(stderr, "-m stream=h|l|p[:max_age]\n");
+				return 2;
+			}
+			config[s].mode = m - modes;
+			config[s].max_age = end[2] == ':' ? strtoul(end + 3, NULL, 10) : 0;
+			modes_given[s] = 1;
+		}
+		else
+		{
+			name = argv[i];
+		}
+	}
+	if (period == 0)
+	{
+		fprintf(stderr, "period must be at least 1 us\n");
+		return 2;
+	}
+
+	if (benchmark)
+	{
+		return bench(name, config, streams, period, latency, modes_given);
+	}
+	if (!name)
+	{
+		fprintf(stderr, "usage: %s [-p period] [-l latency] "
+			"[-m stream=mode[:max_age]] log.csv\n"
+			"       %s -b [-p period] [-l latency] [-m ...] [log.csv]\n",
+			argv[0], argv[0]);
+		return 2;
+	}
+
+	{
+		log_summary_t sum;
+		log_output_t out;
+		log_sample_t * samples;
+		unsigned long rejected;
+		size_t count;
+
+		samples = load_log(name, config, &streams, &count);
+		if (!samples)
+		{
+			fprintf(stderr, "can't read %s\n", name);
+			return 2;
+		}
+		out.config = config;
+		out.streams = streams;
+		rejected = run(samples, count, config, streams, period, latency, &sum,
+			write_frame, &out);
+		report(&sum, count, streams, rejected);
+		free(samples);
+	}
+	return 0;
+}
@@ -0,0 +1,1512 @@
+// Batch calibration of the accelerometer and magnetometer from logged
+// multi-orientation sessions, written as the EEPROM blob calib.c loads at
+// boot. Linux only.
+//
+// Build from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -pthread
+//       -Itools/host -I. -o calib_solve tools/calib_solve.c calib.c -lm
+//
+//   ./calib_solve [-a stream] [-m stream] [-A ascale] [-M mscale]
+//       [-w window] [-s mg] [-j threads] [-o blob.bin] [-e blob.eep] log...
+//   ./calib_solve -b [-n lines] [-j 1,2,4,...] [-w window] [-s mg]
+//
+// The logs are in the format of tools/align_log.c, one sample per line,
+// "stream,stamp,value,value,value", lines starting with # skipped; only the
+// accelerometer (stream -a, default 0) and magnetometer (-m, default 2)
+// streams are read, raw LSB as the firmware reads them, at the full scale
+// ranges -A and -M (AFS_ and MFS_ numbers, default MPU9250_CONFIG.h). Log
+// them from a firmware built with -DCALIB_SESSION_ENABLE=1, which keeps the
+// accelerometer's factory trim and applies no loaded calibration.
+//
+// Accelerometer, six-position: the accelerometer stream is cut into
+// windows of -w samples (default 50). A window is at rest when the standard
+// deviation of its axes together is below -s mg (default 10), and lies on
+// a face when its mean is within 15 degrees of an axis and 20 % of 1 g.
+// Every sample of such a window is one equation of the linear least
+// squares problem
+//
+//   face's up vector (1 g) = M raw + w
+//
+// with each face weighted equally; M is the scale and cross-axis matrix,
+// the offset is -M^-1 w. All six faces must be present.
+//
+// Magnetometer, ellipsoid: every magnetometer sample is one equation of
+// the algebraic fit x' A x + 2 b' x = 1 (nine unknowns, linear least
+// squares). The centre is the offset, the symmetric square root of A
+// scaled to the sphere of the axes' geometric mean is the matrix, so the
+// correction adds no rotation. The samples must cover enough orientations
+// for A to be positive definite.
+//
+// Both fits only need sums of products, so the logs are mapped into memory
+// and cut into chunks of a few MB (at line ends) that -j threads (default
+// all cores) take from a shared queue, each summing its own; the sums are
+// added up and solved at the end. A second parallel pass applies the
+// result through calib_apply(), as the firmware will, and reports the
+// residuals: for windows at rest the error of |g| in mg and the angle to
+// the face, for the magnetometer the error of |B| in %.
+//
+// -o writes the 56 byte blob, -e the same as an Intel HEX EEPROM image
+// at CALIB_EEPROM_ADDR for avrdude (-U eeprom:w:blob.eep:i).
+//
+// -b benchmarks on a simulated session of -n lines (default 4000000) held
+// in memory: six faces held for 10 s each with tumbling of 10 s between,
+// accelerometer at 200 Hz with offsets, scale and cross-axis errors and
+// 40 LSB noise, magnetometer at 100 Hz with hard and (symmetric) soft iron
+// and 1 LSB noise. It solves the session with each thread count of the -j
+// list (default 1, 2, 4, ... up to all cores) and reports the time, the
+// speed-up and the errors against the true parameters and motion.
+//
+// The exit status is 1 if no sensor could be solved (or with -b, if an
+// error is above its bound), 2 on bad arguments or files.
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "mpu9250.h"
+#include "calib.h"
+
+#define THREADS_MAX		64
+#define FILES_MAX		256
+#define CHUNK_BYTES		(4 << 20)
+#define WINDOW_MAX		1000
+#define FACES			6
+#define MAG_TERMS		9
+#define MAG_SCALE		(1.0 / 32768)	// raw to the units of the fit
+#define FACE_COS		0.96592583		// cos 15 degrees
+#define FACE_MAGNITUDE	0.2				// |g| tolerance of a face
+#define SIM_ACCEL_NOISE	40.0			// LSB
+#define SIM_MAG_NOISE	1.0
+#define SIM_HOLD_STEPS	2000			// 10 s of accelerometer samples at 200 Hz
+
+// Bounds of the benchmark
+#define BOUND_ACCEL_MG		1.0		// |g| rms
+#define BOUND_ACCEL_DEG		0.05	// angle to the face rms
+#define BOUND_MAG_PERCENT	0.5		// |B| rms
+#define BOUND_MAG_DEG		0.5		// direction rms
+
+typedef struct
+{
+	const char * data;
+	size_t size;
+} chunk_t;
+
+// Samples of the windows at rest on a face
+typedef struct
+{
+	double n;
+	double sum[3];
+	double outer[3][3];
+	unsigned long windows;
+} face_t;
+
+// What a thread sums over its chunks
+typedef struct
+{
+	face_t face[FACES];
+	double mag_normal[MAG_TERMS][MAG_TERMS];
+	double mag_rhs[MAG_TERMS];
+	unsigned long accel_samples, mag_samples, lines, bad_lines;
+	unsigned long windows, rest_windows, off_face;
+	// second pass, through the solution
+	double g_square, g_max, angle_square, angle_max;
+	double b_square, b_max;
+	unsigned long g_windows, b_samples;
+} sums_t;
+
+typedef struct
+{
+	pthread_t thread;
+	sums_t sums;
+	int16_t window[WINDOW_MAX][3];
+	int fill;
+} worker_t;
+
+static int accel_stream = 0, mag_stream = 2, window = 50;
+static int ascale = MPU_ASCALE, mscale = MPU_MSCALE;
+static double rest_mg = 10;
+
+static chunk_t * chunks;
+static unsigned chunk_count;
+static unsigned chunk_next;
+static int pass;
+static calib_blob_t solution;
+
+static double mag_radius;     // of the corrected sphere, LSB
+static uint8_t sim_eeprom[4096];
+
+void eeprom_read_block(void * dst, const void * src, size_t n)
+{
+	memcpy(dst, &sim_eeprom[(uintptr_t)src], n);
+}
+
+typedef char calib_blob_size_check[sizeof(calib_blob_t) == CALIB_BLOB_BYTES ?
+	1 : -1];
+
+static double now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// 1 g in LSB
+static double accel_one_g(int scale)
+{
+	return 32768.0 / (2 << scale);
+}
+
+// mG per LSB
+static double mag_res(int scale)
+{
+	return scale == MFS_16BITS ? 10.0 * 4912.0 / 32760.0 :
+		10.0 * 4912.0 / 8190.0;
+}
+
+static const char * face_names[FACES] = {"+x", "-x", "+y", "-y", "+z", "-z"};
+
+// Reading ---------------------------------------------------------------
+
+// Decimal integer at *p, before end
+static int parse_long(const char ** p, const char * end, long * v)
+{
+	const char * s = *p;
+	long x = 0;
+	int neg = 0, digits = 0;
+
+	while (s < end && (*s == ' ' || *s == '\t'))
+	{
+		s++;
+	}
+	if (s < end && (*s == '-' || *s == '+'))
+	{
+		neg = *s++ == '-';
+	}
+	while (s < end && *s >= '0' && *s <= '9' && digits < 12)
+	{
+		x = x * 10 + (*s++ - '0');
+		digits++;
+	}
+	if (!digits)
+	{
+		return 0;
+	}
+	*v = neg ? -x : x;
+	*p = s;
+	return 1;
+}
+
+// "stream,stamp,x,y,z" of an accelerometer or magnetometer line; 0 for
+// other streams, -1 for lines that don't parse
+static int parse_line(const char * s, const char * end, int * stream,
+	int16_t * xyz)
+{
+	long v;
+	int a;
+
+	if (!parse_long(&s, end, &v) || s >= end || *s++ != ',')
+	{
+		return -1;
+	}
+	if (v != accel_stream && v != mag_stream)
+	{
+		return 0;
+	}
+	*stream = (int)v;
+	if (!parse_long(&s, end, &v))
+	{
+		return -1;
+	}
+	for (a = 0; a < 3; a++)
+	{
+		if (s >= end || *s++ != ',' || !parse_long(&s, end, &v) ||
+			v < -32768 || v > 32767)
+		{
+			return -1;
+		}
+		xyz[a] = (int16_t)v;
+	}
+	while (s < end && (*s == ' ' || *s == '\t' || *s == '\r'))
+	{
+		s++;
+	}
+	return s == end ? 1 : -1;
+}
+
+// Least squares ---------------------------------------------------------
+
+// Solve the symmetric positive definite n x n system a x = b for m right
+// hand sides, in place (x in b). 0 if a is not positive definite.
+static int cholesky_solve(double a[][MAG_TERMS], int n, double b[][3], int m)
+{
+	int i, j, k;
+
+	for (j = 0; j < n; j++)
+	{
+		double d = a[j][j];
+
+		for (k = 0; k < j; k++)
+		{
+			d -= a[j][k] * a[j][k];
+		}
+		if (d <= 0)
+		{
+			return 0;
+		}
+		a[j][j] = sqrt(d);
+		for (i = j + 1; i < n; i++)
+		{
+			double s = a[i][j];
+
+			for (k = 0; k < j; k++)
+			{
+				s -= a[i][k] * a[j][k];
+			}
+			a[i][j] = s / a[j][j];
+		}
+	}
+	for (k = 0; k < m; k++)
+	{
+		for (i = 0; i < n; i++)
+		{
+			double s = b[i][k];
+
+			for (j = 0; j < i; j++)
+			{
+				s -= a[i][j] * b[j][k];
+			}
+			b[i][k] = s / a[i][i];
+		}
+		for (i = n - 1; i >= 0; i--)
+		{
+			double s = b[i][k];
+
+			for (j = i + 1; j < n; j++)
+			{
+				s -= a[j][i] * b[j][k];
+			}
+			b[i][k] = s / a[i][i];
+		}
+	}
+	return 1;
+}
+
+static int invert3(const double m[3][3], double out[3][3])
+{
+	double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+		m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+		m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+	int i, j;
+
+	if (fabs(det) < 1e-12)
+	{
+		return 0;
+	}
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			// cofactor of m[j][i]
+			int r0 = (j + 1) % 3, r1 = (j + 2) % 3;
+			int c0 = (i + 1) % 3, c1 = (i + 2) % 3;
+
+			out[i][j] = (m[r0][c0] * m[r1][c1] - m[r0][c1] * m[r1][c0]) / det;
+		}
+	}
+	return 1;
+}
+
+// Eigenvalues and vectors (columns of v) of a symmetric 3 x 3 matrix,
+// cyclic Jacobi
+static void eigen3(const double m[3][3], double value[3], double v[3][3])
+{
+	double a[3][3];
+	int i, j, k, sweep;
+
+	memcpy(a, m, sizeof(a));
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			v[i][j] = i == j;
+		}
+	}
+	for (sweep = 0; sweep < 50; sweep++)
+	{
+		double off = fabs(a[0][1]) + fabs(a[0][2]) + fabs(a[1][2]);
+
+		if (off < 1e-15 * (fabs(a[0][0]) + fabs(a[1][1]) + fabs(a[2][2])))
+		{
+			break;
+		}
+		for (i = 0; i < 2; i++)
+		{
+			for (j = i + 1; j < 3; j++)
+			{
+				double theta, t, c, s;
+
+				if (a[i][j] == 0)
+				{
+					continue;
+				}
+				theta = (a[j][j] - a[i][i]) / (2 * a[i][j]);
+				t = (theta >= 0 ? 1 : -1) /
+					(fabs(theta) + sqrt(theta * theta + 1));
+				c = 1 / sqrt(t * t + 1);
+				s = t * c;
+				for (k = 0; k < 3; k++)
+				{
+					double x = a[k][i], y = a[k][j];
+					a[k][i] = c * x - s * y;
+					a[k][j] = s * x + c * y;
+				}
+				for (k = 0; k < 3; k++)
+				{
+					double x = a[i][k], y = a[j][k];
+					a[i][k] = c * x - s * y;
+					a[j][k] = s * x + c * y;
+				}
+				for (k = 0; k < 3; k++)
+				{
+					double x = v[k][i], y = v[k][j];
+					v[k][i] = c * x - s * y;
+					v[k][j] = s * x + c * y;
+				}
+			}
+		}
+	}
+	for (i = 0; i < 3; i++)
+	{
+		value[i] = a[i][i];
+	}
+}
+
+// Passes over the logs --------------------------------------------------
+
+// The face a window's mean lies on, -1 for none
+static int face_of(const double * mean)
+{
+	double g = accel_one_g(ascale);
+	double norm = sqrt(mean[0] * mean[0] + mean[1] * mean[1] +
+		mean[2] * mean[2]);
+	int a, axis = 0;
+
+	for (a = 1; a < 3; a++)
+	{
+		if (fabs(mean[a]) > fabs(mean[axis]))
+		{
+			axis = a;
+		}
+	}
+	if (fabs(norm - g) > FACE_MAGNITUDE * g ||
+		fabs(mean[axis]) < FACE_COS * norm)
+	{
+		return -1;
+	}
+	return 2 * axis + (mean[axis] < 0);
+}
+
+static void window_done(worker_t * w)
+{
+	sums_t * s = &w->sums;
+	double mean[3] = {0, 0, 0}, var = 0, limit;
+	int i, a, b, face;
+
+	s->windows += pass == 0;
+	for (i = 0; i < w->fill; i++)
+	{
+		for (a = 0; a < 3; a++)
+		{
+			mean[a] += w->window[i][a];
+		}
+	}
+	for (a = 0; a < 3; a++)
+	{
+		mean[a] /= w->fill;
+	}
+	for (i = 0; i < w->fill; i++)
+	{
+		for (a = 0; a < 3; a++)
+		{
+			double d = w->window[i][a] - mean[a];
+			var += d * d;
+		}
+	}
+	var /= w->fill;
+	limit = rest_mg / 1000 * accel_one_g(ascale);
+	w->fill = 0;
+	if (var > limit * limit)
+	{
+		return;
+	}
+	s->rest_windows += pass == 0;
+	face = face_of(mean);
+	if (face < 0)
+	{
+		s->off_face += pass == 0;
+		return;
+	}
+
+	if (pass == 0)
+	{
+		face_t * f = &s->face[face];
+
+		f->windows++;
+		for (i = 0; i < window; i++)
+		{
+			f->n++;
+			for (a = 0; a < 3; a++)
+			{
+				f->sum[a] += w->window[i][a];
+				for (b = 0; b < 3; b++)
+				{
+					f->outer[a][b] += (double)w->window[i][a] * w->window[i][b];
+				}
+			}
+		}
+	}
+	else if (solution.valid & CALIB_ACCEL)
+	{
+		// the window's mean through the firmware's correction
+		double g = accel_one_g(ascale), c[3] = {0, 0, 0}, norm, err, angle;
+
+		for (i = 0; i < window; i++)
+		{
+			int16_t out[3];
+
+			calib_apply(&solution.accel, w->window[i], out);
+			for (a = 0; a < 3; a++)
+			{
+				c[a] += out[a];
+			}
+		}
+		norm = sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]);
+		err = (norm / window - g) / g * 1000;
+		angle = acos(fmin(1, fabs(c[face / 2]) / norm)) * (180 / M_PI);
+		s->g_square += err * err;
+		s->g_max = fmax(s->g_max, fabs(err));
+		s->angle_square += angle * angle;
+		s->angle_max = fmax(s->angle_max, angle);
+		s->g_windows++;
+	}
+}
+
+static void mag_sample(worker_t * w, const int16_t * xyz)
+{
+	sums_t * s = &w->sums;
+	int i, j;
+
+	if (pass == 0)
+	{
+		double x = xyz[0] * MAG_SCALE, y = xyz[1] * MAG_SCALE;
+		double z = xyz[2] * MAG_SCALE;
+		double d[MAG_TERMS] = {x * x, y * y, z * z, 2 * y * z, 2 * x * z,
+			2 * x * y, 2 * x, 2 * y, 2 * z};
+
+		for (i = 0; i < MAG_TERMS; i++)
+		{
+			for (j = 0; j <= i; j++)
+			{
+				s->mag_normal[i][j] += d[i] * d[j];
+			}
+			s->mag_rhs[i] += d[i];
+		}
+	}
+	else if (solution.valid & CALIB_MAG)
+	{
+		int16_t out[3];
+		double err;
+
+		calib_apply(&solution.mag, xyz, out);
+		err = (sqrt((double)out[0] * out[0] + (double)out[1] * out[1] +
+			(double)out[2] * out[2]) / mag_radius - 1) * 100;
+		s->b_square += err * err;
+		s->b_max = fmax(s->b_max, fabs(err));
+		s->b_samples++;
+	}
+}
+
+static void chunk_run(worker_t * w, const chunk_t * c)
+{
+	const char * p = c->data, * end = c->data + c->size;
+	sums_t * s = &w->sums;
+
+	w->fill = 0;
+	while (p < end)
+	{
+		const char * eol = memchr(p, '\n', end - p);
+		const char * next = eol ? eol + 1 : end;
+		int16_t xyz[3];
+		int stream, r;
+
+		eol = eol ? eol : end;
+		// counted in the first pass
+		s->lines += pass == 0;
+		if (*p == '#' || eol == p || (eol == p + 1 && *p == '\r'))
+		{
+			p = next;
+			continue;
+		}
+		r = parse_line(p, eol, &stream, xyz);
+		if (r < 0)
+		{
+			s->bad_lines += pass == 0;
+		}
+		else if (r > 0 && stream == accel_stream)
+		{
+			s->accel_samples += pass == 0;
+			memcpy(w->window[w->fill++], xyz, sizeof(xyz));
+			if (w->fill == window)
+			{
+				window_done(w);
+			}
+		}
+		else if (r > 0)
+		{
+			mag_sample(w, xyz);
+			s->mag_samples += pass == 0;
+		}
+		p = next;
+	}
+}
+
+static void * worker_main(void * arg)
+{
+	worker_t * w = arg;
+	unsigned i;
+
+	while ((i = __atomic_fetch_add(&chunk_next, 1, __ATOMIC_RELAXED)) <
+		chunk_count)
+	{
+		chunk_run(w, &chunks[i]);
+	}
+	return NULL;
+}
+
+static void sums_add(sums_t * total, const sums_t * s)
+{
+	int f, i, j;
+
+	for (f = 0; f < FACES; f++)
+	{
+		face_t * t = &total->face[f];
+		const face_t * x = &s->face[f];
+
+		t->n += x->n;
+		t->windows += x->windows;
+		for (i = 0; i < 3; i++)
+		{
+			t->sum[i] += x->sum[i];
+			for (j = 0; j < 3; j++)
+			{
+				t->outer[i][j] += x->outer[i][j];
+			}
+		}
+	}
+	for (i = 0; i < MAG_TERMS; i++)
+	{
+		for (j = 0; j <= i; j++)
+		{
+			total->mag_normal[i][j] += s->mag_normal[i][j];
+		}
+		total->mag_rhs[i] += s->mag_rhs[i];
+	}
+	total->accel_samples += s->accel_samples;
+	total->mag_samples += s->mag_samples;
+	total->lines += s->lines;
+	total->bad_lines += s->bad_lines;
+	total->windows += s->windows;
+	total->rest_windows += s->rest_windows;
+	total->off_face += s->off_face;
+	total->g_square += s->g_square;
+	total->g_max = fmax(total->g_max, s->g_max);
+	total->angle_square += s->angle_square;
+	total->angle_max = fmax(total->angle_max, s->angle_max);
+	total->b_square += s->b_square;
+	total->b_max = fmax(total->b_max, s->b_max);
+	total->g_windows += s->g_windows;
+	total->b_samples += s->b_samples;
+}
+
+// One pass over every chunk with threads workers, the sums added to total
+static void pass_run(int p, int threads, sums_t * total)
+{
+	static worker_t workers[THREADS_MAX];
+	int i;
+
+	pass = p;
+	chunk_next = 0;
+	for (i = 0; i < threads; i++)
+	{
+		memset(&workers[i].sums, 0, sizeof(sums_t));
+		pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+	}
+	for (i = 0; i < threads; i++)
+	{
+		pthread_join(workers[i].thread, NULL);
+		sums_add(total, &workers[i].sums);
+	}
+}
+
+// Solving ---------------------------------------------------------------
+
+// Round a matrix and offset into the blob's fixed point; 0 if they don't fit
+static int sensor_store(const double m[3][3], const double * offset,
+	calib_sensor_t * cal)
+{
+	int i, j;
+
+	for (i = 0; i < 3; i++)
+	{
+		double row = 0;
+
+		for (j = 0; j < 3; j++)
+		{
+			row += fabs(m[i][j]);
+			cal->matrix[i][j] = (int16_t)lround(m[i][j] *
+				(1 << CALIB_MATRIX_FRAC));
+		}
+		if (row >= 2 || fabs(offset[i]) > 32767)
+		{
+			return 0;
+		}
+		cal->offset[i] = (int16_t)lround(offset[i]);
+	}
+	return 1;
+}
+
+static int solve_accel(const sums_t * s, double m[3][3], double offset[3])
+{
+	double n[MAG_TERMS][MAG_TERMS], x[MAG_TERMS][3], w[3], inverse[3][3];
+	double g = accel_one_g(ascale), total = 0;
+	int f, i, j, k, missing = 0;
+
+	memset(n, 0, sizeof(n));
+	memset(x, 0, sizeof(x));
+	for (f = 0; f < FACES; f++)
+	{
+		if (!s->face[f].windows)
+		{
+			fprintf(stderr, "accelerometer: no window at rest on face %s\n",
+				face_names[f]);
+			missing = 1;
+		}
+		total += s->face[f].n;
+	}
+	if (missing)
+	{
+		return 0;
+	}
+
+	// normal equations of [raw 1] X = up, every face weighted the same
+	for (f = 0; f < FACES; f++)
+	{
+		const face_t * face = &s->face[f];
+		double weight = total / (FACES * face->n), up[3] = {0, 0, 0};
+
+		up[f / 2] = f & 1 ? -g : g;
+		for (i = 0; i < 4; i++)
+		{
+			double r = i < 3 ? face->sum[i] : face->n;
+
+			for (j = 0; j < 4; j++)
+			{
+				n[i][j] += weight * (i < 3 && j < 3 ? face->outer[i][j] :
+					j < 3 ? face->sum[j] : r);
+			}
+			for (k = 0; k < 3; k++)
+			{
+				x[i][k] += weight * r * up[k];
+			}
+		}
+	}
+	if (!cholesky_solve(n, 4, x, 3))
+	{
+		fprintf(stderr, "accelerometer: the faces don't determine a solution\n");
+		return 0;
+	}
+
+	// up = M raw + w, raw - offset = raw + M^-1 w
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			m[i][j] = x[j][i];
+		}
+		w[i] = x[3][i];
+	}
+	if (!invert3(m, inverse))
+	{
+		return 0;
+	}
+	for (i = 0; i < 3; i++)
+	{
+		offset[i] = -(inverse[i][0] * w[0] + inverse[i][1] * w[1] +
+			inverse[i][2] * w[2]);
+	}
+	return 1;
+}
+
+static int solve_mag(const sums_t * s, double m[3][3], double offset[3],
+	double axes[3])
+{
+	double n[MAG_TERMS][MAG_TERMS], v[MAG_TERMS][3], a[3][3], inverse[3][3];
+	double b[3], c[3], vec[3][3], value[3], k = 1, radius;
+	int i, j, l;
+
+	if (s->mag_samples < 100)
+	{
+		fprintf(stderr, "magnetometer: %lu samples, too few to fit\n",
+			s->mag_samples);
+		return 0;
+	}
+	for (i = 0; i < MAG_TERMS; i++)
+	{
+		for (j = 0; j <= i; j++)
+		{
+			n[i][j] = n[j][i] = s->mag_normal[i][j];
+		}
+		v[i][0] = s->mag_rhs[i];
+	}
+	if (!cholesky_solve(n, MAG_TERMS, v, 1))
+	{
+		fprintf(stderr, "magnetometer: the samples don't determine a fit\n");
+		return 0;
+	}
+
+	// x' A x + 2 b' x = 1 is (x - c)' A (x - c) = 1 + c' A c
+	a[0][0] = v[0][0];
+	a[1][1] = v[1][0];
+	a[2][2] = v[2][0];
+	a[1][2] = a[2][1] = v[3][0];
+	a[0][2] = a[2][0] = v[4][0];
+	a[0][1] = a[1][0] = v[5][0];
+	b[0] = v[6][0];
+	b[1] = v[7][0];
+	b[2] = v[8][0];
+	if (!invert3(a, inverse))
+	{
+		fprintf(stderr, "magnetometer: degenerate fit\n");
+		return 0;
+	}
+	for (i = 0; i < 3; i++)
+	{
+		c[i] = -(inverse[i][0] * b[0] + inverse[i][1] * b[1] +
+			inverse[i][2] * b[2]);
+	}
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			k += c[i] * a[i][j] * c[j];
+		}
+	}
+	eigen3(a, value, vec);
+	for (i = 0; i < 3; i++)
+	{
+		value[i] /= k;
+		if (!(value[i] > 0))
+		{
+			fprintf(stderr, "magnetometer: not an ellipsoid, the samples "
+				"cover too few orientations\n");
+			return 0;
+		}
+		axes[i] = 1 / sqrt(value[i]) / MAG_SCALE;
+	}
+
+	// the symmetric root of A / k, onto the sphere of the geometric mean
+	radius = pow(value[0] * value[1] * value[2], -1.0 / 6);
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			m[i][j] = 0;
+			for (l = 0; l < 3; l++)
+			{
+				m[i][j] += vec[i][l] * sqrt(value[l]) * vec[j][l];
+			}
+			m[i][j] *= radius;
+		}
+		offset[i] = c[i] / MAG_SCALE;
+	}
+	mag_radius = radius / MAG_SCALE;
+	return 1;
+}
+
+typedef struct
+{
+	double accel[3][3], accel_offset[3];
+	double mag[3][3], mag_offset[3], mag_axes[3];
+	sums_t sums;
+	double seconds;
+} result_t;
+
+// Both passes and the fits between them; the valid bits of solution
+static uint8_t solve(int threads, result_t * r)
+{
+	double start = now();
+
+	memset(r, 0, sizeof(*r));
+	calib_identity(&solution);
+	solution.ascale = ascale;
+	solution.mscale = mscale;
+
+	pass_run(0, threads, &r->sums);
+	if (solve_accel(&r->sums, r->accel, r->accel_offset))
+	{
+		if (sensor_store(r->accel, r->accel_offset, &solution.accel))
+		{
+			solution.valid |= CALIB_ACCEL;
+		}
+		else
+		{
+			fprintf(stderr, "accelerometer: solution out of the blob's range\n");
+		}
+	}
+	if (solve_mag(&r->sums, r->mag, r->mag_offset, r->mag_axes))
+	{
+		if (sensor_store(r->mag, r->mag_offset, &solution.mag))
+		{
+			solution.valid |= CALIB_MAG;
+		}
+		else
+		{
+			fprintf(stderr, "magnetometer: solution out of the blob's range\n");
+		}
+	}
+	solution.crc = calib_crc(&solution);
+
+	// residuals through the firmware's correction, summed into the same
+	// totals
+	pass_run(1, threads, &r->sums);
+	r->seconds = now() - start;
+	return solution.valid;
+}
+
+// Output ----------------------------------------------------------------
+
+static void print_sensor(const char * name, const calib_sensor_t * cal,
+	double unit, const char * unit_name)
+{
+	int i;
+
+	printf("  offset  %7d %7d %7d LSB  (%.1f %.1f %.1f %s)\n", cal->offset[0],
+		cal->offset[1], cal->offset[2], cal->offset[0] * unit,
+		cal->offset[1] * unit, cal->offset[2] * unit, unit_name);
+	for (i = 0; i < 3; i++)
+	{
+		printf("  %-7s %9.6f %9.6f %9.6f\n", i ? "" : name,
+			cal->matrix[i][0] / (double)(1 << CALIB_MATRIX_FRAC),
+			cal->matrix[i][1] / (double)(1 << CALIB_MATRIX_FRAC),
+			cal->matrix[i][2] / (double)(1 << CALIB_MATRIX_FRAC));
+	}
+}
+
+static void print_result(const result_t * r, size_t bytes, int threads)
+{
+	const sums_t * s = &r->sums;
+	int f;
+
+	printf("%lu lines, %.1f MB: %lu accelerometer and %lu magnetometer "
+		"samples, %lu bad lines\n", s->lines, bytes / 1e6, s->accel_samples,
+		s->mag_samples, s->bad_lines);
+	printf("accelerometer: %lu windows of %d, %lu at rest, %lu of them off "
+		"the faces\n ", s->windows, window, s->rest_windows, s->off_face);
+	for (f = 0; f < FACES; f++)
+	{
+		printf(" %s %lu", face_names[f], s->face[f].windows);
+	}
+	printf(" windows\n");
+	if (solution.valid & CALIB_ACCEL)
+	{
+		print_sensor("matrix", &solution.accel, 1000 / accel_one_g(ascale),
+			"mg");
+		printf("  |g| error rms %.2f mg, max %.2f mg; angle to the face rms "
+			"%.3f deg, max %.3f deg\n", sqrt(s->g_square / s->g_windows),
+			s->g_max, sqrt(s->angle_square / s->g_windows), s->angle_max);
+	}
+	else
+	{
+		printf("  not solved\n");
+	}
+	printf("magnetometer: %lu samples\n", s->mag_samples);
+	if (solution.valid & CALIB_MAG)
+	{
+		print_sensor("matrix", &solution.mag, mag_res(mscale), "mG");
+		printf("  sphere %.1f LSB (%.1f mG), ellipsoid axes %.1f %.1f %.1f "
+			"LSB\n", mag_radius, mag_radius * mag_res(mscale), r->mag_axes[0],
+			r->mag_axes[1], r->mag_axes[2]);
+		printf("  |B| error rms %.3f %%, max %.3f %%\n",
+			sqrt(s->b_square / s->b_samples), s->b_max);
+	}
+	else
+	{
+		printf("  not solved\n");
+	}
+	printf("solved in %.3f s with %d threads, %.0f MB of log/s\n",
+		r->seconds, threads, bytes / 1e6 / r->seconds);
+}
+
+static int write_blob(const char * path)
+{
+	FILE * out = fopen(path, "wb");
+	int ok;
+
+	if (!out)
+	{
+		fprintf(stderr, "can't write %s\n", path);
+		return 0;
+	}
+	ok = fwrite(&solution, sizeof(solution), 1, out) == 1;
+	return !fclose(out) && ok;
+}
+
+// Intel HEX, 16 data bytes a record
+static int write_hex(const char * path)
+{
+	const uint8_t * p = (const uint8_t *)&solution;
+	FILE * out = fopen(path, "w");
+	unsigned at, i;
+
+	if (!out)
+	{
+		fprintf(stderr, "can't write %s\n", path);
+		return 0;
+	}
+	for (at = 0; at < sizeof(solution); at += 16)
+	{
+		unsigned n = sizeof(solution) - at < 16 ? sizeof(solution) - at : 16;
+		unsigned address = CALIB_EEPROM_ADDR + at;
+		uint8_t sum = n + (address >> 8) + address;
+
+		fprintf(out, ":%02X%04X00", n, address);
+		for (i = 0; i < n; i++)
+		{
+			fprintf(out, "%02X", p[at + i]);
+			sum += p[at + i];
+		}
+		fprintf(out, "%02X\n", (uint8_t)-sum);
+	}
+	fprintf(out, ":00000001FF\n");
+	return !fclose(out);
+}
+
+// Simulated session -----------------------------------------------------
+
+typedef struct
+{
+	double w, x, y, z;
+} quat_t;
+
+typedef struct
+{
+	double accel[3][3], accel_offset[3];     // raw = accel up + offset
+	double mag[3][3], mag_offset[3];         // raw = mag field + offset
+	double field[3];                         // world, LSB
+} truth_t;
+
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t next_random(void)
+{
+	// xorshift64*
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return (uint32_t)((rng * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static double uniform(double low, double high)
+{
+	return low + (high - low) * (next_random() / 4294967296.0);
+}
+
+static double gauss(void)
+{
+	double u = (next_random() + 1.0) / 4294967297.0;
+	double v = next_random() / 4294967296.0;
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static quat_t quat_mul(quat_t a, quat_t b)
+{
+	quat_t q;
+
+	q.w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+	q.x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+	q.y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+	q.z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+	return q;
+}
+
+static quat_t quat_axis(const double * axis, double angle)
+{
+	quat_t q = {cos(angle / 2), axis[0] * sin(angle / 2),
+		axis[1] * sin(angle / 2), axis[2] * sin(angle / 2)};
+
+	return q;
+}
+
+// A world vector in the body frame of attitude q
+static void quat_to_body(quat_t q, const double * v, double * out)
+{
+	quat_t p = {0, v[0], v[1], v[2]}, c = {q.w, -q.x, -q.y, -q.z};
+
+	p = quat_mul(quat_mul(c, p), q);
+	out[0] = p.x;
+	out[1] = p.y;
+	out[2] = p.z;
+}
+
+static void random_axis(double * axis)
+{
+	double n;
+
+	do
+	{
+		axis[0] = gauss();
+		axis[1] = gauss();
+		axis[2] = gauss();
+		n = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	} while (n < 1e-6);
+	axis[0] /= n;
+	axis[1] /= n;
+	axis[2] /= n;
+}
+
+static int16_t sim_lsb(double x)
+{
+	x = floor(x + 0.5);
+	return x < -32768 ? -32768 : x > 32767 ? 32767 : (int16_t)x;
+}
+
+// raw = m v + offset (+ noise)
+static void sim_sensor(const double m[3][3], const double * offset,
+	const double * v, double noise, int16_t * raw)
+{
+	int a;
+
+	for (a = 0; a < 3; a++)
+	{
+		raw[a] = sim_lsb(m[a][0] * v[0] + m[a][1] * v[1] + m[a][2] * v[2] +
+			offset[a] + noise * gauss());
+	}
+}
+
+static void sim_truth(truth_t * t)
+{
+	const double field_mg[3] = {200, 0, -430};
+	double g = accel_one_g(ascale);
+	int i, j;
+
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			t->accel[i][j] = i == j ? 1 + uniform(-0.02, 0.02) :
+				uniform(-0.005, 0.005);
+			t->mag[i][j] = i == j ? 1 + uniform(-0.05, 0.05) :
+				j > i ? uniform(-0.03, 0.03) : t->mag[j][i];
+		}
+		t->accel_offset[i] = uniform(-0.08, 0.08) * g;
+		t->mag_offset[i] = uniform(-150, 150);
+		t->field[i] = field_mg[i] / mag_res(mscale);
+	}
+}
+
+// The session as log text: faces held for 10 s in turn, at a random
+// heading, with 10 s of tumbling at 90 deg/s between
+static char * sim_session(const truth_t * t, unsigned long lines,
+	size_t * size)
+{
+	static const quat_t faces[FACES] =
+	{
+		{M_SQRT1_2, 0, -M_SQRT1_2, 0}, {M_SQRT1_2, 0, M_SQRT1_2, 0},
+		{M_SQRT1_2, M_SQRT1_2, 0, 0}, {M_SQRT1_2, -M_SQRT1_2, 0, 0},
+		{1, 0, 0, 0}, {0, 1, 0, 0}
+	};
+	const double z[3] = {0, 0, 1}, up[3] = {0, 0, accel_one_g(ascale)};
+	size_t capacity = lines * 40 + 64, used = 0;
+	char * text = malloc(capacity);
+	unsigned long n = 0, step = 0, i;
+	double axis[3];
+	quat_t q;
+	int f = 0;
+
+	while (n < lines)
+	{
+		// a face at rest, then tumbling
+		q = quat_mul(quat_axis(z, uniform(0, 2 * M_PI)), faces[f]);
+		f = (f + 1) % FACES;
+		for (i = 0; i < 2 * SIM_HOLD_STEPS && n < lines; i++, step++)
+		{
+			double body[3];
+			int16_t raw[3];
+
+			if (i >= SIM_HOLD_STEPS)
+			{
+				if (i % 200 == 0)
+				{
+					random_axis(axis);
+				}
+				q = quat_mul(q, quat_axis(axis, M_PI / 2 * 0.005));
+			}
+			quat_to_body(q, up, body);
+			sim_sensor(t->accel, t->accel_offset, body, SIM_ACCEL_NOISE, raw);
+			used += sprintf(text + used, "0,%u,%d,%d,%d\n",
+				(uint32_t)(step * 5000), raw[0], raw[1], raw[2]);
+			n++;
+			if (step & 1 && n < lines)
+			{
+				quat_to_body(q, t->field, body);
+				sim_sensor(t->mag, t->mag_offset, body, SIM_MAG_NOISE, raw);
+				used += sprintf(text + used, "2,%u,%d,%d,%d\n",
+					(uint32_t)(step * 5000), raw[0], raw[1], raw[2]);
+				n++;
+			}
+		}
+	}
+	*size = used;
+	return text;
+}
+
+// Errors of the blob over directions all around, without noise: the
+// corrected vector's magnitude against out (in units) and angle against
+// the true vector of magnitude in (deg)
+static void sim_errors(const calib_sensor_t * cal, const double m[3][3],
+	const double * offset, double in, double out_magnitude, double unit,
+	double * rms, double * angle)
+{
+	double square = 0, angles = 0;
+	int i, a;
+
+	for (i = 0; i < 10000; i++)
+	{
+		double v[3], dot = 0, norm = 0;
+		int16_t raw[3], out[3];
+
+		random_axis(v);
+		for (a = 0; a < 3; a++)
+		{
+			v[a] *= in;
+		}
+		sim_sensor(m, offset, v, 0, raw);
+		calib_apply(cal, raw, out);
+		for (a = 0; a < 3; a++)
+		{
+			dot += out[a] * v[a];
+			norm += (double)out[a] * out[a];
+		}
+		norm = sqrt(norm);
+		square += (norm - out_magnitude) * (norm - out_magnitude);
+		angles += pow(acos(fmin(1, dot / (norm * in))) *
+			(180 / M_PI), 2);
+	}
+	*rms = sqrt(square / i) * unit;
+	*angle = sqrt(angles / i);
+}
+
+static int bench(unsigned long lines, const int * list, int lists)
+{
+	truth_t truth;
+	result_t r;
+	calib_blob_t loaded;
+	double first = 0, g = accel_one_g(ascale), accel_mg, accel_deg;
+	double mag_percent, mag_deg, field, offset_error = 0;
+	size_t size;
+	char * text;
+	int i, failed = 0;
+
+	sim_truth(&truth);
+	text = sim_session(&truth, lines, &size);
+	chunk_count = 0;
+	chunks = malloc((size / CHUNK_BYTES + 2) * sizeof(chunk_t));
+	for (i = 0; (size_t)i * CHUNK_BYTES < size; i++)
+	{
+		// the session is cut at line ends like a file
+		const char * start = text + (size_t)i * CHUNK_BYTES;
+		const char * end = text + size;
+
+		if (i)
+		{
+			start = memchr(start, '\n', end - start) + 1;
+		}
+		if ((size_t)(i + 1) * CHUNK_BYTES < size)
+		{
+			end = memchr(text + (size_t)(i + 1) * CHUNK_BYTES, '\n',
+				size - (size_t)(i + 1) * CHUNK_BYTES) + 1;
+		}
+		chunks[chunk_count].data = start;
+		chunks[chunk_count++].size = end - start;
+	}
+
+	printf("simulated session: %lu lines, %.1f MB, %ld cores\n", lines,
+		size / 1e6, sysconf(_SC_NPROCESSORS_ONLN));
+	printf("%7s %9s %9s %9s\n", "threads", "seconds", "MB/s", "speed-up");
+	for (i = 0; i < lists; i++)
+	{
+		uint8_t valid = solve(list[i], &r);
+
+		first = i ? first : r.seconds;
+		printf("%7d %9.3f %9.0f %9.2f\n", list[i], r.seconds,
+			size / 1e6 / r.seconds, first / r.seconds);
+		if (valid != (CALIB_ACCEL | CALIB_MAG))
+		{
+			printf("not solved\n");
+			return 1;
+		}
+	}
+	printf("\n");
+	print_result(&r, size, list[lists - 1]);
+
+	// against the truth
+	for (i = 0; i < 3; i++)
+	{
+		offset_error = fmax(offset_error,
+			fabs(r.accel_offset[i] - truth.accel_offset[i]));
+	}
+	sim_errors(&solution.accel, truth.accel, truth.accel_offset, g, g,
+		1000 / g, &accel_mg, &accel_deg);
+	printf("\naccelerometer against the truth: offset error max %.2f LSB, "
+		"|g| rms %.3f mg, direction rms %.4f deg\n", offset_error, accel_mg,
+		accel_deg);
+	offset_error = 0;
+	for (i = 0; i < 3; i++)
+	{
+		offset_error = fmax(offset_error,
+			fabs(r.mag_offset[i] - truth.mag_offset[i]));
+	}
+	field = sqrt(truth.field[0] * truth.field[0] +
+		truth.field[1] * truth.field[1] + truth.field[2] * truth.field[2]);
+	// the sphere is the ellipsoid's geometric mean, not the field
+	sim_errors(&solution.mag, truth.mag, truth.mag_offset, field, mag_radius,
+		100 / mag_radius, &mag_percent, &mag_deg);
+	printf("magnetometer against the truth: offset error max %.2f LSB, "
+		"|B| rms %.3f %%, direction rms %.3f deg\n", offset_error,
+		mag_percent, mag_deg);
+
+	// through the EEPROM as the firmware loads it
+	memcpy(&sim_eeprom[CALIB_EEPROM_ADDR], &solution, sizeof(solution));
+	if (calib_load(&loaded) != solution.valid ||
+		memcmp(&loaded.accel, &solution.accel, sizeof(loaded.accel)) ||
+		memcmp(&loaded.mag, &solution.mag, sizeof(loaded.mag)))
+	{
+		printf("calib_load() doesn't read the blob back\n");
+		failed = 1;
+	}
+	if (accel_mg > BOUND_ACCEL_MG || accel_deg > BOUND_ACCEL_DEG ||
+		mag_percent > BOUND_MAG_PERCENT || mag_deg > BOUND_MAG_DEG)
+	{
+		printf("errors above the bounds (%.1f mg, %.2f deg, %.1f %%, %.1f deg)\n",
+			BOUND_ACCEL_MG, BOUND_ACCEL_DEG, BOUND_MAG_PERCENT, BOUND_MAG_DEG);
+		failed = 1;
+	}
+	free(chunks);
+	free(text);
+	return failed;
+}
+
+// Logs ------------------------------------------------------------------
+
+// Map the logs and cut them into chunks at line ends; the bytes mapped,
+// (size_t)-1 if a log can't be read
+static size_t map_logs(char ** paths, int count)
+{
+	size_t total = 0, capacity = 0;
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		struct stat st;
+		const char * data;
+		size_t at = 0;
+		int fd = open(paths[i], O_RDONLY);
+
+		if (fd < 0 || fstat(fd, &st) < 0)
+		{
+			fprintf(stderr, "can't read %s\n", paths[i]);
+			return (size_t)-1;
+		}
+		if (st.st_size == 0)
+		{
+			close(fd);
+			continue;
+		}
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (data == MAP_FAILED)
+		{
+			fprintf(stderr, "can't map %s\n", paths[i]);
+			return (size_t)-1;
+		}
+		madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+		while (at < (size_t)st.st_size)
+		{
+			size_t end = at + CHUNK_BYTES;
+
+			if (end < (size_t)st.st_size)
+			{
+				const char * eol = memchr(data + end, '\n', st.st_size - end);
+				end = eol ? (size_t)(eol - data) + 1 : (size_t)st.st_size;
+			}
+			else
+			{
+				end = st.st_size;
+			}
+			if (chunk_count == capacity)
+			{
+				capacity = capacity ? 2 * capacity : 64;
+				chunks = realloc(chunks, capacity * sizeof(chunk_t));
+			}
+			chunks[chunk_count].data = data + at;
+			chunks[chunk_count++].size = end - at;
+			at = end;
+		}
+		total += st.st_size;
+	}
+	return total;
+}
+
+int main(int argc, char ** argv)
+{
+	const char * blob = NULL, * hex = NULL;
+	unsigned long lines = 4000000;
+	int list[THREADS_MAX], lists = 0, i, first = 0, benchmark = 0, bad = 0;
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	result_t r;
+	size_t bytes;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-a") && i + 1 < argc)
+		{
+			accel_stream = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+		{
+			mag_stream = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-A") && i + 1 < argc)
+		{
+			ascale = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-M") && i + 1 < argc)
+		{
+			mscale = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+		{
+			window = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+		{
+			rest_mg = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+		{
+			char * p = argv[++i];
+
+			for (lists = 0; *p && lists < THREADS_MAX; lists++)
+			{
+				list[lists] = (int)strtol(p, &p, 10);
+				p += *p == ',';
+			}
+		}
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+		{
+			blob = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-e") && i + 1 < argc)
+		{
+			hex = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+		{
+			lines = strtoul(argv[++i], NULL, 10);
+		}
+		else if (!strcmp(argv[i], "-b"))
+		{
+			benchmark = 1;
+		}
+		else if (argv[i][0] == '-')
+		{
+			bad = 1;
+			break;
+		}
+		else
+		{
+			first = i;
+			break;
+		}
+	}
+	if (bad || !benchmark == !first)
+	{
+		fprintf(stderr, "usage: %s [-a stream] [-m stream] [-A ascale] "
+			"[-M mscale] [-w window] [-s mg] [-j threads] [-o blob.bin] "
+			"[-e blob.eep] log...\n"
+			"       %s -b [-n lines] [-j 1,2,4,...] [-w window] [-s mg]\n",
+			argv[0], argv[0]);
+		return 2;
+	}
+	if (ascale < AFS_2G || ascale > AFS_16G || mscale < MFS_14BITS ||
+		mscale > MFS_16BITS || window < 2 || window > WINDOW_MAX ||
+		rest_mg <= 0 || accel_stream == mag_stream)
+	{
+		fprintf(stderr, "bad scale, window, rest level or streams\n");
+		return 2;
+	}
+	if (!lists)
+	{
+		// 1, 2, 4, ... and all cores for the benchmark, all cores otherwise
+		for (i = benchmark ? 1 : cores; i < cores && lists < THREADS_MAX - 1;
+			i *= 2)
+		{
+			list[lists++] = i;
+		}
+		list[lists++] = cores < THREADS_MAX ? cores : THREADS_MAX;
+	}
+	for (i = 0; i < lists; i++)
+	{
+		if (list[i] < 1 || list[i] > THREADS_MAX)
+		{
+			fprintf(stderr, "1 - %d threads\n", THREADS_MAX);
+			return 2;
+		}
+	}
+
+	if (benchmark)
+	{
+		return bench(lines, list, lists);
+	}
+
+	bytes = map_logs(&argv[first], argc - first);
+	if (bytes == (size_t)-1)
+	{
+		return 2;
+	}
+	if (!chunk_count)
+	{
+		fprintf(stderr, "no log data\n");
+		return 2;
+	}
+	if (!solve(list[0], &r))
+	{
+		print_result(&r, bytes, list[0]);
+		return 1;
+	}
+	print_result(&r, bytes, list[0]);
+	if ((blob && !write_blob(blob)) || (hex && !write_hex(hex)))
+	{
+		return 2;
+	}
+	return 0;
+}
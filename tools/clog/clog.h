@@ -0,0 +1,190 @@
+#ifndef CLOG_H_INCLUDED
+#define CLOG_H_INCLUDED
+
+// Columnar, time indexed sensor log files for the host tools. Linux only.
+//
+// A file holds channels (one per logged stream) of samples, each a stamp
+// in us and up to CLOG_AXES_MAX int16 values. Every channel is cut into
+// blocks of up to block_samples samples in time order, and each block is
+// stored as columns: all its stamps, then all values of axis 0, of axis 1
+// and so on. A block header in front of the columns carries the block's
+// time span and the count, sum, minimum and maximum of each axis, so an
+// overview at a coarser time scale than a block never reads its columns.
+//
+//   clog_header_t       64 bytes, at offset 0
+//   block ...           clog_block_t + columns, in the order written
+//   clog_channel_t ...  the channel table
+//   clog_index_t ...    the sparse index: one entry per block, each
+//                       channel's entries together and in time order
+//
+// Everything is little endian and aligned to 8 bytes in the file, so a
+// reader maps the file and uses the tables and the columns of raw blocks
+// where they lie (clog_read.c); a time range is found by binary search in
+// the channel's index and only the blocks it overlaps are touched. All of a
+// channel's blocks but its last hold block_samples samples, so sample i of
+// a channel is sample i % block_samples of its block i / block_samples.
+//
+// Blocks are encoded CLOG_RAW (int64 stamps, int16 values, read in place)
+// or CLOG_DELTA, decoded into the reader's buffers: the stamps after the
+// first (which is in the header) as their second difference, each axis as
+// its first value (int16) and the first differences after it. Differences
+// are zig-zag coded (0, -1, 1, -2, ...) and bit packed in groups of
+// CLOG_GROUP, each group a byte of its bit width followed by its values,
+// so the width follows the signal and an outlier costs one group. The
+// writer (clog_write.c) keeps a CLOG_DELTA block raw when it would not be
+// smaller.
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define CLOG_MAGIC			0x474F4C43UL	// "CLOG"
+#define CLOG_BLOCK_MAGIC	0x4B4C4243UL	// "CBLK"
+#define CLOG_VERSION		1
+
+#define CLOG_CHANNELS_MAX	64
+#define CLOG_AXES_MAX		9
+#define CLOG_NAME_BYTES		16
+#define CLOG_BLOCK_SAMPLES	4096		// default block length
+#define CLOG_BLOCK_SAMPLES_MAX	65536
+#define CLOG_GROUP			128			// values of a CLOG_DELTA bit width
+
+// Block encodings
+#define CLOG_RAW			0
+#define CLOG_DELTA			1
+
+typedef struct
+{
+	uint32_t magic;          // CLOG_MAGIC
+	uint16_t version;        // CLOG_VERSION
+	uint16_t channels;
+	uint32_t block_samples;
+	uint32_t reserved;
+	uint64_t blocks;
+	uint64_t samples;
+	uint64_t channel_offset; // channel table, 0 until the file is finished
+	uint64_t index_offset;   // index
+	int64_t first;           // earliest and latest stamp of any channel, us
+	int64_t last;
+} clog_header_t;
+
+typedef struct
+{
+	char name[CLOG_NAME_BYTES];  // zero terminated
+	uint16_t id;             // stream number of the source log
+	uint8_t axes;
+	uint8_t reserved[5];
+	uint64_t blocks;         // index entries
+	uint64_t index_first;    // first index entry, counted from the index
+	uint64_t samples;
+	int64_t first;           // stamp span, us
+	int64_t last;
+} clog_channel_t;
+
+typedef struct
+{
+	int64_t first;           // stamp span of the block, us
+	int64_t last;
+	uint64_t offset;         // of the block header in the file
+	uint32_t count;
+	uint16_t channel;
+	uint8_t encoding;
+	uint8_t reserved;
+} clog_index_t;
+
+typedef struct
+{
+	uint32_t magic;          // CLOG_BLOCK_MAGIC
+	uint16_t channel;
+	uint8_t encoding;
+	uint8_t axes;
+	uint32_t count;
+	uint32_t bytes;          // of the columns after the header, padded to 8
+	int64_t first;
+	int64_t last;
+	int64_t sum[CLOG_AXES_MAX];
+	int16_t min[CLOG_AXES_MAX];
+	int16_t max[CLOG_AXES_MAX];
+	uint8_t reserved[4];
+} clog_block_t;
+
+// Layout checks: the sizes are part of the format
+typedef char clog_header_size[sizeof(clog_header_t) == 64 ? 1 : -1];
+typedef char clog_channel_size[sizeof(clog_channel_t) == 64 ? 1 : -1];
+typedef char clog_index_size[sizeof(clog_index_t) == 32 ? 1 : -1];
+typedef char clog_block_size[sizeof(clog_block_t) == 144 ? 1 : -1];
+
+// Writer side, one per channel
+typedef struct
+{
+	int64_t * stamps;        // block being filled
+	int16_t * values;        // axis a at values + a * block_samples
+	uint32_t count;
+	clog_index_t * index;
+	uint64_t capacity;       // index entries allocated
+	clog_channel_t channel;
+} clog_track_t;
+
+typedef struct
+{
+	FILE * file;
+	const char * error;      // what failed, when a call returned -1
+	uint8_t encoding;
+	uint8_t * scratch;       // encoded columns
+	uint64_t * zigzag;       // differences of a column being encoded
+	uint64_t offset;         // end of the file
+	clog_header_t header;
+	clog_track_t track[CLOG_CHANNELS_MAX];
+} clog_writer_t;
+
+typedef struct
+{
+	const uint8_t * map;
+	size_t size;
+	const char * error;
+	const clog_header_t * header;
+	const clog_channel_t * channels;
+	const clog_index_t * index;
+} clog_file_t;
+
+int clog_create(clog_writer_t * w, const char * path, uint32_t block_samples,
+	uint8_t encoding);
+int clog_add_channel(clog_writer_t * w, const char * name, uint16_t id,
+	uint8_t axes);
+int clog_append(clog_writer_t * w, int channel, int64_t stamp,
+	const int16_t * values);
+int clog_finish(clog_writer_t * w);
+
+int clog_open(clog_file_t * f, const char * path);
+void clog_close(clog_file_t * f);
+int clog_channel(const clog_file_t * f, const char * name);
+const clog_index_t * clog_seek(const clog_file_t * f, int channel,
+	int64_t from, uint64_t * left);
+const clog_block_t * clog_block(const clog_file_t * f,
+	const clog_index_t * entry);
+uint32_t clog_columns(const clog_block_t * b, int64_t * stamps,
+	int16_t * values, const int64_t ** t, const int16_t ** v);
+
+// First of n stamps at or after stamp (n if none)
+static inline uint32_t clog_lower(const int64_t * t, uint32_t n,
+	int64_t stamp)
+{
+	uint32_t low = 0, high = n;
+
+	while (low < high)
+	{
+		uint32_t mid = low + (high - low) / 2;
+
+		if (t[mid] < stamp)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+	return low;
+}
+
+#endif
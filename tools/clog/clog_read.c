@@ -0,0 +1,298 @@
+// Reading columnar logs through a read only mapping of the file; see
+// clog.h.
+//
+// Opening checks the header and the tables and nothing else, so it costs
+// the same for any file size. Blocks are checked when they are asked for;
+// raw blocks are read where they lie in the mapping, delta blocks are
+// decoded into the caller's buffers.
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "clog.h"
+
+static int clog_bad(clog_file_t * f, const char * error)
+{
+	clog_close(f);
+	f->error = error;
+	return -1;
+}
+
+// Map the file and check its tables. Returns 0, or -1 with f->error set.
+int clog_open(clog_file_t * f, const char * path)
+{
+	const clog_header_t * h;
+	struct stat st;
+	uint64_t entries = 0;
+	void * map;
+	int fd;
+	uint16_t c;
+
+	memset(f, 0, sizeof(*f));
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		f->error = "cannot open file";
+		return -1;
+	}
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(clog_header_t))
+	{
+		close(fd);
+		f->error = "not a clog file";
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		f->error = "cannot map file";
+		return -1;
+	}
+	f->map = map;
+	f->size = st.st_size;
+
+	h = (const clog_header_t *)f->map;
+	if (h->magic != CLOG_MAGIC)
+	{
+		return clog_bad(f, "not a clog file");
+	}
+	if (h->version != CLOG_VERSION)
+	{
+		return clog_bad(f, "unknown version");
+	}
+	if (h->channel_offset == 0)
+	{
+		return clog_bad(f, "file not finished");
+	}
+	if (h->channels > CLOG_CHANNELS_MAX || h->channel_offset % 8 ||
+		h->channel_offset > f->size ||
+		h->index_offset != h->channel_offset +
+			(uint64_t)h->channels * sizeof(clog_channel_t) ||
+		h->index_offset > f->size)
+	{
+		return clog_bad(f, "damaged tables");
+	}
+	f->header = h;
+	f->channels = (const clog_channel_t *)(f->map + h->channel_offset);
+	f->index = (const clog_index_t *)(f->map + h->index_offset);
+	for (c = 0; c < h->channels; c++)
+	{
+		const clog_channel_t * ch = &f->channels[c];
+
+		if (ch->axes < 1 || ch->axes > CLOG_AXES_MAX ||
+			ch->index_first != entries || ch->blocks > h->blocks - entries)
+		{
+			return clog_bad(f, "damaged tables");
+		}
+		entries += ch->blocks;
+	}
+	if (entries != h->blocks ||
+		(f->size - h->index_offset) / sizeof(clog_index_t) < entries)
+	{
+		return clog_bad(f, "damaged index");
+	}
+	return 0;
+}
+
+void clog_close(clog_file_t * f)
+{
+	if (f->map)
+	{
+		munmap((void *)f->map, f->size);
+	}
+	memset(f, 0, sizeof(*f));
+}
+
+// Channel number by name or source stream number, -1 if there is none
+int clog_channel(const clog_file_t * f, const char * name)
+{
+	char * end;
+	long id = strtol(name, &end, 10);
+	uint16_t c;
+
+	for (c = 0; c < f->header->channels; c++)
+	{
+		if (*end == 0 && end != name ? f->channels[c].id == id :
+			!strncmp(f->channels[c].name, name, CLOG_NAME_BYTES))
+		{
+			return c;
+		}
+	}
+	return -1;
+}
+
+// The channel's first block that ends at or after from, with the number of
+// the channel's blocks from it on in left (0 when there are none)
+const clog_index_t * clog_seek(const clog_file_t * f, int channel,
+	int64_t from, uint64_t * left)
+{
+	const clog_channel_t * ch = &f->channels[channel];
+	const clog_index_t * e = f->index + ch->index_first;
+	uint64_t low = 0, high = ch->blocks;
+
+	while (low < high)
+	{
+		uint64_t mid = low + (high - low) / 2;
+
+		if (e[mid].last < from)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+	*left = ch->blocks - low;
+	return e + low;
+}
+
+// The block an index entry points to, NULL if it is damaged
+const clog_block_t * clog_block(const clog_file_t * f,
+	const clog_index_t * entry)
+{
+	const clog_block_t * b;
+
+	if (entry->offset % 8 || entry->offset >= f->header->channel_offset ||
+		f->header->channel_offset - entry->offset < sizeof(clog_block_t))
+	{
+		return NULL;
+	}
+	b = (const clog_block_t *)(f->map + entry->offset);
+	if (b->magic != CLOG_BLOCK_MAGIC || b->count != entry->count ||
+		b->count == 0 || b->count > f->header->block_samples ||
+		b->axes != f->channels[entry->channel].axes ||
+		b->bytes > f->header->channel_offset - entry->offset -
+			sizeof(clog_block_t) ||
+		(b->encoding == CLOG_RAW &&
+			b->bytes < (uint64_t)b->count * (8 + 2 * b->axes)))
+	{
+		return NULL;
+	}
+	return b;
+}
+
+// Unpack a group of n zig-zag coded values into x
+static const uint8_t * clog_unpack(const uint8_t * p, const uint8_t * end,
+	uint32_t n, int64_t * x)
+{
+	uint8_t copy[CLOG_GROUP * 8 + 16];
+	const uint8_t * q = p + 1;
+	uint64_t mask;
+	size_t bytes;
+	uint32_t i;
+	uint8_t width;
+
+	if (p >= end || (width = *p) > 64)
+	{
+		return NULL;
+	}
+	bytes = ((size_t)n * width + 7) / 8;
+	if ((size_t)(end - q) < bytes)
+	{
+		return NULL;
+	}
+	// words are read whole, so the last ones from a copy near the end
+	if ((size_t)(end - q) < bytes + 16)
+	{
+		memcpy(copy, q, bytes);
+		memset(copy + bytes, 0, 16);
+		q = copy;
+	}
+	mask = width == 64 ? ~(uint64_t)0 : ((uint64_t)1 << width) - 1;
+	for (i = 0; i < n; i++)
+	{
+		size_t bit = (size_t)i * width;
+		uint8_t shift = bit & 7;
+		uint64_t z;
+
+		memcpy(&z, q + (bit >> 3), 8);
+		z >>= shift;
+		if (shift + width > 64)
+		{
+			z |= (uint64_t)q[(bit >> 3) + 8] << (64 - shift);
+		}
+		z &= mask;
+		x[i] = (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+	}
+	return p + 1 + bytes;
+}
+
+// The block's columns: stamps in *t, axis a's values at *v + a * count.
+// Raw blocks point into the mapping; delta blocks are decoded into stamps
+// and values, which must hold block_samples stamps and axes times as many
+// values (either may be NULL for a raw file). Returns the sample count, 0
+// if the columns are damaged.
+uint32_t clog_columns(const clog_block_t * b, int64_t * stamps,
+	int16_t * values, const int64_t ** t, const int16_t ** v)
+{
+	const uint8_t * p = (const uint8_t *)(b + 1);
+	const uint8_t * end = p + b->bytes;
+	uint32_t n = b->count, i, j;
+	int64_t x[CLOG_GROUP], step = 0;
+	uint8_t a;
+
+	if (b->encoding == CLOG_RAW)
+	{
+		*t = (const int64_t *)p;
+		*v = (const int16_t *)(p + (size_t)n * 8);
+		return n;
+	}
+	if (b->encoding != CLOG_DELTA || !stamps || !values)
+	{
+		return 0;
+	}
+
+	stamps[0] = b->first;
+	for (i = 1; i < n; i += CLOG_GROUP)
+	{
+		uint32_t m = n - i < CLOG_GROUP ? n - i : CLOG_GROUP;
+
+		if (!(p = clog_unpack(p, end, m, x)))
+		{
+			return 0;
+		}
+		for (j = 0; j < m; j++)
+		{
+			step += x[j];
+			stamps[i + j] = stamps[i + j - 1] + step;
+		}
+	}
+	for (a = 0; a < b->axes; a++)
+	{
+		int16_t * col = values + (size_t)a * n;
+		int32_t last;
+
+		if (end - p < 2)
+		{
+			return 0;
+		}
+		memcpy(&col[0], p, 2);
+		p += 2;
+		last = col[0];
+		for (i = 1; i < n; i += CLOG_GROUP)
+		{
+			uint32_t m = n - i < CLOG_GROUP ? n - i : CLOG_GROUP;
+
+			if (!(p = clog_unpack(p, end, m, x)))
+			{
+				return 0;
+			}
+			for (j = 0; j < m; j++)
+			{
+				last += (int32_t)x[j];
+				col[i + j] = (int16_t)last;
+			}
+		}
+	}
+	if (stamps[n - 1] != b->last)
+	{
+		return 0;
+	}
+	*t = stamps;
+	*v = values;
+	return n;
+}
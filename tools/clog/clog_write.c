@@ -0,0 +1,405 @@
+// Writing columnar logs; see clog.h.
+//
+// Samples are appended per channel and held until the channel's block is
+// full, so memory is one block per channel plus the index. The file is
+// written front to back through stdio, with the header rewritten at the
+// end, once the tables are known.
+
+#include <stdlib.h>
+#include <string.h>
+#include "clog.h"
+
+#define CLOG_PAD(n)		(((n) + 7) & ~(uint64_t)7)
+
+static int clog_fail(clog_writer_t * w, const char * error)
+{
+	w->error = error;
+	return -1;
+}
+
+static int clog_put(clog_writer_t * w, const void * p, size_t n)
+{
+	if (n && fwrite(p, 1, n, w->file) != n)
+	{
+		return clog_fail(w, "write failed");
+	}
+	w->offset += n;
+	return 0;
+}
+
+static uint64_t clog_zigzag(int64_t x)
+{
+	return ((uint64_t)x << 1) ^ (uint64_t)(x >> 63);
+}
+
+// Bit pack n zig-zag coded values in groups of CLOG_GROUP, each after a
+// byte of its width
+static uint8_t * clog_pack(uint8_t * p, const uint64_t * z, uint32_t n)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < n; i += CLOG_GROUP)
+	{
+		uint32_t m = n - i < CLOG_GROUP ? n - i : CLOG_GROUP;
+		uint64_t any = 0, acc = 0;
+		uint8_t width = 0, held = 0;
+
+		for (j = 0; j < m; j++)
+		{
+			any |= z[i + j];
+		}
+		while (width < 64 && any >> width)
+		{
+			width++;
+		}
+		*p++ = width;
+		for (j = 0; j < m && width; j++)
+		{
+			uint64_t x = z[i + j];
+
+			acc |= x << held;
+			if (held + width < 64)
+			{
+				held += width;
+				continue;
+			}
+			memcpy(p, &acc, 8);
+			p += 8;
+			acc = held ? x >> (64 - held) : 0;
+			held = held + width - 64;
+		}
+		while (held)
+		{
+			*p++ = (uint8_t)acc;
+			acc >>= 8;
+			held = held > 8 ? held - 8 : 0;
+		}
+	}
+	return p;
+}
+
+// CLOG_DELTA columns of the track's block into scratch, returns the bytes
+static size_t clog_encode(const clog_writer_t * w, const clog_track_t * t)
+{
+	uint32_t n = t->count, i;
+	uint64_t * z = w->zigzag;
+	uint8_t * p = w->scratch;
+	int64_t step = 0;
+	uint8_t a;
+
+	for (i = 1; i < n; i++)
+	{
+		int64_t d = t->stamps[i] - t->stamps[i - 1];
+
+		z[i - 1] = clog_zigzag(d - step);
+		step = d;
+	}
+	p = clog_pack(p, z, n - 1);
+	for (a = 0; a < t->channel.axes; a++)
+	{
+		const int16_t * v = t->values + (size_t)a * w->header.block_samples;
+
+		memcpy(p, &v[0], 2);
+		p += 2;
+		for (i = 1; i < n; i++)
+		{
+			z[i - 1] = clog_zigzag((int32_t)v[i] - v[i - 1]);
+		}
+		p = clog_pack(p, z, n - 1);
+	}
+	return p - w->scratch;
+}
+
+// Write the track's block and index it
+static int clog_flush(clog_writer_t * w, uint16_t channel)
+{
+	static const uint8_t zero[8];
+	clog_track_t * t = &w->track[channel];
+	uint8_t axes = t->channel.axes, a;
+	uint32_t n = t->count, i;
+	size_t raw = (size_t)n * (8 + 2 * axes), bytes = raw;
+	clog_block_t b;
+	clog_index_t * e;
+
+	if (n == 0)
+	{
+		return 0;
+	}
+	if (w->encoding == CLOG_DELTA)
+	{
+		bytes = clog_encode(w, t);
+	}
+
+	memset(&b, 0, sizeof(b));
+	b.magic = CLOG_BLOCK_MAGIC;
+	b.channel = channel;
+	b.encoding = bytes < raw ? CLOG_DELTA : CLOG_RAW;
+	b.axes = axes;
+	b.count = n;
+	b.first = t->stamps[0];
+	b.last = t->stamps[n - 1];
+	if (b.encoding == CLOG_RAW)
+	{
+		bytes = raw;
+	}
+	b.bytes = CLOG_PAD(bytes);
+	for (a = 0; a < axes; a++)
+	{
+		const int16_t * v = t->values + (size_t)a * w->header.block_samples;
+		int64_t sum = 0;
+		int16_t low = v[0], high = v[0];
+
+		for (i = 0; i < n; i++)
+		{
+			sum += v[i];
+			low = v[i] < low ? v[i] : low;
+			high = v[i] > high ? v[i] : high;
+		}
+		b.sum[a] = sum;
+		b.min[a] = low;
+		b.max[a] = high;
+	}
+
+	if (t->channel.blocks == t->capacity)
+	{
+		uint64_t capacity = t->capacity ? 2 * t->capacity : 64;
+		clog_index_t * index = realloc(t->index, capacity * sizeof(*index));
+
+		if (!index)
+		{
+			return clog_fail(w, "out of memory");
+		}
+		t->index = index;
+		t->capacity = capacity;
+	}
+	e = &t->index[t->channel.blocks++];
+	memset(e, 0, sizeof(*e));
+	e->first = b.first;
+	e->last = b.last;
+	e->offset = w->offset;
+	e->count = n;
+	e->channel = channel;
+	e->encoding = b.encoding;
+
+	if (clog_put(w, &b, sizeof(b)))
+	{
+		return -1;
+	}
+	if (b.encoding == CLOG_DELTA)
+	{
+		if (clog_put(w, w->scratch, bytes))
+		{
+			return -1;
+		}
+	}
+	else
+	{
+		if (clog_put(w, t->stamps, (size_t)n * 8))
+		{
+			return -1;
+		}
+		for (a = 0; a < axes; a++)
+		{
+			if (clog_put(w, t->values + (size_t)a * w->header.block_samples,
+				(size_t)n * 2))
+			{
+				return -1;
+			}
+		}
+	}
+	if (clog_put(w, zero, b.bytes - bytes))
+	{
+		return -1;
+	}
+
+	w->header.blocks++;
+	t->count = 0;
+	return 0;
+}
+
+// Start a file of blocks of block_samples (0 for CLOG_BLOCK_SAMPLES)
+// samples in the encoding given. Returns 0, or -1 with w->error set.
+int clog_create(clog_writer_t * w, const char * path, uint32_t block_samples,
+	uint8_t encoding)
+{
+	memset(w, 0, sizeof(*w));
+	if (block_samples == 0)
+	{
+		block_samples = CLOG_BLOCK_SAMPLES;
+	}
+	if (block_samples < 2 || block_samples > CLOG_BLOCK_SAMPLES_MAX)
+	{
+		return clog_fail(w, "block length out of range");
+	}
+	if (encoding != CLOG_RAW && encoding != CLOG_DELTA)
+	{
+		return clog_fail(w, "unknown encoding");
+	}
+	w->encoding = encoding;
+	w->header.magic = CLOG_MAGIC;
+	w->header.version = CLOG_VERSION;
+	w->header.block_samples = block_samples;
+	// 64 bit second differences of stamps, 17 bit differences of values
+	// and the group widths fit
+	w->scratch = malloc((size_t)block_samples * (10 + 3 * CLOG_AXES_MAX));
+	w->zigzag = malloc((size_t)block_samples * sizeof(*w->zigzag));
+	w->file = fopen(path, "wb");
+	if (!w->scratch || !w->zigzag || !w->file)
+	{
+		const char * error = w->file ? "out of memory" : "cannot create file";
+
+		if (w->file)
+		{
+			fclose(w->file);
+		}
+		free(w->scratch);
+		free(w->zigzag);
+		w->file = NULL;
+		w->scratch = NULL;
+		w->zigzag = NULL;
+		return clog_fail(w, error);
+	}
+	setvbuf(w->file, NULL, _IOFBF, 1 << 20);
+	// the header again at the end, when it is complete
+	return clog_put(w, &w->header, sizeof(w->header));
+}
+
+// Add a channel of samples with axes values each. Returns its number, or
+// -1 with w->error set.
+int clog_add_channel(clog_writer_t * w, const char * name, uint16_t id,
+	uint8_t axes)
+{
+	clog_track_t * t = &w->track[w->header.channels];
+	size_t n = w->header.block_samples;
+
+	if (w->header.channels == CLOG_CHANNELS_MAX)
+	{
+		return clog_fail(w, "too many channels");
+	}
+	if (axes < 1 || axes > CLOG_AXES_MAX)
+	{
+		return clog_fail(w, "axes out of range");
+	}
+	memset(t, 0, sizeof(*t));
+	strncpy(t->channel.name, name, CLOG_NAME_BYTES - 1);
+	t->channel.id = id;
+	t->channel.axes = axes;
+	t->stamps = malloc(n * sizeof(*t->stamps));
+	t->values = malloc(n * axes * sizeof(*t->values));
+	if (!t->stamps || !t->values)
+	{
+		free(t->stamps);
+		free(t->values);
+		return clog_fail(w, "out of memory");
+	}
+	return w->header.channels++;
+}
+
+// Append a sample of the channel; stamps must not go back in time. Returns
+// 0, or -1 with w->error set.
+int clog_append(clog_writer_t * w, int channel, int64_t stamp,
+	const int16_t * values)
+{
+	clog_track_t * t;
+	uint8_t a;
+
+	if (channel < 0 || channel >= w->header.channels)
+	{
+		return clog_fail(w, "no such channel");
+	}
+	t = &w->track[channel];
+	if (t->channel.samples && stamp < t->channel.last)
+	{
+		return clog_fail(w, "stamp out of order");
+	}
+	if (t->channel.samples == 0)
+	{
+		t->channel.first = stamp;
+	}
+	t->channel.last = stamp;
+	t->channel.samples++;
+	t->stamps[t->count] = stamp;
+	for (a = 0; a < t->channel.axes; a++)
+	{
+		t->values[(size_t)a * w->header.block_samples + t->count] = values[a];
+	}
+	if (++t->count == w->header.block_samples)
+	{
+		return clog_flush(w, channel);
+	}
+	return 0;
+}
+
+// Write the last blocks, the tables and the header, close the file and
+// free the writer. Returns 0, or -1 with w->error set.
+int clog_finish(clog_writer_t * w)
+{
+	uint64_t entries = 0;
+	int status = 0;
+	uint16_t c;
+
+	for (c = 0; c < w->header.channels && status == 0; c++)
+	{
+		status = clog_flush(w, c);
+	}
+
+	if (status == 0)
+	{
+		w->header.channel_offset = w->offset;
+		w->header.first = INT64_MAX;
+		w->header.last = INT64_MIN;
+		for (c = 0; c < w->header.channels; c++)
+		{
+			clog_channel_t * ch = &w->track[c].channel;
+
+			ch->index_first = entries;
+			entries += ch->blocks;
+			w->header.samples += ch->samples;
+			if (ch->samples)
+			{
+				w->header.first = ch->first < w->header.first ?
+					ch->first : w->header.first;
+				w->header.last = ch->last > w->header.last ?
+					ch->last : w->header.last;
+			}
+		}
+		if (w->header.samples == 0)
+		{
+			w->header.first = 0;
+			w->header.last = 0;
+		}
+		for (c = 0; c < w->header.channels && status == 0; c++)
+		{
+			status = clog_put(w, &w->track[c].channel, sizeof(clog_channel_t));
+		}
+		w->header.index_offset = w->offset;
+		for (c = 0; c < w->header.channels && status == 0; c++)
+		{
+			clog_track_t * t = &w->track[c];
+
+			status = clog_put(w, t->index, t->channel.blocks * sizeof(*t->index));
+		}
+	}
+	if (status == 0 && (fseek(w->file, 0, SEEK_SET) ||
+		fwrite(&w->header, sizeof(w->header), 1, w->file) != 1))
+	{
+		status = clog_fail(w, "write failed");
+	}
+	if (fclose(w->file) && status == 0)
+	{
+		status = clog_fail(w, "write failed");
+	}
+
+	for (c = 0; c < w->header.channels; c++)
+	{
+		free(w->track[c].stamps);
+		free(w->track[c].values);
+		free(w->track[c].index);
+	}
+	free(w->scratch);
+	free(w->zigzag);
+	w->file = NULL;
+	w->scratch = NULL;
+	w->zigzag = NULL;
+	return status;
+}
@@ -0,0 +1,1211 @@
+// Packs logged sensor streams into columnar, time indexed log files
+// (tools/clog/clog.h) and queries them by time range and channel without
+// reading more than the blocks involved. Linux only.
+//
+// Build from the repository root:
+//
+//   gcc -std=gnu99 -O2 -Itools/clog -o clog_query tools/clog_query.c
+//       tools/clog/clog_read.c tools/clog/clog_write.c -lm
+//
+//   ./clog_query -p [-B samples] [-z] -o out.clog log...
+//   ./clog_query [-c channel,...] [-t from,to] [-d buckets] file.clog
+//   ./clog_query -b [-S gigabytes] [-B samples] [-q queries] [-k] file
+//
+// -p packs logs in the format of tools/align_log.c, "stream,stamp,value...",
+// lines starting with # skipped, into one file: a channel per stream (named
+// accel, gyro, mag and dht for streams 0 to 3 as main.c logs them), blocks
+// of -B samples (default 4096), CLOG_DELTA encoded with -z. The logs are
+// read in the order given and the 32 bit stamps of each stream are unwound
+// across their wraps into 64 bit us; a sample that goes back in time or
+// doesn't have the stream's number of values is dropped and counted.
+//
+// With only a file, the channels, their blocks, rates and sizes are listed.
+// -c picks channels by name or stream number (default all), -t a range of
+// seconds from the start of the file, either end may be left out ("60,",
+// ",3600"). The samples in the range are printed as "stream,stamp,value..."
+// (the format packed from, stamps in 64 bit us), a channel at a time; -d
+// prints an overview instead: the range cut into that many buckets of
+// equal time and for each bucket of a channel with samples
+// "stream,stamp,count,min,max,mean" with the last three for every axis.
+// A block that lies in one bucket adds its header's summary without its
+// columns being read. What was touched goes to stderr.
+//
+// -b benchmarks on a synthetic log of -S GB (default 2, raw): the streams
+// of main.c (accelerometer and gyro at 1 kHz, magnetometer at 100 Hz, DHT
+// every 2 s) with timing jitter, vibration and noise, written raw to file
+// and delta encoded to file.z. For both it reports the write rate, the
+// scan rate over all samples with the file's pages dropped from the cache
+// first and again when they are cached, the latency percentiles of -q
+// (default 1000) range queries of 10 ms, 1 s and 60 s of the accelerometer
+// at random times, cold and cached, and the time of a 1000 bucket overview
+// of everything. The files are removed at the end unless -k is given.
+//
+// The exit status is 1 if a file is damaged (with -b, if the raw and the
+// delta encoded file disagree with each other or the generator), 2 on bad
+// arguments or files.
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "clog.h"
+
+#define STREAMS_MAX		256
+#define FILES_MAX		256
+#define BENCH_WINDOWS	3
+#define BENCH_BUCKETS	1000
+
+typedef struct
+{
+	uint64_t blocks;        // whose columns were read
+	uint64_t summaries;     // whose header summary was used
+	uint64_t samples;
+	int64_t sum;            // of the stamps and values read
+} touch_t;
+
+typedef void (*visit_t)(void * ctx, const int64_t * t, const int16_t * v,
+	uint32_t count, uint32_t begin, uint32_t end);
+
+static int64_t * stamp_buf;
+static int16_t * value_buf;
+
+static double now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int open_log(clog_file_t * f, const char * path)
+{
+	uint32_t n;
+
+	if (clog_open(f, path))
+	{
+		fprintf(stderr, "%s: %s\n", path, f->error);
+		return -1;
+	}
+	n = f->header->block_samples;
+	free(stamp_buf);
+	free(value_buf);
+	stamp_buf = malloc((size_t)n * sizeof(*stamp_buf));
+	value_buf = malloc((size_t)n * CLOG_AXES_MAX * sizeof(*value_buf));
+	if (!stamp_buf || !value_buf)
+	{
+		fprintf(stderr, "out of memory\n");
+		clog_close(f);
+		return -1;
+	}
+	return 0;
+}
+
+// Hand the samples of the channel in [from, to] to visit a block at a
+// time. Returns -1 at a damaged block.
+static int range(const clog_file_t * f, int channel, int64_t from, int64_t to,
+	visit_t visit, void * ctx, touch_t * touch)
+{
+	uint64_t left;
+	const clog_index_t * e = clog_seek(f, channel, from, &left);
+
+	for (; left && e->first <= to; left--, e++)
+	{
+		const clog_block_t * b = clog_block(f, e);
+		const int64_t * t;
+		const int16_t * v;
+		uint32_t n, begin, end;
+
+		if (!b || !(n = clog_columns(b, stamp_buf, value_buf, &t, &v)))
+		{
+			return -1;
+		}
+		begin = b->first >= from ? 0 : clog_lower(t, n, from);
+		end = b->last <= to ? n : clog_lower(t, n, to + 1);
+		touch->blocks++;
+		touch->samples += end - begin;
+		visit(ctx, t, v, n, begin, end);
+	}
+	return 0;
+}
+
+typedef struct
+{
+	uint8_t axes;
+	int64_t sum;
+} sum_t;
+
+static void visit_sum(void * ctx, const int64_t * t, const int16_t * v,
+	uint32_t count, uint32_t begin, uint32_t end)
+{
+	sum_t * s = ctx;
+	uint32_t i;
+	uint8_t a;
+
+	for (i = begin; i < end; i++)
+	{
+		s->sum += t[i];
+	}
+	for (a = 0; a < s->axes; a++)
+	{
+		const int16_t * col = v + (size_t)a * count;
+		int32_t part = 0;
+
+		for (i = begin; i < end; i++)
+		{
+			part += col[i];
+		}
+		s->sum += part;
+	}
+}
+
+// Sum of the stamps and values of the channel in [from, to]
+static int sum_range(const clog_file_t * f, int channel, int64_t from,
+	int64_t to, touch_t * touch)
+{
+	sum_t s = {f->channels[channel].axes, 0};
+
+	if (range(f, channel, from, to, visit_sum, &s, touch))
+	{
+		return -1;
+	}
+	touch->sum += s.sum;
+	return 0;
+}
+
+typedef struct
+{
+	uint16_t id;
+	uint8_t axes;
+} print_t;
+
+static void visit_print(void * ctx, const int64_t * t, const int16_t * v,
+	uint32_t count, uint32_t begin, uint32_t end)
+{
+	const print_t * p = ctx;
+	uint32_t i;
+	uint8_t a;
+
+	for (i = begin; i < end; i++)
+	{
+		printf("%u,%lld", p->id, (long long)t[i]);
+		for (a = 0; a < p->axes; a++)
+		{
+			printf(",%d", v[(size_t)a * count + i]);
+		}
+		putchar('\n');
+	}
+}
+
+typedef struct
+{
+	uint64_t count;
+	int64_t sum[CLOG_AXES_MAX];
+	int16_t min[CLOG_AXES_MAX];
+	int16_t max[CLOG_AXES_MAX];
+} bucket_t;
+
+typedef struct
+{
+	bucket_t * bucket;
+	int64_t from;
+	int64_t width;          // us
+	uint8_t axes;
+} overview_t;
+
+// Buckets of whole us that cover [from, to]
+static int64_t bucket_width(int64_t from, int64_t to, uint32_t buckets)
+{
+	return (int64_t)(((uint64_t)(to - from) + buckets) / buckets);
+}
+
+static void bucket_add(bucket_t * k, uint8_t axes, uint64_t count,
+	const int64_t * sum, const int16_t * min, const int16_t * max)
+{
+	uint8_t a;
+
+	for (a = 0; a < axes; a++)
+	{
+		if (k->count == 0 || min[a] < k->min[a])
+		{
+			k->min[a] = min[a];
+		}
+		if (k->count == 0 || max[a] > k->max[a])
+		{
+			k->max[a] = max[a];
+		}
+		k->sum[a] += sum[a];
+	}
+	k->count += count;
+}
+
+static void visit_overview(void * ctx, const int64_t * t, const int16_t * v,
+	uint32_t count, uint32_t begin, uint32_t end)
+{
+	const overview_t * o = ctx;
+	uint32_t i;
+	uint8_t a;
+
+	for (i = begin; i < end; i++)
+	{
+		int64_t sum[CLOG_AXES_MAX];
+		int16_t x[CLOG_AXES_MAX];
+
+		for (a = 0; a < o->axes; a++)
+		{
+			x[a] = v[(size_t)a * count + i];
+			sum[a] = x[a];
+		}
+		bucket_add(&o->bucket[(t[i] - o->from) / o->width], o->axes, 1, sum,
+			x, x);
+	}
+}
+
+// Min, max and mean of the channel in buckets of [from, to]; bucket must
+// hold buckets entries
+static int overview(const clog_file_t * f, int channel, int64_t from,
+	int64_t to, uint32_t buckets, bucket_t * bucket, touch_t * touch)
+{
+	overview_t o;
+	uint64_t left;
+	const clog_index_t * e = clog_seek(f, channel, from, &left);
+
+	o.bucket = bucket;
+	o.from = from;
+	o.width = bucket_width(from, to, buckets);
+	o.axes = f->channels[channel].axes;
+	memset(bucket, 0, buckets * sizeof(*bucket));
+
+	for (; left && e->first <= to; left--, e++)
+	{
+		const clog_block_t * b = clog_block(f, e);
+		const int64_t * t;
+		const int16_t * v;
+		uint32_t n, begin, end;
+
+		if (!b)
+		{
+			return -1;
+		}
+		if (b->first >= from && b->last <= to &&
+			(b->first - from) / o.width == (b->last - from) / o.width)
+		{
+			bucket_add(&bucket[(b->first - from) / o.width], o.axes, b->count,
+				b->sum, b->min, b->max);
+			touch->summaries++;
+			touch->samples += b->count;
+			continue;
+		}
+		if (!(n = clog_columns(b, stamp_buf, value_buf, &t, &v)))
+		{
+			return -1;
+		}
+		begin = b->first >= from ? 0 : clog_lower(t, n, from);
+		end = b->last <= to ? n : clog_lower(t, n, to + 1);
+		touch->blocks++;
+		touch->samples += end - begin;
+		visit_overview(&o, t, v, n, begin, end);
+	}
+	return 0;
+}
+
+static void print_overview(const clog_channel_t * ch, const bucket_t * bucket,
+	uint32_t buckets, int64_t from, int64_t to)
+{
+	int64_t width = bucket_width(from, to, buckets);
+	uint32_t k;
+	uint8_t a;
+
+	for (k = 0; k < buckets; k++)
+	{
+		const bucket_t * b = &bucket[k];
+
+		if (b->count == 0)
+		{
+			continue;
+		}
+		printf("%u,%lld,%llu", ch->id, (long long)(from + k * width),
+			(unsigned long long)b->count);
+		for (a = 0; a < ch->axes; a++)
+		{
+			printf(",%d,%d,%.2f", b->min[a], b->max[a],
+				(double)b->sum[a] / b->count);
+		}
+		putchar('\n');
+	}
+}
+
+static int info(const char * path)
+{
+	clog_file_t f;
+	const clog_header_t * h;
+	uint16_t c;
+	int status = 0;
+
+	if (open_log(&f, path))
+	{
+		return 2;
+	}
+	h = f.header;
+	printf("%s: %zu bytes, %u channels, %llu blocks of up to %u samples, "
+		"%llu samples\n", path, f.size, h->channels,
+		(unsigned long long)h->blocks, h->block_samples,
+		(unsigned long long)h->samples);
+	printf("stamps %lld to %lld us, %.3f s\n", (long long)h->first,
+		(long long)h->last, (h->last - h->first) * 1e-6);
+	printf("%-16s %6s %4s %12s %8s %6s %10s %10s\n", "channel", "stream",
+		"axes", "samples", "blocks", "delta", "rate Hz", "B/sample");
+	for (c = 0; c < h->channels; c++)
+	{
+		const clog_channel_t * ch = &f.channels[c];
+		const clog_index_t * e = f.index + ch->index_first;
+		uint64_t bytes = 0, delta = 0, i;
+
+		// the block headers only, for the sizes
+		for (i = 0; i < ch->blocks; i++)
+		{
+			const clog_block_t * b = clog_block(&f, &e[i]);
+
+			if (!b)
+			{
+				fprintf(stderr, "%s: block %llu of %s damaged\n", path,
+					(unsigned long long)i, ch->name);
+				status = 1;
+				continue;
+			}
+			bytes += sizeof(*b) + b->bytes;
+			delta += b->encoding == CLOG_DELTA;
+		}
+		printf("%-16s %6u %4u %12llu %8llu %5.0f%% %10.2f %10.2f\n", ch->name,
+			ch->id, ch->axes, (unsigned long long)ch->samples,
+			(unsigned long long)ch->blocks,
+			ch->blocks ? 100.0 * delta / ch->blocks : 0.0,
+			ch->last > ch->first ? (ch->samples - 1) * 1e6 /
+				(ch->last - ch->first) : 0.0,
+			ch->samples ? (double)bytes / ch->samples : 0.0);
+	}
+	clog_close(&f);
+	return status;
+}
+
+static int query(const char * path, const char * channels, const char * times,
+	uint32_t buckets)
+{
+	clog_file_t f;
+	uint8_t pick[CLOG_CHANNELS_MAX];
+	int64_t from, to;
+	bucket_t * bucket = NULL;
+	touch_t touch;
+	double start = now();
+	uint16_t c;
+	int status = 0;
+
+	if (open_log(&f, path))
+	{
+		return 2;
+	}
+	memset(pick, channels == NULL, sizeof(pick));
+	while (channels && *channels)
+	{
+		const char * comma = strchr(channels, ',');
+		size_t n = comma ? (size_t)(comma - channels) : strlen(channels);
+		char name[CLOG_NAME_BYTES];
+		int k;
+
+		snprintf(name, sizeof(name), "%.*s", (int)n, channels);
+		if ((k = clog_channel(&f, name)) < 0)
+		{
+			fprintf(stderr, "%s: no channel %s\n", path, name);
+			clog_close(&f);
+			return 2;
+		}
+		pick[k] = 1;
+		channels += n + (comma != NULL);
+	}
+	from = f.header->first;
+	to = f.header->last;
+	if (times)
+	{
+		const char * comma = strchr(times, ',');
+		char * end;
+
+		if (*times != ',')
+		{
+			from = f.header->first + llround(strtod(times, &end) * 1e6);
+		}
+		if (comma && comma[1])
+		{
+			to = f.header->first + llround(strtod(comma + 1, &end) * 1e6);
+		}
+	}
+	if (to < from)
+	{
+		fprintf(stderr, "empty time range\n");
+		clog_close(&f);
+		return 2;
+	}
+	if (buckets)
+	{
+		bucket = malloc(buckets * sizeof(*bucket));
+		if (!bucket)
+		{
+			fprintf(stderr, "out of memory\n");
+			clog_close(&f);
+			return 2;
+		}
+		printf("# stream,stamp,count,min,max,mean...\n");
+	}
+
+	memset(&touch, 0, sizeof(touch));
+	for (c = 0; c < f.header->channels && status == 0; c++)
+	{
+		const clog_channel_t * ch = &f.channels[c];
+
+		if (!pick[c])
+		{
+			continue;
+		}
+		if (buckets)
+		{
+			status = overview(&f, c, from, to, buckets, bucket, &touch);
+			if (status == 0)
+			{
+				print_overview(ch, bucket, buckets, from, to);
+			}
+		}
+		else
+		{
+			print_t p = {ch->id, ch->axes};
+
+			status = range(&f, c, from, to, visit_print, &p, &touch);
+		}
+		if (status)
+		{
+			fprintf(stderr, "%s: damaged block in %s\n", path, ch->name);
+		}
+	}
+	fprintf(stderr, "%llu samples, %llu of %llu blocks read, %llu summaries, "
+		"%.3f s\n", (unsigned long long)touch.samples,
+		(unsigned long long)touch.blocks,
+		(unsigned long long)f.header->blocks,
+		(unsigned long long)touch.summaries, now() - start);
+	free(bucket);
+	clog_close(&f);
+	return status ? 1 : 0;
+}
+
+static const char * stream_name(long stream, char * buf, size_t n)
+{
+	static const char * const names[] = {"accel", "gyro", "mag", "dht"};
+
+	if (stream < 4)
+	{
+		return names[stream];
+	}
+	snprintf(buf, n, "stream%ld", stream);
+	return buf;
+}
+
+static int pack(const char * out, const char * const * logs, int count,
+	uint32_t block_samples, uint8_t encoding)
+{
+	static int channel[STREAMS_MAX];
+	static int64_t last[STREAMS_MAX];
+	clog_writer_t w;
+	uint64_t lines = 0, dropped = 0, bytes = 0;
+	double start = now();
+	struct stat st;
+	int i;
+
+	if (clog_create(&w, out, block_samples, encoding))
+	{
+		fprintf(stderr, "%s: %s\n", out, w.error);
+		return 2;
+	}
+	memset(channel, -1, sizeof(channel));
+
+	for (i = 0; i < count; i++)
+	{
+		const char * p, * end;
+		char * map;
+		int fd = open(logs[i], O_RDONLY);
+
+		if (fd < 0 || fstat(fd, &st))
+		{
+			fprintf(stderr, "%s: cannot open\n", logs[i]);
+			clog_finish(&w);
+			return 2;
+		}
+		if (st.st_size == 0)
+		{
+			close(fd);
+			continue;
+		}
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (map == MAP_FAILED)
+		{
+			fprintf(stderr, "%s: cannot map\n", logs[i]);
+			clog_finish(&w);
+			return 2;
+		}
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+		bytes += st.st_size;
+
+		for (p = map, end = map + st.st_size; p < end; )
+		{
+			const char * eol = memchr(p, '\n', end - p);
+			char line[256], * q, * e;
+			int16_t value[CLOG_AXES_MAX];
+			uint32_t stamp;
+			long stream;
+			uint8_t axes = 0;
+			size_t n;
+
+			eol = eol ? eol : end;
+			n = eol - p < (long)sizeof(line) - 1 ? (size_t)(eol - p) :
+				sizeof(line) - 1;
+			memcpy(line, p, n);
+			line[n] = 0;
+			p = eol + 1;
+			if (line[0] == '#' || n == 0 || line[0] == '\r')
+			{
+				continue;
+			}
+			lines++;
+
+			stream = strtol(line, &e, 10);
+			if (e == line || *e != ',' || stream < 0 || stream >= STREAMS_MAX)
+			{
+				dropped++;
+				continue;
+			}
+			q = e + 1;
+			stamp = strtoul(q, &e, 10);
+			if (e == q)
+			{
+				dropped++;
+				continue;
+			}
+			while (axes < CLOG_AXES_MAX && *e == ',')
+			{
+				q = e + 1;
+				value[axes] = (int16_t)strtol(q, &e, 10);
+				if (e == q)
+				{
+					break;
+				}
+				axes++;
+			}
+			if (axes == 0)
+			{
+				dropped++;
+				continue;
+			}
+
+			if (channel[stream] < 0)
+			{
+				char name[CLOG_NAME_BYTES];
+
+				channel[stream] = clog_add_channel(&w,
+					stream_name(stream, name, sizeof(name)), stream, axes);
+				if (channel[stream] < 0)
+				{
+					fprintf(stderr, "%s: %s\n", out, w.error);
+					clog_finish(&w);
+					return 2;
+				}
+				last[stream] = stamp;
+			}
+			else
+			{
+				// the step from the last stamp, across a wrap
+				int32_t step = (int32_t)(stamp - (uint32_t)last[stream]);
+
+				if (step < 0 || axes != w.track[channel[stream]].channel.axes)
+				{
+					dropped++;
+					continue;
+				}
+				last[stream] += step;
+			}
+			if (clog_append(&w, channel[stream], last[stream], value))
+			{
+				fprintf(stderr, "%s: %s\n", out, w.error);
+				clog_finish(&w);
+				return 2;
+			}
+		}
+		munmap(map, st.st_size);
+	}
+
+	if (clog_finish(&w))
+	{
+		fprintf(stderr, "%s: %s\n", out, w.error);
+		return 2;
+	}
+	if (stat(out, &st))
+	{
+		st.st_size = 0;
+	}
+	printf("%llu samples of %llu lines (%llu dropped) in %u channels, "
+		"%llu blocks\n", (unsigned long long)w.header.samples,
+		(unsigned long long)lines, (unsigned long long)dropped,
+		w.header.channels, (unsigned long long)w.header.blocks);
+	printf("%.1f MB of logs into %.1f MB, %.2f bytes a sample, %.2f s\n",
+		bytes / 1e6, st.st_size / 1e6,
+		w.header.samples ? (double)st.st_size / w.header.samples : 0.0,
+		now() - start);
+	return 0;
+}
+
+// Benchmark
+
+static uint64_t rng = 88172645463325252ULL;
+
+static uint32_t next_random(void)
+{
+	// xorshift64*
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return (uint32_t)((rng * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static double gauss(void)
+{
+	double u = (next_random() + 1.0) / 4294967297.0;
+	double v = next_random() / 4294967296.0;
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+// Noise from a table, as drawing it for every value would take longer than
+// writing it
+static int16_t noise[65536];
+
+static int16_t noisy(double x, uint8_t scale)
+{
+	int32_t v = (int32_t)x + (noise[next_random() >> 16] >> scale);
+
+	return v > 32767 ? 32767 : v < -32768 ? -32768 : (int16_t)v;
+}
+
+typedef struct
+{
+	uint64_t samples;
+	int64_t sum;
+	int64_t first, last;
+} truth_t;
+
+// The synthetic session, samples of both files from the same seed
+static int generate(const char * path, uint8_t encoding, uint64_t bytes,
+	uint32_t block_samples, truth_t * truth)
+{
+	// raw bytes for a second of all streams
+	const double rate = 1000 * 14 + 1000 * 14 + 100 * 14 + 0.5 * 12;
+	uint64_t ms, end = (uint64_t)(bytes / rate * 1000);
+	int accel, gyro, mag, dht;
+	int64_t epoch = 1000000;
+	double tilt = 0, drift = 0;
+	clog_writer_t w;
+
+	rng = 88172645463325252ULL;
+	memset(truth, 0, sizeof(*truth));
+	if (clog_create(&w, path, block_samples, encoding))
+	{
+		fprintf(stderr, "%s: %s\n", path, w.error);
+		return -1;
+	}
+	accel = clog_add_channel(&w, "accel", 0, 3);
+	gyro = clog_add_channel(&w, "gyro", 1, 3);
+	mag = clog_add_channel(&w, "mag", 2, 3);
+	dht = clog_add_channel(&w, "dht", 3, 2);
+
+	for (ms = 0; ms < end; ms++)
+	{
+		// sampled on a 1 kHz clock, read a few us late
+		int64_t stamp = epoch + (int64_t)ms * 1000 + (next_random() >> 30);
+		double vib = 300 * sin(2 * M_PI * 50 * 1e-3 * (ms % 20));
+		int16_t v[3];
+		int status;
+		uint8_t a;
+
+		if (ms % 100 == 0)
+		{
+			tilt = 4000 * sin(2 * M_PI * ms / 600000.0);
+			drift = 200 * sin(2 * M_PI * ms / 3600000.0);
+		}
+		v[0] = noisy(tilt + vib, 0);
+		v[1] = noisy(-tilt / 2 + vib, 0);
+		v[2] = noisy(16384 - fabs(tilt) / 8, 0);
+		status = clog_append(&w, accel, stamp, v);
+		for (a = 0; a < 3; a++)
+		{
+			truth->sum += v[a];
+		}
+		truth->sum += stamp;
+		v[0] = noisy(drift + vib / 4, 1);
+		v[1] = noisy(vib / 2, 1);
+		v[2] = noisy(-drift, 1);
+		status |= clog_append(&w, gyro, stamp + 2, v);
+		for (a = 0; a < 3; a++)
+		{
+			truth->sum += v[a];
+		}
+		truth->sum += stamp + 2;
+		truth->samples += 2;
+		if (ms % 10 == 0)
+		{
+			v[0] = noisy(200 + tilt / 40, 5);
+			v[1] = noisy(-50, 5);
+			v[2] = noisy(-300, 5);
+			status |= clog_append(&w, mag, stamp + 400, v);
+			truth->sum += (int64_t)v[0] + v[1] + v[2] + stamp + 400;
+			truth->samples++;
+		}
+		if (ms % 2000 == 0)
+		{
+			v[0] = (int16_t)(235 + drift / 20);
+			v[1] = (int16_t)(450 - drift / 10);
+			status |= clog_append(&w, dht, stamp + 800, v);
+			truth->sum += (int64_t)v[0] + v[1] + stamp + 800;
+			truth->samples++;
+		}
+		if (status)
+		{
+			fprintf(stderr, "%s: %s\n", path, w.error);
+			clog_finish(&w);
+			return -1;
+		}
+	}
+	truth->first = epoch;
+	truth->last = epoch + (int64_t)end * 1000;
+	if (clog_finish(&w))
+	{
+		fprintf(stderr, "%s: %s\n", path, w.error);
+		return -1;
+	}
+	return 0;
+}
+
+// Take the file's pages out of the page cache so the next reads go to the
+// disk; the file must not be mapped
+static void drop_cache(const char * path)
+{
+	int fd = open(path, O_RDONLY);
+
+	if (fd >= 0)
+	{
+		fdatasync(fd);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+}
+
+static int scan(const clog_file_t * f, touch_t * touch)
+{
+	uint16_t c;
+
+	memset(touch, 0, sizeof(*touch));
+	for (c = 0; c < f->header->channels; c++)
+	{
+		if (sum_range(f, c, INT64_MIN, INT64_MAX, touch))
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int compare_double(const void * a, const void * b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+typedef struct
+{
+	double p50, p99, max;   // us
+	double blocks;          // read per query
+	int64_t sum;            // over all queries
+} latency_t;
+
+// Queries of the accelerometer for span us at the starts given
+static int queries(const clog_file_t * f, const int64_t * starts,
+	uint32_t count, int64_t span, double * took, latency_t * l)
+{
+	touch_t touch;
+	uint32_t i;
+
+	memset(&touch, 0, sizeof(touch));
+	for (i = 0; i < count; i++)
+	{
+		double start = now();
+
+		if (sum_range(f, 0, starts[i], starts[i] + span - 1, &touch))
+		{
+			return -1;
+		}
+		took[i] = (now() - start) * 1e6;
+	}
+	qsort(took, count, sizeof(*took), compare_double);
+	l->p50 = took[count / 2];
+	l->p99 = took[(uint32_t)(count * 0.99)];
+	l->max = took[count - 1];
+	l->blocks = (double)touch.blocks / count;
+	l->sum = touch.sum;
+	return 0;
+}
+
+static int overview_all(const clog_file_t * f, bucket_t * bucket,
+	touch_t * touch, int64_t * check)
+{
+	uint16_t c;
+	uint32_t k;
+
+	memset(touch, 0, sizeof(*touch));
+	*check = 0;
+	for (c = 0; c < f->header->channels; c++)
+	{
+		if (overview(f, c, f->header->first, f->header->last, BENCH_BUCKETS,
+			bucket, touch))
+		{
+			return -1;
+		}
+		for (k = 0; k < BENCH_BUCKETS; k++)
+		{
+			uint8_t a;
+
+			*check += bucket[k].count;
+			for (a = 0; a < f->channels[c].axes; a++)
+			{
+				*check += bucket[k].sum[a] + bucket[k].min[a] + bucket[k].max[a];
+			}
+		}
+	}
+	return 0;
+}
+
+static int bench(const char * path, double gigabytes, uint32_t block_samples,
+	uint32_t count, int keep)
+{
+	static const int64_t windows[BENCH_WINDOWS] = {10000, 1000000, 60000000};
+	static const char * const window_names[BENCH_WINDOWS] = {
+		"10 ms", "1 s", "60 s"};
+	static const char * const names[2] = {"raw", "delta"};
+	char paths[2][4096];
+	truth_t truth[2];
+	latency_t cold[2][BENCH_WINDOWS], warm[2][BENCH_WINDOWS];
+	double write_s[2], scan_s[2][2], overview_s[2][2];
+	touch_t scanned[2][2], viewed[2];
+	int64_t view_check[2][2];
+	uint64_t size[2];
+	int64_t * starts;
+	double * took;
+	bucket_t * bucket;
+	int failed = 0, e, w;
+	uint32_t i;
+
+	snprintf(paths[0], sizeof(paths[0]), "%s", path);
+	snprintf(paths[1], sizeof(paths[1]), "%s.z", path);
+	starts = malloc(count * sizeof(*starts));
+	took = malloc(count * sizeof(*took));
+	bucket = malloc(BENCH_BUCKETS * sizeof(*bucket));
+	if (!starts || !took || !bucket)
+	{
+		fprintf(stderr, "out of memory\n");
+		return 2;
+	}
+	for (i = 0; i < 65536; i++)
+	{
+		noise[i] = (int16_t)lround(40 * gauss());
+	}
+
+	for (e = 0; e < 2; e++)
+	{
+		struct stat st;
+		double start = now();
+
+		printf("writing %s (%s)...\n", paths[e], names[e]);
+		fflush(stdout);
+		if (generate(paths[e], e == 0 ? CLOG_RAW : CLOG_DELTA,
+			(uint64_t)(gigabytes * (1 << 30)), block_samples, &truth[e]))
+		{
+			return 2;
+		}
+		write_s[e] = now() - start;
+		size[e] = stat(paths[e], &st) ? 0 : st.st_size;
+	}
+	printf("%.1f h of 4 channels, %.1f M samples\n\n",
+		(truth[0].last - truth[0].first) / 3.6e9, truth[0].samples / 1e6);
+
+	// random query starts, the same for both files
+	for (i = 0; i < count; i++)
+	{
+		int64_t room = truth[0].last - truth[0].first - windows[2];
+
+		starts[i] = truth[0].first + (int64_t)((double)next_random() /
+			4294967296.0 * room);
+	}
+
+	for (e = 0; e < 2; e++)
+	{
+		clog_file_t f;
+
+		for (w = 0; w < 2; w++)
+		{
+			double start;
+
+			if (w == 0)
+			{
+				drop_cache(paths[e]);
+			}
+			if (open_log(&f, paths[e]))
+			{
+				return 2;
+			}
+			madvise((void *)f.map, f.size, MADV_SEQUENTIAL);
+			start = now();
+			failed |= scan(&f, &scanned[e][w]) != 0;
+			scan_s[e][w] = now() - start;
+			clog_close(&f);
+		}
+
+		drop_cache(paths[e]);
+		if (open_log(&f, paths[e]))
+		{
+			return 2;
+		}
+		madvise((void *)f.map, f.size, MADV_RANDOM);
+		for (w = 0; w < BENCH_WINDOWS; w++)
+		{
+			failed |= queries(&f, starts, count, windows[w], took,
+				&cold[e][w]) != 0;
+		}
+		for (w = 0; w < BENCH_WINDOWS; w++)
+		{
+			failed |= queries(&f, starts, count, windows[w], took,
+				&warm[e][w]) != 0;
+		}
+		clog_close(&f);
+
+		drop_cache(paths[e]);
+		if (open_log(&f, paths[e]))
+		{
+			return 2;
+		}
+		for (w = 0; w < 2; w++)
+		{
+			double start = now();
+
+			failed |= overview_all(&f, bucket, &viewed[e],
+				&view_check[e][w]) != 0;
+			overview_s[e][w] = now() - start;
+		}
+		clog_close(&f);
+	}
+	if (failed)
+	{
+		fprintf(stderr, "damaged block\n");
+	}
+
+	printf("%-6s %14s %9s %10s\n", "file", "bytes", "B/sample", "write MB/s");
+	for (e = 0; e < 2; e++)
+	{
+		printf("%-6s %14llu %9.2f %10.0f\n", names[e],
+			(unsigned long long)size[e], (double)size[e] / truth[e].samples,
+			size[e] / write_s[e] / 1e6);
+	}
+
+	printf("\n%-6s %22s %22s\n", "scan", "cold MB/s  Msamples/s",
+		"cached MB/s  Msamples/s");
+	for (e = 0; e < 2; e++)
+	{
+		printf("%-6s %10.0f %11.1f %11.0f %11.1f\n", names[e],
+			size[e] / scan_s[e][0] / 1e6,
+			scanned[e][0].samples / scan_s[e][0] / 1e6,
+			size[e] / scan_s[e][1] / 1e6,
+			scanned[e][1].samples / scan_s[e][1] / 1e6);
+	}
+
+	printf("\n%-6s %-6s %8s %8s %8s %8s %8s %8s %7s\n", "query", "span",
+		"cold p50", "p99", "max", "cached", "p99", "max", "blocks");
+	for (e = 0; e < 2; e++)
+	{
+		for (w = 0; w < BENCH_WINDOWS; w++)
+		{
+			printf("%-6s %-6s %8.0f %8.0f %8.0f %8.1f %8.1f %8.1f %7.1f\n",
+				names[e], window_names[w], cold[e][w].p50, cold[e][w].p99,
+				cold[e][w].max, warm[e][w].p50, warm[e][w].p99,
+				warm[e][w].max, cold[e][w].blocks);
+		}
+	}
+	printf("(us, %u queries of the accelerometer each)\n", count);
+
+	printf("\n%-8s %9s %9s %12s %12s\n", "overview", "cold ms", "cached ms",
+		"blocks read", "summaries");
+	for (e = 0; e < 2; e++)
+	{
+		printf("%-8s %9.1f %9.1f %12llu %12llu\n", names[e],
+			overview_s[e][0] * 1e3, overview_s[e][1] * 1e3,
+			(unsigned long long)viewed[e].blocks,
+			(unsigned long long)viewed[e].summaries);
+	}
+	printf("(%u buckets of every channel over the whole log)\n",
+		BENCH_BUCKETS);
+
+	// both files and the generator must agree
+	for (e = 0; e < 2 && !failed; e++)
+	{
+		for (w = 0; w < 2; w++)
+		{
+			if (scanned[e][w].samples != truth[e].samples ||
+				scanned[e][w].sum != truth[e].sum)
+			{
+				fprintf(stderr, "%s scan differs from the generator\n",
+					names[e]);
+				failed = 1;
+			}
+			if (view_check[e][w] != view_check[0][0])
+			{
+				fprintf(stderr, "%s overview differs\n", names[e]);
+				failed = 1;
+			}
+		}
+		for (w = 0; w < BENCH_WINDOWS; w++)
+		{
+			if (cold[e][w].sum != cold[0][w].sum ||
+				warm[e][w].sum != cold[0][w].sum)
+			{
+				fprintf(stderr, "%s %s queries differ\n", names[e],
+					window_names[w]);
+				failed = 1;
+			}
+		}
+	}
+	if (!keep)
+	{
+		unlink(paths[0]);
+		unlink(paths[1]);
+	}
+	free(starts);
+	free(took);
+	free(bucket);
+	return failed;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: clog_query -p [-B samples] [-z] -o out.clog log...\n"
+		"       clog_query [-c channel,...] [-t from,to] [-d buckets] "
+		"file.clog\n"
+		"       clog_query -b [-S gigabytes] [-B samples] [-q queries] [-k] "
+		"file\n");
+}
+
+int main(int argc, char ** argv)
+{
+	const char * files[FILES_MAX];
+	const char * out = NULL, * channels = NULL, * times = NULL;
+	uint32_t block_samples = CLOG_BLOCK_SAMPLES, buckets = 0, count = 1000;
+	double gigabytes = 2;
+	int packing = 0, benchmark = 0, keep = 0, n = 0, bad = 0, i;
+	uint8_t encoding = CLOG_RAW;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-p"))
+		{
+			packing = 1;
+		}
+		else if (!strcmp(argv[i], "-b"))
+		{
+			benchmark = 1;
+		}
+		else if (!strcmp(argv[i], "-z"))
+		{
+			encoding = CLOG_DELTA;
+		}
+		else if (!strcmp(argv[i], "-k"))
+		{
+			keep = 1;
+		}
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+		{
+			out = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-B") && i + 1 < argc)
+		{
+			block_samples = strtoul(argv[++i], NULL, 10);
+		}
+		else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+		{
+			channels = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+		{
+			times = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+		{
+			buckets = strtoul(argv[++i], NULL, 10);
+		}
+		else if (!strcmp(argv[i], "-S") && i + 1 < argc)
+		{
+			gigabytes = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-q") && i + 1 < argc)
+		{
+			count = strtoul(argv[++i], NULL, 10);
+		}
+		else if (argv[i][0] == '-' || n == FILES_MAX)
+		{
+			bad = 1;
+		}
+		else
+		{
+			files[n++] = argv[i];
+		}
+	}
+	if (bad || packing + benchmark > 1 || n == 0 ||
+		block_samples < 2 || block_samples > CLOG_BLOCK_SAMPLES_MAX)
+	{
+		usage();
+		return 2;
+	}
+
+	if (packing)
+	{
+		if (!out)
+		{
+			usage();
+			return 2;
+		}
+		return pack(out, files, n, block_samples, encoding);
+	}
+	if (benchmark)
+	{
+		if (n != 1 || gigabytes <= 0 || count < 1)
+		{
+			usage();
+			return 2;
+		}
+		return bench(files[0], gigabytes, block_samples, count, keep);
+	}
+	if (n != 1)
+	{
+		usage();
+		return 2;
+	}
+	if (!channels && !times && !buckets)
+	{
+		return info(files[0]);
+	}
+	return query(files[0], channels, times, buckets);
+}
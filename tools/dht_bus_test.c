@@ -0,0 +1,173 @@
+// Waveform test of DHT_readBus() against the DHT model of tools/sim: a
+// DHT11 and two DHT22 on port D answer every start signal together, with
+// their pulse lengths scaled away from the datasheet and the polling loop
+// made slower, and every decoded reading is compared with what the sensors
+// sent.
+//
+// Build and run from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -Itools/host -Itools/sim -I. -o dht_bus_test tools/dht_bus_test.c
+//       tools/sim/sim_world.c tools/sim/sim_mpu.c tools/sim/sim_dht.c
+//       DHT.c sensor_cache.c -lm
+//   ./dht_bus_test
+//
+// The rows are the cost of one pass of the polling loop (the simulator's
+// overhead, added to the DHT_BUS_POLL_US pause), the columns the factor
+// all pulse lengths are scaled by (dht_timing). Each cell reads the bus
+// TEST_READS times with a new temperature and humidity before every read
+// and shows how many readings of the three sensors came back right. Up to
+// TEST_LOOP_US per pass, what an idle pass takes at 1 MHz, and within
+// TEST_SKEW of the datasheet timing, about the spread of the parts, every
+// reading must be right; the cells outside are shown for the margin. A bus
+// of more than DHT_BUS_MAX sensors must be refused without a start signal.
+// The exit status is 1 if a check fails.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "DHT.h"
+#include "sim.h"
+
+#define TEST_SENSORS	3
+#define TEST_READS		40
+#define TEST_LOOP_US	17			// largest pass that must decode
+#define TEST_SKEW		0.15		// largest timing error that must decode
+
+static const double test_loop_us[] = {2, 6, 10, 17, 20, 26};
+static const double test_skew[] = {0.6, 0.7, 0.85, 1.0, 1.15, 1.3, 1.5};
+
+#define TEST_LOOPS	(sizeof(test_loop_us) / sizeof(test_loop_us[0]))
+#define TEST_SKEWS	(sizeof(test_skew) / sizeof(test_skew[0]))
+
+// The tenths a sensor of a type sends for t and h, quantised as
+// tools/sim/sim_dht.c does
+static void expected(uint8_t type, double t, double h, int16_t * temp,
+	uint16_t * hum)
+{
+	if (type == DHT11)
+	{
+		*hum = (uint16_t)floor(h + 0.5) * 10;
+		*temp = (int16_t)(floor(t) * 10 + (uint8_t)((t - floor(t)) * 10));
+	}
+	else
+	{
+		*hum = (uint16_t)floor(h * 10 + 0.5);
+		*temp = (int16_t)floor(fabs(t) * 10 + 0.5);
+		if (t < 0)
+		{
+			*temp = -*temp;
+		}
+	}
+}
+
+// Reads of one cell; returns the readings that came back right
+static unsigned run_cell(DHT_bus_t * bus, double loop_us, double skew)
+{
+	char line[48];
+	double t = sim.temperature.value, h = sim.humidity.value;
+	unsigned right = 0, r;
+	uint8_t i;
+
+	snprintf(line, sizeof(line), "overhead %g", loop_us - DHT_BUS_POLL_US);
+	sim_command(line, "test");
+	snprintf(line, sizeof(line), "dht_timing %g", skew);
+	sim_command(line, "test");
+
+	// the first answer carries what the sensors measured before
+	DHT_readBus(bus);
+	for (r = 0; r < TEST_READS; r++)
+	{
+		// the sensors send what they measured at the previous read, so the
+		// values set now come back with the next one. A quarter of a step
+		// off the tenths and whole percent keeps them clear of the rounding
+		// of either type and of the element's lag.
+		double next_t = (rand() % 490 + 5.25) / 10;
+		double next_h = rand() % 90 + 5.025;
+
+		sim.temperature.value = sim.temperature.target = next_t;
+		sim.humidity.value = sim.humidity.target = next_h;
+		sim_advance(100000);
+		DHT_readBus(bus);
+		for (i = 0; i < bus->count; i++)
+		{
+			DHT_sensor_t * s = &bus->sensors[i];
+			int16_t temp;
+			uint16_t hum;
+
+			expected(s->type, t, h, &temp, &hum);
+			right += s->status == DHT_OK && s->temperature == temp &&
+				s->humidity == hum;
+		}
+		t = next_t;
+		h = next_h;
+	}
+	return right;
+}
+
+int main(void)
+{
+	DHT_sensor_t sensors[DHT_BUS_MAX + 1] = {DHT_SENSOR(DHT11, 5),
+		DHT_SENSOR(DHT22, 6), DHT_SENSOR(DHT22, 7)};
+	DHT_bus_t bus = DHT_BUS(D, sensors, TEST_SENSORS);
+	unsigned long failures = 0, starts;
+	unsigned l, k;
+	uint8_t i;
+
+	sim_init(1);
+	sim_command("dht_lag 0.000001", "test");
+	srand(1);
+	for (i = 0; i < TEST_SENSORS; i++)
+	{
+		sim_dht_add('D', 5 + i, sensors[i].type);
+	}
+
+	printf("right readings of %u per cell; rows: us per polling pass, "
+		"columns: pulse length factor\n", TEST_READS * TEST_SENSORS);
+	printf("%8s", "");
+	for (k = 0; k < TEST_SKEWS; k++)
+	{
+		printf(" %6.2f", test_skew[k]);
+	}
+	printf("\n");
+	for (l = 0; l < TEST_LOOPS; l++)
+	{
+		printf("%5.0f us", test_loop_us[l]);
+		for (k = 0; k < TEST_SKEWS; k++)
+		{
+			unsigned right = run_cell(&bus, test_loop_us[l], test_skew[k]);
+			int must = test_loop_us[l] <= TEST_LOOP_US &&
+				fabs(test_skew[k] - 1) <= TEST_SKEW + 1e-9;
+			int ok = !must || right == TEST_READS * TEST_SENSORS;
+
+			printf(" %5u%c", right, ok ? (must ? ' ' : '.') : '!');
+			failures += !ok;
+		}
+		printf("\n");
+	}
+	printf("' ' must decode, '.' margin, '!' failed\n");
+
+	// more sensors than a port has bits
+	starts = sim_dht_stats.starts;
+	bus.count = DHT_BUS_MAX + 1;
+	for (i = 0; i < bus.count; i++)
+	{
+		sensors[i].status = DHT_OK;
+	}
+	DHT_readBus(&bus);
+	for (i = 0; i < bus.count; i++)
+	{
+		failures += sensors[i].status != DHT_ERROR_TIMEOUT;
+	}
+	if (sim_dht_stats.starts != starts)
+	{
+		printf("a bus of %u sensors was started\n", bus.count);
+		failures++;
+	}
+
+	if (failures)
+	{
+		printf("%lu checks failed\n", failures);
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,298 @@
+// Frequency response of the stages of filter.c on the host against the
+// response of their coefficients in double precision, a biquad pushed into
+// saturation, and the cost of a sample on this host.
+//
+// Build and run from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -Itools/host -I. -o filter_test tools/filter_test.c filter.c -lm
+//   ./filter_test
+//
+// Every stage (a two section biquad lowpass, a biquad highpass, a moving
+// average, the CIC and an FIR decimator) gets sines of TEST_AMPLITUDE at
+// frequencies from DC to Nyquist of its input. Once it has settled, the
+// gain at the output is measured over a whole number of periods and must
+// match |H| of the quantised coefficients within 1 % or TEST_NOISE_LSB
+// times the gain the rounding sees, whichever is larger. A high Q highpass with its coefficients near 2 is
+// fed a full scale square wave, whose products overflow 32 bits; it must
+// follow a double precision model of the same saturating filter. A moving
+// average of length 0 must be rejected. The exit status is 1 if a check
+// fails. Cycle counts on the target come from filter_bench() in the
+// firmware.
+
+#include <complex.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <avr/pgmspace.h>
+#include "filter.h"
+
+#define TEST_AMPLITUDE	16000
+#define TEST_NOISE_LSB	2.0			// rounding noise allowed in the gain
+#define TEST_OUTPUTS	1024		// output samples the gain is taken over
+#define TEST_SETTLE		4096		// input samples before that
+#define TEST_BLOCK		32
+#define TEST_TAPS		15
+
+// Windowed sinc lowpass at a quarter of the input rate, Q15
+static const int16_t test_taps[TEST_TAPS] PROGMEM = {
+	-53, 0, 416, 0, -1887, 0, 9853, 16146, 9853, 0, -1887, 0, 416, 0, -53
+};
+
+enum { TEST_LOWPASS, TEST_HIGHPASS, TEST_AVERAGE, TEST_CIC, TEST_FIR,
+	TEST_STAGES };
+
+static const char * const stage_name[TEST_STAGES] = {"biquad lowpass x2",
+	"biquad highpass", "average 8", "CIC / 4", "FIR / 2"};
+
+typedef struct
+{
+	biquad_coef_t coef[2];
+	biquad_state_t state[2];
+	filter_stage_t stage;
+	uint8_t decimation;
+} test_stage_t;
+
+// History of the average and the FIR, one stage runs at a time
+static int16_t test_history[TEST_TAPS];
+
+static void stage_init(test_stage_t * t, int kind)
+{
+	t->decimation = 1;
+	switch (kind)
+	{
+		case TEST_LOWPASS:
+			filter_biquad_lowpass(&t->coef[0], 0.05f, 0.541f);
+			filter_biquad_lowpass(&t->coef[1], 0.05f, 1.307f);
+			filter_biquad_init(&t->stage, t->coef, t->state, 2);
+			break;
+		case TEST_HIGHPASS:
+			filter_biquad_highpass(&t->coef[0], 0.02f, 0.707f);
+			filter_biquad_init(&t->stage, t->coef, t->state, 1);
+			break;
+		case TEST_AVERAGE:
+			filter_average_init(&t->stage, test_history, 8);
+			break;
+		case TEST_CIC:
+			filter_cic_init(&t->stage, 2);
+			t->decimation = 4;
+			break;
+		default:
+			filter_fir_init(&t->stage, test_taps, test_history, TEST_TAPS, 2);
+			t->decimation = 2;
+			break;
+	}
+}
+
+// |H| of the stage at f cycles per input sample, from its coefficients
+static double response(const test_stage_t * t, int kind, double f)
+{
+	double complex z = cexp(-2 * M_PI * I * f), h = 1;
+	uint8_t s, k;
+
+	switch (kind)
+	{
+		case TEST_LOWPASS:
+		case TEST_HIGHPASS:
+			for (s = 0; s < t->stage.u.biquad.sections; s++)
+			{
+				const biquad_coef_t * c = &t->coef[s];
+
+				h *= (c->b0 + c->b1 * z + c->b2 * z * z) /
+					(FILTER_Q14_ONE + c->a1 * z + c->a2 * z * z);
+			}
+			return cabs(h);
+		case TEST_AVERAGE:
+			h = 0;
+			for (k = 0; k < 8; k++)
+			{
+				h += cpow(z, k) / 8;
+			}
+			return cabs(h);
+		case TEST_CIC:
+			h = 0;
+			for (k = 0; k < 4; k++)
+			{
+				h += cpow(z, k) / 4;
+			}
+			return pow(cabs(h), FILTER_CIC_ORDER);
+		default:
+			h = 0;
+			for (k = 0; k < TEST_TAPS; k++)
+			{
+				h += (int16_t)pgm_read_word(&test_taps[k]) / 32768.0 * cpow(z, k);
+			}
+			return cabs(h);
+	}
+}
+
+// Gain of the rounding of a stage at f: the rounding of a biquad's output
+// goes through its feedback, 1 / A(z), and the sections after it
+static double noise_gain(const test_stage_t * t, int kind, double f)
+{
+	double complex z = cexp(-2 * M_PI * I * f);
+	double gain = 0;
+	uint8_t s;
+
+	if (kind != TEST_LOWPASS && kind != TEST_HIGHPASS)
+	{
+		return 1;
+	}
+	for (s = 0; s < t->stage.u.biquad.sections; s++)
+	{
+		const biquad_coef_t * c = &t->coef[s];
+
+		gain = gain * cabs((c->b0 + c->b1 * z + c->b2 * z * z) /
+			(FILTER_Q14_ONE + c->a1 * z + c->a2 * z * z)) +
+			FILTER_Q14_ONE / cabs(FILTER_Q14_ONE + c->a1 * z + c->a2 * z * z);
+	}
+	return fmax(gain, 1);
+}
+
+// Gain of a stage for a sine of k periods over the inputs of the measured
+// outputs
+static double measure(int kind, unsigned k, double * seconds,
+	unsigned long * samples)
+{
+	test_stage_t t;
+	unsigned long inputs, i = 0;
+	double complex x = 0;
+	unsigned out = 0;
+	double f;
+
+	stage_init(&t, kind);
+	inputs = (unsigned long)TEST_OUTPUTS * t.decimation;
+	f = (double)k / inputs;
+	while (i < TEST_SETTLE + inputs)
+	{
+		int16_t block[TEST_BLOCK];
+		uint8_t n, j;
+		clock_t start;
+
+		for (j = 0; j < TEST_BLOCK; j++, i++)
+		{
+			block[j] = (int16_t)lrint(TEST_AMPLITUDE * cos(2 * M_PI * f * i));
+		}
+		start = clock();
+		n = filter_stage_run(&t.stage, block, TEST_BLOCK);
+		*seconds += (double)(clock() - start) / CLOCKS_PER_SEC;
+		*samples += TEST_BLOCK;
+
+		// the outputs of the last inputs, i is one past the block
+		for (j = 0; j < n; j++)
+		{
+			unsigned long at = i - TEST_BLOCK + (unsigned long)(j + 1) *
+				t.decimation - 1;
+
+			if (at >= TEST_SETTLE && out < TEST_OUTPUTS)
+			{
+				x += block[j] * cexp(-2 * M_PI * I * f * at);
+				out++;
+			}
+		}
+	}
+	// a sine that aliases to DC or Nyquist adds to its mirror image
+	return cabs(x) * (k % (TEST_OUTPUTS / 2) ? 2 : 1) / TEST_OUTPUTS /
+		TEST_AMPLITUDE;
+}
+
+// Double precision direct form I with the same Q14 coefficients, rounding
+// and saturation as filter_biquad_run()
+static int16_t model_biquad(const biquad_coef_t * c, double * s, int16_t x)
+{
+	double acc = (double)c->b0 * x + (double)c->b1 * s[0] +
+		(double)c->b2 * s[1] - (double)c->a1 * s[2] - (double)c->a2 * s[3];
+	double y = floor((acc + FILTER_Q14_ONE / 2) / FILTER_Q14_ONE);
+
+	y = y > 32767 ? 32767 : y < -32768 ? -32768 : y;
+	s[1] = s[0];
+	s[0] = x;
+	s[3] = s[2];
+	s[2] = y;
+	return (int16_t)y;
+}
+
+// A resonant lowpass with a1 near -2 and a DC gain of several hundred:
+// with the state at full scale the sum of its products needs 33 bits, and
+// every edge of the square wave swings it from one end to the other.
+static int check_saturation(void)
+{
+	const biquad_coef_t coef = {30000, 30000, 30000, -32000, 15700};
+	biquad_state_t state;
+	filter_stage_t stage;
+	double s[4] = {0, 0, 0, 0};
+	unsigned long i, wrong = 0, clipped = 0;
+
+	filter_biquad_init(&stage, &coef, &state, 1);
+	for (i = 0; i < 20000; i++)
+	{
+		int16_t x = (i / 500) & 1 ? 32767 : -32768, y = x, want;
+
+		filter_stage_run(&stage, &y, 1);
+		want = model_biquad(&coef, s, x);
+		wrong += y != want;
+		clipped += want == 32767 || want == -32768;
+	}
+	printf("saturation: b1 %d a1 %d a2 %d, %lu of 20000 outputs clipped, "
+		"%lu differ from the model\n", coef.b1, coef.a1, coef.a2, clipped,
+		wrong);
+	return wrong == 0 && clipped > 0;
+}
+
+int main(void)
+{
+	// periods over TEST_OUTPUTS input samples, none of them aliasing to DC
+	// or Nyquist at the output of a decimator
+	static const unsigned periods[] = {0, 5, 20, 51, 102, 205, 307, 410, 480,
+		511};
+	double seconds[TEST_STAGES] = {0};
+	unsigned long samples[TEST_STAGES] = {0}, failures = 0;
+	filter_stage_t rejected;
+	int16_t history[1];
+	int kind;
+	unsigned p;
+
+	printf("%-18s %9s %10s %10s %8s\n", "stage", "f/fs in", "gain",
+		"expected", "dB");
+	for (kind = 0; kind < TEST_STAGES; kind++)
+	{
+		test_stage_t t;
+
+		stage_init(&t, kind);
+		for (p = 0; p < sizeof(periods) / sizeof(periods[0]); p++)
+		{
+			// the same frequencies relative to the input rate; decimating
+			// stages alias them at their output
+			unsigned k = periods[p] * t.decimation;
+			double f = (double)periods[p] / TEST_OUTPUTS;
+			double gain = measure(kind, k, &seconds[kind], &samples[kind]);
+			double want = response(&t, kind, f);
+			int ok = fabs(gain - want) <= fmax(0.01 * want, TEST_NOISE_LSB *
+				noise_gain(&t, kind, f) / TEST_AMPLITUDE);
+
+			printf("%-18s %9.4f %10.5f %10.5f %8.1f%s\n", stage_name[kind], f,
+				gain, want, 20 * log10(fmax(gain, 1e-6)), ok ? "" : "  FAIL");
+			failures += !ok;
+		}
+	}
+
+	failures += !check_saturation();
+	if (filter_average_init(&rejected, history, 0))
+	{
+		printf("a moving average of length 0 was accepted\n");
+		failures++;
+	}
+
+	printf("\nns per input sample on this host:");
+	for (kind = 0; kind < TEST_STAGES; kind++)
+	{
+		printf(" %s %.1f%s", stage_name[kind], seconds[kind] * 1e9 /
+			samples[kind], kind + 1 < TEST_STAGES ? "," : "\n");
+	}
+	if (failures)
+	{
+		printf("%lu checks failed\n", failures);
+	}
+	return failures ? 1 : 0;
+}
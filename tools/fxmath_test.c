@@ -0,0 +1,269 @@
+// Accuracy check of fxmath.c against libm on the host. Every function is
+// compared with the exactly rounded (integer products) or double precision
+// (libm) result and the largest error is checked against the bound
+// documented in fxmath.h.
+//
+// Build and run from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -Itools/host -I. -o fxmath_test tools/fxmath_test.c fxmath.c -lm
+//   ./fxmath_test [-f]
+//
+// fx_sin/fx_cos are always run over all 65536 angles and fx_mul_q15 over all
+// 2^32 operand pairs. fx_rsqrt runs over every input below 2^24, fx_atan2
+// over all points with both coordinates in -2048 .. 2047, and both over a
+// stride through the rest; -f runs all 2^32 inputs of both (a few minutes).
+// fx_mul_q31 and fx_normalize3 have larger input spaces and get the edge
+// cases plus pseudo-random operands. The exit status is 1 if a bound is
+// exceeded.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fxmath.h"
+
+#define TEST_STRIDE		65521		// prime, through all bit patterns
+#define TEST_RANDOM		(1UL << 26)
+
+typedef struct
+{
+	const char * name;
+	double bound;           // documented largest error in LSB
+	double worst;
+	double sum;
+	uint64_t count;
+	char where[64];         // argument of the worst case
+} test_t;
+
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t next_random(void)
+{
+	// xorshift64*
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return (uint32_t)((rng * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+// fmt names the arguments, b is unused by single argument formats
+static void record(test_t * t, double error, const char * fmt, long a, long b)
+{
+	error = fabs(error);
+	t->count++;
+	t->sum += error;
+	if (error > t->worst)
+	{
+		t->worst = error;
+		snprintf(t->where, sizeof(t->where), fmt, a, b);
+	}
+}
+
+static int report(const test_t * t)
+{
+	int ok = t->worst <= t->bound;
+
+	printf("%-14s %12llu inputs  max %.3f LSB (bound %.2f)  mean %.4f  %s%s\n",
+		t->name, (unsigned long long)t->count, t->worst, t->bound,
+		t->count ? t->sum / t->count : 0, ok ? "ok" : "FAIL at ",
+		ok ? "" : t->where);
+	return ok;
+}
+
+static void test_mul_q15(test_t * t)
+{
+	long a, b, want, got;
+
+	for (a = INT16_MIN; a <= INT16_MAX; a++)
+	{
+		for (b = INT16_MIN; b <= INT16_MAX; b++)
+		{
+			want = (a * b + 0x4000) >> 15;
+			if (want > INT16_MAX)
+			{
+				want = INT16_MAX;
+			}
+			got = fx_mul_q15(a, b);
+			if (got != want)
+			{
+				record(t, got - want, "%ld * %ld", a, b);
+			}
+			else
+			{
+				t->count++;
+			}
+		}
+	}
+}
+
+static void check_mul_q31(test_t * t, int32_t a, int32_t b)
+{
+	int64_t want = ((int64_t)a * b + (1LL << 30)) >> 31;
+
+	if (want > INT32_MAX)
+	{
+		want = INT32_MAX;
+	}
+	record(t, (double)(fx_mul_q31(a, b) - want), "%ld * %ld", a, b);
+}
+
+static void test_mul_q31(test_t * t)
+{
+	static const int32_t edge[] = {INT32_MIN, INT32_MIN + 1, -65536, -65535,
+		-32768, -2, -1, 0, 1, 2, 32767, 32768, 65535, 65536, 0x3FFFFFFF,
+		0x40000000, INT32_MAX - 1, INT32_MAX};
+	unsigned i, j;
+	unsigned long n;
+
+	for (i = 0; i < sizeof(edge) / sizeof(edge[0]); i++)
+	{
+		for (j = 0; j < sizeof(edge) / sizeof(edge[0]); j++)
+		{
+			check_mul_q31(t, edge[i], edge[j]);
+		}
+	}
+	for (n = 0; n < TEST_RANDOM; n++)
+	{
+		check_mul_q31(t, (int32_t)next_random(), (int32_t)next_random());
+	}
+}
+
+static void check_rsqrt(test_t * t, uint32_t x)
+{
+	double want = 16777216.0 / sqrt((double)x);
+	record(t, fx_rsqrt(x) - want, "x = %ld", (long)x, 0);
+}
+
+static void test_rsqrt(test_t * t, int full)
+{
+	uint64_t x;
+
+	for (x = 1; x < (1UL << 24); x++)
+	{
+		check_rsqrt(t, x);
+	}
+	for (x = 1UL << 24; x <= UINT32_MAX; x += full ? 1 : TEST_STRIDE)
+	{
+		check_rsqrt(t, x);
+	}
+	check_rsqrt(t, UINT32_MAX);
+}
+
+static void test_sin_cos(test_t * sin_t, test_t * cos_t)
+{
+	long a;
+	double w, s, c;
+
+	for (a = 0; a < 65536; a++)
+	{
+		w = 2 * M_PI * a / 65536;
+		s = fmin(fmax(32768 * sin(w), -32767), 32767);
+		c = fmin(fmax(32768 * cos(w), -32767), 32767);
+		record(sin_t, fx_sin(a) - s, "angle %ld", a, 0);
+		record(cos_t, fx_cos(a) - c, "angle %ld", a, 0);
+	}
+}
+
+static void check_atan2(test_t * t, int16_t y, int16_t x)
+{
+	double want, d;
+
+	if (x == 0 && y == 0)
+	{
+		return;
+	}
+	want = atan2(y, x) * 32768 / M_PI;
+	// compare on the circle, pi and -pi are the same angle
+	d = fmod(fx_atan2(y, x) - want + 98304.0, 65536.0) - 32768;
+	record(t, d, "y %ld x %ld", y, x);
+}
+
+static void test_atan2(test_t * t, int full)
+{
+	uint64_t n;
+
+	for (n = 0; n < (1UL << 24); n++)
+	{
+		check_atan2(t, (int16_t)(n >> 12) - 2048, (int16_t)(n & 0xFFF) - 2048);
+	}
+	for (n = 0; n <= UINT32_MAX; n += full ? 1 : TEST_STRIDE)
+	{
+		check_atan2(t, (int16_t)(n >> 16), (int16_t)n);
+	}
+}
+
+static void check_normalize3(test_t * t, int16_t x, int16_t y, int16_t z)
+{
+	int16_t v[3] = {x, y, z};
+	q15_t out[3];
+	double norm = sqrt((double)x * x + (double)y * y + (double)z * z), want;
+	int i;
+
+	if (!fx_normalize3(v, out))
+	{
+		if (norm != 0)
+		{
+			record(t, 1e9, "x %ld y %ld (no result)", x, y);
+		}
+		return;
+	}
+	for (i = 0; i < 3; i++)
+	{
+		want = fmin(fmax(32768 * v[i] / norm, -32767), 32767);
+		record(t, out[i] - want, "x %ld y %ld", x, y);
+	}
+}
+
+static void test_normalize3(test_t * t)
+{
+	int x, y, z;
+	unsigned long n;
+
+	// short vectors, where the normalising shift is largest
+	for (x = -16; x <= 16; x++)
+	{
+		for (y = -16; y <= 16; y++)
+		{
+			for (z = -16; z <= 16; z++)
+			{
+				check_normalize3(t, x, y, z);
+			}
+		}
+	}
+	check_normalize3(t, INT16_MIN, INT16_MIN, INT16_MIN);
+	check_normalize3(t, INT16_MIN, 0, 0);
+	check_normalize3(t, INT16_MAX, INT16_MAX, INT16_MAX);
+	for (n = 0; n < TEST_RANDOM; n++)
+	{
+		uint32_t r = next_random();
+		// random magnitudes too, not only full scale vectors
+		int shift = r & 15;
+		check_normalize3(t, (int16_t)(r >> 16) >> shift,
+			(int16_t)next_random() >> shift, (int16_t)r >> shift);
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	test_t mul15 = {"fx_mul_q15", 0}, mul31 = {"fx_mul_q31", 0};
+	test_t rsqrt_t = {"fx_rsqrt", 0.51}, sin_t = {"fx_sin", 1.5};
+	test_t cos_t = {"fx_cos", 1.5}, atan2_t = {"fx_atan2", 1.5};
+	test_t norm = {"fx_normalize3", 1};
+	int full = argc > 1 && strcmp(argv[1], "-f") == 0, ok = 1;
+
+	test_sin_cos(&sin_t, &cos_t);
+	ok &= report(&sin_t);
+	ok &= report(&cos_t);
+	test_atan2(&atan2_t, full);
+	ok &= report(&atan2_t);
+	test_rsqrt(&rsqrt_t, full);
+	ok &= report(&rsqrt_t);
+	test_normalize3(&norm);
+	ok &= report(&norm);
+	test_mul_q31(&mul31);
+	ok &= report(&mul31);
+	test_mul_q15(&mul15);
+	ok &= report(&mul15);
+	return !ok;
+}
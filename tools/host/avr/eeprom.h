@@ -0,0 +1,16 @@
+#ifndef HOST_EEPROM_H_INCLUDED
+#define HOST_EEPROM_H_INCLUDED
+
+// Host build stand-in for <avr/eeprom.h>. A host tool that reads or writes
+// EEPROM links a definition of each function it needs, over an array of its
+// own.
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#define EEMEM
+
+void eeprom_read_block(void * dst, const void * src, size_t n);
+void eeprom_update_block(const void * src, void * dst, size_t n);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef HOST_INTERRUPT_H_INCLUDED
+#define HOST_INTERRUPT_H_INCLUDED
+
+// Host build stand-in for <avr/interrupt.h>. An ISR becomes a plain function
+// the host tool calls to simulate the interrupt.
+
+#define ISR(vector)		void vector(void)
+#define sei()
+#define cli()
+
+#endif
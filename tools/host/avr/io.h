@@ -0,0 +1,43 @@
+#ifndef HOST_IO_H_INCLUDED
+#define HOST_IO_H_INCLUDED
+
+// Host build stand-in for <avr/io.h> (ATmega1284P). Only the names the
+// firmware uses are declared; a host tool that touches them links a
+// definition of each register it needs. The pin registers are read through
+// host_pin(), so a simulated device can bring the level on the wire up to
+// date with what was just written to PORTx and DDRx.
+
+#include <inttypes.h>
+
+extern volatile uint8_t PORTA, DDRA, host_PINA;
+extern volatile uint8_t PORTB, DDRB, host_PINB;
+extern volatile uint8_t PORTC, DDRC, host_PINC;
+extern volatile uint8_t PORTD, DDRD, host_PIND;
+
+volatile uint8_t * host_pin(volatile uint8_t * pin);
+
+#define PINA	(*host_pin(&host_PINA))
+#define PINB	(*host_pin(&host_PINB))
+#define PINC	(*host_pin(&host_PINC))
+#define PIND	(*host_pin(&host_PIND))
+
+#define PA0		0
+#define PA1		1
+
+extern volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, TIMSK0, TIFR0;
+
+#define CS00	0
+#define CS02	2
+#define WGM01	1
+#define OCIE0A	1
+#define OCF0A	1
+
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+extern volatile uint16_t TCNT1;
+
+#define CS10	0
+#define CS11	1
+#define TOV1	0
+#define TOIE1	0
+
+#endif
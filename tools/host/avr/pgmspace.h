@@ -0,0 +1,14 @@
+#ifndef HOST_PGMSPACE_H_INCLUDED
+#define HOST_PGMSPACE_H_INCLUDED
+
+// Host build stand-in for <avr/pgmspace.h>: flash data is ordinary memory
+
+#include <inttypes.h>
+
+#define PROGMEM
+#define PSTR(s)				(s)
+#define pgm_read_byte(p)	(*(const uint8_t *)(p))
+#define pgm_read_word(p)	(*(const uint16_t *)(p))
+#define pgm_read_dword(p)	(*(const uint32_t *)(p))
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef HOST_ATOMIC_H_INCLUDED
+#define HOST_ATOMIC_H_INCLUDED
+
+// Host build stand-in for <util/atomic.h>, host tools are single threaded
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type)	for (int atomic_once = 1; atomic_once; atomic_once = 0)
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef HOST_DELAY_H_INCLUDED
+#define HOST_DELAY_H_INCLUDED
+
+// Host build stand-in for <util/delay.h>. Busy waits become calls into the
+// host tool, which advances its simulated time instead of sleeping.
+
+void host_delay_us(double us);
+
+#define _delay_us(us)	host_delay_us(us)
+#define _delay_ms(ms)	host_delay_us((ms) * 1000.0)
+
+#endif
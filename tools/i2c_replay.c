@@ -0,0 +1,338 @@
+// Replay of an I2C trace (see i2c_trace.h) against the host build of
+// mpu9250.c. The trace stands in for the devices: every transaction the
+// driver issues is matched against the next recorded one, reads get the
+// recorded data and status, writes must carry the recorded data. The trace
+// holds every attempt, a transaction takes the failed attempts it recorded
+// up to the retries i2c_txn.c allows it and ends with the attempt that
+// succeeded or the last one. The first transaction that differs stops the
+// run, so a driver change that alters the bus traffic of a captured session
+// is caught.
+//
+// Build and run from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -Itools/host -I. -o i2c_replay tools/i2c_replay.c mpu9250.c
+//   ./i2c_replay [-c] trace.txt
+//
+// The driver runs the boot sequence of main.c: mpu_calibrate(), without the
+// accelerometer bias if -c says the unit had an accelerometer calibration in
+// EEPROM, mpu_init() and mpu_configure() with the accelerometer streaming
+// through the FIFO. After that each remaining record is handed to the driver
+// call that produces it: accelerometer reads, FIFO drains and plain register
+// reads. Lines of the dump that are not trace records are skipped, so a raw
+// serial log can be replayed as it is. The traces under tools/traces, made
+// by tools/i2c_trace_sim.c, must replay clean:
+//
+//   ./i2c_replay tools/traces/main_loop.txt
+//   ./i2c_replay -c tools/traces/main_loop_calib.txt
+//
+// A record the recorder cut to I2C_TRACE_DATA_MAX bytes (marked '+') is
+// reported with its line: a read hands the driver only the bytes the trace
+// has and leaves the rest of its buffer alone, a write is compared as far as
+// it was kept. Record with a larger I2C_TRACE_DATA_MAX to replay them
+// whole. The exit status is 0 when the whole trace was consumed without a
+// difference and no record was cut.
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "i2c_txn.h"
+#include "mpu9250.h"
+#include "timebase.h"
+
+#define REPLAY_MAX_RECORDS	65536
+
+typedef struct
+{
+	uint32_t time;
+	uint8_t device;
+	uint8_t read;
+	uint8_t reg;
+	uint8_t status;
+	uint8_t count;
+	uint8_t kept;       // data bytes present in the trace
+	uint8_t cut;        // the recorder dropped the rest, kept < count
+	uint8_t data[255];
+	unsigned line;
+} replay_record_t;
+
+typedef struct
+{
+	unsigned transactions;
+	unsigned bytes;
+	unsigned retries;   // failed attempts that were retried
+	unsigned failed;
+	unsigned truncated;
+	uint32_t first_time;
+	uint32_t last_time;
+	double delay_us;    // time the driver spent in _delay_ms()/_delay_us()
+} replay_phase_t;
+
+enum I2C_STATUS_t I2C_STATUS = I2C_OK;
+i2c_txn_stats_t i2c_txn_stats;
+
+static replay_record_t * records;
+static unsigned record_count, next_record;
+static replay_phase_t * phase;
+static jmp_buf diverged;
+
+void host_delay_us(double us)
+{
+	phase->delay_us += us;
+}
+
+// Samples are stamped with the time of the transaction that fetches them
+uint32_t timebase_now(void)
+{
+	if (next_record < record_count)
+	{
+		return records[next_record].time;
+	}
+	return record_count ? records[record_count - 1].time : 0;
+}
+
+static int hex_byte(const char * s, uint8_t * out)
+{
+	unsigned v;
+	if (sscanf(s, "%2x", &v) != 1)
+	{
+		return 0;
+	}
+	*out = v;
+	return 1;
+}
+
+static void load(FILE * f)
+{
+	char line[1024], dir, data[600];
+	unsigned long time;
+	unsigned device, reg, status, count, n = 0;
+
+	records = calloc(REPLAY_MAX_RECORDS, sizeof(*records));
+	while (fgets(line, sizeof(line), f) && record_count < REPLAY_MAX_RECORDS)
+	{
+		replay_record_t * r = &records[record_count];
+		int fields;
+
+		n++;
+		data[0] = 0;
+		fields = sscanf(line, "%8lx %2x %c %2x %1u %2x %599s",
+			&time, &device, &dir, &reg, &status, &count, data);
+		if (fields < 6 || (dir != 'R' && dir != 'W'))
+		{
+			continue;
+		}
+		r->time = time;
+		r->device = device;
+		r->read = dir == 'R';
+		r->reg = reg;
+		r->status = status;
+		r->count = count;
+		r->line = n;
+		for (r->kept = 0; r->kept < count &&
+			hex_byte(&data[2 * r->kept], &r->data[r->kept]); r->kept++)
+			;
+		r->cut = r->kept < count;
+		if (r->cut && data[2 * r->kept] != '+')
+		{
+			printf("line %u: %u of %u data bytes without the mark of a cut "
+				"record, the line is damaged\n", n, r->kept, count);
+		}
+		record_count++;
+	}
+}
+
+static void report_divergence(const char * what, int read, uint8_t device,
+	uint8_t reg, uint8_t count)
+{
+	printf("diverged: driver %s %c %02X reg %02X count %u",
+		what, read ? 'R' : 'W', device, reg, count);
+	if (next_record < record_count)
+	{
+		const replay_record_t * r = &records[next_record];
+		printf(", trace line %u has %c %02X reg %02X count %u\n", r->line,
+			r->read ? 'R' : 'W', r->device, r->reg, r->count);
+	}
+	else
+	{
+		printf(", trace ended\n");
+	}
+	longjmp(diverged, 1);
+}
+
+// One attempt: consume the next record if it is this transaction
+static const replay_record_t * replay_attempt(int read, uint8_t device,
+	uint8_t reg, uint8_t * data, uint8_t count)
+{
+	replay_record_t * r;
+
+	if (next_record >= record_count)
+	{
+		report_divergence("issued", read, device, reg, count);
+	}
+	r = &records[next_record];
+	if (r->read != read || r->device != device || r->reg != reg ||
+		r->count != count)
+	{
+		report_divergence("issued", read, device, reg, count);
+	}
+	if (!read && memcmp(data, r->data, r->kept) != 0)
+	{
+		report_divergence("wrote other data to", read, device, reg, count);
+	}
+	if (read)
+	{
+		memcpy(data, r->data, r->kept);
+	}
+	if (r->cut)
+	{
+		printf("line %u: %c %02X reg %02X cut to %u of %u bytes, the %s\n",
+			r->line, read ? 'R' : 'W', device, reg, r->kept, count, read ?
+			"driver didn't get the rest" : "rest wasn't compared");
+	}
+
+	if (phase->transactions == 0)
+	{
+		phase->first_time = r->time;
+	}
+	phase->last_time = r->time;
+	phase->truncated += r->cut;
+	next_record++;
+	return r;
+}
+
+// The simulated bus: a transaction with up to retries retries, as
+// i2c_txn_run() makes it
+static enum I2C_STATUS_t replay(int read, uint8_t retries, uint8_t device,
+	uint8_t reg, uint8_t * data, uint8_t count)
+{
+	const replay_record_t * r = replay_attempt(read, device, reg, data,
+		count);
+	uint8_t attempt;
+
+	for (attempt = 0; attempt < retries && r->status != I2C_OK; attempt++)
+	{
+		phase->retries++;
+		r = replay_attempt(read, device, reg, data, count);
+	}
+	phase->transactions++;
+	phase->bytes += count;
+	phase->failed += r->status != I2C_OK;
+
+	I2C_STATUS = r->status;
+	return I2C_STATUS;
+}
+
+enum I2C_STATUS_t i2c_txn_write(uint8_t device, uint8_t reg,
+	const uint8_t * data, uint8_t count)
+{
+	return replay(0, I2C_TXN_RETRIES, device, reg, (uint8_t *)data, count);
+}
+
+enum I2C_STATUS_t i2c_txn_read(uint8_t device, uint8_t reg, uint8_t * dest,
+	uint8_t count)
+{
+	return replay(1, I2C_TXN_RETRIES, device, reg, dest, count);
+}
+
+enum I2C_STATUS_t i2c_txn_read_stream(uint8_t device, uint8_t reg,
+	uint8_t * dest, uint8_t count)
+{
+	return replay(1, 0, device, reg, dest, count);
+}
+
+static void print_phase(const char * name, const replay_phase_t * p)
+{
+	printf("%-6s %6u transactions %8u bytes %5u retries %5u failed "
+		"%5u truncated, trace span %lu, driver delays %.1f ms\n", name,
+		p->transactions, p->bytes, p->retries, p->failed, p->truncated,
+		(unsigned long)(p->last_time - p->first_time), p->delay_us / 1000.0);
+}
+
+// Hand the next record to the driver call that issues it
+static void replay_step(mpu9250_t * dev)
+{
+	const replay_record_t * r = &records[next_record];
+	uint8_t buffer[MPU_FIFO_SIZE];
+	enum MPU_STATUS_t status;
+
+	if (r->device == dev->address && r->read && r->reg == ACCEL_XOUT_H &&
+		r->count == 6)
+	{
+		int16_t accel[3];
+		mpu_read_accel(dev, accel);
+	}
+	else if (r->device == dev->address && r->read && r->reg == INT_STATUS &&
+		dev->fifo_en)
+	{
+		mpu_fifo_drain(dev, buffer, sizeof(buffer), &status);
+	}
+	else if (r->read && r->count == 1)
+	{
+		mpu_read_byte(r->device, r->reg);
+	}
+	else if (r->read)
+	{
+		mpu_read_bytes(r->device, r->reg, r->count, buffer);
+	}
+	else
+	{
+		report_divergence("has no call for", r->read, r->device, r->reg,
+			r->count);
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	replay_phase_t boot = {0}, loop = {0};
+	mpu9250_t imu = MPU9250_DEVICE(MPU9250_ADDRESS);
+	const mpu_config_t stream = {MPU_GSCALE, MPU_ASCALE, MPU_DLPF_CFG,
+		MPU_A_DLPF_CFG, MPU_SMPLRT_DIV, MPU_FIFO_ACCEL};
+	float gyroBias[3] = {0, 0, 0}, accelBias[3] = {0, 0, 0};
+	int calibrated = argc == 3 && !strcmp(argv[1], "-c");
+	FILE * f;
+	volatile int ok = 1;
+
+	if (argc != 2 + calibrated || !(f = fopen(argv[1 + calibrated], "r")))
+	{
+		fprintf(stderr, "usage: %s [-c] trace.txt\n", argv[0]);
+		return 2;
+	}
+	load(f);
+	fclose(f);
+	printf("%u records\n", record_count);
+
+	if (setjmp(diverged) == 0)
+	{
+		phase = &boot;
+		mpu_calibrate(&imu, gyroBias, calibrated ? NULL : accelBias);
+		mpu_init(&imu);
+		mpu_configure(&imu, &stream);
+
+		phase = &loop;
+		while (next_record < record_count)
+		{
+			replay_step(&imu);
+		}
+	}
+	else
+	{
+		ok = 0;
+	}
+
+	print_phase("boot", &boot);
+	print_phase("loop", &loop);
+	printf("gyro bias %.3f %.3f %.3f dps, accel bias %.4f %.4f %.4f g\n",
+		gyroBias[0], gyroBias[1], gyroBias[2],
+		accelBias[0], accelBias[1], accelBias[2]);
+	printf("%s after %u of %u records\n", ok ? "replayed" : "stopped",
+		next_record, record_count);
+	if (boot.truncated + loop.truncated)
+	{
+		printf("%u records were cut by the recorder\n",
+			boot.truncated + loop.truncated);
+		ok = 0;
+	}
+	return ok ? 0 : 1;
+}
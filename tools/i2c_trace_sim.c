@@ -0,0 +1,104 @@
+// I2C trace of the boot and main loop of main.c recorded on the MPU-9250
+// model of tools/sim through i2c_trace.c, for tools/i2c_replay.c when no
+// board is at hand and for the traces under tools/traces.
+//
+// Build and run from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -DI2C_TRACE_ENABLE=1 -DI2C_TRACE_SIZE=32768 -DI2C_TRACE_DATA_MAX=255
+//       -Itools/host -Itools/sim -I. -o i2c_trace_sim tools/i2c_trace_sim.c
+//       tools/sim/sim_world.c tools/sim/sim_mpu.c tools/sim/sim_dht.c
+//       i2c_trace.c mpu9250.c -lm
+//   ./i2c_trace_sim [-c] [-n nak] [-p passes] > trace.txt
+//
+// The driver boots as main.c does: mpu_calibrate(), without the
+// accelerometer bias when -c says an accelerometer calibration was loaded
+// from EEPROM, mpu_init() and mpu_configure() with the accelerometer
+// streaming through the FIFO. Then -p passes of the main loop (default 3)
+// read the AK8963's WHO_AM_I for the LCD and drain the FIFO once per sample
+// period for TRACE_REFRESH_US. -n is the chance of a NAK per attempt
+// (default 0), so the trace holds retried transactions. The dump goes to
+// stdout after a comment line with the options; the exit status is 1 if the
+// ring dropped records.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "i2c_trace.h"
+#include "mpu9250.h"
+#include "sim.h"
+#include "timebase.h"
+
+#define TRACE_REFRESH_US	100000
+
+static void trace_putchar(char c)
+{
+	putchar(c);
+}
+
+int main(int argc, char ** argv)
+{
+	mpu9250_t imu = MPU9250_DEVICE(MPU9250_ADDRESS);
+	const mpu_config_t stream = {MPU_GSCALE, MPU_ASCALE, MPU_DLPF_CFG,
+		MPU_A_DLPF_CFG, MPU_SMPLRT_DIV, MPU_FIFO_ACCEL};
+	float gyroBias[3], accelBias[3];
+	uint8_t fifo[16 * 6];
+	enum MPU_STATUS_t status;
+	int calibrated = 0, passes = 3, opt, p;
+	double nak = 0;
+	char line[32];
+	uint64_t shown;
+
+	while ((opt = getopt(argc, argv, "cn:p:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'c':
+			calibrated = 1;
+			break;
+		case 'n':
+			nak = atof(optarg);
+			break;
+		case 'p':
+			passes = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-c] [-n nak] [-p passes]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+
+	sim_init(1);
+	sim_mpu_init();
+	snprintf(line, sizeof(line), "mpu_nak %g", nak);
+	sim_command(line, "trace");
+	// the recorder's clock is the simulated timebase
+	i2c_trace_start(timebase_now);
+
+	mpu_calibrate(&imu, gyroBias, calibrated ? NULL : accelBias);
+	mpu_init(&imu);
+	mpu_configure(&imu, &stream);
+	for (p = 0; p < passes; p++)
+	{
+		mpu_read_byte(AK8963_ADDRESS, WHO_AM_I_AK8963);
+		shown = sim.now_us;
+		while (sim.now_us - shown < TRACE_REFRESH_US)
+		{
+			mpu_fifo_drain(&imu, fifo, sizeof(fifo), &status);
+			sim_advance(1000000UL / MPU_SAMPLE_RATE_HZ);
+		}
+	}
+	i2c_trace_stop();
+
+	printf("# i2c_trace_sim%s -n %g -p %d\n", calibrated ? " -c" : "", nak,
+		passes);
+	i2c_trace_dump(trace_putchar);
+	if (i2c_trace_stats.dropped)
+	{
+		fprintf(stderr, "%u records dropped, the ring is too small\n",
+			i2c_trace_stats.dropped);
+		return 1;
+	}
+	return 0;
+}
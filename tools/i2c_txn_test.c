@@ -0,0 +1,380 @@
+// Fault injection test of i2c_txn.c and of the FIFO drain of mpu9250.c: the
+// routines of i2cmaster.S are replaced by a byte level model of one slave
+// that can refuse its address, stretch SCL past the limit in the middle of
+// a read and hold SDA low.
+//
+// Build and run from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -DI2C_TRACE_ENABLE=1 -Itools/host -I. -o i2c_txn_test
+//       tools/i2c_txn_test.c i2c_txn.c i2c_trace.c mpu9250.c -lm
+//   ./i2c_txn_test
+//
+// Every byte on the wire costs I2C_TXN_BYTE_US, a stretch cut off by
+// i2cmaster.S I2C_TXN_STRETCH_US. A register read must come through two
+// refused addresses and a stretch timeout followed by a bus recovery with
+// the right data, fail with I2C_ERROR_NAK after three refusals and with
+// I2C_ERROR_BUS on a bus held low for good, each within I2C_TXN_WORST_US().
+// The recorder of i2c_trace.c must hold one record per attempt, the failed
+// ones with their status and the last with the status of the read.
+// A FIFO drain whose second burst times out must read FIFO_R_W only once
+// per burst, reset the FIFO, report MPU_ERROR_BUS and return the whole
+// packets of the first burst in order. The exit status is 1 if a check
+// fails.
+
+#include <stdio.h>
+#include <string.h>
+#include <avr/io.h>
+#include "i2cmaster.h"
+#include "i2c_txn.h"
+#include "i2c_trace.h"
+#include "mpu9250.h"
+#include "timebase.h"
+
+#define TEST_FIFO_PACKETS	30			// 360 bytes, two bursts
+#define TEST_STUCK			0xFF		// SDA held low whatever is clocked
+
+// The slave at MPU9250_ADDRESS and the faults armed for it
+static struct
+{
+	uint8_t regs[128];
+	uint8_t reg;              // register pointer
+	uint8_t addressed;        // the slave has acknowledged its address
+	uint8_t first;            // the next written byte is the register
+	uint16_t fifo_pos;        // bytes taken out of the FIFO since its reset
+	uint16_t fifo_count;      // bytes queued
+	uint8_t naks;             // address bytes still to refuse
+	int16_t stretch_after;    // read bytes before SCL is held, -1 for never
+	uint8_t sda_hold;         // SCL pulses until SDA is let go, TEST_STUCK
+	uint16_t fifo_reads;      // transactions that read FIFO_R_W
+	uint16_t fifo_resets;
+} slave;
+
+static uint32_t now_us;
+
+unsigned char i2c_timeout;
+volatile uint8_t PORTC, DDRC, host_PINC;
+
+// SCL is bit 0 and SDA bit 1 of port C, both pulled up unless driven or
+// held
+volatile uint8_t * host_pin(volatile uint8_t * pin)
+{
+	*pin = 0x03 & ~DDRC;
+	if (slave.sda_hold)
+	{
+		*pin &= ~0x02;
+	}
+	return pin;
+}
+
+// Every SCL low phase of a recovery clocks one bit out of a held slave
+void host_delay_us(double us)
+{
+	if ((DDRC & 0x01) && slave.sda_hold && slave.sda_hold != TEST_STUCK)
+	{
+		slave.sda_hold--;
+	}
+	now_us += (uint32_t)us;
+}
+
+uint32_t timebase_now(void)
+{
+	return now_us;
+}
+
+// A FIFO byte tells where in the stream it was: its offset in the packet
+// and the packet number
+static uint8_t fifo_byte(uint16_t pos)
+{
+	return (uint8_t)((pos % 12) | ((pos / 12 & 0x0F) << 4));
+}
+
+void i2c_init(void)
+{
+}
+
+void i2c_stop(void)
+{
+	slave.addressed = 0;
+}
+
+unsigned char i2c_start(unsigned char addr)
+{
+	now_us += I2C_TXN_BYTE_US;
+	slave.addressed = 0;
+	if (slave.sda_hold || (addr >> 1) != MPU9250_ADDRESS)
+	{
+		return 1;
+	}
+	if (slave.naks)
+	{
+		slave.naks--;
+		return 1;
+	}
+	slave.addressed = 1;
+	slave.first = !(addr & I2C_READ);
+	if ((addr & I2C_READ) && slave.reg == FIFO_R_W)
+	{
+		slave.fifo_reads++;
+	}
+	return 0;
+}
+
+unsigned char i2c_rep_start(unsigned char addr)
+{
+	return i2c_start(addr);
+}
+
+unsigned char i2c_write(unsigned char data)
+{
+	now_us += I2C_TXN_BYTE_US;
+	if (!slave.addressed)
+	{
+		return 1;
+	}
+	if (slave.first)
+	{
+		slave.reg = data & 0x7F;
+		slave.first = 0;
+		return 0;
+	}
+	if (slave.reg == USER_CTRL && (data & 0x04))
+	{
+		slave.fifo_resets++;
+		slave.fifo_pos = 0;
+		slave.fifo_count = 0;
+		data &= ~0x04;
+	}
+	slave.regs[slave.reg++ & 0x7F] = data;
+	return 0;
+}
+
+static unsigned char slave_read(void)
+{
+	uint8_t value;
+
+	now_us += I2C_TXN_BYTE_US;
+	if (slave.stretch_after == 0)
+	{
+		// cut off by i2cmaster.S with the slave in the middle of its byte
+		slave.stretch_after = -1;
+		slave.sda_hold = 4;
+		slave.addressed = 0;
+		i2c_timeout = 1;
+		now_us += I2C_TXN_STRETCH_US;
+		return 0xFF;
+	}
+	if (slave.stretch_after > 0)
+	{
+		slave.stretch_after--;
+	}
+	if (!slave.addressed)
+	{
+		return 0xFF;
+	}
+	if (slave.reg == FIFO_R_W)
+	{
+		if (!slave.fifo_count)
+		{
+			return 0xFF;
+		}
+		slave.fifo_count--;
+		return fifo_byte(slave.fifo_pos++);
+	}
+	if (slave.reg == FIFO_COUNTH)
+	{
+		slave.regs[FIFO_COUNTH] = slave.fifo_count >> 8;
+		slave.regs[FIFO_COUNTH + 1] = slave.fifo_count & 0xFF;
+	}
+	value = slave.regs[slave.reg];
+	slave.reg = (slave.reg + 1) & 0x7F;
+	return value;
+}
+
+unsigned char i2c_readAck(void)
+{
+	return slave_read();
+}
+
+unsigned char i2c_readNak(void)
+{
+	return slave_read();
+}
+
+static void slave_reset(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < 6; i++)
+	{
+		slave.regs[ACCEL_XOUT_H + i] = 0x10 + i;
+	}
+	slave.regs[WHO_AM_I_MPU] = 0x71;
+	memset(&i2c_txn_stats, 0, sizeof(i2c_txn_stats));
+	slave.naks = 0;
+	slave.stretch_after = -1;
+	slave.sda_hold = 0;
+}
+
+// Text of i2c_trace_dump()
+static char dump[I2C_TRACE_SIZE * 4];
+static unsigned dump_len;
+
+static void dump_put(char c)
+{
+	if (dump_len + 1 < sizeof(dump))
+	{
+		dump[dump_len++] = c;
+		dump[dump_len] = 0;
+	}
+}
+
+// Attempts in the trace and their statuses, the last one first in *last;
+// returns the number of records with a failed status before the last
+static unsigned trace_attempts(unsigned * records, unsigned * last)
+{
+	unsigned failed = 0, status;
+	const char * line;
+
+	dump_len = 0;
+	dump[0] = 0;
+	i2c_trace_dump(dump_put);
+	*records = 0;
+	*last = I2C_OK;
+	for (line = dump; *line; line = strchr(line, '\n') + 1)
+	{
+		if (sscanf(line, "%*8x %*2x %*c %*2x %1u", &status) != 1)
+		{
+			break;
+		}
+		failed += status != I2C_OK;
+		*last = status;
+		(*records)++;
+	}
+	return failed - (*last != I2C_OK);
+}
+
+// One register read with the faults armed; returns the checks that failed
+static unsigned check_read(const char * name, uint8_t naks,
+	int16_t stretch_after, uint8_t sda_hold, enum I2C_STATUS_t want)
+{
+	uint8_t data[6] = {0};
+	uint32_t start = now_us, took;
+	enum I2C_STATUS_t status;
+	unsigned failures = 0, records, last, failed;
+	uint8_t i;
+
+	slave_reset();
+	slave.naks = naks;
+	slave.stretch_after = stretch_after;
+	slave.sda_hold = sda_hold;
+	i2c_trace_start(timebase_now);
+	status = i2c_txn_read(MPU9250_ADDRESS, ACCEL_XOUT_H, data, 6);
+	i2c_trace_stop();
+	took = now_us - start;
+	printf("%-22s status %u, %5lu us of %lu, %u retries %u recoveries\n", name,
+		status, (unsigned long)took, (unsigned long)I2C_TXN_WORST_US(6),
+		i2c_txn_stats.retries, i2c_txn_stats.recoveries);
+	if (status != want || I2C_STATUS != want)
+	{
+		printf("%-22s FAIL, status %u instead of %u\n", name, status, want);
+		failures++;
+	}
+	if (took > I2C_TXN_WORST_US(6))
+	{
+		printf("%-22s FAIL, took longer than I2C_TXN_WORST_US\n", name);
+		failures++;
+	}
+	for (i = 0; want == I2C_OK && i < 6; i++)
+	{
+		if (data[i] != 0x10 + i)
+		{
+			printf("%-22s FAIL, byte %u is 0x%02X\n", name, i, data[i]);
+			failures++;
+			break;
+		}
+	}
+	failed = trace_attempts(&records, &last);
+	if (records != i2c_txn_stats.retries + 1u ||
+		failed != i2c_txn_stats.retries || last != want)
+	{
+		printf("%-22s FAIL, %u records with %u failed before a last one of "
+			"status %u\n", name, records, failed, last);
+		failures++;
+	}
+	return failures;
+}
+
+// A drain whose second burst times out; returns the checks that failed
+static unsigned check_drain(void)
+{
+	mpu9250_t dev = MPU9250_DEVICE(MPU9250_ADDRESS);
+	static uint8_t dest[TEST_FIFO_PACKETS * 12];
+	enum MPU_STATUS_t status;
+	unsigned failures = 0;
+	uint16_t bytes, i, resets;
+
+	slave_reset();
+	dev.fifo_en = MPU_FIFO_ACCEL | MPU_FIFO_GYRO;
+	slave.fifo_pos = 0;
+	slave.fifo_count = TEST_FIFO_PACKETS * 12;
+	slave.fifo_reads = 0;
+	resets = slave.fifo_resets;
+	// after INT_STATUS and the count the first burst takes 252 bytes, the
+	// second stops 40 bytes in
+	slave.stretch_after = 3 + 252 + 40;
+	bytes = mpu_fifo_drain(&dev, dest, sizeof(dest), &status);
+	printf("%-22s status %u, %u bytes, %u FIFO reads, %u resets\n",
+		"FIFO drain timeout", status, bytes, slave.fifo_reads,
+		slave.fifo_resets - resets);
+	if (status != MPU_ERROR_BUS)
+	{
+		printf("FIFO drain FAIL, the failed burst wasn't reported\n");
+		failures++;
+	}
+	if (slave.fifo_reads != 2)
+	{
+		printf("FIFO drain FAIL, FIFO_R_W read %u times for two bursts\n",
+			slave.fifo_reads);
+		failures++;
+	}
+	if (slave.fifo_resets - resets != 1 ||
+		dev.fifo_backlog != MPU_FIFO_BACKLOG_UNKNOWN)
+	{
+		printf("FIFO drain FAIL, the FIFO wasn't started over\n");
+		failures++;
+	}
+	if (bytes != 252)
+	{
+		printf("FIFO drain FAIL, %u bytes returned instead of 252\n", bytes);
+		failures++;
+	}
+	for (i = 0; i < bytes; i++)
+	{
+		if (dest[i] != fifo_byte(i))
+		{
+			printf("FIFO drain FAIL, byte %u is 0x%02X, packets shifted\n", i,
+				dest[i]);
+			failures++;
+			break;
+		}
+	}
+	return failures;
+}
+
+int main(void)
+{
+	unsigned failures = 0;
+
+	failures += check_read("two NAKs", 2, -1, 0, I2C_OK);
+	failures += check_read("three NAKs", 3, -1, 0, I2C_ERROR_NAK);
+	failures += check_read("stretch timeout", 0, 1, 0, I2C_OK);
+	failures += check_read("SDA held low", 0, -1, TEST_STUCK, I2C_ERROR_BUS);
+	failures += check_drain();
+
+	if (failures)
+	{
+		printf("%u checks failed\n", failures);
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,212 @@
+// Register model test of mpu_configure(): every profile below is applied to
+// the MPU-9250 model of tools/sim and the configuration registers it ends
+// up with are compared with the values the datasheet asks for, the output
+// rate the model derives from them with mpu_gyro_rate_hz(), and the scale
+// factors with the full scale range. Rejected profiles must not touch the
+// bus.
+//
+// Build and run from the repository root, once as configured and once with
+// runtime full scale ranges:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -Itools/host -Itools/sim -I. -o mpu_config_test tools/mpu_config_test.c
+//       tools/sim/sim_world.c tools/sim/sim_mpu.c tools/sim/sim_dht.c
+//       mpu9250.c -lm
+//   gcc ... -DMPU_RUNTIME_CONFIG=1 ...
+//   ./mpu_config_test
+//
+// Profiles that change the full scale range are only accepted with
+// MPU_RUNTIME_CONFIG; the configured build checks that they are rejected.
+// The exit status is 1 if a register, rate or status is wrong.
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "i2c_txn.h"
+#include "mpu9250.h"
+#include "sim.h"
+
+#define CHECK_US		200000		// time the sample rate is counted over
+
+typedef struct
+{
+	const char * name;
+	mpu_config_t cfg;
+	uint8_t runtime;        // needs MPU_RUNTIME_CONFIG
+	uint8_t valid;
+	// expected SMPLRT_DIV, CONFIG & 0x07, GYRO_CONFIG & 0x1B,
+	// ACCEL_CONFIG & 0x18, ACCEL_CONFIG2 & 0x0F
+	uint8_t reg[5];
+	uint16_t gyro_hz, accel_hz;
+} profile_t;
+
+static const profile_t profiles[] = {
+	{"default 200 Hz", MPU_CONFIG_DEFAULT, 0, 1,
+		{MPU_SMPLRT_DIV, MPU_DLPF_CFG, MPU_GSCALE << 3, MPU_ASCALE << 3,
+		MPU_A_DLPF_CFG}, MPU_SAMPLE_RATE_HZ, MPU_SAMPLE_RATE_HZ},
+	{"1 kHz, 184 Hz", {MPU_GSCALE, MPU_ASCALE, GBW_184HZ, ABW_184HZ, 0, 0},
+		0, 1, {0, 1, MPU_GSCALE << 3, MPU_ASCALE << 3, 1}, 1000, 1000},
+	{"100 Hz, 10 Hz", {MPU_GSCALE, MPU_ASCALE, GBW_10HZ, ABW_10HZ, 9, 0},
+		0, 1, {9, 5, MPU_GSCALE << 3, MPU_ASCALE << 3, 5}, 100, 100},
+	{"8 kHz gyro, FIFO", {MPU_GSCALE, MPU_ASCALE, GBW_250HZ, ABW_460HZ, 0,
+		MPU_FIFO_GYRO}, 0, 1, {0, 0, MPU_GSCALE << 3, MPU_ASCALE << 3, 0},
+		8000, 1000},
+	{"8 kHz gyro, 3600 Hz", {MPU_GSCALE, MPU_ASCALE, GBW_3600HZ_8K,
+		ABW_460HZ, 0, MPU_FIFO_GYRO}, 0, 1,
+		{0, 7, MPU_GSCALE << 3, MPU_ASCALE << 3, 0}, 8000, 1000},
+	{"32 kHz gyro, 3600 Hz", {MPU_GSCALE, MPU_ASCALE, GBW_3600HZ_32K,
+		ABW_460HZ, 0, MPU_FIFO_GYRO}, 0, 1,
+		{0, 0, MPU_GSCALE << 3 | 0x02, MPU_ASCALE << 3, 0}, 32000, 1000},
+	{"32 kHz gyro, 8800 Hz", {MPU_GSCALE, MPU_ASCALE, GBW_8800HZ_32K,
+		ABW_460HZ, 0, MPU_FIFO_GYRO}, 0, 1,
+		{0, 0, MPU_GSCALE << 3 | 0x01, MPU_ASCALE << 3, 0}, 32000, 1000},
+	{"4 kHz accel, FIFO", {MPU_GSCALE, MPU_ASCALE, GBW_41HZ, ABW_1130HZ_4K,
+		0, MPU_FIFO_ACCEL}, 0, 1,
+		{0, 3, MPU_GSCALE << 3, MPU_ASCALE << 3, 0x08}, 1000, 4000},
+	{"8 kHz gyro polled", {MPU_GSCALE, MPU_ASCALE, GBW_250HZ, ABW_460HZ, 0,
+		0}, 0, 0},
+	{"4 kHz accel polled", {MPU_GSCALE, MPU_ASCALE, GBW_41HZ, ABW_1130HZ_4K,
+		0, 0}, 0, 0},
+	{"divider at 8 kHz", {MPU_GSCALE, MPU_ASCALE, GBW_250HZ, ABW_460HZ, 4,
+		MPU_FIFO_GYRO}, 0, 0},
+	{"divider at 32 kHz", {MPU_GSCALE, MPU_ASCALE, GBW_8800HZ_32K,
+		ABW_460HZ, 1, MPU_FIFO_GYRO}, 0, 0},
+	{"bandwidth out of range", {MPU_GSCALE, MPU_ASCALE, GBW_8800HZ_32K + 1,
+		ABW_460HZ, 0, 0}, 0, 0},
+	{"range out of range", {GFS_2000DPS + 1, MPU_ASCALE, GBW_41HZ,
+		ABW_41HZ, 4, 0}, 0, 0},
+	{"500 dps, 4 g", {GFS_500DPS, AFS_4G, GBW_41HZ, ABW_41HZ, 4, 0}, 1, 1,
+		{4, 3, GFS_500DPS << 3, AFS_4G << 3, 3}, 200, 200},
+	{"2000 dps, 16 g, 1 kHz", {GFS_2000DPS, AFS_16G, GBW_92HZ, ABW_92HZ, 0,
+		0}, 1, 1, {0, 2, GFS_2000DPS << 3, AFS_16G << 3, 2}, 1000, 1000},
+	{"1000 dps, 8 g, 32 kHz", {GFS_1000DPS, AFS_8G, GBW_8800HZ_32K,
+		ABW_1130HZ_4K, 0, MPU_FIFO_GYRO | MPU_FIFO_ACCEL}, 1, 1,
+		{0, 0, GFS_1000DPS << 3 | 0x01, AFS_8G << 3, 0x08}, 32000, 4000},
+	{"back to the default", MPU_CONFIG_DEFAULT, 0, 1,
+		{MPU_SMPLRT_DIV, MPU_DLPF_CFG, MPU_GSCALE << 3, MPU_ASCALE << 3,
+		MPU_A_DLPF_CFG}, MPU_SAMPLE_RATE_HZ, MPU_SAMPLE_RATE_HZ},
+};
+
+static const uint8_t regs[5] = {SMPLRT_DIV, CONFIG, GYRO_CONFIG,
+	ACCEL_CONFIG, ACCEL_CONFIG2};
+static const uint8_t masks[5] = {0xFF, 0x07, 0x1B, 0x18, 0x0F};
+
+// The registers as the device holds them, read past the shadow copies
+static void read_regs(uint8_t * out)
+{
+	uint8_t i;
+
+	for (i = 0; i < 5; i++)
+	{
+		out[i] = mpu_read_byte(MPU9250_ADDRESS, regs[i]);
+	}
+	out[5] = mpu_read_byte(MPU9250_ADDRESS, FIFO_EN);
+	out[6] = mpu_read_byte(MPU9250_ADDRESS, USER_CTRL);
+}
+
+static int check_profile(mpu9250_t * dev, const profile_t * p)
+{
+	uint8_t valid = p->valid && (MPU_RUNTIME_CONFIG || !p->runtime);
+	uint8_t before[7], after[7], i;
+	unsigned long transactions, samples;
+	enum MPU_STATUS_t status;
+	int ok = 1;
+
+	read_regs(before);
+	transactions = sim_mpu_stats.transactions;
+	status = mpu_configure(dev, &p->cfg);
+	printf("%-24s %-9s", p->name, status == MPU_OK ? "accepted" :
+		"rejected");
+	if (status != (valid ? MPU_OK : MPU_ERROR_CONFIG))
+	{
+		printf(" FAIL, expected %s\n", valid ? "MPU_OK" : "MPU_ERROR_CONFIG");
+		return 0;
+	}
+	if (!valid)
+	{
+		transactions = sim_mpu_stats.transactions - transactions;
+		read_regs(after);
+		if (transactions || memcmp(before, after, sizeof(before)))
+		{
+			printf(" FAIL, the bus was touched\n");
+			return 0;
+		}
+		printf(" ok\n");
+		return 1;
+	}
+
+	read_regs(after);
+	for (i = 0; i < 5; i++)
+	{
+		if ((after[i] & masks[i]) != p->reg[i])
+		{
+			printf(" FAIL, register 0x%02X is 0x%02X, expected 0x%02X", regs[i],
+				after[i] & masks[i], p->reg[i]);
+			ok = 0;
+		}
+	}
+	if (after[5] != p->cfg.fifo_en ||
+		!(after[6] & 0x40) != !p->cfg.fifo_en)
+	{
+		printf(" FAIL, FIFO_EN 0x%02X USER_CTRL 0x%02X", after[5], after[6]);
+		ok = 0;
+	}
+	if (mpu_gyro_rate_hz(&p->cfg) != p->gyro_hz ||
+		mpu_accel_rate_hz(&p->cfg) != p->accel_hz)
+	{
+		printf(" FAIL, rates %u %u Hz", mpu_gyro_rate_hz(&p->cfg),
+			mpu_accel_rate_hz(&p->cfg));
+		ok = 0;
+	}
+
+	// the model samples at the rate the registers give
+	sim_advance(1000);
+	samples = sim_mpu_stats.samples;
+	sim_advance(CHECK_US);
+	samples = sim_mpu_stats.samples - samples;
+	if (fabs(samples - p->gyro_hz * (CHECK_US / 1e6)) >
+		0.05 * p->gyro_hz * (CHECK_US / 1e6) + 1)
+	{
+		printf(" FAIL, the model samples at %.0f Hz", samples / (CHECK_US / 1e6));
+		ok = 0;
+	}
+
+	// full scale of the conversions
+	if (fabs(mpu_gyro_dps(16384) - (125 << p->cfg.gscale)) > 1e-3 ||
+		fabs(mpu_accel_g(16384) - (1 << p->cfg.ascale)) > 1e-6 ||
+		mpu_gyro_cdps(16384) != (12500L << p->cfg.gscale) ||
+		mpu_accel_mg(16384) != (1000L << p->cfg.ascale))
+	{
+		printf(" FAIL, scale %.3f dps %.4f g", mpu_gyro_dps(16384),
+			mpu_accel_g(16384));
+		ok = 0;
+	}
+	if (ok)
+	{
+		printf(" ok, %u / %u Hz, %d dps, %d g\n", p->gyro_hz, p->accel_hz,
+			250 << p->cfg.gscale, 2 << p->cfg.ascale);
+	}
+	else
+	{
+		printf("\n");
+	}
+	return ok;
+}
+
+int main(void)
+{
+	mpu9250_t imu = MPU9250_DEVICE(MPU9250_ADDRESS);
+	unsigned i, failed = 0;
+
+	sim_init(1);
+	sim_mpu_init();
+	mpu_init(&imu);
+	printf("MPU_RUNTIME_CONFIG %d\n", MPU_RUNTIME_CONFIG);
+	for (i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++)
+	{
+		failed += !check_profile(&imu, &profiles[i]);
+	}
+	printf("%u of %u profiles failed\n", failed,
+		(unsigned)(sizeof(profiles) / sizeof(profiles[0])));
+	return failed ? 1 : 0;
+}
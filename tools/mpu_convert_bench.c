@@ -0,0 +1,215 @@
+// Cost of the raw-to-physical conversions of mpu9250.h on the host, with
+// the scale factors as compile time constants (MPU9250_CONFIG.h) against
+// the two ways of keeping them in SRAM: the mutable range globals the
+// driver used to define in mpu9250.h, converted through a resolution
+// computed from them per sample, and the mpu_scale table of
+// MPU_RUNTIME_CONFIG. Linux on x86 only.
+//
+// Build and run from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -Itools/host -I. -o mpu_convert_bench tools/mpu_convert_bench.c
+//   ./mpu_convert_bench [-n samples]
+//
+// Each variant converts the same -n samples (default 16777216) of three
+// axes of gyro and accelerometer, float and integer, and the cycles of the
+// time stamp counter per sample are the best of five runs. The SRAM
+// variables are volatile: in the firmware a conversion sits between bus
+// transactions, so every sample loads the range again, which a loop the
+// compiler can see through would not. All variants must give the same
+// results; the exit status is 1 if they don't.
+//
+// The SRAM columns count the bytes each variant keeps in .data or .bss
+// with the AVR sizes of its types.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <x86intrin.h>
+#include "mpu9250.h"
+
+#define BENCH_RUNS		5
+
+// Before: the globals mpu9250.h defined, Gscale, Ascale, Mscale, Mmode
+// and the SPI chip select pin
+static volatile uint8_t Gscale = MPU_GSCALE, Ascale = MPU_ASCALE;
+static volatile uint8_t Mscale = MPU_MSCALE, Mmode = MPU_MMODE;
+static volatile int8_t _csPin;
+
+static float old_gyro_res(void)
+{
+	switch (Gscale)
+	{
+		case GFS_250DPS:
+			return 250.0f / 32768.0f;
+		case GFS_500DPS:
+			return 500.0f / 32768.0f;
+		case GFS_1000DPS:
+			return 1000.0f / 32768.0f;
+		default:
+			return 2000.0f / 32768.0f;
+	}
+}
+
+static float old_accel_res(void)
+{
+	switch (Ascale)
+	{
+		case AFS_2G:
+			return 2.0f / 32768.0f;
+		case AFS_4G:
+			return 4.0f / 32768.0f;
+		case AFS_8G:
+			return 8.0f / 32768.0f;
+		default:
+			return 16.0f / 32768.0f;
+	}
+}
+
+// MPU_RUNTIME_CONFIG: mpu_scale_t of mpu9250.h
+static volatile struct
+{
+	float gyro_res;
+	float accel_res;
+	uint8_t gscale;
+	uint8_t ascale;
+} scale = {MPU_GYRO_RES, MPU_ACCEL_RES, MPU_GSCALE, MPU_ASCALE};
+
+typedef struct
+{
+	float gyro[3], accel[3];
+	int32_t cdps[3], mg[3];
+} converted_t;
+
+typedef void (*convert_t)(const int16_t * raw, converted_t * out);
+
+static void convert_constant(const int16_t * raw, converted_t * out)
+{
+	uint8_t a;
+
+	for (a = 0; a < 3; a++)
+	{
+		out->accel[a] = mpu_accel_g(raw[a]);
+		out->gyro[a] = mpu_gyro_dps(raw[3 + a]);
+		out->mg[a] = mpu_accel_mg(raw[a]);
+		out->cdps[a] = mpu_gyro_cdps(raw[3 + a]);
+	}
+}
+
+static void convert_globals(const int16_t * raw, converted_t * out)
+{
+	uint8_t a;
+
+	for (a = 0; a < 3; a++)
+	{
+		out->accel[a] = (float)raw[a] * old_accel_res();
+		out->gyro[a] = (float)raw[3 + a] * old_gyro_res();
+		out->mg[a] = ((int32_t)raw[a] * 1000L) >> (14 - Ascale);
+		out->cdps[a] = ((int32_t)raw[3 + a] * 25000L) >> (15 - Gscale);
+	}
+}
+
+static void convert_table(const int16_t * raw, converted_t * out)
+{
+	uint8_t a;
+
+	for (a = 0; a < 3; a++)
+	{
+		out->accel[a] = (float)raw[a] * scale.accel_res;
+		out->gyro[a] = (float)raw[3 + a] * scale.gyro_res;
+		out->mg[a] = ((int32_t)raw[a] * 1000L) >> (14 - scale.ascale);
+		out->cdps[a] = ((int32_t)raw[3 + a] * 25000L) >> (15 - scale.gscale);
+	}
+}
+
+// Best cycles per sample over BENCH_RUNS runs, the results in out
+static double run(convert_t convert, const int16_t * raw, unsigned long n,
+	converted_t * out)
+{
+	double best = 0;
+	unsigned long i;
+	int r;
+
+	for (r = 0; r < BENCH_RUNS; r++)
+	{
+		uint64_t start = __rdtsc(), cycles;
+
+		for (i = 0; i < n; i++)
+		{
+			convert(&raw[6 * i], &out[i]);
+		}
+		cycles = __rdtsc() - start;
+		best = r == 0 || cycles < best ? cycles : best;
+	}
+	return best / n;
+}
+
+int main(int argc, char ** argv)
+{
+	static const char * names[3] = {"constants", "range globals",
+		"mpu_scale table"};
+	static const convert_t variants[3] = {convert_constant, convert_globals,
+		convert_table};
+	// AVR sizes: uint8_t and int8_t 1 byte, float 4
+	static const unsigned sram[3] = {0, 5, 4 + 4 + 1 + 1};
+	unsigned long n = 1UL << 24, i;
+	uint64_t rng = 0x9E3779B97F4A7C15ULL;
+	converted_t * out[3];
+	double cycles[3];
+	int16_t * raw;
+	int v, arg, same = 1;
+
+	for (arg = 1; arg < argc; arg++)
+	{
+		if (!strcmp(argv[arg], "-n") && arg + 1 < argc)
+		{
+			n = strtoul(argv[++arg], NULL, 10);
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [-n samples]\n", argv[0]);
+			return 2;
+		}
+	}
+	raw = malloc(n * 6 * sizeof(*raw));
+	for (v = 0; v < 3; v++)
+	{
+		out[v] = malloc(n * sizeof(converted_t));
+	}
+	if (!n || !raw || !out[0] || !out[1] || !out[2])
+	{
+		fprintf(stderr, "out of memory\n");
+		return 2;
+	}
+	for (i = 0; i < n * 6; i++)
+	{
+		// xorshift64*, all of int16
+		rng ^= rng >> 12;
+		rng ^= rng << 25;
+		rng ^= rng >> 27;
+		raw[i] = (int16_t)((rng * 0x2545F4914F6CDD1DULL) >> 48);
+	}
+	(void)Mscale;
+	(void)Mmode;
+	(void)_csPin;
+
+	printf("%lu samples of accel and gyro, %d dps, %d g\n", n,
+		MPU_GYRO_FS_DPS, MPU_ACCEL_FS_G);
+	printf("%-16s %14s %13s %10s\n", "scale factors", "cycles/sample",
+		"over constant", "SRAM bytes");
+	for (v = 0; v < 3; v++)
+	{
+		cycles[v] = run(variants[v], raw, n, out[v]);
+	}
+	for (v = 0; v < 3; v++)
+	{
+		printf("%-16s %14.2f %13.2f %10u\n", names[v], cycles[v],
+			cycles[v] - cycles[0], sram[v]);
+		if (v && memcmp(out[v], out[0], n * sizeof(converted_t)))
+		{
+			printf("%s differ from the constants\n", names[v]);
+			same = 0;
+		}
+	}
+	return same ? 0 : 1;
+}
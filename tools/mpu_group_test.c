@@ -0,0 +1,153 @@
+// Bus model test of mpu_group.c: two MPU-9250s of tools/sim, at
+// MPU9250_ADDRESS and MPU9250_ADDRESS_AD0, are sampled as a group, polled
+// through their data ready flags and streamed through their FIFOs.
+//
+// Build and run from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -Itools/host -Itools/sim -I. -o mpu_group_test tools/mpu_group_test.c
+//       tools/sim/sim_world.c tools/sim/sim_mpu.c tools/sim/sim_dht.c
+//       mpu9250.c mpu_group.c -lm
+//   ./mpu_group_test
+//
+// Each mode reads TEST_SETS sets at 200 Hz. Every set must be complete,
+// spread over less than a sample period, and the two devices must agree
+// within TEST_AGREE_G, the noise of the model. A FIFO packet of
+// accelerometer and gyro must come back with the temperature zero and no
+// sample lost. A FIFO left to overflow must be reported by the drain for
+// both devices, which it can't be if anything else reads INT_STATUS first.
+// The exit status is 1 if a check fails.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "mpu9250.h"
+#include "mpu_group.h"
+#include "timebase.h"
+#include "sim.h"
+
+#define TEST_SETS		400
+#define TEST_AGREE_G	0.05		// largest difference between the devices
+#define TEST_PERIOD_US	5000		// 200 Hz
+
+static uint32_t test_clock(void)
+{
+	return timebase_now();
+}
+
+// Read a run of sets; returns the checks that failed
+static unsigned run(const char * name, mpu_group_t * group,
+	const mpu_config_t * cfg)
+{
+	unsigned failures = 0, s;
+	double worst = 0;
+	uint8_t k;
+	int temperature = 0;
+
+	if (mpu_group_start(group, cfg) != MPU_OK)
+	{
+		printf("%-8s FAIL, mpu_group_start() refused the configuration\n",
+			name);
+		return 1;
+	}
+	for (s = 0; s < TEST_SETS; s++)
+	{
+		mpu_sample_t set[2];
+
+		if (mpu_group_read(group, set) != 0x03)
+		{
+			continue;
+		}
+		for (k = 0; k < 3; k++)
+		{
+			worst = fmax(worst, fabs(mpu_accel_g(set[0].accel[k]) -
+				mpu_accel_g(set[1].accel[k])));
+		}
+		temperature |= set[0].temperature | set[1].temperature;
+	}
+
+	printf("%-8s %u sets, %u missed, skew mean %lu max %lu us, "
+		"largest difference %.3f g, %lu bytes\n", name, group->stats.sets,
+		group->stats.missed, (unsigned long)mpu_group_skew_mean(group),
+		(unsigned long)group->stats.skew_max, worst,
+		(unsigned long)group->stats.bytes);
+	if (group->stats.sets != TEST_SETS || group->stats.missed)
+	{
+		printf("%-8s FAIL, incomplete sets\n", name);
+		failures++;
+	}
+	if (group->stats.skew_max >= TEST_PERIOD_US)
+	{
+		printf("%-8s FAIL, a set spread over more than a sample period\n",
+			name);
+		failures++;
+	}
+	if (worst > TEST_AGREE_G)
+	{
+		printf("%-8s FAIL, the devices disagree\n", name);
+		failures++;
+	}
+	if (!cfg->fifo_en != !!temperature)
+	{
+		printf("%-8s FAIL, temperature %s\n", name, cfg->fifo_en ?
+			"read from a FIFO without it" : "missing");
+		failures++;
+	}
+	if (group->stats.overflows)
+	{
+		printf("%-8s FAIL, %u FIFO overflows\n", name, group->stats.overflows);
+		failures++;
+	}
+	return failures;
+}
+
+int main(void)
+{
+	mpu9250_t imu[2] = {MPU9250_DEVICE(MPU9250_ADDRESS),
+		MPU9250_DEVICE(MPU9250_ADDRESS_AD0)};
+	mpu_group_t group = {imu, 2, test_clock, 0, {0}};
+	const mpu_config_t polled = {MPU_GSCALE, MPU_ASCALE, GBW_41HZ, ABW_41HZ,
+		4, 0};
+	const mpu_config_t fifo = {MPU_GSCALE, MPU_ASCALE, GBW_41HZ, ABW_41HZ, 4,
+		MPU_FIFO_ACCEL | MPU_FIFO_GYRO};
+	unsigned failures = 0;
+	unsigned long before;
+	mpu_sample_t set[2];
+
+	sim_init(1);
+	sim_mpu_init();
+	sim_command("mpu_ad0 1", "test");
+	// 400 kHz: a FIFO packet of both devices fits into a sample period
+	sim_command("bus_byte 25", "test");
+	mpu_init(&imu[0]);
+	mpu_init(&imu[1]);
+
+	failures += run("polled", &group, &polled);
+
+	// every packet the devices queue is read exactly once
+	before = sim_mpu_stats.samples;
+	failures += run("FIFO", &group, &fifo);
+	if (sim_mpu_stats.samples - before < 2 * TEST_SETS ||
+		sim_mpu_stats.samples - before > 2 * TEST_SETS + 4)
+	{
+		printf("FIFO     FAIL, the devices sampled %lu times for %u sets\n",
+			sim_mpu_stats.samples - before, TEST_SETS);
+		failures++;
+	}
+
+	// a second unread is 2400 bytes per FIFO
+	sim_advance(1000000);
+	mpu_group_read(&group, set);
+	printf("overflow %u of 2 reported\n", group.stats.overflows);
+	if (group.stats.overflows != 2)
+	{
+		printf("overflow FAIL\n");
+		failures++;
+	}
+
+	if (failures)
+	{
+		printf("%u checks failed\n", failures);
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,105 @@
+// Bus traffic of the register set-up of mpu9250.c on the bus model of
+// tools/sim: what the PROGMEM sequences of mpu_run_sequence() and the
+// burst writes of the bias push save against one write per register.
+//
+// Build and run from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -Itools/host -Itools/sim -I. -o mpu_seq_bench tools/mpu_seq_bench.c
+//       tools/sim/sim_world.c tools/sim/sim_mpu.c tools/sim/sim_dht.c
+//       mpu9250.c -lm
+//   ./mpu_seq_bench
+//
+// mpu_calibrate(), mpu_init() and ak8963_init() run as main.c calls them
+// at 100 and 400 kHz. For each the write transactions and the registers
+// they wrote are counted by the model; a burst of n registers puts n + 2
+// bytes on the wire and takes n + 3 byte times with the start and stop, a
+// single register write 3 bytes and 4 byte times. The simulated time of
+// the whole call, delays included, is shown for scale. The exit status is 1
+// if the set-up of mpu_calibrate() or mpu_init() is no longer coalesced.
+
+#include <stdio.h>
+#include "mpu9250.h"
+#include "sim.h"
+
+typedef struct
+{
+	const char * name;
+	unsigned long writes;
+	unsigned long registers;
+	double us;               // simulated time of the call
+} phase_t;
+
+static void phase_start(phase_t * p, const char * name)
+{
+	p->name = name;
+	p->writes = sim_mpu_stats.writes;
+	p->registers = sim_mpu_stats.registers;
+	p->us = (double)sim.now_us;
+}
+
+static void phase_end(phase_t * p)
+{
+	p->writes = sim_mpu_stats.writes - p->writes;
+	p->registers = sim_mpu_stats.registers - p->registers;
+	p->us = sim.now_us - p->us;
+}
+
+static void phase_print(const phase_t * p, double byte_us)
+{
+	double burst_us = (p->registers + 3 * p->writes) * byte_us;
+	double single_us = 4 * p->registers * byte_us;
+
+	printf("%-14s %6lu %6lu %6lu %6lu %9.0f %9.0f %9.0f %10.0f\n", p->name,
+		p->registers, p->writes, p->registers + 2 * p->writes,
+		3 * p->registers, single_us, burst_us, single_us - burst_us, p->us);
+}
+
+int main(void)
+{
+	// bus_byte of the model at 100 and 400 kHz
+	static const double byte_us[2] = {100, 25};
+	static const unsigned khz[2] = {100, 400};
+	unsigned failures = 0;
+	uint8_t b;
+
+	for (b = 0; b < 2; b++)
+	{
+		mpu9250_t imu = MPU9250_DEVICE(MPU9250_ADDRESS);
+		float gyro_bias[3], accel_bias[3], mag_asa[3];
+		phase_t phase[3];
+		char line[32];
+		uint8_t i;
+
+		sim_init(1);
+		sim_mpu_init();
+		snprintf(line, sizeof(line), "bus_byte %g", byte_us[b]);
+		sim_command(line, "bench");
+
+		phase_start(&phase[0], "mpu_calibrate");
+		mpu_calibrate(&imu, gyro_bias, accel_bias);
+		phase_end(&phase[0]);
+		phase_start(&phase[1], "mpu_init");
+		mpu_init(&imu);
+		phase_end(&phase[1]);
+		phase_start(&phase[2], "ak8963_init");
+		ak8963_init(mag_asa);
+		phase_end(&phase[2]);
+
+		printf("%s%u kHz, writes only\n", b ? "\n" : "", khz[b]);
+		printf("%-14s %6s %6s %6s %6s %9s %9s %9s %10s\n", "", "regs",
+			"txns", "bytes", "single", "single us", "burst us", "saved us",
+			"call us");
+		for (i = 0; i < 3; i++)
+		{
+			phase_print(&phase[i], byte_us[b]);
+		}
+		if (phase[0].writes >= phase[0].registers ||
+			phase[1].writes >= phase[1].registers)
+		{
+			printf("FAIL, the set-up went out one register at a time\n");
+			failures++;
+		}
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,150 @@
+// Shadow register test of mpu9250.c against the MPU-9250 model of
+// tools/sim: the copies of the configuration registers in mpu9250_t must
+// match the device and save the bus traffic they are there for.
+//
+// Build and run from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -Itools/host -Itools/sim -I. -o mpu_shadow_test
+//       tools/mpu_shadow_test.c tools/sim/sim_world.c tools/sim/sim_mpu.c
+//       tools/sim/sim_dht.c mpu9250.c -lm
+//   ./mpu_shadow_test
+//
+// After mpu_calibrate() the set-up of mpu_init() must not read a register,
+// every valid shadow register must hold what the device reads back, and
+// applying the same configuration again must cost at most one write and no
+// read. A reset behind the driver's back must leave the shadow stale until
+// mpu_shadow_invalidate(), after which mpu_init() brings the device back.
+// A soft reset of the AK8963 followed by mpu_shadow_invalidate() and
+// ak8963_init() must leave the magnetometer measuring. The exit status is 1
+// if a check fails.
+
+#include <stdio.h>
+#include "mpu9250.h"
+#include "sim.h"
+
+#define TEST_AK_CNTL2	0x0B		// soft reset on bit 0
+
+// The mirrored registers in the order of mpu9250_t.shadow
+static const uint8_t shadow_reg[MPU_SHADOW_REGS] = {SMPLRT_DIV, CONFIG,
+	GYRO_CONFIG, ACCEL_CONFIG, ACCEL_CONFIG2, FIFO_EN, INT_PIN_CFG,
+	INT_ENABLE, USER_CTRL, PWR_MGMT_1, PWR_MGMT_2};
+
+// Valid shadow registers that differ from the device
+static unsigned stale(const mpu9250_t * dev, int print)
+{
+	unsigned differ = 0;
+	uint8_t i;
+
+	for (i = 0; i < MPU_SHADOW_REGS; i++)
+	{
+		uint8_t value = mpu_read_byte(dev->address, shadow_reg[i]);
+
+		if ((dev->shadow_valid & (1u << i)) && dev->shadow[i] != value)
+		{
+			if (print)
+			{
+				printf("register 0x%02X: shadow 0x%02X, device 0x%02X\n",
+					shadow_reg[i], dev->shadow[i], value);
+			}
+			differ++;
+		}
+	}
+	return differ;
+}
+
+typedef struct
+{
+	unsigned long reads;
+	unsigned long writes;
+} traffic_t;
+
+static void traffic_start(traffic_t * t)
+{
+	t->reads = sim_mpu_stats.transactions - sim_mpu_stats.writes;
+	t->writes = sim_mpu_stats.writes;
+}
+
+static void traffic_end(traffic_t * t)
+{
+	t->reads = sim_mpu_stats.transactions - sim_mpu_stats.writes - t->reads;
+	t->writes = sim_mpu_stats.writes - t->writes;
+}
+
+int main(void)
+{
+	mpu9250_t imu = MPU9250_DEVICE(MPU9250_ADDRESS);
+	const mpu_config_t cfg = MPU_CONFIG_DEFAULT;
+	float gyro_bias[3], accel_bias[3], mag_asa[3];
+	unsigned failures = 0, differ;
+	traffic_t t;
+	uint8_t cntl;
+
+	sim_init(1);
+	sim_mpu_init();
+	mpu_calibrate(&imu, gyro_bias, accel_bias);
+
+	traffic_start(&t);
+	mpu_init(&imu);
+	traffic_end(&t);
+	printf("mpu_init after mpu_calibrate: %lu reads, %lu writes\n", t.reads,
+		t.writes);
+	if (t.reads)
+	{
+		printf("FAIL, mpu_init() read registers the shadow holds\n");
+		failures++;
+	}
+	ak8963_init(mag_asa);
+	if (stale(&imu, 1))
+	{
+		printf("FAIL, the shadow doesn't match the device after mpu_init()\n");
+		failures++;
+	}
+
+	traffic_start(&t);
+	mpu_configure(&imu, &cfg);
+	traffic_end(&t);
+	printf("same configuration again: %lu reads, %lu writes\n", t.reads,
+		t.writes);
+	if (t.reads || t.writes > 1)
+	{
+		printf("FAIL, an unchanged configuration went out on the bus\n");
+		failures++;
+	}
+
+	// H_RESET the driver doesn't know of
+	mpu_write_byte(imu.address, PWR_MGMT_1, 0x80);
+	sim_advance(100000);
+	differ = stale(&imu, 0);
+	printf("after a hidden reset %u shadow registers are stale", differ);
+	mpu_shadow_invalidate(&imu);
+	mpu_init(&imu);
+	printf(", after mpu_shadow_invalidate() and mpu_init() %u\n",
+		stale(&imu, 1));
+	if (!differ || stale(&imu, 0))
+	{
+		printf("FAIL, the shadow didn't follow the reset\n");
+		failures++;
+	}
+
+	// the AK8963 powers down on a soft reset
+	mpu_write_byte(AK8963_ADDRESS, TEST_AK_CNTL2, 0x01);
+	mpu_shadow_invalidate(&imu);
+	ak8963_init(mag_asa);
+	cntl = mpu_read_byte(AK8963_ADDRESS, AK8963_CNTL);
+	printf("AK8963 CNTL after a soft reset and ak8963_init(): 0x%02X\n", cntl);
+	if (cntl != MPU_AK8963_CNTL_VALUE)
+	{
+		printf("FAIL, the magnetometer was left in mode 0x%02X\n", cntl);
+		failures++;
+	}
+
+	printf("reads saved %u, writes saved %u\n", mpu_shadow_stats.reads_saved,
+		mpu_shadow_stats.writes_saved);
+
+	if (failures)
+	{
+		printf("%u checks failed\n", failures);
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,120 @@
+// Throughput of the MPU-9250 over SPI against I2C on the bus model of
+// tools/sim, and a check that a device on SPI keeps its I2C slave off.
+//
+// Build and run from the repository root, with the SPI transport compiled
+// in:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -DMPU_SPI_ENABLE=1 -Itools/host -Itools/sim -I. -o mpu_spi_bench
+//       tools/mpu_spi_bench.c tools/sim/sim_world.c tools/sim/sim_mpu.c
+//       tools/sim/sim_dht.c mpu9250.c -lm
+//   ./mpu_spi_bench
+//
+// For I2C at 100 and 400 kHz and for SPI the simulated time of a 14 byte
+// sample burst from ACCEL_XOUT_H and of a FIFO drain of BENCH_PACKETS
+// accelerometer and gyro packets through mpu_fifo_drain() is measured, and
+// the sample rate that leaves for everything else. The times follow from
+// the byte times of the model (bus_byte, spi_byte); on the board the SPI
+// byte is 16 cycles of F_CPU / 2 and the loop of mpu_spi.c, the I2C byte
+// whatever i2cmaster.S manages at that clock.
+//
+// After mpu_init(), mpu_configure() with the FIFO and mpu_calibrate() over
+// SPI the device must not answer on I2C (I2C_IF_DIS). The exit status is 1
+// if it does.
+
+#include <stdio.h>
+#include "i2c_txn.h"
+#include "mpu9250.h"
+#include "mpu_spi.h"
+#include "sim.h"
+
+#define BENCH_BURSTS	1000
+#define BENCH_PACKETS	40			// 480 bytes, what the FIFO holds safely
+
+typedef struct
+{
+	const char * name;
+	uint8_t device;
+	double byte_us;         // bus_byte or spi_byte
+} transport_t;
+
+// Simulated us of one sample burst and of one packet of a FIFO drain
+static void measure(mpu9250_t * dev, double * burst_us, double * packet_us)
+{
+	const mpu_config_t fifo = {MPU_GSCALE, MPU_ASCALE, GBW_184HZ, ABW_184HZ,
+		0, MPU_FIFO_ACCEL | MPU_FIFO_GYRO};
+	static uint8_t data[BENCH_PACKETS * 12];
+	enum MPU_STATUS_t status;
+	uint64_t start;
+	uint16_t bytes;
+	unsigned i;
+
+	start = sim.now_us;
+	for (i = 0; i < BENCH_BURSTS; i++)
+	{
+		mpu_read_bytes(dev->address, ACCEL_XOUT_H, 14, data);
+	}
+	*burst_us = (double)(sim.now_us - start) / BENCH_BURSTS;
+
+	// 1 kHz into the FIFO; the drain only takes what was there at its start
+	mpu_configure(dev, &fifo);
+	sim_advance(BENCH_PACKETS * 1000 + 500);
+	start = sim.now_us;
+	bytes = mpu_fifo_drain(dev, data, sizeof(data), &status);
+	*packet_us = bytes ? (double)(sim.now_us - start) / (bytes / 12) : 0;
+}
+
+int main(void)
+{
+	static const transport_t transports[3] = {
+		{"I2C 100 kHz", MPU9250_ADDRESS, 100},
+		{"I2C 400 kHz", MPU9250_ADDRESS, 25},
+		{"SPI", MPU9250_SPI(0), 22},
+	};
+	float gyro_bias[3], accel_bias[3];
+	int failures = 0;
+	uint8_t t;
+
+	printf("%-12s %8s %14s %14s %14s\n", "transport", "byte us",
+		"burst us", "FIFO us/pkt", "max rate Hz");
+	for (t = 0; t < 3; t++)
+	{
+		mpu9250_t dev = MPU9250_DEVICE(transports[t].device);
+		double burst, packet;
+		char line[32];
+
+		sim_init(1);
+		sim_mpu_init();
+		snprintf(line, sizeof(line), "%s %g", t == 2 ? "spi_byte" :
+			"bus_byte", transports[t].byte_us);
+		sim_command(line, "bench");
+		if (t == 2)
+		{
+			sim_command("mpu_spi 0", "bench");
+		}
+		mpu_init(&dev);
+		measure(&dev, &burst, &packet);
+		printf("%-12s %8.0f %14.0f %14.0f %14.0f\n", transports[t].name,
+			transports[t].byte_us, burst, packet, packet ? 1e6 / packet : 0);
+
+		if (t == 2)
+		{
+			uint8_t who;
+
+			mpu_calibrate(&dev, gyro_bias, accel_bias);
+			who = mpu_read_byte(MPU9250_ADDRESS, WHO_AM_I_MPU);
+			if (who != 0xFF || I2C_STATUS == I2C_OK)
+			{
+				printf("the SPI device answers on I2C, WHO_AM_I 0x%02X\n",
+					who);
+				failures++;
+			}
+			if (mpu_read_byte(dev.address, WHO_AM_I_MPU) != 0x71)
+			{
+				printf("the SPI device doesn't answer on SPI\n");
+				failures++;
+			}
+		}
+	}
+	return failures ? 1 : 0;
+}
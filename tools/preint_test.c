@@ -0,0 +1,471 @@
+// Accuracy of preint.c against coning and sculling motion on the host, by
+// decimation ratio, and the cost of a sample on this host.
+//
+// Build and run from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -Itools/host
+//       -I. -o preint_test tools/preint_test.c preint.c -lm
+//   ./preint_test [-r rate_hz] [-f motion_hz] [-t seconds] [-n noise_lsb]
+//
+// Two motions are sampled at rate_hz (1000 by default) at the full scale
+// ranges of MPU9250_CONFIG.h. Each sample is the mean rate or specific force
+// over the sample interval, as after the sensor's low pass filter, with
+// gaussian noise of noise_lsb (1 by default, it also dithers the rounding)
+// and rounded to LSB:
+//
+//   coning    the rotation vector a (cos wt, sin wt, 0), a = 1 degree,
+//             w = 2 pi motion_hz (10 by default); the body turns about z
+//             at w (1 - cos a), which a sum of rates doesn't see
+//   sculling  a rotation of 1 degree sin wt about x while the body
+//             accelerates by 0.5 g sin wt along y, gravity on z; the
+//             velocity creeps along z at 1/2 a 0.5 g
+//
+// For every decimation ratio the deltas of seconds (60 by default) of
+// motion are chained into attitude and velocity in double precision and
+// compared with the true motion, for three sources of deltas: plain sums of
+// the samples (downsampling before integration), the two sample algorithms
+// of preint.h in double precision, and preint.c itself. The attitude error
+// is shown as a drift in deg/h, the velocity error as a mean acceleration
+// in ug. The exit status is 1 if preint.c is not within 10 % (plus the
+// noise) of the double precision algorithm, or not better than the plain
+// sums wherever they are off by more than the noise.
+//
+// Cycle counts on the target come from preint_bench() in the firmware.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mpu9250.h"
+#include "preint.h"
+
+#define TEST_CONE_ANGLE		(M_PI / 180)	// rad
+#define TEST_SCULL_ANGLE	(M_PI / 180)	// rad
+#define TEST_SCULL_ACCEL	0.5				// g
+#define TEST_SOURCES		3
+
+typedef struct
+{
+	double w, x, y, z;
+} quat_t;
+
+typedef struct
+{
+	int16_t * gyro;          // three axes per sample
+	int16_t * accel;
+	unsigned long samples;
+	double rate;
+	quat_t initial;          // true attitude at the start and the end
+	quat_t attitude;
+	double velocity[3];
+} motion_t;
+
+typedef struct
+{
+	double angle[3], velocity[3];
+} delta_t;
+
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t next_random(void)
+{
+	// xorshift64*
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return (uint32_t)((rng * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static double gauss(void)
+{
+	double u = (next_random() + 1.0) / 4294967297.0;
+	double v = next_random() / 4294967296.0;
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static int16_t quantize(double x, double noise)
+{
+	x = floor(x + noise * gauss() + 0.5);
+	return x < -32768 ? -32768 : x > 32767 ? 32767 : (int16_t)x;
+}
+
+static quat_t quat_mul(quat_t a, quat_t b)
+{
+	quat_t q;
+
+	q.w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+	q.x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+	q.y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+	q.z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+	return q;
+}
+
+// Quaternion of a rotation vector
+static quat_t quat_exp(const double * phi)
+{
+	double angle = sqrt(phi[0] * phi[0] + phi[1] * phi[1] + phi[2] * phi[2]);
+	double s = angle > 1e-12 ? sin(angle / 2) / angle : 0.5;
+	quat_t q = {cos(angle / 2), s * phi[0], s * phi[1], s * phi[2]};
+
+	return q;
+}
+
+// Rotate v from the body to the reference frame
+static void quat_rotate(quat_t q, const double * v, double * out)
+{
+	quat_t p = {0, v[0], v[1], v[2]}, c = {q.w, -q.x, -q.y, -q.z};
+
+	p = quat_mul(quat_mul(q, p), c);
+	out[0] = p.x;
+	out[1] = p.y;
+	out[2] = p.z;
+}
+
+// Angle between two attitudes, rad
+static double quat_error(quat_t a, quat_t b)
+{
+	quat_t c = {a.w, -a.x, -a.y, -a.z};
+	quat_t d = quat_mul(c, b);
+	double v = sqrt(d.x * d.x + d.y * d.y + d.z * d.z);
+
+	return 2 * atan2(v, fabs(d.w));
+}
+
+static void motion_alloc(motion_t * m, double rate, double seconds)
+{
+	memset(m, 0, sizeof(*m));
+	m->rate = rate;
+	m->samples = (unsigned long)(rate * seconds);
+	m->gyro = malloc(m->samples * 3 * sizeof(int16_t));
+	m->accel = malloc(m->samples * 3 * sizeof(int16_t));
+}
+
+static void motion_free(motion_t * m)
+{
+	free(m->gyro);
+	free(m->accel);
+}
+
+static void motion_sample(motion_t * m, unsigned long i, const double * rate,
+	const double * force, double noise)
+{
+	uint8_t a;
+
+	for (a = 0; a < 3; a++)
+	{
+		m->gyro[3 * i + a] = quantize(rate[a] * (180 / M_PI) / MPU_GYRO_RES,
+			noise);
+		m->accel[3 * i + a] = quantize(force[a] / PREINT_GRAVITY /
+			MPU_ACCEL_RES, noise);
+	}
+}
+
+static void coning(motion_t * m, double rate, double seconds, double hz,
+	double noise)
+{
+	double w = 2 * M_PI * hz, a = TEST_CONE_ANGLE, T = 1 / rate, t;
+	double force[3] = {0, 0, 0};
+	unsigned long i;
+
+	motion_alloc(m, rate, seconds);
+	m->initial.w = cos(a / 2);
+	m->initial.x = sin(a / 2);
+	for (i = 0; i < m->samples; i++)
+	{
+		// the body rate (-w sin a sin wt, w sin a cos wt, -w (1 - cos a))
+		// averaged over the sample
+		double t1 = i * T, t2 = t1 + T, omega[3];
+
+		omega[0] = sin(a) * (cos(w * t2) - cos(w * t1)) / T;
+		omega[1] = sin(a) * (sin(w * t2) - sin(w * t1)) / T;
+		omega[2] = -w * (1 - cos(a));
+		motion_sample(m, i, omega, force, noise);
+	}
+	t = m->samples * T;
+	m->attitude.w = cos(a / 2);
+	m->attitude.x = sin(a / 2) * cos(w * t);
+	m->attitude.y = sin(a / 2) * sin(w * t);
+	m->attitude.z = 0;
+}
+
+// Specific force of the sculling motion in the reference frame at t
+static void scull_force(double w, double t, double * out)
+{
+	double theta = TEST_SCULL_ANGLE * sin(w * t);
+	double fy = TEST_SCULL_ACCEL * PREINT_GRAVITY * sin(w * t);
+
+	out[0] = 0;
+	out[1] = cos(theta) * fy - sin(theta) * PREINT_GRAVITY;
+	out[2] = sin(theta) * fy + cos(theta) * PREINT_GRAVITY;
+}
+
+static void sculling(motion_t * m, double rate, double seconds, double hz,
+	double noise)
+{
+	double w = 2 * M_PI * hz, T = 1 / rate, t, phi[3];
+	unsigned long i;
+	uint8_t a;
+
+	motion_alloc(m, rate, seconds);
+	m->initial.w = 1;
+	for (i = 0; i < m->samples; i++)
+	{
+		double t1 = i * T, t2 = t1 + T, omega[3], force[3], f1[3], f2[3], f3[3];
+
+		omega[0] = TEST_SCULL_ANGLE * (sin(w * t2) - sin(w * t1)) / T;
+		omega[1] = 0;
+		omega[2] = 0;
+		force[0] = 0;
+		force[1] = TEST_SCULL_ACCEL * PREINT_GRAVITY *
+			(cos(w * t1) - cos(w * t2)) / (w * T);
+		force[2] = PREINT_GRAVITY;
+		motion_sample(m, i, omega, force, noise);
+
+		// true velocity, Simpson's rule over the sample
+		scull_force(w, t1, f1);
+		scull_force(w, t1 + T / 2, f2);
+		scull_force(w, t2, f3);
+		for (a = 0; a < 3; a++)
+		{
+			m->velocity[a] += T / 6 * (f1[a] + 4 * f2[a] + f3[a]);
+		}
+	}
+	t = m->samples * T;
+	phi[0] = TEST_SCULL_ANGLE * sin(w * t);
+	phi[1] = 0;
+	phi[2] = 0;
+	m->attitude = quat_exp(phi);
+}
+
+static void cross(const double * u, const double * v, double * out)
+{
+	out[0] = u[1] * v[2] - u[2] * v[1];
+	out[1] = u[2] * v[0] - u[0] * v[2];
+	out[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+// Deltas of decimation samples from i by plain sums (two_sample 0) or the
+// algorithms of preint.h in double precision. last holds the previous
+// sample in rad and m/s, carried across deltas.
+static void delta_double(const motion_t * m, unsigned long i,
+	unsigned decimation, int two_sample, double * last, delta_t * d)
+{
+	double k = MPU_GYRO_RES * (M_PI / 180) / m->rate;
+	double c = MPU_ACCEL_RES * PREINT_GRAVITY / m->rate;
+	double alpha[3] = {0, 0, 0}, nu[3] = {0, 0, 0};
+	double cone[3] = {0, 0, 0}, scull[3] = {0, 0, 0}, x[3], rot[3];
+	unsigned j;
+	uint8_t a;
+
+	for (j = 0; j < decimation; j++)
+	{
+		double dtheta[3], dv[3], u[3], v[3];
+
+		for (a = 0; a < 3; a++)
+		{
+			dtheta[a] = m->gyro[3 * (i + j) + a] * k;
+			dv[a] = m->accel[3 * (i + j) + a] * c;
+			u[a] = alpha[a] + last[a] / 6;
+			v[a] = nu[a] + last[3 + a] / 6;
+		}
+		cross(u, dtheta, x);
+		for (a = 0; a < 3; a++)
+		{
+			cone[a] += x[a] / 2;
+		}
+		cross(u, dv, x);
+		for (a = 0; a < 3; a++)
+		{
+			scull[a] += x[a] / 2;
+		}
+		cross(v, dtheta, x);
+		for (a = 0; a < 3; a++)
+		{
+			scull[a] += x[a] / 2;
+			alpha[a] += dtheta[a];
+			nu[a] += dv[a];
+			last[a] = dtheta[a];
+			last[3 + a] = dv[a];
+		}
+	}
+	cross(alpha, nu, rot);
+	for (a = 0; a < 3; a++)
+	{
+		d->angle[a] = alpha[a] + (two_sample ? cone[a] : 0);
+		d->velocity[a] = nu[a] + (two_sample ? rot[a] / 2 + scull[a] : 0);
+	}
+}
+
+// Chain the deltas of a source into attitude and velocity; the errors
+// against the true motion go to drift (deg/h) and accel (ug)
+static void run(const motion_t * m, unsigned decimation, int source,
+	double * drift, double * accel, double * seconds)
+{
+	static preint_t p;
+	preint_delta_t pd;
+	double last[6] = {0, 0, 0, 0, 0, 0}, v[3] = {0, 0, 0}, dv[3], T;
+	quat_t q = m->initial;
+	unsigned long i, n = m->samples - m->samples % decimation;
+	clock_t start = clock();
+	uint8_t a;
+
+	preint_init(&p, (uint16_t)m->rate, decimation, NULL, NULL);
+	for (i = 0; i < n; i += decimation)
+	{
+		delta_t d;
+
+		if (source < 2)
+		{
+			delta_double(m, i, decimation, source, last, &d);
+		}
+		else
+		{
+			unsigned j;
+
+			for (j = 0; j < decimation; j++)
+			{
+				preint_push(&p, i + j, &m->gyro[3 * (i + j)],
+					&m->accel[3 * (i + j)], &pd);
+			}
+			for (a = 0; a < 3; a++)
+			{
+				d.angle[a] = pd.angle[a] / (double)(1UL << PREINT_ANGLE_FRAC);
+				d.velocity[a] = pd.velocity[a] /
+					(double)(1UL << PREINT_VELOCITY_FRAC);
+			}
+		}
+		// the velocity delta is in the body frame at the start
+		quat_rotate(q, d.velocity, dv);
+		for (a = 0; a < 3; a++)
+		{
+			v[a] += dv[a];
+		}
+		q = quat_mul(q, quat_exp(d.angle));
+	}
+	if (seconds)
+	{
+		*seconds += (double)(clock() - start) / CLOCKS_PER_SEC;
+	}
+
+	T = n / m->rate;
+	*drift = quat_error(q, m->attitude) * (180 / M_PI) / T * 3600;
+	for (a = 0; a < 3; a++)
+	{
+		v[a] -= m->velocity[a];
+	}
+	*accel = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]) / T /
+		PREINT_GRAVITY * 1e6;
+}
+
+// preint.c within 10 % (plus the noise floor) of the double precision
+// algorithm, and better than the plain sums where they are off by more
+// than the noise
+static int check(const double * e, double floor)
+{
+	if (e[2] > e[1] * 1.1 + floor)
+	{
+		return 0;
+	}
+	return e[0] < e[1] + 3 * floor || e[2] < e[0];
+}
+
+int main(int argc, char ** argv)
+{
+	static const unsigned decimations[] = {1, 2, 4, 5, 10, 20, 50, 100, 200,
+		500, 1000};
+	double rate = 1000, hz = 10, seconds = 60, noise = 1, cpu = 0;
+	double walk, drift_floor, accel_floor;
+	unsigned long pushes = 0;
+	motion_t cone, scull;
+	unsigned d;
+	int i, failures = 0;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-r") && i + 1 < argc)
+		{
+			rate = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+		{
+			hz = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+		{
+			seconds = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+		{
+			noise = atof(argv[++i]);
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [-r rate_hz] [-f motion_hz] "
+				"[-t seconds] [-n noise_lsb]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (rate < 1 || rate > 65535 || seconds * rate < 1 || hz <= 0 || noise < 0)
+	{
+		fprintf(stderr, "%s: bad rate, motion frequency, length or noise\n",
+			argv[0]);
+		return 2;
+	}
+
+	coning(&cone, rate, seconds, hz, noise);
+	sculling(&scull, rate, seconds, hz, noise);
+
+	// what the noise alone leaves after the given time, three sigma: the
+	// random walk of noise LSB per sample (with some for the rounding of
+	// the outputs), and gravity through the attitude's random walk
+	walk = 3 * (noise + 0.3) * sqrt(rate * seconds);
+	drift_floor = walk * MPU_GYRO_RES / rate / seconds * 3600;
+	accel_floor = walk * (MPU_ACCEL_RES / (rate * seconds) +
+		MPU_GYRO_RES * (M_PI / 180) / rate / sqrt(3)) * 1e6;
+
+	printf("%.0f Hz samples, %.0f Hz motion, %.0f s, noise %.1f LSB\n\n",
+		rate, hz, seconds, noise);
+	printf("%6s %9s  %27s  %27s\n", "", "", "coning drift, deg/h",
+		"sculling error, ug");
+	printf("%6s %9s  %8s %9s %8s  %8s %9s %8s\n", "ratio", "output Hz",
+		"plain", "two smpl", "preint", "plain", "two smpl", "preint");
+	for (d = 0; d < sizeof(decimations) / sizeof(decimations[0]); d++)
+	{
+		unsigned decimation = decimations[d];
+		double drift[TEST_SOURCES], accel[TEST_SOURCES];
+		int source, ok;
+
+		if (decimation > PREINT_DECIMATION_MAX || decimation > cone.samples)
+		{
+			continue;
+		}
+		for (source = 0; source < TEST_SOURCES; source++)
+		{
+			double * cpu_time = source == 2 ? &cpu : NULL;
+			double unused;
+
+			run(&cone, decimation, source, &drift[source], &unused, cpu_time);
+			run(&scull, decimation, source, &unused, &accel[source], cpu_time);
+		}
+		pushes += 2 * (cone.samples - cone.samples % decimation);
+
+		ok = check(drift, drift_floor) && check(accel, accel_floor);
+		printf("%6u %9.1f  %8.2f %9.3f %8.3f  %8.1f %9.2f %8.2f%s\n",
+			decimation, rate / decimation, drift[0], drift[1], drift[2],
+			accel[0], accel[1], accel[2], ok ? "" : "  FAILED");
+		failures += !ok;
+	}
+
+	printf("\nnoise floor: %.3f deg/h, %.2f ug\n", drift_floor, accel_floor);
+	printf("%.1f ns per preint_push() on this host\n", cpu * 1e9 / pushes);
+
+	motion_free(&cone);
+	motion_free(&scull);
+	if (failures)
+	{
+		printf("%d ratios failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
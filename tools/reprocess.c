@@ -0,0 +1,1391 @@
+// Offline reprocessing of recorded telemetry on all cores: attitude,
+// windowed statistics and vibration spectra of a logged accelerometer and
+// gyro, computed by the firmware's own code so the results are the ones the
+// device would have produced. Linux only.
+//
+// Build from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -pthread -Itools/host
+//       -Itools/clog -I. -o reprocess tools/reprocess.c tools/clog/clog_read.c
+//       tools/clog/clog_write.c calib.c filter.c preint.c vibration.c
+//       wstats.c -lm
+//
+//   ./reprocess [-a channel] [-G channel] [-C blob.bin] [-g x,y,z]
+//       [-s seconds] [-c samples] [-D decimation] [-W window] [-f hz]
+//       [-j threads] [-o prefix] log.clog
+//   ./reprocess -b [-S gigabytes] [-j 1,2,4,...] [-k] file
+//
+// The log is a columnar file of tools/clog_query.c (pack CSV logs with
+// clog_query -p) with the accelerometer (-a, default accel) and the gyro
+// (-G, default gyro) as channels, raw LSB as read, sampled together: the
+// gyro is paired with the accelerometer by sample number, as the device
+// reads both in one burst, and pairs whose stamps are more than half a
+// period apart are counted. The rate is that of the accelerometer's stamps.
+// The accelerometer is corrected with the calibration blob of
+// tools/calib_solve.c (-C) through calib_apply(), the gyro bias is -g (dps)
+// or the mean of the first -s seconds (default 5), which must be at rest,
+// as mpu_calibrate() assumes at boot.
+//
+// Every sample then goes through these kernels, the firmware's sources
+// compiled for the host:
+//
+//   preint.c     pre-integration of gyro and accelerometer into deltas of
+//                -D samples (default 16), bias removed in it
+//   filter.c     two section Butterworth low-pass at -f Hz (default 20) on
+//                each accelerometer axis
+//   wstats.c     statistics of windows of -W samples (default 1024) of the
+//                filtered accelerometer and the bias free gyro
+//   vibration.c  spectra of blocks of VIB_FFT_SIZE accelerometer samples,
+//                bands at 0, 5, 15, 30 and 50 % of the rate
+//
+// The log is cut into chunks of -c samples (default 65536, a multiple of
+// the delta, window and spectrum lengths) and -j threads (default all
+// cores) run them. Each thread starts with a contiguous range of chunks
+// and takes them in time order; one that runs out steals the later half of
+// the range of another, with a compare and swap on the range, so the load
+// evens out without a shared queue. Filters and the statistics' references
+// carry state across windows, so every chunk first runs a warm-up of the
+// samples before it (whole deltas, windows and blocks, at least 1024
+// samples for the filters to settle and a window after them) whose results
+// are dropped; the results are then those of running the whole log at
+// once, which the benchmark checks bit for bit.
+//
+// The main thread merges the chunks in time order as they complete. The
+// deltas are composed into attitude there, the one sequential step (a
+// complementary filter: gyro deltas corrected toward the gravity direction
+// of the velocity deltas when their magnitude is near 1 g, time constant
+// FUSION_TAU), as it costs a delta instead of a sample. -o writes
+// prefix.attitude.csv (stamp, roll, pitch, yaw in degrees), prefix.stats.csv
+// (stream 0 accelerometer in mg, 1 gyro in 0.01 dps: start, end, then mean,
+// rms, min and max per axis) and prefix.spectrum.csv (stamp, axis, peak
+// frequency in Hz, peak power and the band energies).
+//
+// -b writes a synthetic log of -S GB (default 1) to file: 5 s at rest,
+// then rotation about all axes at rates that wander up to 150 dps, gyro
+// bias and noise, 80 Hz vibration with bursts at 230 Hz, at 1 kHz. It runs
+// it once as a single chunk on one thread (the whole log at once, the
+// reference) and then chunked on each thread count of the -j list (default
+// 1, 2, 4, ... up to all cores), and reports the time, the samples a
+// second, the speed-up over one thread and the steals, whether the
+// results are identical to the reference, and the tilt error of the
+// attitude against the simulated truth. The file is removed at the end
+// unless -k is given.
+//
+// The exit status is 1 if chunks failed (with -b, if a run differs from
+// the reference or the tilt error is above 2 degrees), 2 on bad arguments
+// or files.
+
+#define _GNU_SOURCE
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "clog.h"
+#include "mpu9250.h"
+#include "calib.h"
+#include "filter.h"
+#include "preint.h"
+#include "vibration.h"
+#include "wstats.h"
+
+#define THREADS_MAX		64
+#define SUB_BLOCK		128			// samples through the filters at once
+#define WARMUP_MIN		1024		// samples
+#define LOWPASS_SECTIONS	2
+#define FUSION_TAU		2.0			// s
+#define FUSION_GATE		0.1			// g off 1 g that still corrects tilt
+#define BENCH_RATE		1000		// Hz
+#define BENCH_TILT_MAX	2.0			// deg
+#define TRUTH_EVERY		1000		// samples between truth attitudes
+
+typedef struct
+{
+	double w, x, y, z;
+} quat_t;
+
+// A delta, window or spectrum with the 64 bit stamp of its last sample
+typedef struct
+{
+	int64_t stamp;
+	uint64_t sample;
+	preint_delta_t delta;
+} delta_rec_t;
+
+typedef struct
+{
+	int64_t stamp;
+	wstats_summary_t accel;
+	wstats_summary_t gyro;
+} stats_rec_t;
+
+typedef struct
+{
+	int64_t stamp;
+	vib_result_t vib;
+} spectrum_rec_t;
+
+typedef struct
+{
+	delta_rec_t * delta;
+	stats_rec_t * stats;
+	spectrum_rec_t * spectrum;
+	uint32_t deltas, windows, spectra;
+	uint32_t unpaired;
+	int failed;
+	int done;
+} chunk_t;
+
+// What to compute, the same for every chunk
+typedef struct
+{
+	const clog_file_t * f;
+	int accel, gyro;        // channels
+	uint64_t samples;       // pairs
+	uint16_t rate;          // Hz
+	uint16_t decimation;
+	uint16_t window;
+	uint32_t align;         // lcm of the above and VIB_FFT_SIZE
+	float gyro_bias[3];     // dps
+	int16_t gyro_lsb[3];    // the same, rounded to LSB
+	calib_blob_t calib;
+	biquad_coef_t lowpass[LOWPASS_SECTIONS];
+	uint16_t bands[VIB_BANDS + 1];
+} job_t;
+
+// A channel's current block
+typedef struct
+{
+	const clog_index_t * index;
+	uint64_t blocks;
+	uint64_t block;         // loaded, UINT64_MAX for none
+	const int64_t * t;
+	const int16_t * v;
+	uint32_t n;
+	int64_t * stamps;       // decode buffers for delta blocks
+	int16_t * values;
+} cursor_t;
+
+// A thread's chunks not yet taken, next << 32 | end, alone in a cache line
+typedef struct
+{
+	uint64_t range;
+	uint8_t pad[56];
+} __attribute__((aligned(64))) deque_t;
+
+typedef struct
+{
+	pthread_t thread;
+	uint32_t id;
+	uint64_t chunks;
+	uint64_t steals;
+	cursor_t accel, gyro;
+} worker_t;
+
+// Result of a run
+typedef struct
+{
+	double seconds;
+	double merge;           // s the merge waited for nothing
+	uint64_t chunks;
+	uint64_t steals;
+	uint64_t deltas, windows, spectra, unpaired;
+	uint64_t hash[3];       // of the deltas, windows and spectra
+	double roll, pitch, yaw;  // at the end, deg
+	double tilt_rms, tilt_max;  // against the truth, deg
+	uint32_t peak_power;    // strongest vibration
+	double peak_hz;
+	uint8_t peak_axis;
+	int64_t peak_stamp;
+	int failed;
+} run_t;
+
+static const job_t * job;
+static chunk_t * chunks;
+static uint32_t chunk_count;
+static uint64_t chunk_samples, warmup;
+static deque_t deques[THREADS_MAX];
+static worker_t workers[THREADS_MAX];
+static int worker_count;
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+// Benchmark truth: body to world attitude every TRUTH_EVERY samples
+static quat_t * truth;
+static uint64_t truths;
+
+static double now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+	while (b)
+	{
+		uint32_t r = a % b;
+
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+static uint32_t lcm(uint32_t a, uint32_t b)
+{
+	return a / gcd(a, b) * b;
+}
+
+// Quaternions ------------------------------------------------------------
+
+static quat_t quat_mul(quat_t a, quat_t b)
+{
+	quat_t q;
+
+	q.w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+	q.x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+	q.y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+	q.z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+	return q;
+}
+
+// Rotation by a rotation vector
+static quat_t quat_vector(const double * v)
+{
+	double angle = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	double s = angle > 1e-12 ? sin(angle / 2) / angle : 0.5;
+	quat_t q = {cos(angle / 2), v[0] * s, v[1] * s, v[2] * s};
+
+	return q;
+}
+
+static quat_t quat_normalize(quat_t q)
+{
+	double n = sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+
+	q.w /= n;
+	q.x /= n;
+	q.y /= n;
+	q.z /= n;
+	return q;
+}
+
+// World up in the body frame of attitude q
+static void quat_up(quat_t q, double * up)
+{
+	up[0] = 2 * (q.x * q.z - q.w * q.y);
+	up[1] = 2 * (q.y * q.z + q.w * q.x);
+	up[2] = 1 - 2 * (q.x * q.x + q.y * q.y);
+}
+
+static void quat_euler(quat_t q, double * roll, double * pitch, double * yaw)
+{
+	double s = 2 * (q.w * q.y - q.z * q.x);
+
+	*roll = atan2(2 * (q.w * q.x + q.y * q.z), 1 - 2 * (q.x * q.x + q.y * q.y)) *
+		180 / M_PI;
+	*pitch = asin(s > 1 ? 1 : s < -1 ? -1 : s) * 180 / M_PI;
+	*yaw = atan2(2 * (q.w * q.z + q.x * q.y), 1 - 2 * (q.y * q.y + q.z * q.z)) *
+		180 / M_PI;
+}
+
+// Chunks -----------------------------------------------------------------
+
+static int cursor_init(cursor_t * c, const clog_file_t * f, int channel)
+{
+	uint32_t n = f->header->block_samples;
+
+	memset(c, 0, sizeof(*c));
+	c->index = f->index + f->channels[channel].index_first;
+	c->blocks = f->channels[channel].blocks;
+	c->block = UINT64_MAX;
+	c->stamps = malloc((size_t)n * sizeof(*c->stamps));
+	c->values = malloc((size_t)n * CLOG_AXES_MAX * sizeof(*c->values));
+	return c->stamps && c->values ? 0 : -1;
+}
+
+static void cursor_free(cursor_t * c)
+{
+	free(c->stamps);
+	free(c->values);
+	c->stamps = NULL;
+	c->values = NULL;
+}
+
+// Load the block of a sample, returns the sample's place in it or -1
+static long cursor_seek(cursor_t * c, uint64_t sample)
+{
+	uint32_t bs = job->f->header->block_samples;
+	uint64_t block = sample / bs;
+
+	if (block != c->block)
+	{
+		const clog_block_t * b;
+
+		if (block >= c->blocks || !(b = clog_block(job->f, &c->index[block])) ||
+			!(c->n = clog_columns(b, c->stamps, c->values, &c->t, &c->v)))
+		{
+			c->block = UINT64_MAX;
+			return -1;
+		}
+		c->block = block;
+	}
+	return sample % bs < c->n ? (long)(sample % bs) : -1;
+}
+
+// Run the kernels over chunk k, after the warm-up before it
+static void run_chunk(worker_t * w, uint32_t k)
+{
+	static const wstats_limit_t none = {WSTATS_NO_LOW, WSTATS_NO_HIGH,
+		WSTATS_NO_LIMIT, WSTATS_NO_LIMIT, 0, 0, 255};
+	chunk_t * c = &chunks[k];
+	uint64_t start = (uint64_t)k * chunk_samples;
+	uint64_t end = start + chunk_samples < job->samples ?
+		start + chunk_samples : job->samples;
+	uint64_t i = start > warmup ? start - warmup : 0;
+	int64_t half = 500000 / job->rate;
+	biquad_state_t state[3][LOWPASS_SECTIONS];
+	filter_stage_t stage[3];
+	filter_pipeline_t lowpass[3];
+	preint_t p;
+	wstats_t accel_ws, gyro_ws;
+	vib_t vib;
+	uint8_t a;
+
+	c->delta = malloc(((end - start) / job->decimation + 1) * sizeof(*c->delta));
+	c->stats = malloc(((end - start) / job->window + 1) * sizeof(*c->stats));
+	c->spectrum = malloc(((end - start) / VIB_FFT_SIZE + 1) *
+		sizeof(*c->spectrum));
+	if (!c->delta || !c->stats || !c->spectrum)
+	{
+		c->failed = 1;
+		return;
+	}
+
+	preint_init(&p, job->rate, job->decimation, job->gyro_bias, NULL);
+	wstats_init(&accel_ws, 0, job->window, &none);
+	wstats_init(&gyro_ws, 1, job->window, &none);
+	vib_init(&vib, job->rate);
+	vib_set_bands(&vib, job->bands);
+	for (a = 0; a < 3; a++)
+	{
+		filter_biquad_init(&stage[a], job->lowpass, state[a], LOWPASS_SECTIONS);
+		lowpass[a].stages = &stage[a];
+		lowpass[a].count = 1;
+	}
+
+	while (i < end)
+	{
+		long ai = cursor_seek(&w->accel, i), gi = cursor_seek(&w->gyro, i);
+		int16_t x[SUB_BLOCK][3], g[SUB_BLOCK][3], y[3][SUB_BLOCK];
+		uint32_t n = SUB_BLOCK, j;
+
+		if (ai < 0 || gi < 0)
+		{
+			c->failed = 1;
+			return;
+		}
+		// within both blocks and the chunk
+		n = w->accel.n - ai < n ? w->accel.n - ai : n;
+		n = w->gyro.n - gi < n ? w->gyro.n - gi : n;
+		n = end - i < n ? end - i : n;
+
+		for (j = 0; j < n; j++)
+		{
+			int64_t ta = w->accel.t[ai + j], tg = w->gyro.t[gi + j];
+
+			for (a = 0; a < 3; a++)
+			{
+				x[j][a] = w->accel.v[(size_t)a * w->accel.n + ai + j];
+				g[j][a] = w->gyro.v[(size_t)a * w->gyro.n + gi + j];
+			}
+			// as acquire_accel() in main.c
+			if (job->calib.valid & CALIB_ACCEL)
+			{
+				calib_apply(&job->calib.accel, x[j], x[j]);
+			}
+			for (a = 0; a < 3; a++)
+			{
+				y[a][j] = x[j][a];
+			}
+			if (i + j >= start && (tg - ta > half || ta - tg > half))
+			{
+				c->unpaired++;
+			}
+		}
+		for (a = 0; a < 3; a++)
+		{
+			filter_run(&lowpass[a], y[a], (uint8_t)n);
+		}
+
+		for (j = 0; j < n; j++)
+		{
+			int64_t stamp = w->accel.t[ai + j];
+			uint8_t keep = i + j >= start;
+			int16_t f[3], gb[3];
+			preint_delta_t d;
+			wstats_summary_t sa, sg;
+
+			if (preint_push(&p, (uint32_t)stamp, g[j], x[j], &d) && keep)
+			{
+				delta_rec_t * r = &c->delta[c->deltas++];
+
+				r->stamp = stamp;
+				r->sample = i + j;
+				r->delta = d;
+			}
+			if (vib_push(&vib, x[j][0], x[j][1], x[j][2]))
+			{
+				vib_result_t v;
+
+				vib_process(&vib, &v);
+				if (keep)
+				{
+					c->spectrum[c->spectra].stamp = stamp;
+					c->spectrum[c->spectra++].vib = v;
+				}
+			}
+			for (a = 0; a < 3; a++)
+			{
+				int32_t b = (int32_t)g[j][a] - job->gyro_lsb[a];
+
+				f[a] = y[a][j];
+				gb[a] = b > 32767 ? 32767 : b < -32768 ? -32768 : (int16_t)b;
+			}
+			// both windows close on the same sample
+			if ((wstats_push(&accel_ws, (uint32_t)stamp, f, &sa) &
+				wstats_push(&gyro_ws, (uint32_t)stamp, gb, &sg)) && keep)
+			{
+				stats_rec_t * r = &c->stats[c->windows++];
+
+				r->stamp = stamp;
+				r->accel = sa;
+				r->gyro = sg;
+			}
+		}
+		i += n;
+	}
+}
+
+// Take the next chunk of the thread's own range
+static int take(deque_t * d, uint32_t * k)
+{
+	uint64_t r = __atomic_load_n(&d->range, __ATOMIC_ACQUIRE);
+
+	while ((uint32_t)(r >> 32) < (uint32_t)r)
+	{
+		if (__atomic_compare_exchange_n(&d->range, &r, r + (1ULL << 32), 0,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		{
+			*k = (uint32_t)(r >> 32);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Take the later half of another thread's range: its first chunk to run
+// now, the rest as the own range. Only thieves shrink a range from the end
+// and only its owner moves its start, so a range that compares equal still
+// holds exactly the chunks nobody has taken.
+static int steal(worker_t * w, uint32_t * k)
+{
+	int v;
+
+	for (v = 1; v < worker_count; v++)
+	{
+		deque_t * d = &deques[(w->id + v) % worker_count];
+		uint64_t r = __atomic_load_n(&d->range, __ATOMIC_ACQUIRE);
+
+		while ((uint32_t)(r >> 32) < (uint32_t)r)
+		{
+			uint32_t next = (uint32_t)(r >> 32), end = (uint32_t)r;
+			uint32_t cut = end - (end - next + 1) / 2;
+
+			if (__atomic_compare_exchange_n(&d->range, &r,
+				((uint64_t)next << 32) | cut, 0, __ATOMIC_ACQ_REL,
+				__ATOMIC_ACQUIRE))
+			{
+				__atomic_store_n(&deques[w->id].range,
+					((uint64_t)(cut + 1) << 32) | end, __ATOMIC_RELEASE);
+				w->steals++;
+				*k = cut;
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static void * worker_main(void * arg)
+{
+	worker_t * w = arg;
+	uint32_t k;
+
+	while (take(&deques[w->id], &k) || steal(w, &k))
+	{
+		run_chunk(w, k);
+		w->chunks++;
+		pthread_mutex_lock(&done_lock);
+		chunks[k].done = 1;
+		pthread_cond_broadcast(&done_cond);
+		pthread_mutex_unlock(&done_lock);
+	}
+	return NULL;
+}
+
+// Merge ------------------------------------------------------------------
+
+static uint64_t mix(uint64_t h, int64_t x)
+{
+	// FNV-1a over 64 bit words
+	return (h ^ (uint64_t)x) * 0x100000001B3ULL;
+}
+
+static uint64_t hash_delta(uint64_t h, const delta_rec_t * r)
+{
+	uint8_t a;
+
+	for (a = 0; a < PREINT_AXES; a++)
+	{
+		h = mix(h, r->delta.angle[a]);
+		h = mix(h, r->delta.velocity[a]);
+	}
+	h = mix(h, r->delta.samples);
+	h = mix(h, r->delta.start);
+	h = mix(h, r->delta.end);
+	return mix(h, r->stamp);
+}
+
+static uint64_t hash_summary(uint64_t h, const wstats_summary_t * s)
+{
+	uint8_t a;
+
+	for (a = 0; a < WSTATS_AXES; a++)
+	{
+		const wstats_axis_t * x = &s->axis[a];
+
+		h = mix(h, x->mean);
+		h = mix(h, x->rms);
+		h = mix(h, x->variance);
+		h = mix(h, x->min);
+		h = mix(h, x->max);
+		h = mix(h, x->crossings);
+		h = mix(h, x->exceeded);
+	}
+	h = mix(h, s->start);
+	return mix(h, s->end);
+}
+
+static uint64_t hash_spectrum(uint64_t h, const spectrum_rec_t * r)
+{
+	uint8_t a, b;
+
+	for (a = 0; a < 3; a++)
+	{
+		const vib_axis_t * x = &r->vib.axis[a];
+
+		for (b = 0; b < VIB_BANDS; b++)
+		{
+			h = mix(h, x->band_energy[b]);
+		}
+		h = mix(h, x->peak_bin);
+		h = mix(h, x->peak_power);
+		h = mix(h, x->peak_freq_dhz);
+	}
+	return mix(h, r->stamp);
+}
+
+typedef struct
+{
+	quat_t q;
+	int started;
+	double tilt_sum;
+	uint64_t tilts;
+} fusion_t;
+
+// Compose a delta into the attitude, with the tilt correction
+static void fusion_update(fusion_t * fu, const delta_rec_t * r, run_t * run)
+{
+	const preint_delta_t * d = &r->delta;
+	double dt = (double)d->samples / job->rate;
+	double phi[3], force[3], n, up[3], e[3];
+	uint8_t a;
+
+	for (a = 0; a < 3; a++)
+	{
+		phi[a] = d->angle[a] / (double)(1UL << PREINT_ANGLE_FRAC);
+		force[a] = d->velocity[a] / (double)(1UL << PREINT_VELOCITY_FRAC) / dt;
+	}
+	n = sqrt(force[0] * force[0] + force[1] * force[1] + force[2] * force[2]);
+	if (!fu->started)
+	{
+		// level and heading zero from the first delta
+		double roll = atan2(force[1], force[2]);
+		double pitch = atan2(-force[0], sqrt(force[1] * force[1] +
+			force[2] * force[2]));
+		double v[3] = {roll, 0, 0}, u[3] = {0, pitch, 0};
+
+		fu->q = quat_mul(quat_vector(u), quat_vector(v));
+		fu->started = 1;
+	}
+	fu->q = quat_normalize(quat_mul(fu->q, quat_vector(phi)));
+
+	if (fabs(n - PREINT_GRAVITY) < FUSION_GATE * PREINT_GRAVITY)
+	{
+		// turn the body a part of the way from the up it believes in to the
+		// up it measures
+		double k = dt / FUSION_TAU;
+
+		quat_up(fu->q, up);
+		e[0] = (force[1] * up[2] - force[2] * up[1]) / n * k;
+		e[1] = (force[2] * up[0] - force[0] * up[2]) / n * k;
+		e[2] = (force[0] * up[1] - force[1] * up[0]) / n * k;
+		fu->q = quat_normalize(quat_mul(fu->q, quat_vector(e)));
+	}
+
+	if (truth && (r->sample + 1) % TRUTH_EVERY == 0 &&
+		(r->sample + 1) / TRUTH_EVERY - 1 < truths)
+	{
+		double want[3], c, err;
+
+		quat_up(fu->q, up);
+		quat_up(truth[(r->sample + 1) / TRUTH_EVERY - 1], want);
+		c = up[0] * want[0] + up[1] * want[1] + up[2] * want[2];
+		err = acos(c > 1 ? 1 : c < -1 ? -1 : c) * 180 / M_PI;
+		fu->tilt_sum += err * err;
+		fu->tilts++;
+		run->tilt_max = err > run->tilt_max ? err : run->tilt_max;
+	}
+}
+
+typedef struct
+{
+	FILE * attitude, * stats, * spectrum;
+} outputs_t;
+
+static void write_summary(FILE * out, const wstats_summary_t * s,
+	int64_t stamp, int64_t first, uint8_t gyro)
+{
+	uint8_t a;
+
+	fprintf(out, "%u,%lld,%lld", s->stream, (long long)first,
+		(long long)stamp);
+	for (a = 0; a < WSTATS_AXES; a++)
+	{
+		const wstats_axis_t * x = &s->axis[a];
+		int16_t rms = x->rms > 32767 ? 32767 : (int16_t)x->rms;
+
+		if (gyro)
+		{
+			fprintf(out, ",%ld,%ld,%ld,%ld", (long)mpu_gyro_cdps(x->mean),
+				(long)mpu_gyro_cdps(rms), (long)mpu_gyro_cdps(x->min),
+				(long)mpu_gyro_cdps(x->max));
+		}
+		else
+		{
+			fprintf(out, ",%ld,%ld,%ld,%ld", (long)mpu_accel_mg(x->mean),
+				(long)mpu_accel_mg(rms), (long)mpu_accel_mg(x->min),
+				(long)mpu_accel_mg(x->max));
+		}
+	}
+	fputc('\n', out);
+}
+
+static void merge_chunk(const chunk_t * c, fusion_t * fu, run_t * run,
+	const outputs_t * out)
+{
+	uint32_t i;
+	uint8_t a, b;
+
+	for (i = 0; i < c->deltas; i++)
+	{
+		const delta_rec_t * r = &c->delta[i];
+
+		run->hash[0] = hash_delta(run->hash[0], r);
+		fusion_update(fu, r, run);
+		if (out->attitude)
+		{
+			double roll, pitch, yaw;
+
+			quat_euler(fu->q, &roll, &pitch, &yaw);
+			fprintf(out->attitude, "%lld,%.3f,%.3f,%.3f\n", (long long)r->stamp,
+				roll, pitch, yaw);
+		}
+	}
+	for (i = 0; i < c->windows; i++)
+	{
+		const stats_rec_t * r = &c->stats[i];
+		// the window's first stamp, its low 32 bits are in the summary
+		int64_t first = r->stamp - (uint32_t)(r->accel.end - r->accel.start);
+
+		run->hash[1] = hash_summary(hash_summary(run->hash[1], &r->accel),
+			&r->gyro);
+		if (out->stats)
+		{
+			write_summary(out->stats, &r->accel, r->stamp, first, 0);
+			write_summary(out->stats, &r->gyro, r->stamp, first, 1);
+		}
+	}
+	for (i = 0; i < c->spectra; i++)
+	{
+		const spectrum_rec_t * r = &c->spectrum[i];
+
+		run->hash[2] = hash_spectrum(run->hash[2], r);
+		for (a = 0; a < 3; a++)
+		{
+			const vib_axis_t * x = &r->vib.axis[a];
+
+			if (x->peak_power > run->peak_power)
+			{
+				run->peak_power = x->peak_power;
+				run->peak_hz = x->peak_freq_dhz / 10.0;
+				run->peak_axis = a;
+				run->peak_stamp = r->stamp;
+			}
+			if (out->spectrum)
+			{
+				fprintf(out->spectrum, "%lld,%u,%.1f,%lu", (long long)r->stamp, a,
+					x->peak_freq_dhz / 10.0, (unsigned long)x->peak_power);
+				for (b = 0; b < VIB_BANDS; b++)
+				{
+					fprintf(out->spectrum, ",%lu",
+						(unsigned long)x->band_energy[b]);
+				}
+				fputc('\n', out->spectrum);
+			}
+		}
+	}
+	run->deltas += c->deltas;
+	run->windows += c->windows;
+	run->spectra += c->spectra;
+	run->unpaired += c->unpaired;
+}
+
+// Run the job on threads threads in chunks of chunk samples
+static int process(int threads, uint64_t chunk, const outputs_t * out,
+	run_t * run)
+{
+	fusion_t fu;
+	double start = now(), t;
+	uint64_t k;
+	int i;
+
+	memset(run, 0, sizeof(*run));
+	memset(&fu, 0, sizeof(fu));
+	chunk_samples = chunk;
+	chunk_count = (uint32_t)((job->samples + chunk - 1) / chunk);
+	// the filters settle, then a window gives the statistics' reference
+	warmup = (WARMUP_MIN + job->window + job->align - 1) / job->align *
+		job->align;
+	chunks = calloc(chunk_count, sizeof(*chunks));
+	if (!chunks)
+	{
+		fprintf(stderr, "out of memory\n");
+		return -1;
+	}
+
+	worker_count = threads;
+	for (i = 0; i < threads; i++)
+	{
+		worker_t * w = &workers[i];
+
+		deques[i].range = ((uint64_t)chunk_count * i / threads) << 32 |
+			(uint64_t)chunk_count * (i + 1) / threads;
+		memset(w, 0, sizeof(*w));
+		w->id = i;
+		if (cursor_init(&w->accel, job->f, job->accel) ||
+			cursor_init(&w->gyro, job->f, job->gyro))
+		{
+			fprintf(stderr, "out of memory\n");
+			return -1;
+		}
+	}
+	for (i = 0; i < threads; i++)
+	{
+		pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+	}
+
+	for (k = 0; k < chunk_count; k++)
+	{
+		chunk_t * c = &chunks[k];
+
+		pthread_mutex_lock(&done_lock);
+		while (!c->done)
+		{
+			pthread_cond_wait(&done_cond, &done_lock);
+		}
+		pthread_mutex_unlock(&done_lock);
+		t = now();
+		if (c->failed)
+		{
+			run->failed = 1;
+		}
+		else
+		{
+			merge_chunk(c, &fu, run, out);
+		}
+		free(c->delta);
+		free(c->stats);
+		free(c->spectrum);
+		run->merge += now() - t;
+	}
+
+	for (i = 0; i < threads; i++)
+	{
+		pthread_join(workers[i].thread, NULL);
+		run->steals += workers[i].steals;
+		cursor_free(&workers[i].accel);
+		cursor_free(&workers[i].gyro);
+	}
+	free(chunks);
+	chunks = NULL;
+	run->seconds = now() - start;
+	run->chunks = chunk_count;
+	run->tilt_rms = fu.tilts ? sqrt(fu.tilt_sum / fu.tilts) : 0;
+	quat_euler(fu.q, &run->roll, &run->pitch, &run->yaw);
+	return run->failed ? -1 : 0;
+}
+
+// Setup ------------------------------------------------------------------
+
+static const char * accel_name = "accel", * gyro_name = "gyro";
+static const char * calib_path;
+static int decimation = 16, window = 1024;
+static double lowpass_hz = 20, rest_seconds = 5;
+static int bias_given;
+static float bias[3];
+static job_t config;
+static uint8_t sim_eeprom[4096];
+
+void eeprom_read_block(void * dst, const void * src, size_t n)
+{
+	memcpy(dst, &sim_eeprom[(uintptr_t)src], n);
+}
+
+// The mean of the first seconds of the gyro, in LSB
+static int gyro_rest(double * mean)
+{
+	uint64_t n = (uint64_t)(rest_seconds * config.rate), i;
+	double sum[3] = {0, 0, 0};
+	cursor_t c;
+	uint8_t a;
+
+	n = n < config.samples ? n : config.samples;
+	if (n == 0 || cursor_init(&c, config.f, config.gyro))
+	{
+		return -1;
+	}
+	for (i = 0; i < n; i++)
+	{
+		long j = cursor_seek(&c, i);
+
+		if (j < 0)
+		{
+			cursor_free(&c);
+			return -1;
+		}
+		for (a = 0; a < 3; a++)
+		{
+			sum[a] += c.v[(size_t)a * c.n + j];
+		}
+	}
+	cursor_free(&c);
+	for (a = 0; a < 3; a++)
+	{
+		mean[a] = sum[a] / n;
+	}
+	return 0;
+}
+
+// Fill config from the log and the options and make it the job
+static int setup(const clog_file_t * f)
+{
+	const clog_channel_t * ca, * cg;
+	double mean[3], rate;
+	uint8_t a;
+
+	memset(&config, 0, sizeof(config));
+	config.f = f;
+	config.accel = clog_channel(f, accel_name);
+	config.gyro = clog_channel(f, gyro_name);
+	if (config.accel < 0 || config.gyro < 0)
+	{
+		fprintf(stderr, "no channel %s\n", config.accel < 0 ? accel_name :
+			gyro_name);
+		return -1;
+	}
+	ca = &f->channels[config.accel];
+	cg = &f->channels[config.gyro];
+	if (ca->axes < 3 || cg->axes < 3)
+	{
+		fprintf(stderr, "channels need three axes\n");
+		return -1;
+	}
+	config.samples = ca->samples < cg->samples ? ca->samples : cg->samples;
+	if (config.samples < 2 || ca->last <= ca->first)
+	{
+		fprintf(stderr, "not enough samples\n");
+		return -1;
+	}
+	rate = (ca->samples - 1) * 1e6 / (ca->last - ca->first);
+	if (rate < 1 || rate > 65535)
+	{
+		fprintf(stderr, "sample rate %.1f Hz out of range\n", rate);
+		return -1;
+	}
+	config.rate = (uint16_t)lround(rate);
+	config.decimation = decimation;
+	config.window = window;
+	config.align = lcm(lcm(decimation, window), VIB_FFT_SIZE);
+	job = &config;
+
+	if (calib_path)
+	{
+		FILE * in = fopen(calib_path, "rb");
+		size_t n = in ? fread(&sim_eeprom[CALIB_EEPROM_ADDR], 1,
+			CALIB_BLOB_BYTES, in) : 0;
+
+		if (in)
+		{
+			fclose(in);
+		}
+		if (n != CALIB_BLOB_BYTES ||
+			!(calib_load(&config.calib) & CALIB_ACCEL))
+		{
+			fprintf(stderr, "%s: no accelerometer calibration\n", calib_path);
+			return -1;
+		}
+	}
+	// Butterworth as two sections
+	filter_biquad_lowpass(&config.lowpass[0], lowpass_hz / config.rate,
+		0.5412f);
+	filter_biquad_lowpass(&config.lowpass[1], lowpass_hz / config.rate,
+		1.3066f);
+	config.bands[0] = 0;
+	config.bands[1] = config.rate / 20;
+	config.bands[2] = config.rate * 3 / 20;
+	config.bands[3] = config.rate * 3 / 10;
+	config.bands[4] = config.rate / 2;
+
+	if (bias_given)
+	{
+		for (a = 0; a < 3; a++)
+		{
+			mean[a] = bias[a] / MPU_GYRO_RES;
+		}
+	}
+	else if (gyro_rest(mean))
+	{
+		fprintf(stderr, "cannot read the gyro\n");
+		return -1;
+	}
+	for (a = 0; a < 3; a++)
+	{
+		config.gyro_bias[a] = (float)(mean[a] * MPU_GYRO_RES);
+		config.gyro_lsb[a] = (int16_t)lround(mean[a]);
+	}
+	return 0;
+}
+
+// Benchmark --------------------------------------------------------------
+
+#define NOISE_TABLE		4096
+
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t next_random(void)
+{
+	// xorshift64*
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return (uint32_t)((rng * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static double gauss(void)
+{
+	double u = (next_random() + 1.0) / 4294967297.0;
+	double v = next_random() / 4294967296.0;
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static int16_t clamp16(double x)
+{
+	return x > 32767 ? 32767 : x < -32768 ? -32768 : (int16_t)lround(x);
+}
+
+// Write a log of pairs samples of the simulated motion to path and keep its
+// truth. Returns 0, or -1 with the error printed.
+static int simulate(const char * path, uint64_t pairs)
+{
+	static const double drift[3] = {1.5, -0.8, 0.6};     // dps
+	static const double shake[3] = {0.12, 0.08, 0.18};   // g at 80 Hz
+	static const double tilt[3] = {0.17, -0.09, 0};      // rad at the start
+	double noise[NOISE_TABLE];
+	double dt = 1.0 / BENCH_RATE, lsb_g = 1 / MPU_ACCEL_RES;
+	double lsb_dps = 1 / MPU_GYRO_RES;
+	double roll[3] = {tilt[0], 0, 0}, pitch[3] = {0, tilt[1], 0};
+	quat_t q = quat_mul(quat_vector(pitch), quat_vector(roll));
+	clog_writer_t w;
+	uint64_t i;
+	int ca, cg;
+	uint8_t a;
+
+	for (i = 0; i < NOISE_TABLE; i++)
+	{
+		noise[i] = gauss();
+	}
+	truths = 0;
+	truth = malloc((pairs / TRUTH_EVERY + 1) * sizeof(*truth));
+	if (!truth || clog_create(&w, path, 0, CLOG_DELTA) ||
+		(ca = clog_add_channel(&w, "accel", 0, 3)) < 0 ||
+		(cg = clog_add_channel(&w, "gyro", 1, 3)) < 0)
+	{
+		fprintf(stderr, "%s: %s\n", path, truth ? w.error : "out of memory");
+		return -1;
+	}
+
+	for (i = 0; i < pairs; i++)
+	{
+		double t = i * dt, m = t + dt / 2, up[3], rate[3], phi[3];
+		// motion after the rest, ramped in over 5 s
+		double move = m < 5 ? 0 : m < 10 ? (m - 5) / 5 : 1;
+		double burst = fmod(t, 20) >= 10 && fmod(t, 20) < 11 ? 0.25 : 0;
+		int64_t stamp = 1000 + (int64_t)i * (1000000 / BENCH_RATE);
+		int16_t accel[3], gyro[3];
+
+		quat_up(q, up);
+		for (a = 0; a < 3; a++)
+		{
+			rate[a] = move * (80 * sin(2 * M_PI * 0.11 * (a + 1) * m + a) +
+				60 * sin(2 * M_PI * 0.37 * (a + 2) * m + 2 * a));
+			phi[a] = rate[a] * M_PI / 180 * dt;
+			accel[a] = clamp16((up[a] + shake[a] * sin(2 * M_PI * 80 * t + a) +
+				burst * sin(2 * M_PI * 230 * t + 2 * a)) * lsb_g +
+				40 * noise[next_random() % NOISE_TABLE]);
+			gyro[a] = clamp16((rate[a] + drift[a]) * lsb_dps +
+				4 * noise[next_random() % NOISE_TABLE]);
+		}
+		if (clog_append(&w, ca, stamp, accel) || clog_append(&w, cg, stamp, gyro))
+		{
+			break;
+		}
+		q = quat_normalize(quat_mul(q, quat_vector(phi)));
+		if ((i + 1) % TRUTH_EVERY == 0)
+		{
+			truth[truths++] = q;
+		}
+	}
+	if (clog_finish(&w))
+	{
+		fprintf(stderr, "%s: %s\n", path, w.error);
+		return -1;
+	}
+	return 0;
+}
+
+static int identical(const run_t * a, const run_t * b)
+{
+	return a->deltas == b->deltas && a->windows == b->windows &&
+		a->spectra == b->spectra && !memcmp(a->hash, b->hash, sizeof(a->hash));
+}
+
+static int bench(const char * path, double gigabytes, const int * list,
+	int lists, int keep)
+{
+	static const outputs_t none;
+	// a pair is two stamps and six values raw
+	uint64_t pairs = (uint64_t)(gigabytes * 1e9 / 28);
+	clog_file_t f;
+	run_t ref, r;
+	double start = now(), first = 0;
+	int i, failed = 0;
+
+	pairs = pairs / TRUTH_EVERY * TRUTH_EVERY;
+	if (pairs < 20 * BENCH_RATE)
+	{
+		fprintf(stderr, "log too short\n");
+		return 2;
+	}
+	if (simulate(path, pairs))
+	{
+		unlink(path);
+		return 2;
+	}
+	if (clog_open(&f, path))
+	{
+		fprintf(stderr, "%s: %s\n", path, f.error);
+		unlink(path);
+		return 2;
+	}
+	printf("simulated log: %llu samples of accel and gyro, %.1f h at %d Hz, "
+		"%.2f GB in %.1f s, %ld cores\n", (unsigned long long)pairs,
+		pairs / (3600.0 * BENCH_RATE), BENCH_RATE, f.size / 1e9, now() - start,
+		sysconf(_SC_NPROCESSORS_ONLN));
+	if (setup(&f))
+	{
+		clog_close(&f);
+		unlink(path);
+		return 2;
+	}
+	printf("gyro bias estimated %.3f %.3f %.3f dps, chunks of %llu samples\n",
+		config.gyro_bias[0], config.gyro_bias[1], config.gyro_bias[2],
+		(unsigned long long)chunk_samples);
+
+	// the whole log at once
+	if (process(1, (config.samples + config.align - 1) / config.align *
+		config.align, &none, &ref))
+	{
+		printf("reference run failed\n");
+		failed = 1;
+	}
+	printf("%9s %9s %10s %9s %7s %7s %9s %9s %9s\n", "threads", "seconds",
+		"Msamples/s", "speed-up", "steals", "merge", "identical", "tilt rms",
+		"tilt max");
+	printf("%9s %9.2f %10.2f %9s %7s %6.1f%% %9s %9.3f %9.3f\n", "reference",
+		ref.seconds, pairs / 1e6 / ref.seconds, "", "",
+		100 * ref.merge / ref.seconds, "", ref.tilt_rms, ref.tilt_max);
+	for (i = 0; i < lists && !failed; i++)
+	{
+		int same;
+
+		if (process(list[i], chunk_samples, &none, &r))
+		{
+			printf("chunks failed\n");
+			failed = 1;
+			break;
+		}
+		same = identical(&r, &ref);
+		first = i ? first : r.seconds;
+		printf("%9d %9.2f %10.2f %9.2f %7llu %6.1f%% %9s %9.3f %9.3f\n",
+			list[i], r.seconds, pairs / 1e6 / r.seconds, first / r.seconds,
+			(unsigned long long)r.steals, 100 * r.merge / r.seconds,
+			same ? "yes" : "NO", r.tilt_rms, r.tilt_max);
+		failed |= !same || r.tilt_max > BENCH_TILT_MAX;
+	}
+	printf("\n%llu deltas, %llu windows, %llu spectra, %llu unpaired; strongest "
+		"vibration %.1f Hz on axis %u\n", (unsigned long long)ref.deltas,
+		(unsigned long long)ref.windows, (unsigned long long)ref.spectra,
+		(unsigned long long)ref.unpaired, ref.peak_hz, ref.peak_axis);
+
+	clog_close(&f);
+	free(truth);
+	truth = NULL;
+	if (!keep)
+	{
+		unlink(path);
+	}
+	return failed;
+}
+
+static FILE * open_output(const char * prefix, const char * name,
+	const char * header)
+{
+	char path[4096];
+	FILE * out;
+
+	snprintf(path, sizeof(path), "%s.%s.csv", prefix, name);
+	out = fopen(path, "w");
+	if (!out)
+	{
+		fprintf(stderr, "%s: cannot create file\n", path);
+		return NULL;
+	}
+	setvbuf(out, NULL, _IOFBF, 1 << 20);
+	fprintf(out, "# %s\n", header);
+	return out;
+}
+
+int main(int argc, char ** argv)
+{
+	const char * prefix = NULL;
+	double gigabytes = 1;
+	int list[THREADS_MAX], lists = 0, i, first = 0, benchmark = 0, keep = 0;
+	int bad = 0, status;
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	uint64_t chunk = 65536;
+	outputs_t out = {NULL, NULL, NULL};
+	clog_file_t f;
+	run_t r;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-a") && i + 1 < argc)
+		{
+			accel_name = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-G") && i + 1 < argc)
+		{
+			gyro_name = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-C") && i + 1 < argc)
+		{
+			calib_path = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-g") && i + 1 < argc)
+		{
+			bias_given = sscanf(argv[++i], "%f,%f,%f", &bias[0], &bias[1],
+				&bias[2]) == 3;
+			bad = !bias_given;
+		}
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+		{
+			rest_seconds = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+		{
+			chunk = strtoull(argv[++i], NULL, 10);
+		}
+		else if (!strcmp(argv[i], "-D") && i + 1 < argc)
+		{
+			decimation = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-W") && i + 1 < argc)
+		{
+			window = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+		{
+			lowpass_hz = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+		{
+			char * p = argv[++i];
+
+			for (lists = 0; *p && lists < THREADS_MAX; lists++)
+			{
+				list[lists] = (int)strtol(p, &p, 10);
+				p += *p == ',';
+			}
+		}
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+		{
+			prefix = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-S") && i + 1 < argc)
+		{
+			gigabytes = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-b"))
+		{
+			benchmark = 1;
+		}
+		else if (!strcmp(argv[i], "-k"))
+		{
+			keep = 1;
+		}
+		else if (argv[i][0] == '-')
+		{
+			bad = 1;
+			break;
+		}
+		else
+		{
+			first = i;
+			break;
+		}
+	}
+	if (bad || !first || first != argc - 1)
+	{
+		fprintf(stderr, "usage: %s [-a channel] [-G channel] [-C blob.bin] "
+			"[-g x,y,z] [-s seconds] [-c samples] [-D decimation] [-W window] "
+			"[-f hz] [-j threads] [-o prefix] log.clog\n"
+			"       %s -b [-S gigabytes] [-j 1,2,4,...] [-k] file\n",
+			argv[0], argv[0]);
+		return 2;
+	}
+	if (decimation < 1 || decimation > PREINT_DECIMATION_MAX || window < 2 ||
+		window > WSTATS_WINDOW_MAX || chunk == 0 ||
+		chunk % lcm(lcm(decimation, window), VIB_FFT_SIZE) ||
+		chunk > UINT32_MAX || lowpass_hz <= 0 || rest_seconds <= 0)
+	{
+		fprintf(stderr, "bad decimation, window, chunk (a multiple of %u), "
+			"low-pass or rest time\n",
+			lcm(lcm(decimation, window), VIB_FFT_SIZE));
+		return 2;
+	}
+	if (!lists)
+	{
+		// 1, 2, 4, ... and all cores for the benchmark, all cores otherwise
+		for (i = benchmark ? 1 : cores; i < cores && lists < THREADS_MAX - 1;
+			i *= 2)
+		{
+			list[lists++] = i;
+		}
+		list[lists++] = cores < THREADS_MAX ? cores : THREADS_MAX;
+	}
+	for (i = 0; i < lists; i++)
+	{
+		if (list[i] < 1 || list[i] > THREADS_MAX)
+		{
+			fprintf(stderr, "1 - %d threads\n", THREADS_MAX);
+			return 2;
+		}
+	}
+	chunk_samples = chunk;
+
+	if (benchmark)
+	{
+		return bench(argv[first], gigabytes, list, lists, keep);
+	}
+
+	if (clog_open(&f, argv[first]))
+	{
+		fprintf(stderr, "%s: %s\n", argv[first], f.error);
+		return 2;
+	}
+	if (setup(&f))
+	{
+		clog_close(&f);
+		return 2;
+	}
+	if (prefix && (!(out.attitude = open_output(prefix, "attitude",
+		"stamp,roll,pitch,yaw")) || !(out.stats = open_output(prefix, "stats",
+		"stream,start,end,mean,rms,min,max of x,y,z")) ||
+		!(out.spectrum = open_output(prefix, "spectrum",
+		"stamp,axis,peak hz,peak power,band energies"))))
+	{
+		clog_close(&f);
+		return 2;
+	}
+
+	printf("%llu samples at %u Hz, gyro bias %.3f %.3f %.3f dps (%s), "
+		"%llu samples a chunk, %d threads\n",
+		(unsigned long long)config.samples, config.rate, config.gyro_bias[0],
+		config.gyro_bias[1], config.gyro_bias[2], bias_given ? "given" :
+		"estimated", (unsigned long long)chunk, list[0]);
+	status = process(list[0], chunk, &out, &r) ? 1 : 0;
+	printf("%llu chunks in %.2f s, %.2f Msamples/s, %llu steals\n",
+		(unsigned long long)r.chunks, r.seconds,
+		config.samples / 1e6 / r.seconds, (unsigned long long)r.steals);
+	printf("%llu deltas, %llu windows, %llu spectra, %llu unpaired samples\n",
+		(unsigned long long)r.deltas, (unsigned long long)r.windows,
+		(unsigned long long)r.spectra, (unsigned long long)r.unpaired);
+	printf("attitude at the end: roll %.2f pitch %.2f yaw %.2f deg\n", r.roll,
+		r.pitch, r.yaw);
+	if (r.peak_power)
+	{
+		printf("strongest vibration: %.1f Hz on axis %u at %.3f s\n", r.peak_hz,
+			r.peak_axis, (r.peak_stamp - f.header->first) / 1e6);
+	}
+	if (status)
+	{
+		printf("chunks failed\n");
+	}
+
+	if (out.attitude)
+	{
+		fclose(out.attitude);
+		fclose(out.stats);
+		fclose(out.spectrum);
+	}
+	clog_close(&f);
+	return status;
+}
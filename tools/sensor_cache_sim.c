@@ -0,0 +1,201 @@
+// Simulated run of sensor_cache.c with the main loop of main.c, to count
+// the physical sensor reads the cache saves. After each LCD refresh the loop
+// asks the accelerometer and the DHT11 for a reading of any age on every
+// pass until the next refresh is due, 1 s later (100 ms while the
+// magnetometer is missing); without the cache each request would be a
+// transfer. The sensors are modelled by the time a read blocks and the time
+// they need for a new value, a read inside that time returns the old value
+// (DHT11/22) or the same sample (MPU-9250).
+//
+// Build and run from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -Itools/host -I. -o sensor_cache_sim tools/sensor_cache_sim.c sensor_cache.c
+//   ./sensor_cache_sim [minutes] [-m]
+//
+// The run lasts 10 minutes of simulated time unless given, -m runs it with
+// the magnetometer missing. The exit status
+// is 1 if a consumer was handed a reading older than it asked for while the
+// sensor could have delivered a newer one, or a sensor was read faster than
+// it produces values.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "sensor_cache.h"
+#include "timebase.h"
+
+typedef struct
+{
+	const char * name;
+	uint32_t interval;      // time for a new value, us
+	uint32_t read_us;       // time a read blocks
+	unsigned long reads;    // the cache's own counters are 16 bits
+	unsigned long too_soon; // reads inside the interval, which the cache
+	                        // must never do
+	unsigned long updates;  // readings that held a new value
+	uint32_t last_read;
+	uint8_t read_once;
+	sensor_cache_t cache;
+} sim_sensor_t;
+
+typedef struct
+{
+	const char * name;
+	sim_sensor_t * sensor;
+	uint32_t max_age;
+	unsigned long requests;
+	unsigned long stale;    // older than asked for
+	unsigned long empty;
+} sim_consumer_t;
+
+static uint64_t clock_us;
+static unsigned long violations;
+
+uint32_t timebase_now(void)
+{
+	return (uint32_t)clock_us;
+}
+
+static uint8_t sim_acquire(sensor_cache_t * cache)
+{
+	sim_sensor_t * s = cache->context;
+
+	if (s->read_once && (uint32_t)clock_us - s->last_read < s->interval)
+	{
+		s->too_soon++;
+	}
+	else
+	{
+		s->updates++;
+	}
+	s->reads++;
+	s->read_once = 1;
+	s->last_read = (uint32_t)clock_us;
+	clock_us += s->read_us;
+	return 0;
+}
+
+// DHT11 on DHT_PIN and the MPU-9250 at its default 200 Hz output rate
+static sim_sensor_t sensors[] =
+{
+	{"DHT11", 1000000, 25000},
+	{"MPU-9250 accel", 5000, 600},
+};
+
+// The requests of one pass of main.c's loop, in its order: accel_cache and
+// DHT_readCached(), both feeding the alarms
+static sim_consumer_t consumers[] =
+{
+	{"loop accel", &sensors[1], 0},
+	{"loop DHT_readCached", &sensors[0], 0},
+};
+
+#define SIM_REFRESH_US		1000000		// LCD refresh with a magnetometer
+#define SIM_REFRESH_NO_MAG	100000
+#define SIM_LCD_US			5000		// the refresh and its WHO_AM_I read
+#define SIM_PASS_US			50			// a pass of the loop besides the reads
+
+#define SIM_SENSORS		(sizeof(sensors) / sizeof(sensors[0]))
+#define SIM_CONSUMERS	(sizeof(consumers) / sizeof(consumers[0]))
+
+static void request(sim_consumer_t * c)
+{
+	sim_sensor_t * s = c->sensor;
+	enum SENSOR_CACHE_STATUS_t status;
+
+	c->requests++;
+	status = sensor_cache_get(&s->cache, c->max_age);
+	if (status == SENSOR_CACHE_STALE)
+	{
+		c->stale++;
+		// fine only while the sensor had no newer value to give
+		if ((uint32_t)clock_us - s->last_read >= s->interval)
+		{
+			violations++;
+		}
+	}
+	else if (status == SENSOR_CACHE_EMPTY)
+	{
+		c->empty++;
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	double minutes = 10;
+	uint32_t refresh = SIM_REFRESH_US;
+	uint64_t end, shown;
+	unsigned long direct = 0, reads = 0, requests, refreshes = 0;
+	unsigned i;
+
+	for (i = 1; i < (unsigned)argc; i++)
+	{
+		if (argv[i][0] == '-' && argv[i][1] == 'm')
+		{
+			refresh = SIM_REFRESH_NO_MAG;
+		}
+		else
+		{
+			minutes = atof(argv[i]);
+		}
+	}
+	end = (uint64_t)(minutes * 60e6);
+
+	for (i = 0; i < SIM_SENSORS; i++)
+	{
+		sensor_cache_t c = SENSOR_CACHE(sim_acquire, SENSOR_SOURCE_SINGLE,
+			&sensors[i], sensors[i].interval);
+		sensors[i].cache = c;
+	}
+	// the clock starts late enough for every interval to have passed
+	clock_us = 10000000;
+	end += clock_us;
+
+	// The loop of main.c; a blocking read delays the rest of the pass like
+	// it does on the single threaded firmware
+	while (clock_us < end)
+	{
+		clock_us += SIM_LCD_US;
+		refreshes++;
+		shown = clock_us;
+		do
+		{
+			for (i = 0; i < SIM_CONSUMERS; i++)
+			{
+				request(&consumers[i]);
+			}
+			clock_us += SIM_PASS_US;
+		} while (clock_us - shown < refresh);
+	}
+
+	printf("%.1f minutes simulated, %lu LCD refreshes %lu ms apart\n\n",
+		minutes, refreshes, (unsigned long)refresh / 1000);
+	printf("%-20s %9s %9s %9s\n", "consumer", "requests", "stale", "empty");
+	for (i = 0; i < SIM_CONSUMERS; i++)
+	{
+		printf("%-20s %9lu %9lu %9lu\n", consumers[i].name,
+			consumers[i].requests, consumers[i].stale, consumers[i].empty);
+	}
+
+	printf("\n%-20s %9s %9s %9s %9s %8s\n", "sensor", "uncached", "reads",
+		"saved", "too soon", "new");
+	for (i = 0; i < SIM_SENSORS; i++)
+	{
+		sim_sensor_t * s = &sensors[i];
+		unsigned j;
+
+		for (requests = 0, j = 0; j < SIM_CONSUMERS; j++)
+		{
+			requests += consumers[j].sensor == s ? consumers[j].requests : 0;
+		}
+		printf("%-20s %9lu %9lu %8.1f%% %9lu %7.1f%%\n", s->name, requests,
+			s->reads, 100.0 * (requests - s->reads) / requests, s->too_soon,
+			100.0 * s->updates / s->reads);
+		direct += requests;
+		reads += s->reads;
+		violations += s->too_soon;
+	}
+	printf("\n%lu of %lu physical reads eliminated, %lu violations\n",
+		direct - reads, direct, violations);
+	return violations != 0;
+}
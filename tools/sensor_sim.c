@@ -0,0 +1,354 @@
+// Run of the firmware's sensor drivers against the simulated world in
+// tools/sim. mpu9250.c, DHT.c and sensor_cache.c are compiled unchanged for
+// the host; the MPU-9250, AK8963 and DHT models answer their bus traffic and
+// pin wiggling with values derived from a motion and environment scenario,
+// so the result can be compared with the truth.
+//
+// Build and run from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -Itools/host -Itools/sim -I. -o sensor_sim tools/sensor_sim.c
+//       tools/sim/sim_world.c tools/sim/sim_mpu.c tools/sim/sim_dht.c
+//       mpu9250.c DHT.c sensor_cache.c -lm
+//   ./sensor_sim [-s scenario] [-t seconds] [-x speed] [-l loop_us] [-f]
+//
+// The drivers boot like main.c does (DHT_setup(), mpu_calibrate(),
+// mpu_init(), ak8963_init()) and then a main loop runs every loop_us
+// (default 5000) for the scenario's length (-t, default 600 s): it reads
+// the accelerometer and gyro registers, or with -f drains the FIFO filled
+// at 500 Hz, polls the magnetometer and asks DHT_readCached() for a reading.
+// The scenario is the built-in one below unless -s names a file; see
+// tools/sim/sim_world.c for its commands. -x runs at that multiple of real
+// time instead of as fast as possible.
+//
+// The report gives the biases the calibration found against the true ones,
+// the error of every stream against the truth, the drift of the integrated
+// gyro, the bus and FIFO counters and the DHT results.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "DHT.h"
+#include "i2c_txn.h"
+#include "mpu9250.h"
+#include "timebase.h"
+#include "sim.h"
+
+// At rest for the calibration, then turns, a tilt, vibration and a slow
+// warm up with the DHT dropping a bit now and then
+static const char sim_default_scenario[] =
+	"gyro_bias 0.8 -0.5 1.2\n"
+	"gyro_tempco 0.01\n"
+	"accel_bias 0.02 -0.015 0.03\n"
+	"accel_misalign 0.3 -0.2 0.5\n"
+	"mag_bias 5 -3 8\n"
+	"dht_flip 0.01\n"
+	"5 rate 0 0 30\n"
+	"17 rate 0 0 0\n"
+	"20 rate 45 0 0\n"
+	"22 rate 0 0 0\n"
+	"30 vibrate 25 0.2\n"
+	"40 vibrate 0 0\n"
+	"45 rate -45 0 0\n"
+	"47 rate 0 0 0\n"
+	"60 temperature 35 300\n"
+	"60 humidity 70 120\n"
+	"300 rate 0 0 -10\n"
+	"336 rate 0 0 0\n"
+	"400 temperature 20 200\n"
+	"400 humidity 40 200\n";
+
+typedef struct
+{
+	const char * name;
+	const char * unit;
+	double sum[3], square[3];
+	unsigned long count;
+} stream_error_t;
+
+static void error_add(stream_error_t * e, const double * measured,
+	const double * truth)
+{
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		double d = measured[i] - truth[i];
+		e->sum[i] += d;
+		e->square[i] += d * d;
+	}
+	e->count++;
+}
+
+static void error_print(const stream_error_t * e)
+{
+	int i;
+
+	printf("%-14s %8lu samples  mean", e->name, e->count);
+	for (i = 0; i < 3; i++)
+	{
+		printf(" %8.4f", e->count ? e->sum[i] / e->count : 0);
+	}
+	printf("  rms");
+	for (i = 0; i < 3; i++)
+	{
+		printf(" %8.4f", e->count ? sqrt(e->square[i] / e->count) : 0);
+	}
+	printf(" %s\n", e->unit);
+}
+
+static int16_t be16(const uint8_t * p)
+{
+	return (int16_t)((uint16_t)p[0] << 8 | p[1]);
+}
+
+int main(int argc, char ** argv)
+{
+	mpu9250_t imu = MPU9250_DEVICE(MPU9250_ADDRESS);
+	float gyroBias[3], accelBias[3], magAdjust[3];
+	double seconds = 600, speed = 0, gyro_angle[3] = {0, 0, 0};
+	double start_angle[3], truth[3], measured[3], temp, hum;
+	uint32_t loop_us = 5000, last_gyro = 0, attempt;
+	uint64_t next, end;
+	unsigned long passes = 0, dht[5] = {0, 0, 0, 0, 0}, dht_readings = 0;
+	double dht_error[2] = {0, 0}, dht_worst[2] = {0, 0};
+	unsigned long overflows = 0;
+	const char * scenario = NULL;
+	int fifo = 0, i;
+	stream_error_t accel_e = {"accelerometer", "g"}, gyro_e = {"gyro", "dps"};
+	stream_error_t mag_e = {"magnetometer", "uT"};
+	struct timespec wall, done;
+	FILE * f;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-s") && i + 1 < argc)
+		{
+			scenario = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+		{
+			seconds = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-x") && i + 1 < argc)
+		{
+			speed = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-l") && i + 1 < argc)
+		{
+			loop_us = strtoul(argv[++i], NULL, 10);
+		}
+		else if (!strcmp(argv[i], "-f"))
+		{
+			fifo = 1;
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [-s scenario] [-t seconds] [-x speed] "
+				"[-l loop_us] [-f]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	sim_init(1);
+	sim_mpu_init();
+	sim_dht_add('D', 7, DHT_TYPE);
+	f = scenario ? fopen(scenario, "r") :
+		fmemopen((void *)sim_default_scenario, strlen(sim_default_scenario), "r");
+	if (!f)
+	{
+		fprintf(stderr, "can't read %s\n", scenario);
+		return 2;
+	}
+	if (!sim_load(f, scenario ? scenario : "built-in scenario"))
+	{
+		return 2;
+	}
+	fclose(f);
+	sim.speed = speed;
+	clock_gettime(CLOCK_MONOTONIC, &wall);
+
+	// ----- boot, as main.c -----
+	DHT_setup();
+	mpu_calibrate(&imu, gyroBias, accelBias);
+	printf("calibration at %.3f s\n", sim.now_us * 1e-6);
+	printf("  gyro bias  found %7.3f %7.3f %7.3f  true %7.3f %7.3f %7.3f dps\n",
+		gyroBias[0], gyroBias[1], gyroBias[2],
+		sim.gyro.bias[0] + sim.gyro.drift[0] + sim.gyro.tempco * (sim.die_temp - 25),
+		sim.gyro.bias[1] + sim.gyro.drift[1] + sim.gyro.tempco * (sim.die_temp - 25),
+		sim.gyro.bias[2] + sim.gyro.drift[2] + sim.gyro.tempco * (sim.die_temp - 25));
+	printf("  accel bias found %7.4f %7.4f %7.4f  true %7.4f %7.4f %7.4f g\n",
+		accelBias[0], accelBias[1], accelBias[2], sim.accel_err.bias[0],
+		sim.accel_err.bias[1], sim.accel_err.bias[2]);
+	mpu_init(&imu);
+	ak8963_init(magAdjust);
+	printf("  magnetometer adjustment %.4f %.4f %.4f, fuse ROM %u %u %u\n",
+		magAdjust[0], magAdjust[1], magAdjust[2], sim_mag_asa(0),
+		sim_mag_asa(1), sim_mag_asa(2));
+	if (fifo)
+	{
+		mpu_config_t cfg = MPU_CONFIG_DEFAULT;
+		// 12 bytes a sample; at 1 kHz the FIFO fills faster than the bus
+		// at 100 kHz drains it
+		cfg.smplrt_div = 1;
+		cfg.fifo_en = MPU_FIFO_ACCEL | MPU_FIFO_GYRO;
+		if (mpu_configure(&imu, &cfg) != MPU_OK)
+		{
+			fprintf(stderr, "FIFO configuration rejected\n");
+			return 2;
+		}
+	}
+
+	// ----- main loop -----
+	memcpy(start_angle, sim.angle, sizeof(start_angle));
+	end = sim.now_us + (uint64_t)(seconds * 1e6);
+	for (next = sim.now_us; sim.now_us < end; next += loop_us)
+	{
+		uint8_t data[MPU_FIFO_SIZE];
+		enum MPU_STATUS_t status;
+		const sim_imu_sample_t * s;
+
+		if (next > sim.now_us)
+		{
+			host_delay_us(next - sim.now_us - sim.delay_overhead_us);
+		}
+		passes++;
+
+		if (fifo)
+		{
+			uint16_t n = mpu_fifo_drain(&imu, data, sizeof(data), &status), p;
+
+			overflows += status == MPU_ERROR_FIFO_OVERFLOW;
+			for (p = 0; p < n; p += MPU_FIFO_PACKET_SIZE)
+			{
+				for (i = 0; i < 3; i++)
+				{
+					gyro_angle[i] += mpu_gyro_dps(be16(&data[p + 6 + 2 * i])) * 0.002;
+				}
+			}
+			// the newest packet is the sample the model holds
+			s = sim_mpu_last();
+			if (n)
+			{
+				for (i = 0; i < 3; i++)
+				{
+					measured[i] = mpu_accel_g(be16(&data[n - 12 + 2 * i]));
+					truth[i] = s->accel_true[i];
+				}
+				error_add(&accel_e, measured, truth);
+				for (i = 0; i < 3; i++)
+				{
+					measured[i] = mpu_gyro_dps(be16(&data[n - 6 + 2 * i]));
+					truth[i] = s->gyro_true[i];
+				}
+				error_add(&gyro_e, measured, truth);
+			}
+		}
+		else
+		{
+			int16_t raw[3];
+			uint32_t stamp;
+
+			mpu_read_accel(&imu, raw);
+			s = sim_mpu_last();
+			for (i = 0; i < 3; i++)
+			{
+				measured[i] = mpu_accel_g(raw[i]);
+				truth[i] = s->accel_true[i];
+			}
+			error_add(&accel_e, measured, truth);
+
+			stamp = timebase_now();
+			mpu_read_bytes(imu.address, GYRO_XOUT_H, 6, data);
+			s = sim_mpu_last();
+			for (i = 0; i < 3; i++)
+			{
+				measured[i] = mpu_gyro_dps(be16(&data[2 * i]));
+				truth[i] = s->gyro_true[i];
+				if (last_gyro)
+				{
+					gyro_angle[i] += measured[i] * (stamp - last_gyro) * 1e-6;
+				}
+			}
+			last_gyro = stamp;
+			error_add(&gyro_e, measured, truth);
+		}
+
+		// magnetometer: ST1, then the data through ST2 to release it
+		if (mpu_read_byte(AK8963_ADDRESS, AK8963_ST1) & 0x01)
+		{
+			mpu_read_bytes(AK8963_ADDRESS, AK8963_XOUT_L, 7, data);
+			if (!(data[6] & 0x08))
+			{
+				int16_t m[3];
+				s = sim_mag_last();
+				for (i = 0; i < 3; i++)
+				{
+					m[i] = (int16_t)((uint16_t)data[2 * i + 1] << 8 | data[2 * i]);
+					truth[i] = s->mag_true[i];
+				}
+				// mG to uT and into the accelerometer's axes
+				measured[0] = mpu_mag_mg(m[1]) * magAdjust[1] / 10;
+				measured[1] = mpu_mag_mg(m[0]) * magAdjust[0] / 10;
+				measured[2] = -mpu_mag_mg(m[2]) * magAdjust[2] / 10;
+				error_add(&mag_e, measured, truth);
+			}
+		}
+
+		// a transfer that failed leaves the old reading, count it anyway
+		attempt = DHT_cache.attempt;
+		if (DHT_readCached(&temp, &hum, 0) == SENSOR_CACHE_ACQUIRED ||
+			DHT_cache.attempt != attempt)
+		{
+			dht[DHT_STATUS]++;
+			if (DHT_STATUS == DHT_OK)
+			{
+				double t, h;
+				sim_dht_truth(0, &t, &h);
+				dht_readings++;
+				dht_error[0] += fabs(temp - t);
+				dht_error[1] += fabs(hum - h);
+				dht_worst[0] = fmax(dht_worst[0], fabs(temp - t));
+				dht_worst[1] = fmax(dht_worst[1], fabs(hum - h));
+			}
+		}
+	}
+
+	// ----- report -----
+	clock_gettime(CLOCK_MONOTONIC, &done);
+	printf("\n%.1f s simulated in %.2f s, %lu passes of %lu us%s\n",
+		sim.now_us * 1e-6, done.tv_sec - wall.tv_sec + (done.tv_nsec - wall.tv_nsec) * 1e-9, passes,
+		(unsigned long)loop_us, fifo ? ", FIFO at 500 Hz" : "");
+	error_print(&accel_e);
+	error_print(&gyro_e);
+	error_print(&mag_e);
+	for (i = 0; i < 3; i++)
+	{
+		truth[i] = sim.angle[i] - start_angle[i];
+	}
+	printf("gyro integral  %8.3f %8.3f %8.3f deg, true %8.3f %8.3f %8.3f deg\n",
+		gyro_angle[0], gyro_angle[1], gyro_angle[2], truth[0], truth[1],
+		truth[2]);
+	printf("bus            %lu transactions, %lu bytes, %lu NAKs, %u failed\n",
+		sim_mpu_stats.transactions, sim_mpu_stats.bytes, sim_mpu_stats.naks,
+		i2c_txn_stats.failures);
+	printf("MPU            %lu samples, %lu FIFO overflows (%lu seen)\n",
+		sim_mpu_stats.samples, sim_mpu_stats.fifo_overflows, overflows);
+	printf("AK8963         %lu samples, %lu overruns\n",
+		sim_mpu_stats.mag_samples, sim_mpu_stats.mag_overruns);
+	printf("DHT            %lu starts, %lu answers, %lu ignored, %lu corrupted\n",
+		sim_dht_stats.starts, sim_dht_stats.responses, sim_dht_stats.ignored,
+		sim_dht_stats.corrupted);
+	printf("DHT reads      %lu ok, %lu checksum, %lu timeout, %lu range\n",
+		dht[DHT_OK], dht[DHT_ERROR_CHECKSUM], dht[DHT_ERROR_TIMEOUT],
+		dht[DHT_ERROR_HUMIDITY] + dht[DHT_ERROR_TEMPERATURE]);
+	if (dht_readings)
+	{
+		printf("DHT error      mean %.2f degC %.2f %%RH, worst %.2f degC %.2f %%RH\n",
+			dht_error[0] / dht_readings, dht_error[1] / dht_readings,
+			dht_worst[0], dht_worst[1]);
+	}
+	return 0;
+}
@@ -0,0 +1,151 @@
+#ifndef SIM_H_INCLUDED
+#define SIM_H_INCLUDED
+
+// Simulated sensor world for host builds of the drivers. A scenario of
+// motion and environment drives the true state (orientation, acceleration,
+// magnetic field, temperature, humidity); sensor models add their errors
+// and serve the result through the protocols the drivers speak:
+//
+//   sim_world.c   clock, scenario script, physics, timebase_now(), TCNT1
+//                 and host_delay_us()
+//   sim_mpu.c     MPU-9250 and AK8963 register files behind i2c_txn_read()
+//                 and i2c_txn_write(), and the mpu_spi_*() transport
+//   sim_dht.c     DHT11/DHT22 single wire timing on the simulated port pins
+//
+// Time only moves when the driver waits (_delay_us(), _delay_ms()) or talks
+// on the bus, so a run takes as long as the host needs to compute it unless
+// a speed is set: then the clock is held back to that multiple of real time.
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#define SIM_EVENTS_MAX		256
+#define SIM_DHT_MAX			8
+#define SIM_MPU_DEVICES		2			// MPU9250_ADDRESS and _AD0
+
+// Error model of a three axis sensor, in its own units (dps, g, uT)
+typedef struct
+{
+	double bias[3];
+	double walk;            // bias random walk per sqrt(s)
+	double noise;           // white noise density per sqrt(Hz), rms for
+	                        // the magnetometer
+	double tempco;          // bias change per degC from 25 degC
+	double scale;           // scale factor error, 0.01 = 1 %
+	double misalign[3];     // sensor axes rotated by these angles, deg
+	double m[3][3];         // misalignment and scale, from the above
+	double drift[3];        // random walk state
+} sim_axes_t;
+
+typedef struct
+{
+	double time;            // s from the start of the scenario
+	char line[96];          // command and arguments
+} sim_event_t;
+
+// A quantity that moves linearly to a target over a time
+typedef struct
+{
+	double value;
+	double target;
+	double rate;            // per s, toward target
+} sim_ramp_t;
+
+typedef struct
+{
+	// clock
+	uint64_t now_us;
+	double speed;           // multiple of real time, 0 unpaced
+	double delay_overhead_us;  // added to every busy wait, the polling code
+	double pace_start;      // wall clock at now_us == 0
+	uint64_t paced_us;
+
+	// scenario
+	sim_event_t events[SIM_EVENTS_MAX];
+	unsigned event_count;
+	unsigned next_event;
+	uint64_t step_us;       // physics step, us
+
+	// true state
+	double q[4];            // body to world rotation, w x y z
+	double rate[3];         // body angular rate, dps
+	double accel[3];        // world linear acceleration, g
+	double vibration[2];    // frequency Hz, amplitude g on all axes
+	double field[3];        // world magnetic field, uT
+	sim_ramp_t temperature; // ambient, degC
+	sim_ramp_t humidity;    // %RH
+	double angle[3];        // integrated body rate, deg
+
+	// sensor errors
+	sim_axes_t gyro, accel_err, mag;
+	double die_offset;      // MPU die above ambient, degC
+	double die_lag;         // time constant of the die temperature, s
+	double die_temp;
+	uint32_t seed;
+} sim_world_t;
+
+extern sim_world_t sim;
+
+// Every sample a sensor model takes: the true value in its frame and the
+// value it measured, both in physical units
+typedef struct
+{
+	double gyro_true[3], gyro[3];       // dps
+	double accel_true[3], accel[3];     // g
+	double mag_true[3], mag[3];         // uT
+	double die_temp;
+} sim_imu_sample_t;
+
+void sim_init(uint32_t seed);
+int sim_load(FILE * f, const char * name);
+int sim_command(const char * line, const char * where);
+void sim_advance(uint64_t us);
+void sim_sample_imu(sim_imu_sample_t * out, double gyro_bw_hz,
+	double accel_bw_hz);
+double sim_gauss(void);
+
+// MPU-9250 at MPU9250_ADDRESS with the AK8963 behind its bypass, a second
+// one at MPU9250_ADDRESS_AD0 and the first one on SPI on request; the counts
+// cover both devices, transactions and bytes are those of I2C
+typedef struct
+{
+	unsigned long transactions;
+	unsigned long bytes;
+	unsigned long writes;          // write transactions
+	unsigned long registers;       // registers those wrote
+	unsigned long naks;
+	unsigned long samples;
+	unsigned long fifo_overflows;
+	unsigned long mag_samples;
+	unsigned long mag_overruns;
+	unsigned long spi_transfers;
+	unsigned long spi_bytes;
+} sim_mpu_stats_t;
+
+extern sim_mpu_stats_t sim_mpu_stats;
+extern double sim_bus_byte_us;
+extern double sim_spi_byte_us;
+
+void sim_mpu_init(void);
+void sim_mpu_update(void);
+const sim_imu_sample_t * sim_mpu_last(void);
+const sim_imu_sample_t * sim_mag_last(void);
+uint8_t sim_mag_asa(uint8_t axis);
+
+// DHT sensors on the simulated port pins
+typedef struct
+{
+	unsigned long starts;
+	unsigned long responses;
+	unsigned long ignored;      // start signals too short or too soon
+	unsigned long corrupted;
+	unsigned long silent;
+} sim_dht_stats_t;
+
+extern sim_dht_stats_t sim_dht_stats;
+
+int sim_dht_add(char port, uint8_t bit, uint8_t type);
+void sim_dht_update(void);
+void sim_dht_truth(uint8_t sensor, double * temperature, double * humidity);
+
+#endif
@@ -0,0 +1,289 @@
+// DHT11/DHT22 single wire model on the simulated port registers; see sim.h.
+//
+// The driver's port, direction and pin registers are plain variables on the
+// host. Every time the clock moves or the driver reads a pin register (see
+// host_pin() in tools/host/avr/io.h) the model looks at what the driver drives
+// and sets the pin bits to the level on the wire: the driver's own output,
+// the sensor pulling low, or the pull-up. A start signal (low for 18 ms on
+// the DHT11, 1 ms on the DHT22) released by the driver is answered after
+// 20 - 40 us with 80 us low, 80 us high and 40 bits of 50 us low and 26 us
+// (0) or 70 us (1) high, then 50 us low.
+//
+// Like the real parts the sensor sends the reading it took at the previous
+// start signal and measures anew after every transfer; its element follows
+// the air with a time lag. The DHT11 reports whole percent and degrees with
+// tenths of a degree in the fourth byte, the DHT22 tenths with the sign in
+// bit 15. Commands, for every sensor:
+//
+//   dht_sensor port bit type  another sensor, port 0 - 3 for A - D
+//   dht_lag s                 time constant of the sensing element
+//   dht_offset degC %RH       calibration error
+//   dht_timing k              all pulse lengths times k
+//   dht_flip p                chance of a flipped bit per transfer
+//   dht_silent p              chance of no answer to a start signal
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include "DHT.h"
+#include "sim.h"
+
+// Level changes of one answer: the start wait, the response and 40 bits,
+// each a low and a high phase, and the final low
+#define SIM_DHT_PHASES	(1 + 2 + 80 + 1)
+
+volatile uint8_t PORTA, DDRA, host_PINA;
+volatile uint8_t PORTB, DDRB, host_PINB;
+volatile uint8_t PORTC, DDRC, host_PINC;
+volatile uint8_t PORTD, DDRD, host_PIND;
+
+sim_dht_stats_t sim_dht_stats;
+
+typedef struct
+{
+	volatile uint8_t * port;
+	volatile uint8_t * ddr;
+	volatile uint8_t * pin;
+	uint8_t mask;
+	uint8_t type;
+	uint8_t driven_low;
+	uint64_t low_since;
+	// answer in progress: phase end times and the level of each phase
+	uint8_t answering;
+	uint8_t phase;
+	uint64_t phase_end[SIM_DHT_PHASES];
+	uint8_t phase_level[SIM_DHT_PHASES];
+	// sensing element and the reading the next answer carries
+	double element_temp, element_hum;
+	uint64_t element_us;
+	uint8_t data[5];
+} sim_dht_t;
+
+static sim_dht_t sensors[SIM_DHT_MAX];
+static uint8_t sensor_count;
+static double dht_lag = 10, dht_temp_offset, dht_hum_offset, dht_timing = 1;
+static double dht_flip, dht_silent;
+
+static double sim_uniform(void)
+{
+	return rand() / (RAND_MAX + 1.0);
+}
+
+// The reading the element gives now, as the sensor's five bytes
+static void sim_dht_measure(sim_dht_t * s)
+{
+	double t = s->element_temp + dht_temp_offset;
+	double h = s->element_hum + dht_hum_offset;
+	uint16_t v;
+
+	h = h < 0 ? 0 : h > 99.9 ? 99.9 : h;
+	if (s->type == DHT11)
+	{
+		t = t < 0 ? 0 : t > 50 ? 50 : t;
+		s->data[0] = (uint8_t)floor(h + 0.5);
+		s->data[1] = 0;
+		s->data[2] = (uint8_t)floor(t);
+		s->data[3] = (uint8_t)((t - floor(t)) * 10);
+	}
+	else
+	{
+		t = t < -40 ? -40 : t > 80 ? 80 : t;
+		v = (uint16_t)floor(h * 10 + 0.5);
+		s->data[0] = v >> 8;
+		s->data[1] = v & 0xFF;
+		v = (uint16_t)floor(fabs(t) * 10 + 0.5);
+		s->data[2] = (v >> 8) | (t < 0 ? 0x80 : 0);
+		s->data[3] = v & 0xFF;
+	}
+	s->data[4] = s->data[0] + s->data[1] + s->data[2] + s->data[3];
+}
+
+int sim_dht_add(char port, uint8_t bit, uint8_t type)
+{
+	sim_dht_t * s;
+
+	if (sensor_count == SIM_DHT_MAX || port < 'A' || port > 'D' || bit > 7)
+	{
+		return 0;
+	}
+	s = &sensors[sensor_count++];
+	memset(s, 0, sizeof(*s));
+	switch (port)
+	{
+		case 'A': s->port = &PORTA; s->ddr = &DDRA; s->pin = &host_PINA; break;
+		case 'B': s->port = &PORTB; s->ddr = &DDRB; s->pin = &host_PINB; break;
+		case 'C': s->port = &PORTC; s->ddr = &DDRC; s->pin = &host_PINC; break;
+		default:  s->port = &PORTD; s->ddr = &DDRD; s->pin = &host_PIND; break;
+	}
+	s->mask = 1 << bit;
+	s->type = type;
+	s->element_temp = sim.temperature.value;
+	s->element_hum = sim.humidity.value;
+	s->element_us = sim.now_us;
+	// the power up reading
+	sim_dht_measure(s);
+	*s->pin |= s->mask;
+	return 1;
+}
+
+int sim_dht_command(const char * cmd, const double * arg, int args)
+{
+	if (!strcmp(cmd, "dht_sensor") && args == 3)
+	{
+		return sim_dht_add('A' + (int)arg[0], (uint8_t)arg[1], (uint8_t)arg[2]);
+	}
+	if (!strcmp(cmd, "dht_lag") && args == 1)
+	{
+		dht_lag = arg[0];
+	}
+	else if (!strcmp(cmd, "dht_offset") && args == 2)
+	{
+		dht_temp_offset = arg[0];
+		dht_hum_offset = arg[1];
+	}
+	else if (!strcmp(cmd, "dht_timing") && args == 1 && arg[0] > 0)
+	{
+		dht_timing = arg[0];
+	}
+	else if (!strcmp(cmd, "dht_flip") && args == 1)
+	{
+		dht_flip = arg[0];
+	}
+	else if (!strcmp(cmd, "dht_silent") && args == 1)
+	{
+		dht_silent = arg[0];
+	}
+	else
+	{
+		return 0;
+	}
+	return 1;
+}
+
+// Lay out the answer to a start signal released now
+static void sim_dht_answer(sim_dht_t * s)
+{
+	uint64_t t = sim.now_us;
+	uint8_t data[5], n = 0, i;
+
+	memcpy(data, s->data, sizeof(data));
+	if (sim_uniform() < dht_flip)
+	{
+		i = rand() % 40;
+		data[i >> 3] ^= 0x80 >> (i & 7);
+		sim_dht_stats.corrupted++;
+	}
+
+#define SIM_DHT_PHASE(us, level) \
+	do { \
+		t += (uint64_t)((us) * dht_timing + 0.5); \
+		s->phase_end[n] = t; \
+		s->phase_level[n++] = (level); \
+	} while (0)
+
+	SIM_DHT_PHASE(20 + sim_uniform() * 20, 1);
+	SIM_DHT_PHASE(80, 0);
+	SIM_DHT_PHASE(80, 1);
+	for (i = 0; i < 40; i++)
+	{
+		SIM_DHT_PHASE(50, 0);
+		SIM_DHT_PHASE(data[i >> 3] & (0x80 >> (i & 7)) ? 70 : 26, 1);
+	}
+	SIM_DHT_PHASE(50, 0);
+#undef SIM_DHT_PHASE
+
+	s->answering = 1;
+	s->phase = 0;
+	sim_dht_stats.responses++;
+	// the next answer carries what the sensor measures after this one
+	sim_dht_measure(s);
+}
+
+void sim_dht_update(void)
+{
+	uint8_t i, level;
+
+	for (i = 0; i < sensor_count; i++)
+	{
+		sim_dht_t * s = &sensors[i];
+		uint8_t output = (*s->ddr & s->mask) != 0;
+		uint8_t low = output && !(*s->port & s->mask);
+		double dt = (sim.now_us - s->element_us) * 1e-6;
+
+		// the element follows the air
+		if (dt > 0)
+		{
+			double k = dt / (dht_lag + dt);
+			s->element_temp += (sim.temperature.value - s->element_temp) * k;
+			s->element_hum += (sim.humidity.value - s->element_hum) * k;
+			s->element_us = sim.now_us;
+		}
+
+		if (low && !s->driven_low)
+		{
+			// a start signal, anything in progress is cut off
+			s->driven_low = 1;
+			s->low_since = sim.now_us;
+			s->answering = 0;
+		}
+		else if (!low && s->driven_low)
+		{
+			s->driven_low = 0;
+			sim_dht_stats.starts++;
+			if (sim.now_us - s->low_since < (s->type == DHT11 ? 18000 : 1000))
+			{
+				sim_dht_stats.ignored++;
+			}
+			else if (sim_uniform() < dht_silent)
+			{
+				sim_dht_stats.silent++;
+			}
+			else
+			{
+				sim_dht_answer(s);
+			}
+		}
+
+		while (s->answering && sim.now_us >= s->phase_end[s->phase])
+		{
+			if (++s->phase == SIM_DHT_PHASES)
+			{
+				s->answering = 0;
+			}
+		}
+
+		if (output)
+		{
+			level = !low;
+		}
+		else
+		{
+			level = s->answering ? s->phase_level[s->phase] : 1;
+		}
+		if (level)
+		{
+			*s->pin |= s->mask;
+		}
+		else
+		{
+			*s->pin &= ~s->mask;
+		}
+	}
+}
+
+// Every read of a pin register: the driver may have released or pulled the
+// line since the clock last moved
+volatile uint8_t * host_pin(volatile uint8_t * pin)
+{
+	sim_dht_update();
+	return pin;
+}
+
+// The air around a sensor, which its readings should match
+void sim_dht_truth(uint8_t sensor, double * temperature, double * humidity)
+{
+	(void)sensor;
+	*temperature = sim.temperature.value;
+	*humidity = sim.humidity.value;
+}
@@ -0,0 +1,681 @@
+// MPU-9250 and AK8963 models behind the host build of i2c_txn.c; see sim.h.
+//
+// The MPU-9250 at MPU9250_ADDRESS keeps a register file like the device:
+// reset through PWR_MGMT_1, sleep, the sample rate from CONFIG, GYRO_CONFIG
+// and SMPLRT_DIV, full scale ranges, the gyro and accelerometer offset
+// registers, the data ready and FIFO overflow flags of INT_STATUS (cleared
+// when read) and the 512 byte FIFO in register order (accelerometer,
+// temperature, gyro), which drops its oldest bytes when it overflows. Data
+// registers are updated at the output data rate; the DLPF setting only
+// decides how much noise gets through. A second MPU-9250 at
+// MPU9250_ADDRESS_AD0, with its own register file, sample clock and noise,
+// answers once mpu_ad0 is set.
+//
+// The AK8963 answers at AK8963_ADDRESS while the MPU's I2C bypass is on. It
+// measures once (mode 1) or continuously at 8 or 100 Hz, sets DRDY and,
+// when a sample was never read, DOR in ST1; reading ST2 releases both. The
+// fuse ROM is readable in mode 0x0F. Its axes are those of the MPU with x
+// and y swapped and z reversed, and its output is the field divided by the
+// sensitivity adjustment the driver multiplies with.
+//
+// The first MPU-9250 can be put on SPI as well, at a chip select of
+// MPU_SPI_CS_PORT, where the host build of the driver (MPU_SPI_ENABLE)
+// reaches it through the mpu_spi_*() functions below instead of mpu_spi.c.
+// Its I2C slave keeps answering until I2C_IF_DIS is set in USER_CTRL.
+//
+// Every I2C transaction takes (bytes + 3) * bus_byte us of simulated time,
+// every SPI transfer (bytes + 1) * spi_byte us. Built with I2C_TRACE_ENABLE
+// and linked with i2c_trace.c, the model feeds the recorder as i2c_txn.c
+// does, one record per attempt. Commands:
+//
+//   bus_byte us              time of one byte on the bus
+//   mag_asa x y z            fuse ROM sensitivity adjustment, 0 - 255
+//   mpu_trim x y z           factory XA/YA/ZA_OFFSET register values
+//   mpu_nak p                chance of a NAK per attempt; the driver's
+//                            I2C_TXN_RETRIES retries are modelled
+//   mpu_ad0 0|1              second MPU-9250 at MPU9250_ADDRESS_AD0
+//   mpu_spi cs               first MPU-9250 on SPI at chip select cs, 0 - 7
+//   spi_byte us              time of one SPI byte
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "i2c_trace.h"
+#include "i2c_txn.h"
+#include "mpu9250.h"
+#include "mpu_spi.h"
+#include "sim.h"
+
+#define SIM_AK_WIA		0x00
+#define SIM_AK_CNTL2	0x0B
+
+enum I2C_STATUS_t I2C_STATUS = I2C_OK;
+i2c_txn_stats_t i2c_txn_stats;
+sim_mpu_stats_t sim_mpu_stats;
+double sim_bus_byte_us = 100;   // 100 kHz and a little
+// F_CPU / 2 at 1 MHz is 16 us a byte, and the loop of mpu_spi.c around it
+double sim_spi_byte_us = 22;
+
+typedef struct
+{
+	uint8_t address;
+	uint8_t spi;                // MPU9250_SPI() device byte, 0 if not on SPI
+	uint8_t present;
+	uint8_t reg[128];
+	uint8_t fifo[MPU_FIFO_SIZE];
+	uint16_t fifo_head;         // oldest byte
+	uint16_t fifo_count;
+	uint64_t next_sample_us;
+	uint32_t period_us;
+	uint16_t trim[3];           // factory accelerometer offsets
+	sim_imu_sample_t last;
+} sim_mpu_dev_t;
+
+static sim_mpu_dev_t mpus[SIM_MPU_DEVICES];
+static double mpu_nak;
+
+static struct
+{
+	uint8_t reg[0x13];
+	uint8_t asa[3];
+	uint64_t next_sample_us;
+	sim_imu_sample_t last;
+} ak;
+
+static const double sim_gyro_bw[8] = {250, 184, 92, 41, 20, 10, 5, 3600};
+static const double sim_accel_bw[8] = {460, 184, 92, 41, 20, 10, 5, 460};
+
+static void sim_mpu_reset(sim_mpu_dev_t * m)
+{
+	int i;
+
+	memset(m->reg, 0, sizeof(m->reg));
+	m->reg[PWR_MGMT_1] = 0x01;
+	m->reg[WHO_AM_I_MPU] = 0x71;
+	for (i = 0; i < 3; i++)
+	{
+		m->reg[XA_OFFSET_H + 3 * i] = m->trim[i] >> 8;
+		m->reg[XA_OFFSET_L + 3 * i] = m->trim[i] & 0xFF;
+	}
+	m->fifo_head = m->fifo_count = 0;
+	m->period_us = 0;
+}
+
+static void sim_ak_reset(void)
+{
+	memset(ak.reg, 0, sizeof(ak.reg));
+	ak.reg[SIM_AK_WIA] = 0x48;
+	ak.reg[INFO] = 0x9A;
+}
+
+void sim_mpu_init(void)
+{
+	static const uint16_t trim[3] = {0x1A3C, 0xE5B1, 0x2C47};
+
+	uint8_t d;
+
+	memset(mpus, 0, sizeof(mpus));
+	mpu_nak = 0;
+	for (d = 0; d < SIM_MPU_DEVICES; d++)
+	{
+		mpus[d].address = d ? MPU9250_ADDRESS_AD0 : MPU9250_ADDRESS;
+		mpus[d].present = !d;
+		memcpy(mpus[d].trim, trim, sizeof(trim));
+		sim_mpu_reset(&mpus[d]);
+	}
+	ak.asa[0] = 176;
+	ak.asa[1] = 177;
+	ak.asa[2] = 165;
+	sim_ak_reset();
+	memset(&sim_mpu_stats, 0, sizeof(sim_mpu_stats));
+}
+
+int sim_mpu_command(const char * cmd, const double * arg, int args)
+{
+	uint8_t d;
+	int i;
+
+	if (!strcmp(cmd, "bus_byte") && args == 1)
+	{
+		sim_bus_byte_us = arg[0];
+	}
+	else if (!strcmp(cmd, "mag_asa") && args == 3)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			ak.asa[i] = (uint8_t)arg[i];
+		}
+	}
+	else if (!strcmp(cmd, "mpu_trim") && args == 3)
+	{
+		for (d = 0; d < SIM_MPU_DEVICES; d++)
+		{
+			for (i = 0; i < 3; i++)
+			{
+				mpus[d].trim[i] = (uint16_t)(int32_t)arg[i];
+			}
+			sim_mpu_reset(&mpus[d]);
+		}
+	}
+	else if (!strcmp(cmd, "mpu_nak") && args == 1)
+	{
+		mpu_nak = arg[0];
+	}
+	else if (!strcmp(cmd, "mpu_ad0") && args == 1)
+	{
+		mpus[1].present = arg[0] != 0;
+	}
+	else if (!strcmp(cmd, "mpu_spi") && args == 1 && arg[0] >= 0 &&
+		arg[0] <= 7)
+	{
+		mpus[0].spi = MPU9250_SPI((uint8_t)arg[0]);
+	}
+	else if (!strcmp(cmd, "spi_byte") && args == 1)
+	{
+		sim_spi_byte_us = arg[0];
+	}
+	else
+	{
+		return 0;
+	}
+	return 1;
+}
+
+// Output data period in us, 0 while asleep
+static uint32_t sim_mpu_period(const sim_mpu_dev_t * m)
+{
+	uint8_t dlpf = m->reg[CONFIG] & 0x07;
+
+	if (m->reg[PWR_MGMT_1] & 0x40)
+	{
+		return 0;
+	}
+	if (m->reg[GYRO_CONFIG] & 0x03)
+	{
+		return 31;      // 32 kHz, rounded
+	}
+	if (dlpf == 0 || dlpf == 7)
+	{
+		return 125;
+	}
+	return 1000 * (1 + m->reg[SMPLRT_DIV]);
+}
+
+static int16_t sim_saturate(double v)
+{
+	v = floor(v + 0.5);
+	return v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : (int16_t)v;
+}
+
+static void sim_put16(uint8_t * p, int16_t v)
+{
+	p[0] = (uint16_t)v >> 8;
+	p[1] = v & 0xFF;
+}
+
+static void sim_fifo_push(sim_mpu_dev_t * m, const uint8_t * data,
+	uint8_t count)
+{
+	while (count--)
+	{
+		if (m->fifo_count == MPU_FIFO_SIZE)
+		{
+			// FIFO_MODE 0: the oldest byte makes room
+			m->fifo_head = (m->fifo_head + 1) % MPU_FIFO_SIZE;
+			m->fifo_count--;
+			if (!(m->reg[INT_STATUS] & 0x10))
+			{
+				sim_mpu_stats.fifo_overflows++;
+			}
+			m->reg[INT_STATUS] |= 0x10;
+		}
+		m->fifo[(m->fifo_head + m->fifo_count) % MPU_FIFO_SIZE] = *data++;
+		m->fifo_count++;
+	}
+}
+
+static void sim_mpu_sample(sim_mpu_dev_t * m)
+{
+	uint8_t gfs = (m->reg[GYRO_CONFIG] >> 3) & 3;
+	uint8_t afs = (m->reg[ACCEL_CONFIG] >> 3) & 3;
+	uint8_t fchoice_b = m->reg[GYRO_CONFIG] & 3, en = m->reg[FIFO_EN];
+	double gyro_bw = fchoice_b ? (fchoice_b & 1 ? 8800 : 3600) :
+		sim_gyro_bw[m->reg[CONFIG] & 7];
+	double accel_bw = m->reg[ACCEL_CONFIG2] & 0x08 ? 1130 :
+		sim_accel_bw[m->reg[ACCEL_CONFIG2] & 7];
+	uint8_t * out = &m->reg[ACCEL_XOUT_H];
+	int i;
+
+	sim_sample_imu(&m->last, gyro_bw, accel_bw);
+	sim_mpu_stats.samples++;
+	for (i = 0; i < 3; i++)
+	{
+		// offset registers: bits 15:1 in 0.98 mg steps relative to the
+		// factory trim, and 4 / 131 dps per gyro offset LSB
+		int16_t trim = (int16_t)(m->reg[XA_OFFSET_H + 3 * i] << 8 |
+			m->reg[XA_OFFSET_L + 3 * i]);
+		int16_t offset = (int16_t)(m->reg[XG_OFFSET_H + 2 * i] << 8 |
+			m->reg[XG_OFFSET_L + 2 * i]);
+		double accel = m->last.accel[i] +
+			((trim >> 1) - ((int16_t)m->trim[i] >> 1)) * 0.00098;
+		double gyro = m->last.gyro[i] + offset * 4.0 / 131;
+
+		sim_put16(&out[2 * i], sim_saturate(accel * 16384 / (1 << afs)));
+		sim_put16(&out[8 + 2 * i], sim_saturate(gyro * 131 / (1 << gfs)));
+	}
+	sim_put16(&out[6], sim_saturate((m->last.die_temp - 21) * 333.87));
+	m->reg[INT_STATUS] |= 0x01;
+
+	if (m->reg[USER_CTRL] & 0x40)
+	{
+		if (en & MPU_FIFO_ACCEL)
+		{
+			sim_fifo_push(m, &out[0], 6);
+		}
+		if (en & MPU_FIFO_TEMP)
+		{
+			sim_fifo_push(m, &out[6], 2);
+		}
+		for (i = 0; i < 3; i++)
+		{
+			if (en & (MPU_FIFO_GYRO_X >> i))
+			{
+				sim_fifo_push(m, &out[8 + 2 * i], 2);
+			}
+		}
+	}
+}
+
+static void sim_ak_sample(void)
+{
+	uint8_t bits16 = ak.reg[AK8963_CNTL] & 0x10;
+	double res = bits16 ? 0.15 : 0.6, limit = bits16 ? 32760 : 8190;
+	uint8_t overflow = 0;
+	int16_t raw[3];
+	int i;
+
+	sim_sample_imu(&ak.last, sim_gyro_bw[3], sim_accel_bw[3]);
+	sim_mpu_stats.mag_samples++;
+	// AK8963 axes in the MPU frame: y, x, -z
+	double field[3] = {ak.last.mag[1], ak.last.mag[0], -ak.last.mag[2]};
+	for (i = 0; i < 3; i++)
+	{
+		double v = field[i] / res / ((ak.asa[i] - 128) / 256.0 + 1);
+		overflow |= fabs(v) > limit;
+		raw[i] = sim_saturate(v);
+		ak.reg[AK8963_XOUT_L + 2 * i] = raw[i] & 0xFF;
+		ak.reg[AK8963_XOUT_H + 2 * i] = (uint16_t)raw[i] >> 8;
+	}
+	if (ak.reg[AK8963_ST1] & 0x01)
+	{
+		ak.reg[AK8963_ST1] |= 0x02;
+		sim_mpu_stats.mag_overruns++;
+	}
+	ak.reg[AK8963_ST1] |= 0x01;
+	ak.reg[AK8963_ST2] = bits16 | (overflow ? 0x08 : 0);
+}
+
+void sim_mpu_update(void)
+{
+	uint8_t mode = ak.reg[AK8963_CNTL] & 0x0F;
+	uint8_t d;
+
+	for (d = 0; d < SIM_MPU_DEVICES; d++)
+	{
+		sim_mpu_dev_t * m = &mpus[d];
+		uint32_t period = m->present ? sim_mpu_period(m) : 0;
+
+		if (period != m->period_us)
+		{
+			// the first sample of a new rate comes one period later
+			m->period_us = period;
+			m->next_sample_us = sim.now_us + period;
+		}
+		while (period && m->next_sample_us <= sim.now_us)
+		{
+			sim_mpu_sample(m);
+			m->next_sample_us += period;
+		}
+	}
+
+	if ((mode == 0x01 || mode == 0x02 || mode == 0x06) &&
+		ak.next_sample_us <= sim.now_us)
+	{
+		sim_ak_sample();
+		if (mode == 0x01)
+		{
+			ak.reg[AK8963_CNTL] &= ~0x0F;
+		}
+		ak.next_sample_us += mode == 0x02 ? 125000 : 10000;
+	}
+}
+
+const sim_imu_sample_t * sim_mpu_last(void)
+{
+	return &mpus[0].last;
+}
+
+// The MPU-9250 answering at an I2C address or SPI device byte, NULL if none
+// does; I2C_IF_DIS takes a device off I2C
+static sim_mpu_dev_t * sim_mpu_find(uint8_t device)
+{
+	uint8_t d;
+
+	for (d = 0; d < SIM_MPU_DEVICES; d++)
+	{
+		sim_mpu_dev_t * m = &mpus[d];
+
+		if (!m->present)
+		{
+			continue;
+		}
+		if (device & MPU_SPI_DEVICE ? m->spi == device :
+			m->address == device && !(m->reg[USER_CTRL] & 0x10))
+		{
+			return m;
+		}
+	}
+	return NULL;
+}
+
+// True and measured field are in the MPU frame
+const sim_imu_sample_t * sim_mag_last(void)
+{
+	return &ak.last;
+}
+
+uint8_t sim_mag_asa(uint8_t axis)
+{
+	return ak.asa[axis];
+}
+
+static uint8_t sim_mpu_read(sim_mpu_dev_t * m, uint8_t reg)
+{
+	uint8_t v;
+
+	switch (reg)
+	{
+		case FIFO_COUNTH:
+			return m->fifo_count >> 8;
+		case FIFO_COUNTL:
+			return m->fifo_count & 0xFF;
+		case FIFO_R_W:
+			if (!m->fifo_count)
+			{
+				return 0xFF;
+			}
+			v = m->fifo[m->fifo_head];
+			m->fifo_head = (m->fifo_head + 1) % MPU_FIFO_SIZE;
+			m->fifo_count--;
+			return v;
+		case INT_STATUS:
+			v = m->reg[INT_STATUS];
+			m->reg[INT_STATUS] = 0;
+			return v;
+	}
+	return m->reg[reg & 0x7F];
+}
+
+static void sim_mpu_write(sim_mpu_dev_t * m, uint8_t reg, uint8_t value)
+{
+	reg &= 0x7F;
+	if (reg == PWR_MGMT_1 && (value & 0x80))
+	{
+		sim_mpu_reset(m);
+		return;
+	}
+	if (reg == USER_CTRL && (value & 0x04))
+	{
+		m->fifo_head = m->fifo_count = 0;
+	}
+	if (reg == WHO_AM_I_MPU || reg == INT_STATUS || reg == FIFO_COUNTH ||
+		reg == FIFO_COUNTL || (reg >= ACCEL_XOUT_H && reg <= EXT_SENS_DATA_23))
+	{
+		return;
+	}
+	if (reg == USER_CTRL)
+	{
+		value &= ~0x0F;     // reset bits clear themselves
+	}
+	m->reg[reg] = value;
+}
+
+static uint8_t sim_ak_read(uint8_t reg)
+{
+	uint8_t v;
+
+	if (reg >= sizeof(ak.reg))
+	{
+		return 0;
+	}
+	if (reg >= AK8963_ASAX)
+	{
+		// fuse ROM, readable in fuse access mode only
+		return (ak.reg[AK8963_CNTL] & 0x0F) == 0x0F ? ak.asa[reg - AK8963_ASAX] : 0;
+	}
+	v = ak.reg[reg];
+	if (reg == AK8963_ST2)
+	{
+		ak.reg[AK8963_ST1] &= ~0x03;
+	}
+	return v;
+}
+
+static void sim_ak_write(uint8_t reg, uint8_t value)
+{
+	if (reg == AK8963_CNTL)
+	{
+		uint8_t mode = value & 0x0F;
+
+		ak.reg[AK8963_CNTL] = value & 0x1F;
+		// single measurements take 7.2 ms, continuous ones start a period on
+		ak.next_sample_us = sim.now_us + (mode == 0x01 ? 7200 :
+			mode == 0x02 ? 125000 : 10000);
+	}
+	else if (reg == SIM_AK_CNTL2 && (value & 0x01))
+	{
+		sim_ak_reset();
+	}
+	else if (reg == AK8963_ASTC)
+	{
+		ak.reg[reg] = value & 0x40;
+	}
+}
+
+// Addressing of one transaction as i2c_txn.c would run it, with up to
+// retries retries; the caller moves the data, records the attempt that
+// succeeded and then lets the transfer time pass.
+static enum I2C_STATUS_t sim_transaction(uint8_t read, uint8_t device,
+	uint8_t reg, uint8_t * data, uint8_t count, uint8_t retries)
+{
+	uint8_t present = sim_mpu_find(device) != NULL ||
+		(device == AK8963_ADDRESS && ((mpus[0].reg[INT_PIN_CFG] |
+		(mpus[1].present ? mpus[1].reg[INT_PIN_CFG] : 0)) & 0x02));
+	uint8_t attempt;
+
+	sim_mpu_stats.transactions++;
+	for (attempt = 0; attempt <= retries; attempt++)
+	{
+		if (attempt)
+		{
+			i2c_txn_stats.retries++;
+		}
+		if (present && (mpu_nak <= 0 || rand() >= mpu_nak * RAND_MAX))
+		{
+			sim_mpu_stats.bytes += count;
+			return I2C_OK;
+		}
+		// the address byte goes unanswered
+		i2c_txn_stats.naks++;
+		sim_mpu_stats.naks++;
+#if I2C_TRACE_ENABLE
+		// a refused read moves no data, its record shows the buffer as the
+		// caller left it, as i2c_txn_run() records it
+		i2c_trace_record(read, device, reg, data, count, I2C_ERROR_NAK);
+#endif
+		sim_advance((uint64_t)(2 * sim_bus_byte_us));
+	}
+	i2c_txn_stats.failures++;
+	return I2C_ERROR_NAK;
+}
+
+enum I2C_STATUS_t i2c_txn_write(uint8_t device, uint8_t reg,
+	const uint8_t * data, uint8_t count)
+{
+	sim_mpu_dev_t * m = sim_mpu_find(device);
+	uint8_t i;
+
+	I2C_STATUS = sim_transaction(0, device, reg, (uint8_t *)data, count,
+		I2C_TXN_RETRIES);
+	if (I2C_STATUS != I2C_OK)
+	{
+		return I2C_STATUS;
+	}
+#if I2C_TRACE_ENABLE
+	i2c_trace_record(0, device, reg, data, count, I2C_OK);
+#endif
+	sim_mpu_stats.writes++;
+	sim_mpu_stats.registers += count;
+	for (i = 0; i < count; i++)
+	{
+		if (m)
+		{
+			sim_mpu_write(m, reg + i, data[i]);
+		}
+		else
+		{
+			sim_ak_write(reg + i, data[i]);
+		}
+	}
+	sim_advance((uint64_t)((count + 3) * sim_bus_byte_us));
+	return I2C_STATUS;
+}
+
+static enum I2C_STATUS_t sim_read(uint8_t device, uint8_t reg,
+	uint8_t * dest, uint8_t count, uint8_t retries)
+{
+	sim_mpu_dev_t * m = sim_mpu_find(device);
+	uint8_t i;
+
+	I2C_STATUS = sim_transaction(1, device, reg, dest, count, retries);
+	if (I2C_STATUS != I2C_OK)
+	{
+		return I2C_STATUS;
+	}
+	// The data registers hold still during a burst, so all bytes are taken
+	// at its start
+	for (i = 0; i < count; i++)
+	{
+		if (m)
+		{
+			// bursts from FIFO_R_W keep reading the FIFO
+			dest[i] = sim_mpu_read(m, reg == FIFO_R_W ? reg : reg + i);
+		}
+		else
+		{
+			dest[i] = sim_ak_read(reg + i);
+		}
+	}
+#if I2C_TRACE_ENABLE
+	i2c_trace_record(1, device, reg, dest, count, I2C_OK);
+#endif
+	sim_advance((uint64_t)((count + 3) * sim_bus_byte_us));
+	return I2C_STATUS;
+}
+
+enum I2C_STATUS_t i2c_txn_read(uint8_t device, uint8_t reg, uint8_t * dest,
+	uint8_t count)
+{
+	return sim_read(device, reg, dest, count, I2C_TXN_RETRIES);
+}
+
+enum I2C_STATUS_t i2c_txn_read_stream(uint8_t device, uint8_t reg,
+	uint8_t * dest, uint8_t count)
+{
+	return sim_read(device, reg, dest, count, 0);
+}
+
+enum I2C_STATUS_t i2c_bus_recover(void)
+{
+	return I2C_OK;
+}
+
+// The SPI transport of the driver. Chip select is the device byte; a
+// transfer to a chip select nobody answers on reads 0xFF.
+static void sim_spi_transfer(uint8_t device, uint8_t reg, uint8_t * data,
+	uint8_t count, uint8_t write)
+{
+	sim_mpu_dev_t * m = sim_mpu_find(device);
+	uint8_t i;
+
+	sim_mpu_stats.spi_transfers++;
+	sim_mpu_stats.spi_bytes += count;
+	for (i = 0; i < count; i++)
+	{
+		if (!m)
+		{
+			if (!write)
+			{
+				data[i] = 0xFF;
+			}
+		}
+		else if (write)
+		{
+			sim_mpu_write(m, reg + i, data[i]);
+		}
+		else
+		{
+			data[i] = sim_mpu_read(m, reg == FIFO_R_W ? reg : reg + i);
+		}
+	}
+	sim_advance((uint64_t)((count + 1) * sim_spi_byte_us));
+}
+
+void mpu_spi_init(uint8_t device)
+{
+	(void)device;
+}
+
+uint8_t mpu_spi_read_byte(uint8_t device, uint8_t address)
+{
+	uint8_t data;
+
+	sim_spi_transfer(device, address, &data, 1, 0);
+	return data;
+}
+
+void mpu_spi_write_byte(uint8_t device, uint8_t address, uint8_t data)
+{
+	sim_spi_transfer(device, address, &data, 1, 1);
+}
+
+void mpu_spi_write_bytes(uint8_t device, uint8_t address, uint8_t count,
+	const uint8_t * data)
+{
+	uint8_t copy[255];
+	uint8_t i;
+
+	for (i = 0; i < count; i++)
+	{
+		copy[i] = data[i];
+	}
+	sim_spi_transfer(device, address, copy, count, 1);
+}
+
+void mpu_spi_read_bytes(uint8_t device, uint8_t address, uint8_t count,
+	uint8_t * dest)
+{
+	sim_spi_transfer(device, address, dest, count, 0);
+}
+
+// The burst completes before this returns
+void mpu_spi_read_start(uint8_t device, uint8_t address, uint8_t count,
+	uint8_t * dest)
+{
+	sim_spi_transfer(device, address, dest, count, 0);
+}
+
+uint8_t mpu_spi_busy(void)
+{
+	return 0;
+}
@@ -0,0 +1,557 @@
+// Clock, scenario and physics of the simulated world; see sim.h.
+//
+// A scenario is a text file of commands, one per line, # starts a comment.
+// A line starting with a time in seconds is carried out when the clock gets
+// there, other lines right away. Angles are degrees, rates dps, the field
+// uT, accelerations g with z up in the world frame.
+//
+//   rate x y z               body angular rate
+//   orient roll pitch yaw    orientation, at once
+//   accel x y z              linear acceleration of the body, world frame
+//   vibrate hz g             sinusoidal acceleration on all world axes
+//   field x y z              earth field, world frame
+//   temperature degC [s]     ambient temperature, ramped over s seconds
+//   humidity %RH [s]         relative humidity, ramped over s seconds
+//
+//   gyro_bias|accel_bias|mag_bias x y z
+//   gyro_misalign|accel_misalign|mag_misalign x y z
+//   gyro_noise|accel_noise density per sqrt(Hz), mag_noise rms
+//   gyro_walk|accel_walk density per sqrt(s)
+//   gyro_tempco|accel_tempco per degC
+//   gyro_scale|accel_scale|mag_scale error, 0.01 = 1 %
+//   die offset_degC lag_s    MPU die temperature over ambient
+//   seed n                   noise generator
+//   speed x                  run at x times real time, 0 as fast as possible
+//   overhead us              cost of the code around every busy wait
+//   step us                  physics step
+//
+// sim_mpu.c and sim_dht.c take the commands starting with mpu_, mag_asa,
+// bus_ and dht_.
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sim.h"
+#include "timebase.h"
+
+sim_world_t sim;
+
+// Timer1 counts the timebase's 1 us; drivers that time short intervals
+// read it directly
+volatile uint16_t TCNT1;
+
+int sim_mpu_command(const char * cmd, const double * arg, int args);
+int sim_dht_command(const char * cmd, const double * arg, int args);
+
+static uint64_t rng_state;
+
+static uint32_t sim_random(void)
+{
+	// xorshift64*
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (uint32_t)((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+// Standard normal deviate, Box-Muller
+double sim_gauss(void)
+{
+	static int have;
+	static double spare;
+	double u, v;
+
+	if (have)
+	{
+		have = 0;
+		return spare;
+	}
+	u = (sim_random() + 1.0) / 4294967297.0;
+	v = sim_random() / 4294967296.0;
+	spare = sqrt(-2 * log(u)) * sin(2 * M_PI * v);
+	have = 1;
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static double rad(double deg)
+{
+	return deg * M_PI / 180;
+}
+
+// Misalignment rotation Rz Ry Rx times (1 + scale)
+static void sim_axes_update(sim_axes_t * a)
+{
+	double cx = cos(rad(a->misalign[0])), sx = sin(rad(a->misalign[0]));
+	double cy = cos(rad(a->misalign[1])), sy = sin(rad(a->misalign[1]));
+	double cz = cos(rad(a->misalign[2])), sz = sin(rad(a->misalign[2]));
+	double k = 1 + a->scale;
+
+	a->m[0][0] = k * cy * cz;
+	a->m[0][1] = k * (sx * sy * cz - cx * sz);
+	a->m[0][2] = k * (cx * sy * cz + sx * sz);
+	a->m[1][0] = k * cy * sz;
+	a->m[1][1] = k * (sx * sy * sz + cx * cz);
+	a->m[1][2] = k * (cx * sy * sz - sx * cz);
+	a->m[2][0] = k * -sy;
+	a->m[2][1] = k * sx * cy;
+	a->m[2][2] = k * cx * cy;
+}
+
+void sim_init(uint32_t seed)
+{
+	memset(&sim, 0, sizeof(sim));
+	TCNT1 = 0;
+	sim.q[0] = 1;
+	sim.step_us = 100;
+	sim.delay_overhead_us = 6;
+	sim.seed = seed;
+	rng_state = 0x9E3779B97F4A7C15ULL ^ seed;
+
+	// Mid latitude earth field and a room
+	sim.field[0] = 20;
+	sim.field[2] = -44;
+	sim.temperature.value = sim.temperature.target = 22;
+	sim.humidity.value = sim.humidity.target = 45;
+	sim.die_offset = 3;
+	sim.die_lag = 60;
+	sim.die_temp = 25;
+
+	// MPU-9250 datasheet typicals
+	sim.gyro.noise = 0.01;
+	sim.gyro.walk = 0.0005;
+	sim.accel_err.noise = 0.0003;
+	sim.mag.noise = 0.3;
+	sim_axes_update(&sim.gyro);
+	sim_axes_update(&sim.accel_err);
+	sim_axes_update(&sim.mag);
+}
+
+// Rotate v from the body into the world frame (inverse 0) or back (1)
+static void sim_rotate(const double * q, const double * v, double * out,
+	int inverse)
+{
+	double w = q[0], x = inverse ? -q[1] : q[1], y = inverse ? -q[2] : q[2];
+	double z = inverse ? -q[3] : q[3];
+	double tx = 2 * (y * v[2] - z * v[1]);
+	double ty = 2 * (z * v[0] - x * v[2]);
+	double tz = 2 * (x * v[1] - y * v[0]);
+
+	out[0] = v[0] + w * tx + (y * tz - z * ty);
+	out[1] = v[1] + w * ty + (z * tx - x * tz);
+	out[2] = v[2] + w * tz + (x * ty - y * tx);
+}
+
+static void sim_orient(double roll, double pitch, double yaw)
+{
+	double cr = cos(rad(roll) / 2), sr = sin(rad(roll) / 2);
+	double cp = cos(rad(pitch) / 2), sp = sin(rad(pitch) / 2);
+	double cy = cos(rad(yaw) / 2), sy = sin(rad(yaw) / 2);
+
+	sim.q[0] = cr * cp * cy + sr * sp * sy;
+	sim.q[1] = sr * cp * cy - cr * sp * sy;
+	sim.q[2] = cr * sp * cy + sr * cp * sy;
+	sim.q[3] = cr * cp * sy - sr * sp * cy;
+}
+
+static void sim_ramp(sim_ramp_t * r, double target, double seconds)
+{
+	r->target = target;
+	if (seconds <= 0)
+	{
+		r->value = target;
+		r->rate = 0;
+	}
+	else
+	{
+		r->rate = fabs(target - r->value) / seconds;
+	}
+}
+
+static void sim_ramp_step(sim_ramp_t * r, double dt)
+{
+	double d = r->target - r->value, step = r->rate * dt;
+
+	r->value = fabs(d) <= step ? r->target : r->value + (d > 0 ? step : -step);
+}
+
+static sim_axes_t * sim_axes_named(const char * cmd, const char ** rest)
+{
+	static const struct
+	{
+		const char * prefix;
+		sim_axes_t * axes;
+	} names[] = {{"gyro_", &sim.gyro}, {"accel_", &sim.accel_err},
+		{"mag_", &sim.mag}};
+	unsigned i;
+
+	for (i = 0; i < 3; i++)
+	{
+		size_t n = strlen(names[i].prefix);
+		if (!strncmp(cmd, names[i].prefix, n))
+		{
+			*rest = cmd + n;
+			return names[i].axes;
+		}
+	}
+	return NULL;
+}
+
+static int sim_axes_command(sim_axes_t * a, const char * what,
+	const double * arg, int args)
+{
+	int i;
+
+	if (!strcmp(what, "bias") && args == 3)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			a->bias[i] = arg[i];
+		}
+	}
+	else if (!strcmp(what, "misalign") && args == 3)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			a->misalign[i] = arg[i];
+		}
+	}
+	else if (!strcmp(what, "noise") && args == 1)
+	{
+		a->noise = arg[0];
+	}
+	else if (!strcmp(what, "walk") && args == 1)
+	{
+		a->walk = arg[0];
+	}
+	else if (!strcmp(what, "tempco") && args == 1)
+	{
+		a->tempco = arg[0];
+	}
+	else if (!strcmp(what, "scale") && args == 1)
+	{
+		a->scale = arg[0];
+	}
+	else
+	{
+		return 0;
+	}
+	sim_axes_update(a);
+	return 1;
+}
+
+// Carry out one command; where names its origin in error messages.
+// Returns 0 if it is not understood.
+int sim_command(const char * line, const char * where)
+{
+	char cmd[32];
+	const char * what, * text = line + strspn(line, " \t");
+	double arg[4];
+	int args = 0, n, ok = 1, i;
+	sim_axes_t * axes;
+
+	if (sscanf(line, "%31s%n", cmd, &n) != 1)
+	{
+		return 1;
+	}
+	line += n;
+	while (args < 4 && sscanf(line, "%lf%n", &arg[args], &n) == 1)
+	{
+		line += n;
+		args++;
+	}
+
+	if (!strcmp(cmd, "rate") && args == 3)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			sim.rate[i] = arg[i];
+		}
+	}
+	else if (!strcmp(cmd, "orient") && args == 3)
+	{
+		sim_orient(arg[0], arg[1], arg[2]);
+	}
+	else if (!strcmp(cmd, "accel") && args == 3)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			sim.accel[i] = arg[i];
+		}
+	}
+	else if (!strcmp(cmd, "vibrate") && args == 2)
+	{
+		sim.vibration[0] = arg[0];
+		sim.vibration[1] = arg[1];
+	}
+	else if (!strcmp(cmd, "field") && args == 3)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			sim.field[i] = arg[i];
+		}
+	}
+	else if (!strcmp(cmd, "temperature") && (args == 1 || args == 2))
+	{
+		sim_ramp(&sim.temperature, arg[0], args == 2 ? arg[1] : 0);
+	}
+	else if (!strcmp(cmd, "humidity") && (args == 1 || args == 2))
+	{
+		sim_ramp(&sim.humidity, arg[0], args == 2 ? arg[1] : 0);
+	}
+	else if (!strcmp(cmd, "die") && args == 2)
+	{
+		sim.die_offset = arg[0];
+		sim.die_lag = arg[1];
+	}
+	else if (!strcmp(cmd, "seed") && args == 1)
+	{
+		rng_state = 0x9E3779B97F4A7C15ULL ^ (uint32_t)arg[0];
+	}
+	else if (!strcmp(cmd, "speed") && args == 1)
+	{
+		sim.speed = arg[0];
+		sim.pace_start = 0;
+	}
+	else if (!strcmp(cmd, "overhead") && args == 1)
+	{
+		sim.delay_overhead_us = arg[0];
+	}
+	else if (!strcmp(cmd, "step") && args == 1 && arg[0] >= 1)
+	{
+		sim.step_us = (uint64_t)arg[0];
+	}
+	else if ((axes = sim_axes_named(cmd, &what)) &&
+		sim_axes_command(axes, what, arg, args))
+	{
+	}
+	else
+	{
+		ok = sim_mpu_command(cmd, arg, args) || sim_dht_command(cmd, arg, args);
+	}
+
+	if (!ok)
+	{
+		fprintf(stderr, "%s: can't do \"%.*s\"\n", where,
+			(int)strcspn(text, "\r\n"), text);
+	}
+	return ok;
+}
+
+// Read a scenario. Returns 0 on an error, which is reported on stderr.
+int sim_load(FILE * f, const char * name)
+{
+	char line[128], where[64];
+	unsigned n = 0;
+	double last = 0;
+
+	while (fgets(line, sizeof(line), f))
+	{
+		char * p = strchr(line, '#'), * end;
+		double time;
+
+		n++;
+		if (p)
+		{
+			*p = 0;
+		}
+		snprintf(where, sizeof(where), "%s:%u", name, n);
+		time = strtod(line, &end);
+		if (end == line)
+		{
+			// set up right away
+			if (!sim_command(line, where))
+			{
+				return 0;
+			}
+			continue;
+		}
+		if (time < last || sim.event_count == SIM_EVENTS_MAX)
+		{
+			fprintf(stderr, "%s: %s\n", where, time < last ?
+				"times must not decrease" : "too many events");
+			return 0;
+		}
+		last = time;
+		sim.events[sim.event_count].time = time;
+		snprintf(sim.events[sim.event_count].line,
+			sizeof(sim.events[0].line), "%s", end);
+		sim.event_count++;
+	}
+	return 1;
+}
+
+// One physics step of dt seconds at the current state
+static void sim_step(double dt)
+{
+	double half[3], angle, s, q[4];
+	int i;
+
+	// orientation, exact for a rate constant over the step
+	for (i = 0; i < 3; i++)
+	{
+		half[i] = rad(sim.rate[i]) * dt / 2;
+	}
+	angle = sqrt(half[0] * half[0] + half[1] * half[1] + half[2] * half[2]);
+	if (angle > 0)
+	{
+		s = sin(angle) / angle;
+		double d[4] = {cos(angle), half[0] * s, half[1] * s, half[2] * s};
+		q[0] = sim.q[0] * d[0] - sim.q[1] * d[1] - sim.q[2] * d[2] - sim.q[3] * d[3];
+		q[1] = sim.q[0] * d[1] + sim.q[1] * d[0] + sim.q[2] * d[3] - sim.q[3] * d[2];
+		q[2] = sim.q[0] * d[2] - sim.q[1] * d[3] + sim.q[2] * d[0] + sim.q[3] * d[1];
+		q[3] = sim.q[0] * d[3] + sim.q[1] * d[2] - sim.q[2] * d[1] + sim.q[3] * d[0];
+		s = 1 / sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+		for (i = 0; i < 4; i++)
+		{
+			sim.q[i] = q[i] * s;
+		}
+	}
+	for (i = 0; i < 3; i++)
+	{
+		sim.angle[i] += sim.rate[i] * dt;
+	}
+
+	sim_ramp_step(&sim.temperature, dt);
+	sim_ramp_step(&sim.humidity, dt);
+	sim.die_temp += (sim.temperature.value + sim.die_offset - sim.die_temp) *
+		(dt / (sim.die_lag + dt));
+}
+
+static double sim_wall(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Hold the clock back to sim.speed times real time
+static void sim_pace(void)
+{
+	double ahead;
+
+	if (sim.speed <= 0 || sim.now_us - sim.paced_us < 1000)
+	{
+		return;
+	}
+	if (sim.pace_start == 0)
+	{
+		sim.pace_start = sim_wall() - sim.now_us * 1e-6 / sim.speed;
+	}
+	sim.paced_us = sim.now_us;
+	ahead = sim.pace_start + sim.now_us * 1e-6 / sim.speed - sim_wall();
+	if (ahead > 0)
+	{
+		struct timespec t = {(time_t)ahead, (long)((ahead - (time_t)ahead) * 1e9)};
+		nanosleep(&t, NULL);
+	}
+}
+
+void sim_advance(uint64_t us)
+{
+	uint64_t end = sim.now_us + us, step;
+	char where[32];
+
+	// pins the driver changed since the last call, at the time it did
+	sim_dht_update();
+	while (sim.now_us < end)
+	{
+		while (sim.next_event < sim.event_count &&
+			sim.events[sim.next_event].time * 1e6 <= sim.now_us)
+		{
+			snprintf(where, sizeof(where), "event at %.3f s",
+				sim.events[sim.next_event].time);
+			sim_command(sim.events[sim.next_event].line, where);
+			sim.next_event++;
+		}
+		step = end - sim.now_us;
+		if (step > sim.step_us)
+		{
+			step = sim.step_us;
+		}
+		sim_step(step * 1e-6);
+		sim.now_us += step;
+		TCNT1 = (uint16_t)sim.now_us;
+		sim_mpu_update();
+		sim_dht_update();
+		sim_pace();
+	}
+}
+
+static void sim_axes_measure(sim_axes_t * a, const double * truth,
+	double * out, double temp, double noise, double dt)
+{
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		a->drift[i] += a->walk * sqrt(dt) * sim_gauss();
+		out[i] = a->m[i][0] * truth[0] + a->m[i][1] * truth[1] +
+			a->m[i][2] * truth[2] + a->bias[i] + a->drift[i] +
+			a->tempco * (temp - 25) + noise * sim_gauss();
+	}
+}
+
+// The true and measured values at the current time; the bandwidths are the
+// low passes of gyro and accelerometer, which set the noise they let through
+void sim_sample_imu(sim_imu_sample_t * out, double gyro_bw_hz,
+	double accel_bw_hz)
+{
+	static uint64_t last_us;
+	double dt = (sim.now_us - last_us) * 1e-6, f[3], phase;
+	// sim and out may be packed, the axes are worked out in copies
+	double q[4], field[3];
+	double gyro_true[3], accel_true[3], mag_true[3], gyro[3], accel[3], mag[3];
+	// white noise density to rms behind a single pole low pass
+	double gyro_band = sqrt(gyro_bw_hz * M_PI / 2);
+	double accel_band = sqrt(accel_bw_hz * M_PI / 2);
+	int i;
+
+	last_us = sim.now_us;
+	phase = 2 * M_PI * sim.vibration[0] * sim.now_us * 1e-6;
+	for (i = 0; i < 3; i++)
+	{
+		f[i] = sim.accel[i] + sim.vibration[1] * sin(phase + i * 2.1);
+		gyro_true[i] = sim.rate[i];
+		field[i] = sim.field[i];
+	}
+	f[2] += 1;
+	for (i = 0; i < 4; i++)
+	{
+		q[i] = sim.q[i];
+	}
+	sim_rotate(q, f, accel_true, 1);
+	sim_rotate(q, field, mag_true, 1);
+	out->die_temp = sim.die_temp;
+
+	sim_axes_measure(&sim.gyro, gyro_true, gyro, sim.die_temp,
+		sim.gyro.noise * gyro_band, dt);
+	sim_axes_measure(&sim.accel_err, accel_true, accel, sim.die_temp,
+		sim.accel_err.noise * accel_band, dt);
+	sim_axes_measure(&sim.mag, mag_true, mag, sim.die_temp, sim.mag.noise,
+		dt);
+	for (i = 0; i < 3; i++)
+	{
+		out->gyro_true[i] = gyro_true[i];
+		out->gyro[i] = gyro[i];
+		out->accel_true[i] = accel_true[i];
+		out->accel[i] = accel[i];
+		out->mag_true[i] = mag_true[i];
+		out->mag[i] = mag[i];
+	}
+}
+
+uint32_t timebase_now(void)
+{
+	return (uint32_t)sim.now_us;
+}
+
+void host_delay_us(double us)
+{
+	static double carry;
+	double total = us + sim.delay_overhead_us + carry;
+
+	carry = total - floor(total);
+	sim_advance((uint64_t)total);
+}
@@ -0,0 +1,746 @@
+// Static worst case stack and RAM check of a firmware build. It reads the
+// disassembly listing of the linked image (the .lss Atmel Studio writes next
+// to the .elf, or avr-objdump -h -S output), follows every call from main()
+// and from each interrupt vector, and adds the deepest call path to the
+// static data (.data, .bss, .noinit) taken from the section table. The exit
+// status is 1 when the sum is over the budget or the depth cannot be bounded
+// (recursion, an unresolved indirect call or a dynamic frame), so the check
+// can gate a build.
+//
+// Build and run from the repository root:
+//
+//   gcc -std=gnu99 -O2 -Wall -o stack_check tools/stack_check.c
+//   ./stack_check [options] Release/GccApplication1.lss [*.su]
+//
+// Options:
+//
+//   -b bytes           RAM budget, default STACK_CHECK_RAM
+//   -p bytes           return address size, 2 up to 128 KB of flash
+//   -i caller=a,b,...  targets of the indirect calls in caller; a number
+//                      stands for a leaf of that many bytes
+//   -w log             compare the "stack" lines of stack_mon_dump() in a
+//                      device log with the static bound
+//
+// Frame sizes come from the code itself: pushes, "rcall .+0" and the stack
+// pointer adjustments of prologues and argument passing are followed through
+// each function. The .su files of -fstack-usage (enabled in the project) may
+// be added; a larger size there wins and dynamic frames are reported.
+// Interrupts are assumed not to nest unless their handler executes sei, in
+// which case every such handler is stacked on top of the others. Indirect
+// jumps (switch tables) are taken to stay inside the function.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STACK_CHECK_RAM		16384	// ATmega1284P
+#define STACK_CHECK_NAME	64
+#define STACK_CHECK_INDIRECT	~0UL
+
+typedef struct
+{
+	unsigned long target;   // address, STACK_CHECK_INDIRECT for icall
+	int depth;          // frame bytes in use at the call
+	int tail;           // jump, no return address pushed
+	int callee;         // function index, -1 if not found
+} call_t;
+
+typedef struct
+{
+	char name[STACK_CHECK_NAME];
+	unsigned long addr;
+	int peak;           // deepest own frame
+	int su;             // -fstack-usage size, -1 if none
+	int dynamic;        // unbounded dynamic frame per -fstack-usage
+	int nests;          // interrupt handler that enables interrupts
+	call_t * calls;
+	int call_count;
+	int state;          // 0 new, 1 on the current path, 2 done
+	int cost;           // worst case with callees
+	int worst;          // call on the worst path, -1 for none
+	int bounded;
+} func_t;
+
+typedef struct
+{
+	char caller[STACK_CHECK_NAME];
+	char * targets;
+} indirect_t;
+
+static func_t * funcs;
+static int func_count, func_alloc;
+static indirect_t * indirects;
+static int indirect_count;
+static int ret_bytes = 2;
+static unsigned long data_bytes, bss_bytes, noinit_bytes;
+static int problems;
+
+static int find_func(const char * name)
+{
+	int i;
+	for (i = 0; i < func_count; i++)
+	{
+		if (strcmp(funcs[i].name, name) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Function holding code address addr; functions are added in address order
+static int func_at(unsigned long addr)
+{
+	int lo = 0, hi = func_count - 1, mid;
+
+	if (func_count == 0 || addr < funcs[0].addr)
+	{
+		return -1;
+	}
+	while (lo < hi)
+	{
+		mid = (lo + hi + 1) / 2;
+		if (funcs[mid].addr <= addr)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+	return lo;
+}
+
+static func_t * add_func(const char * name, unsigned long addr)
+{
+	func_t * f;
+
+	if (func_count == func_alloc)
+	{
+		func_alloc = func_alloc ? 2 * func_alloc : 256;
+		funcs = realloc(funcs, func_alloc * sizeof(*funcs));
+	}
+	f = &funcs[func_count++];
+	memset(f, 0, sizeof(*f));
+	snprintf(f->name, sizeof(f->name), "%s", name);
+	f->addr = addr;
+	f->su = -1;
+	f->worst = -1;
+	return f;
+}
+
+static void add_call(func_t * f, unsigned long target, int depth, int tail)
+{
+	call_t * c;
+
+	f->calls = realloc(f->calls, (f->call_count + 1) * sizeof(*f->calls));
+	c = &f->calls[f->call_count++];
+	c->target = target;
+	c->depth = depth;
+	c->tail = tail;
+	c->callee = -1;
+}
+
+// Register number of an "rN" operand, -1 otherwise
+static int reg(const char * s)
+{
+	int n;
+	if (sscanf(s, " r%d", &n) == 1 && n >= 0 && n < 32)
+	{
+		return n;
+	}
+	return -1;
+}
+
+// The call or jump target address from the listing comment,
+// "; 0x31a <LCD_Init>". The symbol is not used, objdump may name an address
+// after an absolute symbol such as __LOCK_REGION_LENGTH__.
+static int target_addr(const char * comment, unsigned long * addr)
+{
+	return comment && sscanf(comment, " ; 0x%lx", addr) == 1;
+}
+
+// Per function state while its instructions are read
+typedef struct
+{
+	int depth;          // bytes pushed or allocated so far
+	int body;           // depth before the current epilogue
+	int sp_valid[32];   // register holds a copy of SPL
+	int sp_base[32];    // depth when the copy was taken
+	int sp_offset[32];  // bytes subtracted from that copy since
+} walk_t;
+
+static void walk_reset(walk_t * w)
+{
+	memset(w, 0, sizeof(*w));
+}
+
+// Account one instruction of function f
+static void walk(func_t * f, walk_t * w, const char * op, const char * args,
+	const char * comment)
+{
+	unsigned long target;
+	int r = reg(args), k = 0;
+	const char * comma = strchr(args, ',');
+	int epilogue = 0;
+
+	if (comma)
+	{
+		sscanf(comma + 1, " %i", &k);
+	}
+
+	if (strcmp(op, "push") == 0)
+	{
+		w->depth++;
+	}
+	else if (strcmp(op, "pop") == 0)
+	{
+		w->depth -= w->depth > 0;
+		if (r >= 0)
+		{
+			w->sp_valid[r] = 0;
+		}
+		epilogue = 1;
+	}
+	else if (strcmp(op, "in") == 0 && r >= 0)
+	{
+		w->sp_valid[r] = k == 0x3d;
+		w->sp_base[r] = w->depth;
+		w->sp_offset[r] = 0;
+		epilogue = k == 0x3f;
+	}
+	else if (strcmp(op, "out") == 0)
+	{
+		int src = comma ? reg(comma + 1) : -1;
+		sscanf(args, " %i", &k);
+		if (k == 0x3d && src >= 0 && w->sp_valid[src])
+		{
+			w->depth = w->sp_base[src] + (short)(w->sp_offset[src] & 0xFFFF);
+			if (w->depth < 0)
+			{
+				w->depth = 0;
+			}
+			w->sp_base[src] = w->depth;
+			w->sp_offset[src] = 0;
+		}
+		epilogue = k == 0x3d || k == 0x3e || k == 0x3f;
+	}
+	else if (r >= 0 && w->sp_valid[r] &&
+		(strcmp(op, "sbiw") == 0 || strcmp(op, "subi") == 0))
+	{
+		w->sp_offset[r] += k;
+		epilogue = 1;
+	}
+	else if (r >= 0 && w->sp_valid[r] && strcmp(op, "adiw") == 0)
+	{
+		w->sp_offset[r] -= k;
+		epilogue = 1;
+	}
+	else if (r > 0 && w->sp_valid[r - 1] && strcmp(op, "sbci") == 0)
+	{
+		w->sp_offset[r - 1] += k << 8;
+		epilogue = 1;
+	}
+	else if (r > 0 && w->sp_valid[r - 1] && strcmp(op, "sbc") == 0)
+	{
+		epilogue = 1;
+	}
+	else if (strcmp(op, "movw") == 0 && r >= 0 && comma && reg(comma + 1) >= 0)
+	{
+		w->sp_valid[r] = w->sp_valid[reg(comma + 1)];
+		w->sp_base[r] = w->sp_base[reg(comma + 1)];
+		w->sp_offset[r] = w->sp_offset[reg(comma + 1)];
+	}
+	else if (strcmp(op, "cli") == 0)
+	{
+		epilogue = 1;
+	}
+	else if (strcmp(op, "sei") == 0)
+	{
+		f->nests = strncmp(f->name, "__vector_", 9) == 0;
+	}
+	else if (strcmp(op, "rcall") == 0 && strncmp(args, ".+0", 3) == 0 &&
+		(args[3] == 0 || args[3] == ' ' || args[3] == '\t'))
+	{
+		w->depth += ret_bytes;
+	}
+	else if (strcmp(op, "call") == 0 || strcmp(op, "rcall") == 0)
+	{
+		if (target_addr(comment, &target))
+		{
+			add_call(f, target, w->depth, 0);
+		}
+	}
+	else if (strcmp(op, "jmp") == 0 || strcmp(op, "rjmp") == 0)
+	{
+		// jumps inside the function are sorted out in cost()
+		if (target_addr(comment, &target))
+		{
+			add_call(f, target, w->depth, 1);
+			w->depth = w->body;
+			epilogue = 1;
+		}
+	}
+	else if (strcmp(op, "icall") == 0 || strcmp(op, "eicall") == 0)
+	{
+		add_call(f, STACK_CHECK_INDIRECT, w->depth, 0);
+	}
+	else if (strcmp(op, "ret") == 0 || strcmp(op, "reti") == 0)
+	{
+		w->depth = w->body;
+		epilogue = 1;
+	}
+	else if (r >= 0)
+	{
+		// any other write of a register ends its stack pointer copy
+		w->sp_valid[r] = 0;
+	}
+
+	if (w->depth > f->peak)
+	{
+		f->peak = w->depth;
+	}
+	if (!epilogue)
+	{
+		w->body = w->depth;
+	}
+}
+
+static int load_listing(const char * path)
+{
+	FILE * fp = fopen(path, "r");
+	char line[1024];
+	func_t * f = NULL;
+	walk_t w;
+	int disassembly = 0;
+
+	if (!fp)
+	{
+		perror(path);
+		return 0;
+	}
+	walk_reset(&w);
+	while (fgets(line, sizeof(line), fp))
+	{
+		unsigned long addr, size, vma;
+		char name[STACK_CHECK_NAME], * field[5], * s;
+		int idx, n, pos;
+
+		line[strcspn(line, "\r\n")] = 0;
+		if (!disassembly)
+		{
+			if (strncmp(line, "Disassembly of section", 22) == 0)
+			{
+				disassembly = 1;
+			}
+			else if (sscanf(line, " %d %63s %lx %lx", &idx, name, &size,
+				&vma) == 4 && vma >= 0x800000 && vma < 0x810000)
+			{
+				if (strcmp(name, ".data") == 0)
+				{
+					data_bytes += size;
+				}
+				else if (strcmp(name, ".bss") == 0)
+				{
+					bss_bytes += size;
+				}
+				else
+				{
+					noinit_bytes += size;
+				}
+			}
+			continue;
+		}
+
+		// Function label: "00000d2e <main>:"
+		if (sscanf(line, "%lx <%63[^>]>:%n", &addr, name, &pos) == 2 &&
+			line[pos] == 0)
+		{
+			if (name[0] != '.')
+			{
+				f = find_func(name) < 0 ? add_func(name, addr) : NULL;
+				walk_reset(&w);
+			}
+			continue;
+		}
+
+		// Instruction: "     d2e:\tcf 93       \tpush\tr28\t; comment"
+		if (!f || sscanf(line, " %lx:%n", &addr, &pos) != 1 ||
+			line[pos] != '\t')
+		{
+			continue;
+		}
+		n = 0;
+		for (s = strtok(&line[pos + 1], "\t"); s && n < 5;
+			s = strtok(NULL, "\t"))
+		{
+			field[n++] = s;
+		}
+		if (n < 2)
+		{
+			continue;
+		}
+		walk(f, &w, field[1], n > 2 ? field[2] : "", n > 3 ? field[3] : NULL);
+	}
+	fclose(fp);
+	if (!disassembly)
+	{
+		fprintf(stderr, "%s: no disassembly found\n", path);
+		return 0;
+	}
+	return 1;
+}
+
+// -fstack-usage output: "main.c:27:5:main\t64\tstatic"
+static void load_su(const char * path)
+{
+	FILE * fp = fopen(path, "r");
+	char line[512], qualifier[64];
+	char * name;
+	int bytes, i;
+
+	if (!fp)
+	{
+		perror(path);
+		problems++;
+		return;
+	}
+	while (fgets(line, sizeof(line), fp))
+	{
+		char * tab = strchr(line, '\t');
+		if (!tab || sscanf(tab, "%d %63s", &bytes, qualifier) != 2)
+		{
+			continue;
+		}
+		*tab = 0;
+		name = strrchr(line, ':');
+		name = name ? name + 1 : line;
+		if ((i = find_func(name)) < 0)
+		{
+			continue;
+		}
+		if (bytes > funcs[i].su)
+		{
+			funcs[i].su = bytes;
+		}
+		if (strstr(qualifier, "dynamic") && !strstr(qualifier, "bounded"))
+		{
+			funcs[i].dynamic = 1;
+		}
+	}
+	fclose(fp);
+}
+
+static const char * indirect_targets(const char * caller)
+{
+	int i;
+	for (i = 0; i < indirect_count; i++)
+	{
+		if (strcmp(indirects[i].caller, caller) == 0)
+		{
+			return indirects[i].targets;
+		}
+	}
+	return NULL;
+}
+
+// Worst case stack below function i including its return address, or -1
+// when it cannot be bounded
+static int cost(int i)
+{
+	func_t * f = &funcs[i];
+	int c, own = f->peak > f->su ? f->peak : f->su;
+
+	if (f->state == 1)
+	{
+		printf("recursion through %s\n", f->name);
+		problems++;
+		return -1;
+	}
+	if (f->state == 2)
+	{
+		return f->bounded ? f->cost : -1;
+	}
+	f->state = 1;
+	f->bounded = 1;
+	f->cost = own;
+	if (f->dynamic)
+	{
+		printf("%s has a dynamic stack frame\n", f->name);
+		problems++;
+		f->bounded = 0;
+	}
+
+	for (c = 0; c < f->call_count; c++)
+	{
+		call_t * call = &f->calls[c];
+		int below = -1, sub = call->depth + (call->tail ? 0 : ret_bytes);
+
+		if (call->target == STACK_CHECK_INDIRECT)
+		{
+			const char * targets = indirect_targets(f->name), * t;
+			char name[STACK_CHECK_NAME];
+			size_t n;
+
+			if (!targets)
+			{
+				printf("%s has an indirect call, name its targets with "
+					"-i %s=...\n", f->name, f->name);
+				problems++;
+				f->bounded = 0;
+				continue;
+			}
+			for (t = targets; *t; t += n + (t[n] == ','))
+			{
+				int j, b;
+				char * end;
+				long leaf;
+
+				n = strcspn(t, ",");
+				snprintf(name, sizeof(name), "%.*s", (int)n, t);
+				j = find_func(name);
+				leaf = strtol(name, &end, 0);
+				if (name[0] && *end == 0)
+				{
+					b = (int)leaf;
+				}
+				else if (j < 0)
+				{
+					printf("%s: indirect target %s not in the listing\n",
+						f->name, name);
+					problems++;
+					f->bounded = 0;
+					continue;
+				}
+				else
+				{
+					b = cost(j);
+				}
+				if (b < 0)
+				{
+					f->bounded = 0;
+				}
+				else if (sub + b > f->cost)
+				{
+					f->cost = sub + b;
+					f->worst = -1;
+				}
+			}
+			continue;
+		}
+
+		call->callee = func_at(call->target);
+		if (call->callee < 0)
+		{
+			printf("%s calls 0x%lx, which is not in the listing\n", f->name,
+				call->target);
+			problems++;
+			f->bounded = 0;
+			continue;
+		}
+		if (call->callee == i)
+		{
+			// branch or subroutine inside the function
+			if (!call->tail && sub > f->cost)
+			{
+				f->cost = sub;
+			}
+			continue;
+		}
+		below = cost(call->callee);
+		if (below < 0)
+		{
+			f->bounded = 0;
+		}
+		else if (sub + below > f->cost)
+		{
+			f->cost = sub + below;
+			f->worst = c;
+		}
+	}
+
+	f->state = 2;
+	return f->bounded ? f->cost : -1;
+}
+
+// The worst call path from function i, each function with the bytes of its
+// frame in use at the next call
+static void print_path(int i)
+{
+	while (i >= 0)
+	{
+		func_t * f = &funcs[i];
+		if (f->worst >= 0)
+		{
+			printf(" %s(%d)", f->name, f->calls[f->worst].depth);
+			i = f->calls[f->worst].callee;
+		}
+		else
+		{
+			printf(" %s(%d)", f->name, f->peak > f->su ? f->peak : f->su);
+			i = -1;
+		}
+	}
+	printf("\n");
+}
+
+// Largest high water mark in the "stack N of M unused U" lines of a log
+static int log_high_water(const char * path)
+{
+	FILE * fp = fopen(path, "r");
+	char line[256];
+	unsigned high, size, unused;
+	int most = -1;
+
+	if (!fp)
+	{
+		perror(path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp))
+	{
+		char * s = strstr(line, "stack ");
+		if (s && sscanf(s, "stack %u of %u unused %u", &high, &size,
+			&unused) == 3 && (int)high > most)
+		{
+			most = high;
+		}
+	}
+	fclose(fp);
+	return most;
+}
+
+static void usage(const char * name)
+{
+	fprintf(stderr, "usage: %s [-b budget] [-p return bytes] "
+		"[-i caller=target,...] [-w log] listing.lss [file.su ...]\n", name);
+	exit(2);
+}
+
+int main(int argc, char ** argv)
+{
+	long budget = STACK_CHECK_RAM;
+	const char * log = NULL;
+	unsigned long statics;
+	int a, i, worst_isr = 0, nesting = 0, main_cost, stack, measured;
+
+	for (a = 1; a < argc && argv[a][0] == '-'; a++)
+	{
+		char * eq;
+
+		if (a + 1 >= argc || argv[a][1] == 0 || argv[a][2] != 0)
+		{
+			usage(argv[0]);
+		}
+		switch (argv[a][1])
+		{
+		case 'b':
+			budget = strtol(argv[++a], NULL, 0);
+			break;
+		case 'p':
+			ret_bytes = atoi(argv[++a]);
+			break;
+		case 'i':
+			eq = strchr(argv[++a], '=');
+			if (!eq)
+			{
+				usage(argv[0]);
+			}
+			indirects = realloc(indirects,
+				(indirect_count + 1) * sizeof(*indirects));
+			*eq = 0;
+			snprintf(indirects[indirect_count].caller, STACK_CHECK_NAME,
+				"%s", argv[a]);
+			indirects[indirect_count++].targets = eq + 1;
+			break;
+		case 'w':
+			log = argv[++a];
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (a >= argc)
+	{
+		usage(argv[0]);
+	}
+	if (!load_listing(argv[a]))
+	{
+		return 2;
+	}
+	while (++a < argc)
+	{
+		load_su(argv[a]);
+	}
+	if ((i = find_func("main")) < 0)
+	{
+		fprintf(stderr, "no main() in the listing\n");
+		return 2;
+	}
+
+	statics = data_bytes + bss_bytes + noinit_bytes;
+	printf("static RAM: .data %lu + .bss %lu + .noinit %lu = %lu bytes\n",
+		data_bytes, bss_bytes, noinit_bytes, statics);
+
+	main_cost = cost(i);
+	printf("%-16s %5d bytes:", "main", main_cost);
+	print_path(i);
+	for (i = 0; i < func_count; i++)
+	{
+		int c;
+		if (strncmp(funcs[i].name, "__vector_", 9) != 0 ||
+			strcmp(funcs[i].name, "__vector_default") == 0)
+		{
+			continue;
+		}
+		// the hardware pushes the return address
+		c = cost(i);
+		c = c < 0 ? -1 : c + ret_bytes;
+		printf("%-16s %5d bytes:%s", funcs[i].name, c,
+			funcs[i].nests ? " (nests)" : "");
+		print_path(i);
+		if (c < 0)
+		{
+			continue;
+		}
+		if (funcs[i].nests)
+		{
+			nesting += c;
+		}
+		else if (c > worst_isr)
+		{
+			worst_isr = c;
+		}
+	}
+
+	if (problems || main_cost < 0)
+	{
+		printf("stack depth cannot be bounded\n");
+		return 1;
+	}
+	stack = main_cost + nesting + worst_isr;
+	printf("worst case stack %d bytes (main %d + interrupts %d)\n", stack,
+		main_cost, nesting + worst_isr);
+	printf("RAM %lu of %ld bytes budget, %ld left\n", statics + stack, budget,
+		budget - (long)(statics + stack));
+
+	if (log)
+	{
+		measured = log_high_water(log);
+		if (measured >= 0)
+		{
+			printf("measured high water %d bytes\n", measured);
+			if (measured > stack)
+			{
+				printf("measured stack exceeds the static bound\n");
+				return 1;
+			}
+		}
+		else
+		{
+			printf("%s: no stack lines\n", log);
+		}
+	}
+	return (long)(statics + stack) > budget;
+}
@@ -0,0 +1,309 @@
+// Test of tools/stack_check.c on fixtures: a crafted listing with interrupt
+// handlers that do and don't enable interrupts, and .su files written by
+// gcc -fstack-usage for a fixed frame and a variable length array.
+//
+// Build and run from the repository root, with gcc on the path:
+//
+//   gcc -std=gnu99 -O2 -Wall -o stack_check_test tools/stack_check_test.c
+//   ./stack_check_test
+//
+// stack_check.c is compiled in with its main() renamed and run on each
+// fixture as the command line would. In the listing main() takes 5 bytes,
+// the deepest handler without sei 9 and the two with sei 6 and 3, so the
+// worst case is 5 + 9 + 6 + 3 = 23 bytes over 48 bytes of static data: a
+// budget of 71 bytes must pass and one of 70 fail. The .su size of a
+// function must win over the smaller frame in the listing, and a call into
+// the function with the variable length array must make the depth
+// unbounded. The exit status is 1 if a check fails.
+
+#define main stack_check_main
+#include "stack_check.c"
+#undef main
+
+#include <unistd.h>
+
+#define TEST_STATICS	48			// .data and .bss of the listings
+#define TEST_WORST		23
+
+// main -> helper, __vector_10 -> isr_leaf, __vector_11, and __vector_20 and
+// __vector_21 with sei
+static const char listing_isr[] =
+	"\n"
+	"fixture.elf:     file format elf32-avr\n"
+	"\n"
+	"Sections:\n"
+	"Idx Name          Size      VMA       LMA       File off  Algn\n"
+	"  0 .data         00000010  00800100  00000200  00000294  2**0\n"
+	"                  CONTENTS, ALLOC, LOAD, DATA\n"
+	"  1 .text         00000200  00000000  00000000  00000094  2**1\n"
+	"                  CONTENTS, ALLOC, LOAD, READONLY, CODE\n"
+	"  2 .bss          00000020  00800110  00800110  000002a4  2**0\n"
+	"                  ALLOC\n"
+	"\n"
+	"Disassembly of section .text:\n"
+	"\n"
+	"00000100 <main>:\n"
+	"     100:\tcf 93       \tpush\tr28\n"
+	"     102:\tdf 93       \tpush\tr29\n"
+	"     104:\t0e 94 90 00 \tcall\t0x120\t; 0x120 <helper>\n"
+	"     108:\tdf 91       \tpop\tr29\n"
+	"     10a:\tcf 91       \tpop\tr28\n"
+	"     10c:\t08 95       \tret\n"
+	"\n"
+	"00000120 <helper>:\n"
+	"     120:\t0f 93       \tpush\tr16\n"
+	"     122:\t0f 91       \tpop\tr16\n"
+	"     124:\t08 95       \tret\n"
+	"\n"
+	"00000140 <__vector_10>:\n"
+	"     140:\t1f 92       \tpush\tr1\n"
+	"     142:\t0f 92       \tpush\tr0\n"
+	"     144:\t8f 93       \tpush\tr24\n"
+	"     146:\t0e 94 b0 00 \tcall\t0x160\t; 0x160 <isr_leaf>\n"
+	"     14a:\t8f 91       \tpop\tr24\n"
+	"     14c:\t0f 90       \tpop\tr0\n"
+	"     14e:\t1f 90       \tpop\tr1\n"
+	"     150:\t18 95       \treti\n"
+	"\n"
+	"00000160 <isr_leaf>:\n"
+	"     160:\t1f 93       \tpush\tr17\n"
+	"     162:\t2f 93       \tpush\tr18\n"
+	"     164:\t2f 91       \tpop\tr18\n"
+	"     166:\t1f 91       \tpop\tr17\n"
+	"     168:\t08 95       \tret\n"
+	"\n"
+	"00000170 <__vector_11>:\n"
+	"     170:\t8f 93       \tpush\tr24\n"
+	"     172:\t8f 91       \tpop\tr24\n"
+	"     174:\t18 95       \treti\n"
+	"\n"
+	"00000180 <__vector_20>:\n"
+	"     180:\t78 94       \tsei\n"
+	"     182:\t8f 93       \tpush\tr24\n"
+	"     184:\t9f 93       \tpush\tr25\n"
+	"     186:\taf 93       \tpush\tr26\n"
+	"     188:\tbf 93       \tpush\tr27\n"
+	"     18a:\tbf 91       \tpop\tr27\n"
+	"     18c:\taf 91       \tpop\tr26\n"
+	"     18e:\t9f 91       \tpop\tr25\n"
+	"     190:\t8f 91       \tpop\tr24\n"
+	"     192:\t18 95       \treti\n"
+	"\n"
+	"000001a0 <__vector_21>:\n"
+	"     1a0:\t78 94       \tsei\n"
+	"     1a2:\t8f 93       \tpush\tr24\n"
+	"     1a4:\t8f 91       \tpop\tr24\n"
+	"     1a6:\t18 95       \treti\n";
+
+// main -> small_leaf, and with the second listing main -> dyn_func too
+#define LISTING_SU_HEAD \
+	"Sections:\n" \
+	"Idx Name          Size      VMA       LMA       File off  Algn\n" \
+	"  0 .data         00000010  00800100  00000200  00000294  2**0\n" \
+	"  2 .bss          00000020  00800110  00800110  000002a4  2**0\n" \
+	"\n" \
+	"Disassembly of section .text:\n" \
+	"\n" \
+	"00000100 <main>:\n" \
+	"     100:\tcf 93       \tpush\tr28\n" \
+	"     102:\t0e 94 90 00 \tcall\t0x120\t; 0x120 <small_leaf>\n"
+#define LISTING_SU_TAIL \
+	"     10a:\tcf 91       \tpop\tr28\n" \
+	"     10c:\t08 95       \tret\n" \
+	"\n" \
+	"00000120 <small_leaf>:\n" \
+	"     120:\t0f 93       \tpush\tr16\n" \
+	"     122:\t0f 91       \tpop\tr16\n" \
+	"     124:\t08 95       \tret\n" \
+	"\n" \
+	"00000140 <dyn_func>:\n" \
+	"     140:\tcf 93       \tpush\tr28\n" \
+	"     142:\tcf 91       \tpop\tr28\n" \
+	"     144:\t08 95       \tret\n"
+
+static const char listing_su[] = LISTING_SU_HEAD LISTING_SU_TAIL;
+static const char listing_dyn[] = LISTING_SU_HEAD
+	"     106:\t0e 94 a0 00 \tcall\t0x140\t; 0x140 <dyn_func>\n"
+	LISTING_SU_TAIL;
+
+// Compiled with gcc -fstack-usage for the .su file
+static const char fixture_source[] =
+	"int small_leaf(int x)\n"
+	"{\n"
+	"\tvolatile char buf[200];\n"
+	"\tbuf[x & 127] = (char)x;\n"
+	"\treturn buf[0];\n"
+	"}\n"
+	"\n"
+	"int dyn_func(int n)\n"
+	"{\n"
+	"\tvolatile char buf[n];\n"
+	"\tbuf[0] = 1;\n"
+	"\treturn buf[n - 1];\n"
+	"}\n";
+
+static char dir[] = "/tmp/stack_check_XXXXXX";
+
+static int write_file(const char * name, const char * text)
+{
+	char path[128];
+	FILE * fp;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	if (!(fp = fopen(path, "w")))
+	{
+		perror(path);
+		return 0;
+	}
+	fputs(text, fp);
+	fclose(fp);
+	return 1;
+}
+
+// Forget the previous run
+static void reset(void)
+{
+	int i;
+
+	for (i = 0; i < func_count; i++)
+	{
+		free(funcs[i].calls);
+	}
+	free(funcs);
+	funcs = NULL;
+	func_count = func_alloc = 0;
+	data_bytes = bss_bytes = noinit_bytes = 0;
+	problems = 0;
+	ret_bytes = 2;
+}
+
+// stack_check -b budget dir/listing [dir/su]; returns its exit status
+static int run(const char * listing, const char * su, long budget)
+{
+	char budget_arg[16], listing_path[128], su_path[128];
+	char * argv[] = {"stack_check", "-b", budget_arg, listing_path, su_path,
+		NULL};
+
+	reset();
+	snprintf(budget_arg, sizeof(budget_arg), "%ld", budget);
+	snprintf(listing_path, sizeof(listing_path), "%s/%s", dir, listing);
+	snprintf(su_path, sizeof(su_path), "%s/%s", dir, su ? su : "");
+	printf("-- stack_check -b %ld %s%s%s\n", budget, listing, su ? " " : "",
+		su ? su : "");
+	fflush(stdout);
+	return stack_check_main(su ? 5 : 4, argv);
+}
+
+static int func_cost(const char * name)
+{
+	int i = find_func(name);
+	return i < 0 || !funcs[i].bounded ? -1 : funcs[i].cost;
+}
+
+// Interrupt handlers, nesting and the budget; returns the checks that failed
+static unsigned check_isr(void)
+{
+	unsigned failures = 0;
+	int status;
+
+	status = run("isr.lss", NULL, TEST_STATICS + TEST_WORST);
+	if (status != 0)
+	{
+		printf("FAIL, a budget of the worst case returned %d\n", status);
+		failures++;
+	}
+	if (func_cost("main") != 5 || func_cost("__vector_10") != 7 ||
+		func_cost("__vector_20") != 4 || func_cost("__vector_21") != 1)
+	{
+		printf("FAIL, main %d, __vector_10 %d, __vector_20 %d, "
+			"__vector_21 %d bytes below the return address\n",
+			func_cost("main"), func_cost("__vector_10"),
+			func_cost("__vector_20"), func_cost("__vector_21"));
+		failures++;
+	}
+	if (!funcs[find_func("__vector_20")].nests ||
+		funcs[find_func("__vector_10")].nests)
+	{
+		printf("FAIL, sei doesn't decide which handlers nest\n");
+		failures++;
+	}
+
+	status = run("isr.lss", NULL, TEST_STATICS + TEST_WORST - 1);
+	if (status != 1)
+	{
+		printf("FAIL, a budget one byte short returned %d\n", status);
+		failures++;
+	}
+	return failures;
+}
+
+// Frames from gcc -fstack-usage; returns the checks that failed
+static unsigned check_su(void)
+{
+	char command[256];
+	unsigned failures = 0;
+	int status, i, su;
+
+	snprintf(command, sizeof(command), "gcc -std=gnu99 -O1 -fstack-usage -c "
+		"-o %s/fixture.o %s/fixture.c", dir, dir);
+	if (system(command) != 0)
+	{
+		printf("FAIL, %s\n", command);
+		return 1;
+	}
+
+	status = run("su.lss", "fixture.su", STACK_CHECK_RAM);
+	i = find_func("small_leaf");
+	su = i < 0 ? -1 : funcs[i].su;
+	printf("small_leaf: %d bytes in the listing, %d in the .su file\n",
+		i < 0 ? -1 : funcs[i].peak, su);
+	if (status != 0 || i < 0 || su <= funcs[i].peak ||
+		func_cost("main") != 1 + 2 + su)
+	{
+		printf("FAIL, the .su frame of small_leaf wasn't used, main %d bytes\n",
+			func_cost("main"));
+		failures++;
+	}
+
+	status = run("dyn.lss", "fixture.su", STACK_CHECK_RAM);
+	i = find_func("dyn_func");
+	if (status != 1 || i < 0 || !funcs[i].dynamic || func_cost("main") >= 0)
+	{
+		printf("FAIL, the dynamic frame of dyn_func was bounded, status %d\n",
+			status);
+		failures++;
+	}
+	return failures;
+}
+
+int main(void)
+{
+	static const char * files[] = {"isr.lss", "su.lss", "dyn.lss",
+		"fixture.c", "fixture.o", "fixture.su"};
+	unsigned failures = 0, i;
+	char path[128];
+
+	if (!mkdtemp(dir) || !write_file("isr.lss", listing_isr) ||
+		!write_file("su.lss", listing_su) ||
+		!write_file("dyn.lss", listing_dyn) ||
+		!write_file("fixture.c", fixture_source))
+	{
+		perror("fixtures");
+		return 1;
+	}
+	failures += check_isr();
+	failures += check_su();
+
+	for (i = 0; i < sizeof(files) / sizeof(files[0]); i++)
+	{
+		snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+		unlink(path);
+	}
+	rmdir(dir);
+
+	if (failures)
+	{
+		printf("%u checks failed\n", failures);
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,501 @@
+// Decoder for streams written by telem_codec.c, and a benchmark of the
+// encoder on host data.
+//
+// Build from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -Itools/host -I. -o telem_decode tools/telem_decode.c telem_codec.c -lm
+//
+//   ./telem_decode [-a axes] stream.bin      decode to CSV on stdout
+//   ./telem_decode -b [-a axes] [-n block] [-k interval] [samples.csv]
+//
+// Decoding resynchronises on keyframes: a block that is damaged or whose
+// sequence number doesn't follow the last one decoded is skipped, as are the
+// blocks after it up to the next keyframe. The blocks lost are counted from
+// the sequence gaps, modulo 256.
+//
+// The benchmark encodes recorded samples (CSV, one sample of axes integers
+// per line) or, without a file, 60 s of synthetic 9-axis motion at 200 Hz,
+// decodes the result, checks it is identical and reports the compression
+// ratio against raw int16 samples and the encoder time on this host. It
+// then decodes the stream again with an intact block in the middle of the
+// second keyframe interval cut out, and checks that the samples up to the
+// next keyframe are dropped and everything else comes out unchanged. The
+// exit status is 1 if either decode differs.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "telem_codec.h"
+
+typedef struct
+{
+	const uint8_t * in;
+	uint16_t len;
+	uint16_t pos;       // bit position
+} bit_reader_t;
+
+typedef struct
+{
+	uint8_t axes;
+	uint8_t synced;     // predictors hold the end of the previous block
+	int16_t prev[TELEM_AXES_MAX];
+	int16_t prev2[TELEM_AXES_MAX];
+	unsigned blocks, skipped, lost;
+	uint8_t seq;        // sequence of the last block that checked
+	uint8_t seq_valid;
+} decoder_t;
+
+static int get_bits(bit_reader_t * r, uint8_t count, uint32_t * value)
+{
+	*value = 0;
+	while (count--)
+	{
+		if (r->pos >= (uint32_t)r->len * 8)
+		{
+			return 0;
+		}
+		*value = (*value << 1) | ((r->in[r->pos >> 3] >> (7 - (r->pos & 7))) & 1);
+		r->pos++;
+	}
+	return 1;
+}
+
+static int get_rice(bit_reader_t * r, uint8_t k, uint32_t * u)
+{
+	uint32_t bit, q = 0, low;
+
+	for (;;)
+	{
+		if (!get_bits(r, 1, &bit))
+		{
+			return 0;
+		}
+		if (!bit)
+		{
+			break;
+		}
+		if (++q == TELEM_ESCAPE)
+		{
+			return get_bits(r, TELEM_RAW_BITS, u);
+		}
+	}
+	if (!get_bits(r, k, &low))
+	{
+		return 0;
+	}
+	*u = (q << k) | low;
+	return 1;
+}
+
+// Decode the payload of one block into out[samples][axes]. Returns 0 if it
+// doesn't parse, the predictors are left alone then.
+static int decode_block(decoder_t * d, int key, uint8_t n,
+	const uint8_t * payload, uint16_t len, int16_t out[][TELEM_AXES_MAX])
+{
+	bit_reader_t r = {payload, len, 0};
+	int16_t prev[TELEM_AXES_MAX], prev2[TELEM_AXES_MAX];
+	uint32_t order, k, u;
+	int32_t p;
+	uint8_t a, i, first = key ? 1 : 0;
+
+	for (a = 0; a < d->axes; a++)
+	{
+		if (!get_bits(&r, 1, &order) || !get_bits(&r, 4, &k))
+		{
+			return 0;
+		}
+		if (key)
+		{
+			if (!get_bits(&r, 16, &u))
+			{
+				return 0;
+			}
+			out[0][a] = (int16_t)u;
+			prev[a] = prev2[a] = out[0][a];
+		}
+		else
+		{
+			prev[a] = d->prev[a];
+			prev2[a] = d->prev2[a];
+		}
+		for (i = first; i < n; i++)
+		{
+			if (!get_rice(&r, k, &u))
+			{
+				return 0;
+			}
+			p = order ? 2 * (int32_t)prev[a] - prev2[a] : prev[a];
+			p += telem_unzigzag(u);
+			if (p < INT16_MIN || p > INT16_MAX)
+			{
+				return 0;
+			}
+			out[i][a] = (int16_t)p;
+			prev2[a] = prev[a];
+			prev[a] = out[i][a];
+		}
+	}
+	memcpy(d->prev, prev, sizeof(prev));
+	memcpy(d->prev2, prev2, sizeof(prev2));
+	return 1;
+}
+
+// Decode a whole stream, calling emit for every sample. Returns the number
+// of samples.
+static unsigned decode_stream(decoder_t * d, const uint8_t * in, size_t size,
+	void (*emit)(const int16_t * sample, void * ctx), void * ctx)
+{
+	int16_t block[TELEM_BLOCK_MAX > 127 ? TELEM_BLOCK_MAX : 127][TELEM_AXES_MAX];
+	size_t pos = 0;
+	unsigned samples = 0;
+	uint16_t len, i16;
+	uint8_t n, i, crc, seq;
+	int key;
+
+	while (pos + TELEM_HEADER_BYTES <= size)
+	{
+		if (in[pos] != TELEM_SYNC)
+		{
+			pos++;
+			continue;
+		}
+		key = (in[pos + 1] & TELEM_KEYFRAME) != 0;
+		n = in[pos + 1] & 0x7F;
+		seq = in[pos + 2];
+		len = in[pos + 3] | (in[pos + 4] << 8);
+		if (n == 0 || pos + TELEM_HEADER_BYTES + len > size ||
+			len > TELEM_BLOCK_BYTES_MAX(d->axes, n))
+		{
+			pos++;
+			continue;
+		}
+		crc = 0;
+		for (i16 = 1; i16 < TELEM_HEADER_BYTES - 1; i16++)
+		{
+			crc = telem_crc8(crc, in[pos + i16]);
+		}
+		for (i16 = 0; i16 < len; i16++)
+		{
+			crc = telem_crc8(crc, in[pos + TELEM_HEADER_BYTES + i16]);
+		}
+		if (crc != in[pos + TELEM_HEADER_BYTES - 1])
+		{
+			d->synced = 0;
+			d->skipped++;
+			pos++;
+			continue;
+		}
+		if (d->seq_valid && seq != (uint8_t)(d->seq + 1))
+		{
+			// Blocks went missing, the predictors are not at this one's start
+			d->lost += (uint8_t)(seq - d->seq - 1);
+			d->synced = 0;
+		}
+		d->seq = seq;
+		d->seq_valid = 1;
+		if (!key && !d->synced)
+		{
+			// Intact but not decodable here, look for the next keyframe
+			d->skipped++;
+			pos += TELEM_HEADER_BYTES + len;
+			continue;
+		}
+		if (!decode_block(d, key, n, &in[pos + TELEM_HEADER_BYTES], len, block))
+		{
+			d->synced = 0;
+			d->skipped++;
+			pos++;
+			continue;
+		}
+		d->synced = 1;
+		d->blocks++;
+		for (i = 0; i < n; i++)
+		{
+			emit(block[i], ctx);
+		}
+		samples += n;
+		pos += TELEM_HEADER_BYTES + len;
+	}
+	return samples;
+}
+
+static void print_sample(const int16_t * sample, void * ctx)
+{
+	uint8_t a, axes = *(uint8_t *)ctx;
+	for (a = 0; a < axes; a++)
+	{
+		printf(a ? ",%d" : "%d", sample[a]);
+	}
+	printf("\n");
+}
+
+// Benchmark ------------------------------------------------------------
+
+typedef struct
+{
+	const int16_t * expect;
+	uint8_t axes;
+	unsigned index, errors;
+	unsigned skip_from, skip_to;    // samples the decoder must drop
+} check_t;
+
+static void check_sample(const int16_t * sample, void * ctx)
+{
+	check_t * c = ctx;
+	if (c->index == c->skip_from)
+	{
+		c->index = c->skip_to;
+	}
+	if (memcmp(sample, &c->expect[c->index * c->axes],
+		c->axes * sizeof(int16_t)) != 0)
+	{
+		c->errors++;
+	}
+	c->index++;
+}
+
+static double noise(void)
+{
+	// Sum of uniforms, roughly Gaussian with unit variance
+	double s = 0;
+	int i;
+	for (i = 0; i < 12; i++)
+	{
+		s += rand() / (double)RAND_MAX;
+	}
+	return s - 6.0;
+}
+
+// Handheld motion at 200 Hz: accelerometer at 16384 LSB/g with gravity and
+// 8 mg noise, gyro at 131 LSB/dps with 0.1 dps noise, magnetometer at
+// 0.6 uT/LSB with 0.5 LSB noise, plus a 35 Hz motor vibration
+static int16_t * synthesize(unsigned count)
+{
+	int16_t * s = malloc(count * 9 * sizeof(int16_t));
+	unsigned i;
+	int a;
+
+	for (i = 0; i < count; i++)
+	{
+		double t = i / 200.0;
+		double roll = 0.6 * sin(0.7 * t), pitch = 0.4 * sin(0.31 * t + 1);
+		double yaw = 0.5 * t;
+		double vib = 0.02 * sin(2 * M_PI * 35 * t);
+		double v[9];
+
+		v[0] = -sin(pitch) + vib;
+		v[1] = sin(roll) * cos(pitch);
+		v[2] = cos(roll) * cos(pitch) + vib;
+		v[3] = 0.6 * 0.7 * cos(0.7 * t) * 57.3;
+		v[4] = 0.4 * 0.31 * cos(0.31 * t + 1) * 57.3;
+		v[5] = 0.5 * 57.3;
+		v[6] = 30 * cos(yaw);
+		v[7] = 30 * sin(yaw);
+		v[8] = -40;
+		for (a = 0; a < 3; a++)
+		{
+			s[i * 9 + a] = (int16_t)lrint((v[a] + 0.008 * noise()) * 16384);
+			s[i * 9 + 3 + a] = (int16_t)lrint((v[3 + a] + 0.1 * noise()) * 131);
+			s[i * 9 + 6 + a] = (int16_t)lrint(v[6 + a] / 0.6 + 0.5 * noise());
+		}
+	}
+	return s;
+}
+
+static int16_t * load_csv(const char * name, uint8_t axes, unsigned * count)
+{
+	FILE * f = fopen(name, "r");
+	size_t cap = 1024, n = 0;
+	int16_t * s;
+	char line[512], * p;
+	uint8_t a;
+
+	if (!f)
+	{
+		return NULL;
+	}
+	s = malloc(cap * axes * sizeof(int16_t));
+	while (fgets(line, sizeof(line), f))
+	{
+		if (n == cap)
+		{
+			cap *= 2;
+			s = realloc(s, cap * axes * sizeof(int16_t));
+		}
+		for (a = 0, p = line; a < axes; a++)
+		{
+			char * end;
+			long v = strtol(p, &end, 10);
+			if (end == p)
+			{
+				break;
+			}
+			s[n * axes + a] = (int16_t)v;
+			p = end + (*end == ',');
+		}
+		if (a == axes)
+		{
+			n++;
+		}
+	}
+	fclose(f);
+	*count = n;
+	return s;
+}
+
+static int bench(const char * name, uint8_t axes, uint8_t block,
+	uint8_t interval)
+{
+	static telem_encoder_t enc;
+	unsigned count, i, blocks = 0;
+	// the block cut out and the keyframe after it
+	unsigned cut = interval + interval / 2, resume = 2 * interval;
+	int16_t * samples;
+	uint8_t * stream;
+	size_t size = 0, cut_at = 0, cut_len = 0;
+	clock_t start;
+	double seconds;
+	decoder_t d = {axes, 0, {0}, {0}, 0, 0, 0, 0, 0};
+	check_t c = {NULL, axes, 0, 0, 0, 0};
+	uint16_t n;
+	int result;
+
+	if (name)
+	{
+		samples = load_csv(name, axes, &count);
+		if (!samples)
+		{
+			fprintf(stderr, "can't read %s\n", name);
+			return 2;
+		}
+	}
+	else
+	{
+		axes = d.axes = c.axes = 9;
+		count = 200 * 60;
+		samples = synthesize(count);
+	}
+
+	stream = malloc((count / block + 1) * TELEM_BLOCK_BYTES_MAX(axes, block));
+	start = clock();
+	telem_init(&enc, axes, block, interval);
+	for (i = 0; i < count; i++)
+	{
+		n = telem_push(&enc, &samples[i * axes], &stream[size]);
+		if (n && blocks++ == cut)
+		{
+			cut_at = size;
+			cut_len = n;
+		}
+		size += n;
+	}
+	size += telem_flush(&enc, &stream[size]);
+	seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	c.expect = samples;
+	decode_stream(&d, stream, size, check_sample, &c);
+
+	printf("%u samples of %u axes, blocks of %u, keyframe every %u\n",
+		count, axes, block, interval);
+	printf("raw %u bytes, encoded %zu bytes, ratio %.2f, %.2f bits/value\n",
+		count * axes * 2, size, (double)count * axes * 2 / size,
+		size * 8.0 / ((double)count * axes));
+	printf("encoder %.0f ns per sample on this host\n",
+		seconds * 1e9 / count);
+	printf("decoded %u samples, %u mismatches\n", c.index, c.errors);
+	result = c.index == count && c.errors == 0 ? 0 : 1;
+
+	if (cut_len && resume * block < count)
+	{
+		decoder_t gap = {axes, 0, {0}, {0}, 0, 0, 0, 0, 0};
+		check_t cc = {samples, axes, 0, 0, cut * block, resume * block};
+
+		memmove(&stream[cut_at], &stream[cut_at + cut_len],
+			size - cut_at - cut_len);
+		decode_stream(&gap, stream, size - cut_len, check_sample, &cc);
+		printf("block %u cut out: %u lost, %u skipped, resumed at sample %u, "
+			"%u mismatches\n", cut, gap.lost, gap.skipped, resume * block,
+			cc.errors);
+		if (cc.index != count || cc.errors || gap.lost != 1)
+		{
+			result = 1;
+		}
+	}
+	return result;
+}
+
+int main(int argc, char ** argv)
+{
+	uint8_t axes = 9, block = 16, interval = 16;
+	int benchmark = 0, i;
+	const char * name = NULL;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-b"))
+		{
+			benchmark = 1;
+		}
+		else if (!strcmp(argv[i], "-a") && i + 1 < argc)
+		{
+			axes = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+		{
+			block = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-k") && i + 1 < argc)
+		{
+			interval = atoi(argv[++i]);
+		}
+		else
+		{
+			name = argv[i];
+		}
+	}
+	if (axes == 0 || axes > TELEM_AXES_MAX || block == 0 ||
+		block > TELEM_BLOCK_MAX)
+	{
+		fprintf(stderr, "axes 1 - %d, block 1 - %d\n", TELEM_AXES_MAX,
+			TELEM_BLOCK_MAX);
+		return 2;
+	}
+
+	if (benchmark)
+	{
+		return bench(name, axes, block, interval);
+	}
+	if (!name)
+	{
+		fprintf(stderr, "usage: %s [-a axes] stream.bin\n"
+			"       %s -b [-a axes] [-n block] [-k interval] [samples.csv]\n",
+			argv[0], argv[0]);
+		return 2;
+	}
+
+	{
+		FILE * f = fopen(name, "rb");
+		uint8_t * in;
+		long size;
+		decoder_t d = {axes, 0, {0}, {0}, 0, 0, 0, 0, 0};
+
+		if (!f)
+		{
+			fprintf(stderr, "can't read %s\n", name);
+			return 2;
+		}
+		fseek(f, 0, SEEK_END);
+		size = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		in = malloc(size);
+		size = fread(in, 1, size, f);
+		fclose(f);
+		decode_stream(&d, in, size, print_sample, &axes);
+		fprintf(stderr, "%u blocks decoded, %u skipped, %u lost\n", d.blocks,
+			d.skipped, d.lost);
+	}
+	return 0;
+}
@@ -0,0 +1,1082 @@
+// Ingestion daemon for the telemetry of many boards at once, and a load
+// generator to measure it. Linux only.
+//
+// Build from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -pthread
+//       -Itools/host -I. -o telem_ingest tools/telem_ingest.c telem_codec.c -lm
+//
+//   ./telem_ingest [-w workers] [-a axes] [-B baud] [-s seconds] [-o log]
+//       source...
+//   ./telem_ingest -g units [-r rate] [-t seconds] [-w 1,2,4,...] [-G gens]
+//       [-a axes] [-n block] [-k interval] [-e error] [-o log]
+//
+// Every source is one unit sending the block stream of telem_codec.c: a
+// serial device (set to raw mode at -B baud, default 115200), a FIFO, or
+// tcp:port, which listens and takes every connection as another unit.
+//
+// The sources are spread over the worker threads, each waiting on its own
+// epoll set, so a unit's blocks are always handled by the same worker and
+// stay in order. A worker reads what arrived, finds the blocks (sync byte,
+// header, CRC-8; bytes in between are skipped up to the next block that
+// checks) and hands them to the writer through a single producer, single
+// consumer ring without locks. The one writer thread appends them to the
+// log (-o) as
+//
+//   unit (2 bytes), block length (2 bytes), receive time in us since the
+//   epoch (8 bytes), all LSB first, then the block from its sync byte
+//
+// and measures the latency from the read to the write.
+//
+// Blocks missing from a unit are counted from the gaps in the sequence
+// numbers of the blocks that arrived; a run of 256 or more lost blocks is
+// only seen modulo 256. A progress line goes to stderr every -s seconds
+// (default 10); SIGINT or SIGTERM ends the run with a table of every unit
+// on stdout.
+//
+// With -g the daemon ingests from a built in load generator instead: units
+// pipes fed by -G threads (default 2) with blocks encoded by telem_codec.c
+// from synthetic 9-axis motion with a keyframe every -k blocks (default
+// 16), -r blocks per second each (default 50, 0 as fast as the daemon takes
+// them) for -t seconds (default 5). A share -e of the blocks gets a damaged
+// byte, each of which has to show up as one missed block. The run is repeated for every worker
+// count in the -w list and reports the sustained frames per second and
+// the latency percentiles from the generator's write to the daemon's.
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "telem_codec.h"
+
+#define UNITS_MAX		4096
+#define WORKERS_MAX		64
+#define RING_SIZE		1024	// frames from a worker to the writer, power of 2
+#define FRAME_MAX		TELEM_BLOCK_BYTES_MAX(TELEM_AXES_MAX, TELEM_BLOCK_MAX)
+#define READ_CHUNK		65536
+#define READS_MAX		4		// reads of a unit before the next unit's turn
+#define STAMPS			2048	// generator send times kept per unit, power of 2
+#define PIPE_BYTES		8192	// generator pipe size, bounds a unit's backlog
+#define POOL_BLOCKS		256		// generator blocks, one turn of the sequence
+#define HIST_SUB		16		// latency buckets per power of two
+#define HIST_BUCKETS	((64 - 3) * HIST_SUB)
+
+typedef struct
+{
+	uint64_t stamp_ns;      // read, or written by the generator
+	uint16_t unit;
+	uint16_t len;
+	uint8_t data[FRAME_MAX];
+} frame_t;
+
+// One worker's frames for the writer. head is only written by the worker,
+// tail only by the writer.
+typedef struct
+{
+	uint32_t head __attribute__((aligned(64)));
+	uint32_t tail __attribute__((aligned(64)));
+	unsigned long stalls;   // worker waited for space
+	frame_t slot[RING_SIZE];
+} ring_t;
+
+typedef struct
+{
+	int fd;
+	uint8_t listener;       // accepts connections, each a new unit
+	uint8_t open;
+	char name[64];
+	uint8_t buf[2 * FRAME_MAX];
+	uint16_t fill;
+	uint8_t seq;            // sequence of the last block that checked
+	uint8_t seq_valid;
+	unsigned long bytes, frames, samples, keyframes, missed, crc_errors;
+	unsigned long skipped;  // bytes outside blocks
+	// load generator: send time of every block, by sequence number
+	uint64_t * sent;
+} unit_t;
+
+typedef struct
+{
+	unsigned index;
+	int epfd;
+	pthread_t thread;
+	ring_t * ring;
+	uint8_t chunk[READ_CHUNK];
+} worker_t;
+
+typedef struct
+{
+	unsigned first, count;  // units fed
+	pthread_t thread;
+	unsigned seed;
+	unsigned long sent, damaged;
+} generator_t;
+
+// Settings
+static uint8_t axes = 9, block = 8, interval_set;
+static unsigned worker_count = 1;
+static FILE * out;
+
+// State of a run
+static unit_t * units;
+static unsigned unit_count, units_open, next_worker;
+static worker_t * workers[WORKERS_MAX];
+static unsigned workers_running;
+static volatile sig_atomic_t stop;
+static uint64_t hist[HIST_BUCKETS];
+static unsigned long written, written_bytes;
+static uint64_t run_start, last_write;
+
+// Load generator
+static int gen_fds[UNITS_MAX];
+static uint8_t * pool;
+static uint16_t pool_len[POOL_BLOCKS];
+static uint32_t pool_offset[POOL_BLOCKS];
+static unsigned pool_blocks;
+static double gen_rate = 50, gen_error, gen_seconds = 5;
+
+static uint64_t now_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static uint64_t epoch_us(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_REALTIME, &t);
+	return (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+// Latency histogram ----------------------------------------------------
+
+// Buckets of 1/HIST_SUB of a power of two, exact below HIST_SUB ns
+static unsigned hist_bucket(uint64_t ns)
+{
+	unsigned e;
+
+	if (ns < HIST_SUB)
+	{
+		return (unsigned)ns;
+	}
+	e = 63 - __builtin_clzll(ns);
+	return (e - 3) * HIST_SUB + ((ns >> (e - 4)) & (HIST_SUB - 1));
+}
+
+static uint64_t hist_floor(unsigned bucket)
+{
+	if (bucket < HIST_SUB)
+	{
+		return bucket;
+	}
+	return (uint64_t)(HIST_SUB + bucket % HIST_SUB) << (bucket / HIST_SUB - 1);
+}
+
+// Upper end of the bucket holding fraction p of the samples, in us
+static double hist_percentile(double p)
+{
+	uint64_t total = 0, sum = 0;
+	unsigned i;
+
+	for (i = 0; i < HIST_BUCKETS; i++)
+	{
+		total += hist[i];
+	}
+	for (i = 0; i < HIST_BUCKETS && total; i++)
+	{
+		sum += hist[i];
+		if (sum >= p * total)
+		{
+			return (i + 1 < HIST_BUCKETS ? hist_floor(i + 1) : hist_floor(i)) / 1e3;
+		}
+	}
+	return 0;
+}
+
+// Units ----------------------------------------------------------------
+
+// Register a unit with the next worker in turn
+static unit_t * unit_add(int fd, const char * name, uint8_t listener)
+{
+	unsigned i = __atomic_fetch_add(&unit_count, 1, __ATOMIC_RELAXED);
+	struct epoll_event ev = {EPOLLIN};
+	unit_t * u;
+
+	if (i >= UNITS_MAX)
+	{
+		fprintf(stderr, "more than %d units, %s refused\n", UNITS_MAX, name);
+		close(fd);
+		return NULL;
+	}
+	u = &units[i];
+	u->fd = fd;
+	u->listener = listener;
+	u->open = 1;
+	snprintf(u->name, sizeof(u->name), "%s", name);
+	if (!listener)
+	{
+		__atomic_fetch_add(&units_open, 1, __ATOMIC_RELAXED);
+	}
+	ev.data.ptr = u;
+	i = __atomic_fetch_add(&next_worker, 1, __ATOMIC_RELAXED) % worker_count;
+	if (epoll_ctl(workers[i]->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+	{
+		perror(name);
+		return NULL;
+	}
+	return u;
+}
+
+static void unit_close(worker_t * w, unit_t * u)
+{
+	epoll_ctl(w->epfd, EPOLL_CTL_DEL, u->fd, NULL);
+	close(u->fd);
+	u->open = 0;
+	if (__atomic_sub_fetch(&units_open, 1, __ATOMIC_RELAXED) == 0 && pool)
+	{
+		// the generator is done and every unit has been read to the end
+		stop = 1;
+	}
+}
+
+// Sequence of a unit: the blocks between the last one that checked and
+// this one were lost
+static void unit_track(unit_t * u, uint8_t key, uint8_t seq)
+{
+	if (key)
+	{
+		u->keyframes++;
+	}
+	if (u->seq_valid)
+	{
+		u->missed += (uint8_t)(seq - u->seq - 1);
+	}
+	u->seq = seq;
+	u->seq_valid = 1;
+}
+
+// Pass the blocks in the unit's buffer to the writer; the start of an
+// incomplete one stays in the buffer
+static void unit_parse(worker_t * w, unit_t * u, uint64_t stamp)
+{
+	ring_t * r = w->ring;
+	uint16_t pos = 0, len, i;
+	const uint8_t * p;
+	uint8_t n, crc;
+	frame_t * f;
+
+	while (u->fill - pos >= TELEM_HEADER_BYTES)
+	{
+		p = &u->buf[pos];
+		n = p[1] & 0x7F;
+		len = p[3] | (p[4] << 8);
+		if (p[0] != TELEM_SYNC || n == 0 || n > TELEM_BLOCK_MAX ||
+			len > TELEM_BLOCK_BYTES_MAX(axes, n))
+		{
+			pos++;
+			u->skipped++;
+			continue;
+		}
+		if (u->fill - pos < TELEM_HEADER_BYTES + len)
+		{
+			break;
+		}
+		crc = 0;
+		for (i = 1; i < TELEM_HEADER_BYTES - 1; i++)
+		{
+			crc = telem_crc8(crc, p[i]);
+		}
+		for (i = 0; i < len; i++)
+		{
+			crc = telem_crc8(crc, p[TELEM_HEADER_BYTES + i]);
+		}
+		if (crc != p[TELEM_HEADER_BYTES - 1])
+		{
+			u->crc_errors++;
+			pos++;
+			u->skipped++;
+			continue;
+		}
+
+		unit_track(u, p[1] & TELEM_KEYFRAME, p[2]);
+		while (r->head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == RING_SIZE)
+		{
+			r->stalls++;
+			sched_yield();
+		}
+		f = &r->slot[r->head & (RING_SIZE - 1)];
+		f->stamp_ns = u->sent ?
+			__atomic_load_n(&u->sent[u->frames & (STAMPS - 1)], __ATOMIC_RELAXED) :
+			stamp;
+		f->unit = (uint16_t)(u - units);
+		f->len = TELEM_HEADER_BYTES + len;
+		memcpy(f->data, p, f->len);
+		__atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+
+		u->frames++;
+		u->samples += n;
+		pos += TELEM_HEADER_BYTES + len;
+	}
+	memmove(u->buf, u->buf + pos, u->fill - pos);
+	u->fill -= pos;
+}
+
+// Read what the unit has sent. Returns 0 at its end.
+static int unit_read(worker_t * w, unit_t * u)
+{
+	ssize_t n;
+	size_t used, take;
+	int reads;
+
+	for (reads = 0; reads < READS_MAX; reads++)
+	{
+		n = read(u->fd, w->chunk, sizeof(w->chunk));
+		if (n < 0)
+		{
+			return errno == EAGAIN || errno == EINTR;
+		}
+		if (n == 0)
+		{
+			return 0;
+		}
+		u->bytes += n;
+		for (used = 0; used < (size_t)n; used += take)
+		{
+			take = sizeof(u->buf) - u->fill;
+			take = take < n - used ? take : n - used;
+			memcpy(u->buf + u->fill, w->chunk + used, take);
+			u->fill += take;
+			unit_parse(w, u, now_ns());
+		}
+		if ((size_t)n < sizeof(w->chunk))
+		{
+			break;
+		}
+	}
+	return 1;
+}
+
+static void unit_accept(unit_t * listener)
+{
+	struct sockaddr_in peer;
+	socklen_t size = sizeof(peer);
+	char name[64];
+	int fd;
+
+	while ((fd = accept4(listener->fd, (struct sockaddr *)&peer, &size,
+		SOCK_NONBLOCK)) >= 0)
+	{
+		uint32_t a = ntohl(peer.sin_addr.s_addr);
+		snprintf(name, sizeof(name), "%u.%u.%u.%u:%u", a >> 24, (a >> 16) & 255,
+			(a >> 8) & 255, a & 255, ntohs(peer.sin_port));
+		unit_add(fd, name, 0);
+		size = sizeof(peer);
+	}
+}
+
+// Threads --------------------------------------------------------------
+
+static void * worker_main(void * arg)
+{
+	worker_t * w = arg;
+	struct epoll_event ev[8];
+	int n, i;
+
+	while (!stop)
+	{
+		n = epoll_wait(w->epfd, ev, 8, 100);
+		for (i = 0; i < n; i++)
+		{
+			unit_t * u = ev[i].data.ptr;
+
+			if (u->listener)
+			{
+				unit_accept(u);
+			}
+			else if (!unit_read(w, u))
+			{
+				unit_close(w, u);
+			}
+		}
+	}
+	__atomic_sub_fetch(&workers_running, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static void * writer_main(void * arg)
+{
+	uint8_t header[12];
+	unsigned i, idle = 0;
+	uint64_t now;
+	(void)arg;
+
+	for (;;)
+	{
+		unsigned got = 0, running =
+			__atomic_load_n(&workers_running, __ATOMIC_ACQUIRE);
+
+		for (i = 0; i < worker_count; i++)
+		{
+			ring_t * r = workers[i]->ring;
+			uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+			uint32_t tail = r->tail;
+
+			for (; tail != head; tail++, got++)
+			{
+				frame_t * f = &r->slot[tail & (RING_SIZE - 1)];
+
+				if (out)
+				{
+					uint64_t t = epoch_us();
+					int b;
+					header[0] = f->unit;
+					header[1] = f->unit >> 8;
+					header[2] = f->len;
+					header[3] = f->len >> 8;
+					for (b = 0; b < 8; b++)
+					{
+						header[4 + b] = t >> (8 * b);
+					}
+					fwrite(header, 1, sizeof(header), out);
+					fwrite(f->data, 1, f->len, out);
+				}
+				now = now_ns();
+				hist[hist_bucket(now > f->stamp_ns ? now - f->stamp_ns : 0)]++;
+				written++;
+				written_bytes += f->len;
+				last_write = now;
+				// hand slots back every so often, not per frame
+				if ((tail & 63) == 63)
+				{
+					__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+				}
+			}
+			__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+		}
+
+		if (got)
+		{
+			idle = 0;
+		}
+		else if (running == 0)
+		{
+			// the workers were done before this pass emptied the rings
+			break;
+		}
+		else if (++idle < 64)
+		{
+			sched_yield();
+		}
+		else
+		{
+			struct timespec t = {0, 20000};
+			nanosleep(&t, NULL);
+		}
+	}
+	if (out)
+	{
+		fflush(out);
+	}
+	return NULL;
+}
+
+// Sources --------------------------------------------------------------
+
+static speed_t baud_code(long baud)
+{
+	static const struct { long baud; speed_t code; } table[] =
+	{
+		{9600, B9600}, {19200, B19200}, {38400, B38400}, {57600, B57600},
+		{115200, B115200}, {230400, B230400}, {460800, B460800},
+		{500000, B500000}, {921600, B921600}, {1000000, B1000000},
+	};
+	unsigned i;
+
+	for (i = 0; i < sizeof(table) / sizeof(table[0]); i++)
+	{
+		if (table[i].baud == baud)
+		{
+			return table[i].code;
+		}
+	}
+	return 0;
+}
+
+static int source_open(const char * name, speed_t baud)
+{
+	struct stat st;
+	int fd, one = 1;
+
+	if (!strncmp(name, "tcp:", 4))
+	{
+		struct sockaddr_in addr = {AF_INET, htons(atoi(name + 4))};
+
+		fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+			listen(fd, 128) < 0)
+		{
+			perror(name);
+			return 0;
+		}
+		return unit_add(fd, name, 1) != NULL;
+	}
+
+	// a FIFO is also opened for writing so it doesn't end when a writer
+	// goes away
+	if (stat(name, &st) < 0 ||
+		(fd = open(name, (S_ISFIFO(st.st_mode) ? O_RDWR : O_RDONLY) |
+		O_NOCTTY | O_NONBLOCK)) < 0)
+	{
+		perror(name);
+		return 0;
+	}
+	if (S_ISCHR(st.st_mode) && isatty(fd))
+	{
+		struct termios tio;
+
+		if (tcgetattr(fd, &tio) < 0)
+		{
+			perror(name);
+			return 0;
+		}
+		cfmakeraw(&tio);
+		tio.c_cflag |= CLOCAL | CREAD;
+		cfsetispeed(&tio, baud);
+		cfsetospeed(&tio, baud);
+		tcsetattr(fd, TCSANOW, &tio);
+		tcflush(fd, TCIFLUSH);
+	}
+	else if (!S_ISFIFO(st.st_mode) && !S_ISSOCK(st.st_mode) &&
+		!S_ISCHR(st.st_mode))
+	{
+		fprintf(stderr, "%s: not a serial device, FIFO or socket\n", name);
+		return 0;
+	}
+	return unit_add(fd, name, 0) != NULL;
+}
+
+// Runs -----------------------------------------------------------------
+
+static int run_start_workers(void)
+{
+	unsigned i;
+
+	units = calloc(UNITS_MAX, sizeof(unit_t));
+	unit_count = units_open = next_worker = 0;
+	memset(hist, 0, sizeof(hist));
+	written = written_bytes = 0;
+	stop = 0;
+	for (i = 0; i < worker_count; i++)
+	{
+		worker_t * w = calloc(1, sizeof(worker_t));
+		w->index = i;
+		w->ring = aligned_alloc(64, sizeof(ring_t));
+		memset(w->ring, 0, sizeof(ring_t));
+		w->epfd = epoll_create1(0);
+		if (!units || w->epfd < 0)
+		{
+			perror("epoll");
+			return 0;
+		}
+		workers[i] = w;
+	}
+	return 1;
+}
+
+static void run_threads(pthread_t * writer)
+{
+	unsigned i;
+
+	run_start = last_write = now_ns();
+	workers_running = worker_count;
+	for (i = 0; i < worker_count; i++)
+	{
+		pthread_create(&workers[i]->thread, NULL, worker_main, workers[i]);
+	}
+	pthread_create(writer, NULL, writer_main, NULL);
+}
+
+static void run_end(pthread_t writer)
+{
+	unsigned i;
+
+	for (i = 0; i < worker_count; i++)
+	{
+		pthread_join(workers[i]->thread, NULL);
+	}
+	pthread_join(writer, NULL);
+}
+
+static void run_free(void)
+{
+	unsigned i;
+
+	for (i = 0; i < unit_count && i < UNITS_MAX; i++)
+	{
+		if (units[i].open)
+		{
+			close(units[i].fd);
+		}
+		free(units[i].sent);
+	}
+	for (i = 0; i < worker_count; i++)
+	{
+		close(workers[i]->epfd);
+		free(workers[i]->ring);
+		free(workers[i]);
+	}
+	free(units);
+}
+
+typedef struct
+{
+	unsigned long frames, missed, crc_errors, skipped, stalls;
+} totals_t;
+
+static void run_totals(totals_t * t)
+{
+	unsigned i;
+
+	memset(t, 0, sizeof(*t));
+	for (i = 0; i < unit_count && i < UNITS_MAX; i++)
+	{
+		t->frames += units[i].frames;
+		t->missed += units[i].missed;
+		t->crc_errors += units[i].crc_errors;
+		t->skipped += units[i].skipped;
+	}
+	for (i = 0; i < worker_count; i++)
+	{
+		t->stalls += workers[i]->ring->stalls;
+	}
+}
+
+// Daemon ---------------------------------------------------------------
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static int daemon_run(char ** sources, int count, long baud, double every)
+{
+	speed_t code = baud_code(baud);
+	unsigned long last = 0;
+	pthread_t writer;
+	totals_t t;
+	unsigned i;
+	int s;
+
+	if (!code)
+	{
+		fprintf(stderr, "unsupported baud rate %ld\n", baud);
+		return 2;
+	}
+	if (!run_start_workers())
+	{
+		return 2;
+	}
+	for (s = 0; s < count; s++)
+	{
+		if (!source_open(sources[s], code))
+		{
+			return 2;
+		}
+	}
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	run_threads(&writer);
+
+	while (!stop)
+	{
+		struct timespec wait = {(time_t)every, (long)((every - (time_t)every) * 1e9)};
+		unsigned long now;
+
+		if (nanosleep(&wait, NULL) < 0 && stop)
+		{
+			break;
+		}
+		// counters read unlocked, only for the progress line
+		now = written;
+		run_totals(&t);
+		fprintf(stderr, "%.0f s: %u units, %.0f frames/s, %lu frames, %lu missed, "
+			"%lu CRC errors, latency p99 %.0f us\n", (now_ns() - run_start) * 1e-9,
+			__atomic_load_n(&units_open, __ATOMIC_RELAXED),
+			(now - last) / every, now, t.missed, t.crc_errors,
+			hist_percentile(0.99));
+		last = now;
+	}
+	run_end(writer);
+
+	printf("%-24s %10s %10s %9s %8s %8s %10s %12s\n", "unit", "frames",
+		"samples", "keyframes", "missed", "CRC", "skipped", "bytes");
+	for (i = 0; i < unit_count && i < UNITS_MAX; i++)
+	{
+		unit_t * u = &units[i];
+		if (!u->listener)
+		{
+			printf("%-24s %10lu %10lu %9lu %8lu %8lu %10lu %12lu\n", u->name,
+				u->frames, u->samples, u->keyframes, u->missed, u->crc_errors,
+				u->skipped, u->bytes);
+		}
+	}
+	printf("latency p50 %.0f us, p99 %.0f us, p99.9 %.0f us\n",
+		hist_percentile(0.5), hist_percentile(0.99), hist_percentile(0.999));
+	run_free();
+	return 0;
+}
+
+// Load generator -------------------------------------------------------
+
+// Handheld motion at 200 Hz as in telem_decode's benchmark, without noise
+// on the magnetometer
+static void pool_encode(void)
+{
+	static telem_encoder_t enc;
+	uint8_t buf[FRAME_MAX];
+	int16_t s[9];
+	uint32_t size = 0;
+	unsigned i = 0;
+	uint8_t a;
+
+	pool = malloc((size_t)POOL_BLOCKS * FRAME_MAX);
+	pool_blocks = 0;
+	telem_init(&enc, axes, block, interval_set);
+	while (pool_blocks < POOL_BLOCKS)
+	{
+		double t = i++ / 200.0;
+		double roll = 0.6 * sin(0.7 * t), pitch = 0.4 * sin(0.31 * t + 1);
+		double v[9] = {-sin(pitch), sin(roll) * cos(pitch),
+			cos(roll) * cos(pitch), 24 * cos(0.7 * t), 7.1 * cos(0.31 * t + 1),
+			28.6, 30 * cos(0.5 * t), 30 * sin(0.5 * t), -40};
+		uint16_t n;
+
+		for (a = 0; a < 9; a++)
+		{
+			double lsb = a < 3 ? 16384 : a < 6 ? 131 : 1 / 0.6;
+			s[a] = (int16_t)lrint(v[a] * lsb + (rand() % 17 - 8));
+		}
+		n = telem_push(&enc, s, buf);
+		if (n)
+		{
+			pool_offset[pool_blocks] = size;
+			pool_len[pool_blocks++] = n;
+			memcpy(pool + size, buf, n);
+			size += n;
+		}
+	}
+}
+
+static int gen_send(generator_t * g, unsigned unit, unsigned long * seq,
+	unsigned * at)
+{
+	unit_t * u = &units[unit];
+	const uint8_t * p = pool + pool_offset[*at];
+	uint8_t copy[FRAME_MAX];
+	uint16_t len = pool_len[*at];
+	uint8_t damaged = gen_error > 0 && rand_r(&g->seed) < gen_error * RAND_MAX;
+
+	if (damaged)
+	{
+		memcpy(copy, p, len);
+		copy[(*seq * 7919) % len] ^= 0x5A;
+		p = copy;
+		g->damaged++;
+	}
+	else
+	{
+		__atomic_store_n(&u->sent[*seq & (STAMPS - 1)], now_ns(), __ATOMIC_RELAXED);
+		++*seq;
+	}
+	if (write(gen_fds[unit], p, len) != len)
+	{
+		return 0;
+	}
+	g->sent++;
+	*at = (*at + 1) % pool_blocks;
+	return 1;
+}
+
+static void * gen_main(void * arg)
+{
+	generator_t * g = arg;
+	uint64_t start = now_ns(), end = start + (uint64_t)(gen_seconds * 1e9);
+	uint64_t period = gen_rate > 0 ? (uint64_t)(1e9 / gen_rate) : 0;
+	unsigned long * seq = calloc(g->count, sizeof(unsigned long));
+	uint64_t * next = calloc(g->count, sizeof(uint64_t));
+	unsigned * at = calloc(g->count, sizeof(unsigned));
+	unsigned i;
+
+	for (i = 0; i < g->count; i++)
+	{
+		// every unit starts on a keyframe, spread over the period; the pool
+		// wraps with the sequence numbers and starts with a keyframe
+		at[i] = (g->first + i) % ((POOL_BLOCKS + interval_set - 1) /
+			interval_set) * interval_set;
+		next[i] = start + period * (g->first + i) / unit_count;
+	}
+	for (;;)
+	{
+		uint64_t now = now_ns(), soonest = end;
+
+		if (now >= end)
+		{
+			break;
+		}
+		for (i = 0; i < g->count; i++)
+		{
+			if (!period)
+			{
+				gen_send(g, g->first + i, &seq[i], &at[i]);
+				continue;
+			}
+			while (next[i] <= now)
+			{
+				gen_send(g, g->first + i, &seq[i], &at[i]);
+				next[i] += period;
+			}
+			soonest = next[i] < soonest ? next[i] : soonest;
+		}
+		if (period && soonest > now)
+		{
+			struct timespec t = {0, (long)(soonest - now)};
+			t.tv_sec = t.tv_nsec / 1000000000;
+			t.tv_nsec %= 1000000000;
+			nanosleep(&t, NULL);
+		}
+	}
+	for (i = 0; i < g->count; i++)
+	{
+		close(gen_fds[g->first + i]);
+	}
+	free(seq);
+	free(next);
+	free(at);
+	return NULL;
+}
+
+static int gen_run(unsigned count, unsigned gens)
+{
+	generator_t g[WORKERS_MAX];
+	pthread_t writer;
+	unsigned long sent = 0, damaged = 0;
+	double seconds;
+	char name[32];
+	totals_t t;
+	unsigned i;
+
+	if (!run_start_workers())
+	{
+		return 0;
+	}
+	for (i = 0; i < count; i++)
+	{
+		int fd[2];
+		unit_t * u;
+
+		if (pipe2(fd, 0) < 0)
+		{
+			perror("pipe");
+			return 0;
+		}
+		fcntl(fd[0], F_SETFL, O_NONBLOCK);
+		fcntl(fd[1], F_SETPIPE_SZ, PIPE_BYTES);
+		gen_fds[i] = fd[1];
+		snprintf(name, sizeof(name), "unit %u", i);
+		u = unit_add(fd[0], name, 0);
+		if (!u)
+		{
+			return 0;
+		}
+		u->sent = calloc(STAMPS, sizeof(uint64_t));
+	}
+	run_threads(&writer);
+	for (i = 0; i < gens; i++)
+	{
+		g[i].first = count * i / gens;
+		g[i].count = count * (i + 1) / gens - g[i].first;
+		g[i].seed = i + 1;
+		g[i].sent = g[i].damaged = 0;
+		pthread_create(&g[i].thread, NULL, gen_main, &g[i]);
+	}
+	for (i = 0; i < gens; i++)
+	{
+		pthread_join(g[i].thread, NULL);
+		sent += g[i].sent;
+		damaged += g[i].damaged;
+	}
+	run_end(writer);
+
+	seconds = (last_write - run_start) * 1e-9;
+	run_totals(&t);
+	printf("%7u %12.0f %9.1f %9.1f %9.1f %10lu %8lu %8lu %8lu\n", worker_count,
+		written / seconds, hist_percentile(0.5), hist_percentile(0.99),
+		hist_percentile(0.999), written, sent - written, t.missed, damaged);
+	run_free();
+	return 1;
+}
+
+int main(int argc, char ** argv)
+{
+	unsigned list[WORKERS_MAX], lists = 1, units_gen = 0, gens = 2, i;
+	double every = 10;
+	long baud = 115200;
+	const char * log = NULL;
+	char * p;
+	int first = 0;
+
+	list[0] = 1;
+	for (i = 1; i < (unsigned)argc && !first; i++)
+	{
+		if (!strcmp(argv[i], "-w") && i + 1 < (unsigned)argc)
+		{
+			for (lists = 0, p = argv[++i]; *p && lists < WORKERS_MAX; lists++)
+			{
+				list[lists] = strtoul(p, &p, 10);
+				p += *p == ',';
+			}
+		}
+		else if (!strcmp(argv[i], "-a") && i + 1 < (unsigned)argc)
+		{
+			axes = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-n") && i + 1 < (unsigned)argc)
+		{
+			block = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-k") && i + 1 < (unsigned)argc)
+		{
+			interval_set = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-B") && i + 1 < (unsigned)argc)
+		{
+			baud = atol(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-s") && i + 1 < (unsigned)argc)
+		{
+			every = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-o") && i + 1 < (unsigned)argc)
+		{
+			log = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-g") && i + 1 < (unsigned)argc)
+		{
+			units_gen = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-G") && i + 1 < (unsigned)argc)
+		{
+			gens = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-r") && i + 1 < (unsigned)argc)
+		{
+			gen_rate = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-t") && i + 1 < (unsigned)argc)
+		{
+			gen_seconds = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-e") && i + 1 < (unsigned)argc)
+		{
+			gen_error = atof(argv[++i]);
+		}
+		else if (argv[i][0] == '-')
+		{
+			break;
+		}
+		else
+		{
+			first = i;
+		}
+	}
+	if ((!first && !units_gen) || (i < (unsigned)argc && !first) ||
+		axes < 1 || axes > TELEM_AXES_MAX || block < 1 ||
+		block > TELEM_BLOCK_MAX || every <= 0)
+	{
+		fprintf(stderr, "usage: %s [-w workers] [-a axes] [-B baud] "
+			"[-s seconds] [-o log] source...\n"
+			"       %s -g units [-r rate] [-t seconds] [-w 1,2,4,...] "
+			"[-G gens] [-a axes] [-n block] [-k interval] [-e error] [-o log]\n",
+			argv[0], argv[0]);
+		return 2;
+	}
+	for (i = 0; i < lists; i++)
+	{
+		if (list[i] < 1 || list[i] > WORKERS_MAX)
+		{
+			fprintf(stderr, "1 - %d workers\n", WORKERS_MAX);
+			return 2;
+		}
+	}
+	if (log && !(out = fopen(log, "wb")))
+	{
+		fprintf(stderr, "can't write %s\n", log);
+		return 2;
+	}
+	if (out)
+	{
+		setvbuf(out, NULL, _IOFBF, 1 << 20);
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	if (!units_gen)
+	{
+		worker_count = list[0];
+		return daemon_run(&argv[first], argc - first, baud, every);
+	}
+
+	if (units_gen > UNITS_MAX || gens < 1 || gens > units_gen ||
+		gens > WORKERS_MAX)
+	{
+		fprintf(stderr, "1 - %d units, 1 - units generators\n", UNITS_MAX);
+		return 2;
+	}
+	interval_set = interval_set ? interval_set : 16;
+	axes = 9;
+	pool_encode();
+	printf("%u units, blocks of %u samples, keyframe every %u, "
+		"%u generators, %ld cores\n", units_gen, block, interval_set, gens,
+		sysconf(_SC_NPROCESSORS_ONLN));
+	if (gen_rate > 0)
+	{
+		printf("offered %.0f frames/s\n", units_gen * gen_rate);
+	}
+	else
+	{
+		printf("offered as fast as taken\n");
+	}
+	printf("%7s %12s %9s %9s %9s %10s %8s %8s %8s\n", "workers", "frames/s",
+		"p50 us", "p99 us", "p99.9 us", "frames", "lost", "missed", "damaged");
+	for (i = 0; i < lists; i++)
+	{
+		worker_count = list[i];
+		if (!gen_run(units_gen, gens))
+		{
+			return 2;
+		}
+	}
+	free(pool);
+	if (out)
+	{
+		fclose(out);
+	}
+	return 0;
+}
@@ -0,0 +1,186 @@
+// Test of timebase.c against a model of Timer1: the 32 bit clock across
+// overflows whose interrupt is held off, the drift correction from the MPU
+// sample clock, and what a timebase_now() read costs.
+//
+// Build and run from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -Itools/host -I. -o timebase_test tools/timebase_test.c timebase.c
+//   ./timebase_test
+//
+// The timer is walked through more than 2^32 ticks in uneven steps, with
+// the overflow interrupt run late by up to TEST_IRQ_OFF_US as it is while
+// interrupts are disabled; every reading must be the exact tick count and
+// never go backwards, also while TOV1 is pending and across the wrap. Then
+// MPU samples are reported with the timer TEST_DRIFT_PPM fast, once with
+// every drain finding samples and once with drains in between that find
+// none, as the accelerometer cache of main.c makes them: the corrected time
+// must never go backwards, and once the estimate has settled a second of MPU
+// samples must be within TEST_SETTLED_PPM of 1 s. The read
+// cost is timed on the host only; its cycles on the ATmega1284P need the
+// board. The exit status is 1 if a check fails.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <avr/io.h>
+#include "timebase.h"
+
+#define TEST_IRQ_OFF_US		30000		// below the 32.8 ms the flag check covers
+#define TEST_STEP_MAX		3000
+#define TEST_DRIFT_PPM		20000		// RC oscillator 2 % fast
+#define TEST_SETTLED_PPM	1000
+#define TEST_RATE_HZ		200
+#define TEST_DRAIN			10			// samples per FIFO drain
+#define TEST_SYNC_WINDOWS	40
+#define TEST_READS			10000000UL
+
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint16_t TCNT1;
+
+void TIMER1_OVF_vect(void);
+
+// Overflow interrupts run so far
+static uint16_t serviced;
+
+// Put the timer at tick t; the overflow interrupt runs if irq is set, else
+// its flag stays pending
+static void timer_at(uint64_t t, int irq)
+{
+	uint16_t overflows = (uint16_t)(t >> 16);
+
+	TCNT1 = (uint16_t)t;
+	while (irq && serviced != overflows)
+	{
+		TIMER1_OVF_vect();
+		serviced++;
+	}
+	TIFR1 = serviced != overflows ? (1 << TOV1) : 0;
+}
+
+// Uneven steps through more than 2^32 ticks; returns the checks that failed
+static unsigned check_overflows(void)
+{
+	uint64_t t = 0;
+	uint32_t prev = 0, now;
+	unsigned long reads = 0, pending = 0, failures = 0;
+
+	timebase_init();
+	serviced = 0;
+	srand(1);
+	while (t < (1ULL << 32) + (1ULL << 20))
+	{
+		t += 1 + (unsigned)rand() % TEST_STEP_MAX;
+		// interrupts off three times out of four, never longer than
+		// TEST_IRQ_OFF_US past the overflow
+		timer_at(t, rand() % 4 == 0 || (uint16_t)t >= TEST_IRQ_OFF_US);
+		pending += (TIFR1 & (1 << TOV1)) != 0;
+		now = timebase_now();
+		reads++;
+		if (now != (uint32_t)t || (int32_t)(now - prev) <= 0)
+		{
+			if (failures++ < 5)
+			{
+				printf("tick %llu%s: FAIL, read %lu after %lu\n",
+					(unsigned long long)t, TIFR1 ? " (TOV1 pending)" : "",
+					(unsigned long)now, (unsigned long)prev);
+			}
+		}
+		prev = now;
+	}
+	printf("%lu reads over %llu overflows, %lu with TOV1 pending: "
+		"%lu failed\n", reads, (unsigned long long)(t >> 16), pending,
+		failures);
+	return failures ? 1 : 0;
+}
+
+// MPU samples against a fast timer, with empty drains half a sample period
+// after every drain if empty is set; returns the checks that failed
+static unsigned check_sync(int empty)
+{
+	// timer ticks per sample period, and a start just before the wrap
+	const double period = 1e6 / TEST_RATE_HZ * (1 + TEST_DRIFT_PPM / 1e6);
+	const uint32_t start = 0xFFF00000UL;
+	uint32_t stamp, corrected, prev = 0, second = 0;
+	unsigned failures = 0, backwards = 0, n;
+	long error_ppm = 0;
+
+	timebase_init();
+	timebase_sync_rate(TEST_RATE_HZ);
+	for (n = 0; n <= TEST_SYNC_WINDOWS * TIMEBASE_SYNC_SAMPLES;
+		n += TEST_DRAIN)
+	{
+		stamp = start + (uint32_t)(n * period);
+		timebase_sync(stamp, n ? TEST_DRAIN : 0);
+		corrected = timebase_correct(stamp);
+		if (n && (int32_t)(corrected - prev) <= 0)
+		{
+			backwards++;
+		}
+		prev = corrected;
+		if (empty)
+		{
+			timebase_sync(stamp + (uint32_t)(period / 2), 0);
+		}
+		// a second of samples measured in the last window
+		if (n == (TEST_SYNC_WINDOWS - 1) * TIMEBASE_SYNC_SAMPLES)
+		{
+			second = corrected;
+		}
+		if (n == (TEST_SYNC_WINDOWS - 1) * TIMEBASE_SYNC_SAMPLES + TEST_RATE_HZ)
+		{
+			error_ppm = (long)(corrected - second) - 1000000L;
+		}
+	}
+	printf("timer %d ppm fast%s: scale %lu (ideal %.0f), a second of "
+		"samples %ld ppm off, %u corrected readings went backwards\n",
+		TEST_DRIFT_PPM, empty ? ", empty drains" : "",
+		(unsigned long)timebase_scale, 65536 / (1 + TEST_DRIFT_PPM / 1e6),
+		error_ppm, backwards);
+	if (backwards)
+	{
+		printf("FAIL, timebase_correct() went backwards\n");
+		failures++;
+	}
+	if (labs(error_ppm) > TEST_SETTLED_PPM)
+	{
+		printf("FAIL, the correction didn't settle within %d ppm\n",
+			TEST_SETTLED_PPM);
+		failures++;
+	}
+	return failures;
+}
+
+// Host time of one timebase_now() read
+static void time_reads(void)
+{
+	struct timespec a, b;
+	volatile uint32_t sink;
+	unsigned long i;
+
+	timer_at(0x12345, 1);
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	for (i = 0; i < TEST_READS; i++)
+	{
+		sink = timebase_now();
+	}
+	clock_gettime(CLOCK_MONOTONIC, &b);
+	(void)sink;
+	printf("timebase_now(): %.1f ns per read on the host\n",
+		((b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec)) / TEST_READS);
+}
+
+int main(void)
+{
+	unsigned failures = check_overflows();
+
+	failures += check_sync(0);
+	failures += check_sync(1);
+	time_reads();
+
+	if (failures)
+	{
+		printf("%u checks failed\n", failures);
+	}
+	return failures ? 1 : 0;
+}
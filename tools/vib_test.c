@@ -0,0 +1,262 @@
+// Accuracy check of the vibration spectra of vibration.c against double
+// precision on the host, and the cost of a block on this host.
+//
+// Build and run from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -Itools/host -I. -o vib_test tools/vib_test.c vibration.c -lm
+//   ./vib_test
+//
+// Add -DVIB_FFT_BITS=6 or 8 to check the other block lengths. Signals that
+// probe the edges of the Q15 transform (tones on and between bins, a tone
+// at Nyquist, full scale and small tones, two tones, a large offset under a
+// small tone, full scale noise) are pushed through vib_process() and every
+// block is compared with a double precision DFT of the same samples less
+// the same integer mean, saturated to 16 bits as the firmware does, with
+// the exact Hann window and scaled by 1/N like the fixed point transform:
+//
+//   - the magnitude of every bin within TEST_BIN_LSB,
+//   - every band energy within the bound that error gives for its bins,
+//   - the peak bin the strongest, or a bin whose magnitude is within twice
+//     that error of it,
+//   - band energies that add up to the whole spectrum above DC, the
+//     Nyquist bin included.
+//
+// The exit status is 1 if a check fails. Cycle counts on the target come
+// from vib_bench() in the firmware.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "vibration.h"
+
+#define TEST_RATE_HZ	200
+#define TEST_BLOCKS		200			// blocks per signal
+// Magnitude error allowed per bin: every stage halves the data with a
+// truncating shift and rounds the twiddle products
+#define TEST_BIN_LSB	(0.6 * VIB_FFT_BITS)
+#define TEST_SIGNALS	8
+
+static const char * const signal_name[TEST_SIGNALS] = {"tone on bin",
+	"tone between bins", "tone at Nyquist", "full scale tone", "small tone",
+	"two tones", "offset + tone", "full scale noise"};
+
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t next_random(void)
+{
+	// xorshift64*
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return (uint32_t)((rng * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static int16_t clamp(double x)
+{
+	x = floor(x + 0.5);
+	return x < -32768 ? -32768 : x > 32767 ? 32767 : (int16_t)x;
+}
+
+// Sample i of a signal on one axis; the axes differ in amplitude and phase
+static int16_t signal(int kind, unsigned long i, uint8_t axis)
+{
+	double t = (double)i / TEST_RATE_HZ, bin = (double)TEST_RATE_HZ /
+		VIB_FFT_SIZE, a = 1.0 - 0.2 * axis, p = axis;
+
+	switch (kind)
+	{
+		case 0:
+			return clamp(8000 * a * sin(2 * M_PI * 13 * bin * t + p));
+		case 1:
+			return clamp(8000 * a * sin(2 * M_PI * 21.37 * bin * t + p));
+		case 2:
+			return clamp(6000 * a * ((i & 1) ? 1 : -1));
+		case 3:
+			return clamp(32767 * sin(2 * M_PI * 7 * bin * t + p));
+		case 4:
+			return clamp(40 * a * sin(2 * M_PI * 30 * bin * t + p));
+		case 5:
+			return clamp(9000 * a * sin(2 * M_PI * 5 * bin * t + p) +
+				3000 * sin(2 * M_PI * 45.5 * bin * t));
+		case 6:
+			return clamp(16384 + 2000 * a * sin(2 * M_PI * 3 * bin * t + p));
+		default:
+			return (int16_t)(next_random() >> 16);
+	}
+}
+
+typedef struct
+{
+	double bin;        // largest bin magnitude error, LSB
+	double band;       // largest band energy error over its bound
+	unsigned long blocks;
+} worst_t;
+
+// Compare one axis of a processed block with the double precision spectrum
+static int check_axis(const int16_t * x, const vib_axis_t * r,
+	const uint8_t * edge, worst_t * w, const int16_t * re, const int16_t * im)
+{
+	double power[VIB_FFT_SIZE / 2 + 1], band[VIB_BANDS] = {0};
+	double bound[VIB_BANDS] = {0}, total = 0, first = 0;
+	int32_t sum = 0, mean;
+	unsigned k, n, peak = 0;
+	uint8_t b;
+	int ok = 1;
+
+	for (n = 0; n < VIB_FFT_SIZE; n++)
+	{
+		sum += x[n];
+	}
+	mean = sum >> VIB_FFT_BITS;
+
+	for (k = 1; k <= VIB_FFT_SIZE / 2; k++)
+	{
+		double xr = 0, xi = 0, mag, fx;
+
+		for (n = 0; n < VIB_FFT_SIZE; n++)
+		{
+			double v = fmax(-32768, fmin(32767, x[n] - mean)) * 0.5 *
+				(1 - cos(2 * M_PI * n / VIB_FFT_SIZE));
+			xr += v * cos(2 * M_PI * k * n / VIB_FFT_SIZE);
+			xi -= v * sin(2 * M_PI * k * n / VIB_FFT_SIZE);
+		}
+		xr /= VIB_FFT_SIZE;
+		xi /= VIB_FFT_SIZE;
+		power[k] = xr * xr + xi * xi;
+		mag = sqrt(power[k]);
+		fx = sqrt((double)re[k] * re[k] + (double)im[k] * im[k]);
+		w->bin = fmax(w->bin, fabs(fx - mag));
+		if (fabs(fx - mag) > TEST_BIN_LSB)
+		{
+			ok = 0;
+		}
+
+		if (power[k] > first)
+		{
+			first = power[k];
+			peak = k;
+		}
+		for (b = 0; b < VIB_BANDS; b++)
+		{
+			if (k >= edge[b] && k < edge[b + 1])
+			{
+				band[b] += power[k];
+				// (|X| + e)^2 - |X|^2 for every bin
+				bound[b] += 2 * mag * TEST_BIN_LSB + TEST_BIN_LSB * TEST_BIN_LSB;
+				break;
+			}
+		}
+	}
+
+	for (b = 0; b < VIB_BANDS; b++)
+	{
+		double e = fabs(r->band_energy[b] - band[b]);
+
+		w->band = fmax(w->band, bound[b] ? e / bound[b] : e);
+		if (e > bound[b])
+		{
+			ok = 0;
+		}
+		total += r->band_energy[b];
+	}
+	// the default bands cover 0 Hz to Nyquist: nothing may be lost
+	for (k = 1; k <= VIB_FFT_SIZE / 2; k++)
+	{
+		total -= (uint32_t)((int32_t)re[k] * re[k]) +
+			(uint32_t)((int32_t)im[k] * im[k]);
+	}
+	if (total != 0)
+	{
+		ok = 0;
+	}
+	if (r->peak_bin < 1 || r->peak_bin > VIB_FFT_SIZE / 2 ||
+		(r->peak_bin != peak &&
+		sqrt(first) - sqrt(power[r->peak_bin]) > 2 * TEST_BIN_LSB))
+	{
+		ok = 0;
+	}
+	return ok;
+}
+
+int main(void)
+{
+	static vib_t vib, copy;
+	static const uint16_t edges[VIB_BANDS + 1] = {0, 10, 25, 50,
+		TEST_RATE_HZ / 2};
+	uint8_t edge[VIB_BANDS + 1];
+	vib_result_t result;
+	unsigned long failures = 0, blocks = 0, i = 0;
+	double seconds = 0;
+	int kind;
+	uint8_t a, b;
+
+	// a bin belongs to the band its centre k * rate / N lies in, so a band
+	// starts at the first bin centred at or above its lower edge; the last
+	// band includes its upper edge
+	for (b = 0; b <= VIB_BANDS; b++)
+	{
+		double e = ceil((double)edges[b] * VIB_FFT_SIZE / TEST_RATE_HZ);
+		edge[b] = e > VIB_FFT_SIZE / 2 ? VIB_FFT_SIZE / 2 : (uint8_t)e;
+	}
+	edge[VIB_BANDS]++;
+
+	printf("%u points at %u Hz\n", VIB_FFT_SIZE, TEST_RATE_HZ);
+	printf("%-18s %8s %14s %16s\n", "signal", "blocks", "bin error LSB",
+		"band error/bound");
+	for (kind = 0; kind < TEST_SIGNALS; kind++)
+	{
+		worst_t worst = {0, 0, 0};
+		unsigned long failed = 0;
+
+		vib_init(&vib, TEST_RATE_HZ);
+		vib_set_bands(&vib, edges);
+		while (worst.blocks < TEST_BLOCKS)
+		{
+			int16_t s[3];
+
+			for (a = 0; a < 3; a++)
+			{
+				s[a] = signal(kind, i, a);
+			}
+			i++;
+			if (vib_push(&vib, s[0], s[1], s[2]))
+			{
+				clock_t start;
+
+				copy = vib;
+				start = clock();
+				vib_process(&vib, &result);
+				seconds += (double)(clock() - start) / CLOCKS_PER_SEC;
+				blocks++;
+				worst.blocks++;
+
+				for (a = 0; a < 3; a++)
+				{
+					int16_t x[VIB_FFT_SIZE], re[VIB_FFT_SIZE], im[VIB_FFT_SIZE];
+					uint16_t n;
+
+					for (n = 0; n < VIB_FFT_SIZE; n++)
+					{
+						x[n] = copy.block[a][n];
+					}
+					vib_spectrum(&copy, a, re, im);
+					failed += !check_axis(x, &result.axis[a], edge, &worst, re,
+						im);
+				}
+			}
+		}
+		printf("%-18s %8lu %14.3f %16.3f%s\n", signal_name[kind], worst.blocks,
+			worst.bin, worst.band, failed ? "  FAIL" : "");
+		failures += failed;
+	}
+
+	printf("\n%.1f us per block of three axes on this host\n",
+		seconds * 1e6 / blocks);
+	if (failures)
+	{
+		printf("%lu checks failed\n", failures);
+	}
+	return failures ? 1 : 0;
+}
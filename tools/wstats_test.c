@@ -0,0 +1,275 @@
+// Accuracy check of wstats.c against double precision on the host, and the
+// cost of a sample on this host.
+//
+// Build and run from the repository root:
+//
+//   gcc -std=gnu99 -O2 -funsigned-char -fshort-enums -fpack-struct
+//       -Itools/host -I. -o wstats_test tools/wstats_test.c wstats.c -lm
+//   ./wstats_test
+//
+// Signals that are hard on the numbers (a large mean with little spread,
+// full scale square waves, jumps of the mean from one window to the next,
+// full scale noise, a ramp through the whole range) are run through window
+// lengths from 1 to WSTATS_WINDOW_MAX samples. Every window's summary is
+// compared with a two pass double precision computation of the same
+// samples: mean, RMS and variance within the bounds in wstats.h, minimum,
+// maximum, crossings, limit flags and event records exact. The same
+// variance from float sums of x and x^2, as a PC would compute it naively,
+// is shown for comparison. The exit status is 1 if a check fails.
+//
+// Cycle counts on the target come from wstats_bench() in the firmware.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "wstats.h"
+
+#define TEST_SAMPLES_MIN	60000
+
+static const wstats_limit_t test_limit = {-20000, 20000, 15000, 30000, 10000,
+	500, 20};
+
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t next_random(void)
+{
+	// xorshift64*
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return (uint32_t)((rng * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static double gauss(void)
+{
+	double u = (next_random() + 1.0) / 4294967297.0;
+	double v = next_random() / 4294967296.0;
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static int16_t clamp(double x)
+{
+	x = floor(x + 0.5);
+	return x < -32768 ? -32768 : x > 32767 ? 32767 : (int16_t)x;
+}
+
+// Sample i of a signal on one axis, window is the window length
+static int16_t signal(int kind, unsigned long i, unsigned long count,
+	uint16_t window, uint8_t axis)
+{
+	switch (kind)
+	{
+		case 0: // gravity with a little noise
+			return clamp((axis == 2 ? 16384 : 300) + 4 * gauss());
+		case 1: // full scale square wave
+			return i & 1 ? 32767 : -32768;
+		case 2: // close to full scale, small spread
+			return clamp(32760 + (next_random() % 15) - 7.0);
+		case 3: // the mean jumps by 60000 every window
+			return clamp((i / window & 1 ? 30000 : -30000) + 100 * gauss());
+		case 4: // full scale noise
+			return (int16_t)(next_random() >> 16);
+		default: // a ramp through the whole range
+			return clamp(-32768 + 65535.0 * i / count + axis);
+	}
+}
+
+static const char * signal_names[] =
+{
+	"gravity", "square", "near full scale", "jumping mean", "full scale noise",
+	"ramp"
+};
+
+typedef struct
+{
+	double mean, variance, rms, float_variance;
+	unsigned long windows, failures;
+} worst_t;
+
+// The same window in double precision, two passes
+static int check_window(const int16_t * x, uint16_t n, const wstats_axis_t * s,
+	uint8_t * above, worst_t * w)
+{
+	double sum = 0, dev = 0, sq = 0, mean, variance, rms;
+	float fsum = 0, fsq = 0;
+	int16_t min = INT16_MAX, max = INT16_MIN;
+	uint8_t crossings = 0, exceeded = 0;
+	uint16_t i, peak;
+	int ok = 1;
+
+	for (i = 0; i < n; i++)
+	{
+		uint16_t m = x[i] < 0 ? -(int32_t)x[i] : x[i];
+
+		sum += x[i];
+		sq += (double)x[i] * x[i];
+		fsum += x[i];
+		fsq += (float)x[i] * x[i];
+		min = x[i] < min ? x[i] : min;
+		max = x[i] > max ? x[i] : max;
+		if (!*above && m > test_limit.level)
+		{
+			*above = 1;
+			crossings += crossings < 255;
+		}
+		else if (*above && (uint32_t)m + test_limit.hysteresis < test_limit.level)
+		{
+			*above = 0;
+		}
+	}
+	mean = sum / n;
+	for (i = 0; i < n; i++)
+	{
+		dev += (x[i] - mean) * (x[i] - mean);
+	}
+	variance = dev / n;
+	rms = sqrt(sq / n);
+
+	w->mean = fmax(w->mean, fabs(s->mean - mean));
+	w->variance = fmax(w->variance, fabs(s->variance - variance));
+	w->rms = fmax(w->rms, fabs(s->rms - rms));
+	w->float_variance = fmax(w->float_variance,
+		fabs((fsq - fsum * fsum / n) / n - variance));
+	w->windows++;
+
+	peak = wstats_peak(s);
+	exceeded |= (s->mean < test_limit.mean_low) << WSTATS_EVENT_MEAN_LOW;
+	exceeded |= (s->mean > test_limit.mean_high) << WSTATS_EVENT_MEAN_HIGH;
+	exceeded |= (s->rms > test_limit.rms_high) << WSTATS_EVENT_RMS;
+	exceeded |= (peak > test_limit.peak_high) << WSTATS_EVENT_PEAK;
+	exceeded |= (crossings > test_limit.crossings_high) << WSTATS_EVENT_CROSSINGS;
+
+	if (fabs(s->mean - mean) > 0.5 + 1e-9 || fabs(s->rms - rms) > 0.5 + 1e-9 ||
+		fabs(s->variance - variance) > 0.5 + 1e-9 || s->min != min ||
+		s->max != max || s->crossings != crossings || s->exceeded != exceeded)
+	{
+		ok = 0;
+	}
+	return ok;
+}
+
+// Events must be one per flag, in axis and kind order
+static int check_events(const wstats_t * ws, const wstats_summary_t * s)
+{
+	wstats_event_t events[WSTATS_AXES * WSTATS_EVENTS];
+	uint8_t n = wstats_events(ws, s, events, sizeof(events) / sizeof(events[0]));
+	uint8_t a, kind, i = 0;
+
+	for (a = 0; a < WSTATS_AXES; a++)
+	{
+		for (kind = 0; kind < WSTATS_EVENTS; kind++)
+		{
+			if (!(s->axis[a].exceeded & (1 << kind)))
+			{
+				continue;
+			}
+			if (i >= n || events[i].axis != a || events[i].kind != kind ||
+				events[i].sequence != s->sequence || events[i].start != s->start)
+			{
+				return 0;
+			}
+			i++;
+		}
+	}
+	return i == n;
+}
+
+int main(void)
+{
+	static const uint16_t windows[] = {1, 2, 3, 50, 200, 1000, WSTATS_WINDOW_MAX};
+	static wstats_t ws;
+	wstats_summary_t summary;
+	int16_t * x[WSTATS_AXES];
+	unsigned long failures = 0, pushes = 0;
+	double seconds = 0;
+	int kind, failed = 0;
+	unsigned w;
+	uint8_t a;
+
+	printf("%-18s %6s %8s %8s %8s %8s %14s\n", "signal", "window", "windows",
+		"mean", "rms", "variance", "float variance");
+	for (kind = 0; kind < 6; kind++)
+	{
+		for (w = 0; w < sizeof(windows) / sizeof(windows[0]); w++)
+		{
+			uint16_t window = windows[w];
+			unsigned long count = TEST_SAMPLES_MIN, i;
+			uint8_t above[WSTATS_AXES] = {0, 0, 0};
+			worst_t worst;
+			clock_t start;
+
+			if (count < 3UL * window)
+			{
+				count = 3UL * window;
+			}
+			count -= count % window;
+			for (a = 0; a < WSTATS_AXES; a++)
+			{
+				x[a] = malloc(count * sizeof(int16_t));
+				for (i = 0; i < count; i++)
+				{
+					x[a][i] = signal(kind, i, count, window, a);
+				}
+			}
+			memset(&worst, 0, sizeof(worst));
+
+			wstats_init(&ws, kind, window, &test_limit);
+			for (i = 0; i < count; i++)
+			{
+				int16_t v[WSTATS_AXES] = {x[0][i], x[1][i], x[2][i]};
+
+				if (!wstats_push(&ws, i * 5000UL, v, &summary))
+				{
+					continue;
+				}
+				for (a = 0; a < WSTATS_AXES; a++)
+				{
+					if (!check_window(&x[a][i + 1 - window], window,
+						&summary.axis[a], &above[a], &worst))
+					{
+						worst.failures++;
+					}
+				}
+				if (summary.stream != kind ||
+					summary.start != (i + 1 - window) * 5000UL ||
+					summary.end != i * 5000UL || !check_events(&ws, &summary))
+				{
+					worst.failures++;
+				}
+			}
+
+			// the same samples again, only timed
+			wstats_init(&ws, kind, window, &test_limit);
+			start = clock();
+			for (i = 0; i < count; i++)
+			{
+				int16_t v[WSTATS_AXES] = {x[0][i], x[1][i], x[2][i]};
+				wstats_push(&ws, i * 5000UL, v, &summary);
+			}
+			seconds += (double)(clock() - start) / CLOCKS_PER_SEC;
+			pushes += count;
+
+			printf("%-18s %6u %8lu %8.3f %8.3f %8.3f %14.1f%s\n",
+				signal_names[kind], window, worst.windows / WSTATS_AXES,
+				worst.mean, worst.rms, worst.variance, worst.float_variance,
+				worst.failures ? "  FAILED" : "");
+			failures += worst.failures;
+			for (a = 0; a < WSTATS_AXES; a++)
+			{
+				free(x[a]);
+			}
+		}
+	}
+
+	printf("\nbounds: mean 0.5, rms 0.5, variance 0.5 LSB (squared)\n");
+	printf("%.1f ns per three axis sample on this host\n",
+		seconds * 1e9 / pushes);
+	if (failures)
+	{
+		printf("%lu checks failed\n", failures);
+		failed = 1;
+	}
+	return failed;
+}
@@ -0,0 +1,300 @@
+#include <avr/pgmspace.h>
+#include "vibration.h"
+
+// The tables are built for 256 points, smaller transforms step through them
+#define VIB_TABLE_BITS   8
+#define VIB_TABLE_STRIDE (1 << (VIB_TABLE_BITS - VIB_FFT_BITS))
+
+// sin(2 * pi * i / 256) in Q15, three quarters of a period so cosine can be
+// read a quarter period further on
+static const int16_t vib_sine[192] PROGMEM = {
+	     0,    804,   1608,   2410,   3212,   4011,   4808,   5602,
+	  6393,   7179,   7962,   8739,   9512,  10278,  11039,  11793,
+	 12539,  13279,  14010,  14732,  15446,  16151,  16846,  17530,
+	 18204,  18868,  19519,  20159,  20787,  21403,  22005,  22594,
+	 23170,  23731,  24279,  24811,  25329,  25832,  26319,  26790,
+	 27245,  27683,  28105,  28510,  28898,  29268,  29621,  29956,
+	 30273,  30571,  30852,  31113,  31356,  31580,  31785,  31971,
+	 32137,  32285,  32412,  32521,  32609,  32678,  32728,  32757,
+	 32767,  32757,  32728,  32678,  32609,  32521,  32412,  32285,
+	 32137,  31971,  31785,  31580,  31356,  31113,  30852,  30571,
+	 30273,  29956,  29621,  29268,  28898,  28510,  28105,  27683,
+	 27245,  26790,  26319,  25832,  25329,  24811,  24279,  23731,
+	 23170,  22594,  22005,  21403,  20787,  20159,  19519,  18868,
+	 18204,  17530,  16846,  16151,  15446,  14732,  14010,  13279,
+	 12539,  11793,  11039,  10278,   9512,   8739,   7962,   7179,
+	  6393,   5602,   4808,   4011,   3212,   2410,   1608,    804,
+	     0,   -804,  -1608,  -2410,  -3212,  -4011,  -4808,  -5602,
+	 -6393,  -7179,  -7962,  -8739,  -9512, -10278, -11039, -11793,
+	-12539, -13279, -14010, -14732, -15446, -16151, -16846, -17530,
+	-18204, -18868, -19519, -20159, -20787, -21403, -22005, -22594,
+	-23170, -23731, -24279, -24811, -25329, -25832, -26319, -26790,
+	-27245, -27683, -28105, -28510, -28898, -29268, -29621, -29956,
+	-30273, -30571, -30852, -31113, -31356, -31580, -31785, -31971,
+	-32137, -32285, -32412, -32521, -32609, -32678, -32728, -32757
+};
+
+// Periodic Hann window 0.5 * (1 - cos(2 * pi * i / 256)) in Q15, first half
+// including the midpoint; w[N - i] == w[i]
+static const int16_t vib_hann[129] PROGMEM = {
+	     0,      5,     20,     44,     79,    123,    177,    241,
+	   315,    398,    491,    593,    705,    827,    958,   1098,
+	  1247,   1406,   1573,   1749,   1935,   2128,   2331,   2542,
+	  2761,   2989,   3224,   3468,   3719,   3978,   4244,   4518,
+	  4799,   5086,   5381,   5682,   5990,   6304,   6624,   6950,
+	  7281,   7618,   7961,   8308,   8660,   9017,   9379,   9744,
+	 10114,  10487,  10864,  11244,  11628,  12014,  12403,  12794,
+	 13187,  13583,  13980,  14378,  14778,  15178,  15580,  15981,
+	 16383,  16786,  17187,  17589,  17989,  18389,  18787,  19184,
+	 19580,  19973,  20364,  20753,  21139,  21523,  21903,  22280,
+	 22653,  23023,  23388,  23750,  24107,  24459,  24806,  25149,
+	 25486,  25817,  26143,  26463,  26777,  27085,  27386,  27681,
+	 27968,  28249,  28523,  28789,  29048,  29299,  29543,  29778,
+	 30006,  30225,  30436,  30639,  30832,  31018,  31194,  31361,
+	 31520,  31669,  31809,  31940,  32062,  32174,  32276,  32369,
+	 32452,  32526,  32590,  32644,  32688,  32723,  32747,  32762,
+	 32767
+};
+
+// Default band edges in Hz, VIB_BANDS + 1 entries. They split the 100 Hz
+// Nyquist range of a 200 Hz sample rate.
+static const uint16_t vib_default_edge[VIB_BANDS + 1] = {0, 10, 25, 50, 100};
+
+// Q15 multiply with rounding
+static inline int16_t vib_mul(int16_t a, int16_t b)
+{
+	int32_t c = (int32_t)a * b;
+	return (int16_t)((c + 0x4000) >> 15);
+}
+
+void vib_init(vib_t * vib, uint16_t sample_rate_hz)
+{
+	vib->rate = sample_rate_hz;
+	vib->count = 0;
+	vib_set_bands(vib, vib_default_edge);
+}
+
+// Replace the band edges, edges_hz holds VIB_BANDS + 1 ascending frequencies.
+// A bin belongs to the band whose lower edge it is at or above; the last
+// band also takes the bin on its upper edge.
+void vib_set_bands(vib_t * vib, const uint16_t * edges_hz)
+{
+	uint8_t i;
+	for (i = 0; i <= VIB_BANDS; i++)
+	{
+		vib->band_edge[i] = edges_hz[i];
+	}
+}
+
+// Add one accelerometer sample. Returns 1 once a block is complete; it has to
+// be handed to vib_process() before the next sample is pushed.
+uint8_t vib_push(vib_t * vib, int16_t ax, int16_t ay, int16_t az)
+{
+	if (vib->count >= VIB_FFT_SIZE)
+	{
+		return 1;
+	}
+	vib->block[0][vib->count] = ax;
+	vib->block[1][vib->count] = ay;
+	vib->block[2][vib->count] = az;
+	vib->count++;
+	return vib->count == VIB_FFT_SIZE;
+}
+
+// In-place forward FFT of VIB_FFT_SIZE points in Q15. Every stage halves the
+// data so the result is scaled by 1/N and cannot overflow.
+void vib_fft(int16_t * re, int16_t * im)
+{
+	uint16_t i, j, k, m, l, istep;
+	int16_t wr, wi, tr, ti, qr, qi;
+	uint8_t step;
+
+	// Bit reversed reordering (decimation in time)
+	j = 0;
+	for (i = 0; i < VIB_FFT_SIZE - 1; i++)
+	{
+		if (i < j)
+		{
+			tr = re[i]; re[i] = re[j]; re[j] = tr;
+			ti = im[i]; im[i] = im[j]; im[j] = ti;
+		}
+		k = VIB_FFT_SIZE >> 1;
+		while (k <= j)
+		{
+			j -= k;
+			k >>= 1;
+		}
+		j += k;
+	}
+
+	// Butterflies; step is the twiddle stride into the 256 entry table
+	step = (uint8_t)(VIB_FFT_SIZE >> 1) * VIB_TABLE_STRIDE;
+	for (l = 1; l < VIB_FFT_SIZE; l = istep)
+	{
+		istep = l << 1;
+		for (m = 0; m < l; m++)
+		{
+			k = m * step;
+			// Halve the twiddles together with the data below
+			wr =  (int16_t)pgm_read_word(&vib_sine[k + 64]) >> 1;
+			wi = -((int16_t)pgm_read_word(&vib_sine[k]) >> 1);
+			for (i = m; i < VIB_FFT_SIZE; i += istep)
+			{
+				j = i + l;
+				tr = vib_mul(wr, re[j]) - vib_mul(wi, im[j]);
+				ti = vib_mul(wr, im[j]) + vib_mul(wi, re[j]);
+				qr = re[i] >> 1;
+				qi = im[i] >> 1;
+				re[j] = qr - tr;
+				im[j] = qi - ti;
+				re[i] = qr + tr;
+				im[i] = qi + ti;
+			}
+		}
+		step >>= 1;
+	}
+}
+
+// Window one axis of the block into re and im and transform it
+void vib_spectrum(const vib_t * vib, uint8_t axis, int16_t * re,
+	int16_t * im)
+{
+	uint16_t i;
+	int32_t mean = 0;
+	int16_t w;
+
+	// Remove the block mean so gravity doesn't swamp the low bins
+	for (i = 0; i < VIB_FFT_SIZE; i++)
+	{
+		mean += vib->block[axis][i];
+	}
+	mean >>= VIB_FFT_BITS;
+
+	for (i = 0; i < VIB_FFT_SIZE; i++)
+	{
+		int32_t v = (int32_t)vib->block[axis][i] - mean;
+		if (v > 32767) v = 32767;
+		if (v < -32768) v = -32768;
+		w = (int16_t)pgm_read_word(&vib_hann[(i <= VIB_FFT_SIZE / 2 ?
+			i : VIB_FFT_SIZE - i) * VIB_TABLE_STRIDE]);
+		re[i] = vib_mul((int16_t)v, w);
+		im[i] = 0;
+	}
+
+	vib_fft(re, im);
+}
+
+// Analyse the completed block and start collecting the next one
+void vib_process(vib_t * vib, vib_result_t * result)
+{
+	int16_t re[VIB_FFT_SIZE], im[VIB_FFT_SIZE];
+	uint8_t a, b, bin;
+	uint8_t edge[VIB_BANDS + 1];
+
+	// Band edges as bin indices, bin k is centred on k * rate / N and belongs
+	// to the band its centre lies in: a band starts at the first bin centred
+	// at or above its lower edge
+	for (b = 0; b <= VIB_BANDS; b++)
+	{
+		uint32_t e = (((uint32_t)vib->band_edge[b] << VIB_FFT_BITS) +
+			vib->rate - 1) / vib->rate;
+		edge[b] = e > VIB_FFT_SIZE / 2 ? VIB_FFT_SIZE / 2 : (uint8_t)e;
+	}
+	// The last band includes its upper edge, so a band that reaches Nyquist
+	// holds the Nyquist bin
+	edge[VIB_BANDS]++;
+
+	result->sample_rate_hz = vib->rate;
+	for (a = 0; a < 3; a++)
+	{
+		vib_axis_t * out = &result->axis[a];
+
+		vib_spectrum(vib, a, re, im);
+
+		out->peak_bin = 0;
+		out->peak_power = 0;
+		for (b = 0; b < VIB_BANDS; b++)
+		{
+			out->band_energy[b] = 0;
+		}
+
+		// Only the first half of the spectrum is unique for real input
+		for (bin = 1; bin <= VIB_FFT_SIZE / 2; bin++)
+		{
+			uint32_t p = (uint32_t)((int32_t)re[bin] * re[bin]) +
+				(uint32_t)((int32_t)im[bin] * im[bin]);
+
+			if (p > out->peak_power)
+			{
+				out->peak_power = p;
+				out->peak_bin = bin;
+			}
+			for (b = 0; b < VIB_BANDS; b++)
+			{
+				if (bin >= edge[b] && bin < edge[b + 1])
+				{
+					uint32_t e = out->band_energy[b] + p;
+					// Saturate rather than wrap
+					out->band_energy[b] = e < p ? 0xFFFFFFFFUL : e;
+					break;
+				}
+			}
+		}
+
+		out->peak_freq_dhz = (uint16_t)(((uint32_t)out->peak_bin * vib->rate * 10)
+			>> VIB_FFT_BITS);
+	}
+
+	vib->count = 0;
+}
+
+#if VIB_BENCH_ENABLE
+
+#include "timebase.h"
+
+// Cycles of one vib_fft() and of vib_process() on a full block of three
+// axes, printed as "<function> <cycles>" lines; the timebase_now() calls
+// around each call are subtracted.
+void vib_bench(void (*put)(char))
+{
+	static vib_t vib;
+	static int16_t re[VIB_FFT_SIZE], im[VIB_FFT_SIZE];
+	vib_result_t result;
+	uint32_t start, overhead, fft, process;
+	uint16_t i;
+
+	start = timebase_now();
+	overhead = timebase_now() - start;
+
+	vib_init(&vib, 200);
+	for (i = 0; i < VIB_FFT_SIZE; i++)
+	{
+		// a 30 Hz tone on a 1 g offset and a square wave at Nyquist
+		uint8_t k = (uint8_t)(i * 39);
+		int16_t s = (int16_t)pgm_read_word(&vib_sine[k & 0x7F]) >> 2;
+
+		if (k & 0x80)
+		{
+			s = -s;
+		}
+		vib_push(&vib, s, (i & 1) ? 4000 : -4000, 16384 - s);
+	}
+
+	for (i = 0; i < VIB_FFT_SIZE; i++)
+	{
+		re[i] = vib.block[0][i];
+		im[i] = 0;
+	}
+	start = timebase_now();
+	vib_fft(re, im);
+	fft = timebase_now() - start - overhead;
+
+	start = timebase_now();
+	vib_process(&vib, &result);
+	process = timebase_now() - start - overhead;
+
+	timebase_bench_line(put, "vib_fft", fft, 1);
+	timebase_bench_line(put, "vib_process", process, 1);
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef VIBRATION_H_INCLUDED
+#define VIBRATION_H_INCLUDED
+
+#include <inttypes.h>
+
+// Vibration spectrum of the accelerometer stream. Samples are collected into
+// blocks of VIB_FFT_SIZE per axis, the block mean is removed, a Hann window
+// is applied and a Q15 radix-2 FFT gives band energies and the dominant
+// frequency for each axis. All state is in the vib_t instance, so host tools
+// can run one per thread.
+//
+// RAM: 3 * VIB_FFT_SIZE * 2 bytes of sample buffer in vib_t, 768 bytes for
+// 128 points, and 2 * VIB_FFT_SIZE * 2 bytes of working buffer, 512 bytes,
+// on the stack of vib_process().
+//
+// tools/vib_test.c checks the spectra against double precision on the
+// host. Cycle counts on the ATmega1284P are printed by vib_bench() (build
+// with VIB_BENCH_ENABLE 1).
+
+// log2 of the block length, 6 - 8 (64 to 256 points)
+#ifndef VIB_FFT_BITS
+#define VIB_FFT_BITS 7
+#endif
+#define VIB_FFT_SIZE (1 << VIB_FFT_BITS)
+
+// Number of frequency bands energies are reported for
+#define VIB_BANDS 4
+
+#ifndef VIB_BENCH_ENABLE
+#define VIB_BENCH_ENABLE 0
+#endif
+
+#if VIB_FFT_BITS < 6 || VIB_FFT_BITS > 8
+#error "VIB_FFT_BITS must be between 6 and 8"
+#endif
+
+typedef struct
+{
+	// Sum of |X[k]|^2 over the bins of each band. X is scaled by 1/N by the
+	// FFT, a full scale sine in one band reads about 2^26.
+	uint32_t band_energy[VIB_BANDS];
+	// Strongest bin above DC, its power and its centre frequency in 0.1 Hz
+	uint8_t peak_bin;
+	uint32_t peak_power;
+	uint16_t peak_freq_dhz;
+} vib_axis_t;
+
+typedef struct
+{
+	vib_axis_t axis[3];
+	uint16_t sample_rate_hz;
+} vib_result_t;
+
+typedef struct
+{
+	uint16_t band_edge[VIB_BANDS + 1];  // Hz
+	uint16_t rate;
+	uint16_t count;          // samples in the block
+	int16_t block[3][VIB_FFT_SIZE];
+} vib_t;
+
+void vib_init(vib_t * vib, uint16_t sample_rate_hz);
+void vib_set_bands(vib_t * vib, const uint16_t * edges_hz);
+uint8_t vib_push(vib_t * vib, int16_t ax, int16_t ay, int16_t az);
+void vib_process(vib_t * vib, vib_result_t * result);
+// The bins vib_process() works from for one axis of a full block, into the
+// caller's re and im of VIB_FFT_SIZE
+void vib_spectrum(const vib_t * vib, uint8_t axis, int16_t * re,
+	int16_t * im);
+void vib_fft(int16_t * re, int16_t * im);
+void vib_bench(void (*put)(char));
+
+#endif
@@ -0,0 +1,317 @@
+#ifndef  F_CPU
+#define F_CPU 1000000
+#endif
+
+#include <string.h>
+#include "wstats.h"
+
+static void wstats_reset(wstats_t * ws)
+{
+	uint8_t a;
+
+	ws->count = 0;
+	for (a = 0; a < WSTATS_AXES; a++)
+	{
+		wstats_acc_t * acc = &ws->acc[a];
+		acc->sum = 0;
+		acc->square = 0;
+		acc->square_high = 0;
+		acc->min = INT16_MAX;
+		acc->max = INT16_MIN;
+		acc->crossings = 0;
+	}
+}
+
+void wstats_init(wstats_t * ws, uint8_t stream, uint16_t window,
+	const wstats_limit_t * limit)
+{
+	memset(ws, 0, sizeof(*ws));
+	ws->stream = stream;
+	ws->window = window < 1 ? 1 : window > WSTATS_WINDOW_MAX ?
+		WSTATS_WINDOW_MAX : window;
+	ws->limit = *limit;
+	wstats_reset(ws);
+}
+
+static uint16_t wstats_isqrt(uint32_t x)
+{
+	uint32_t root = 0, bit = 1UL << 30;
+
+	while (bit > x)
+	{
+		bit >>= 2;
+	}
+	while (bit)
+	{
+		if (x >= root + bit)
+		{
+			x -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint16_t)root;
+}
+
+// Quotient of a / b rounded to nearest, halves away from zero
+static int64_t wstats_div_round(int64_t a, int64_t b)
+{
+	return a >= 0 ? (a + b / 2) / b : -((-a + b / 2) / b);
+}
+
+// Close one axis of the window: n samples, deviations from ref summed in
+// acc. All in exact integers:
+//   mean     = ref + sum / n
+//   variance = (square - sum^2 / n) / n = (n square - sum^2) / n^2
+//   x^2 sum  = square + 2 ref sum + n ref^2
+static void wstats_close(const wstats_t * ws, const wstats_acc_t * acc,
+	wstats_axis_t * out)
+{
+	const wstats_limit_t * limit = &ws->limit;
+	int64_t n = ws->count;
+	int64_t square = (int64_t)acc->square_high << 32 | acc->square;
+	int64_t squares = square + 2 * (int64_t)acc->ref * acc->sum +
+		n * acc->ref * acc->ref;
+	uint16_t rms, peak;
+
+	out->mean = (int16_t)(acc->ref + wstats_div_round(acc->sum, n));
+	out->variance = (uint32_t)wstats_div_round(n * square -
+		(int64_t)acc->sum * acc->sum, n * n);
+	// floor of the root, then up if x^2 sum / n >= (rms + 1/2)^2
+	rms = wstats_isqrt((uint32_t)(squares / n));
+	if (4 * squares >= n * (2 * (int64_t)rms + 1) * (2 * (int64_t)rms + 1))
+	{
+		rms++;
+	}
+	out->rms = rms;
+	out->min = acc->min;
+	out->max = acc->max;
+	out->crossings = acc->crossings;
+
+	peak = wstats_peak(out);
+	out->exceeded = 0;
+	if (limit->mean_low != WSTATS_NO_LOW && out->mean < limit->mean_low)
+	{
+		out->exceeded |= 1 << WSTATS_EVENT_MEAN_LOW;
+	}
+	if (limit->mean_high != WSTATS_NO_HIGH && out->mean > limit->mean_high)
+	{
+		out->exceeded |= 1 << WSTATS_EVENT_MEAN_HIGH;
+	}
+	if (limit->rms_high != WSTATS_NO_LIMIT && rms > limit->rms_high)
+	{
+		out->exceeded |= 1 << WSTATS_EVENT_RMS;
+	}
+	if (limit->peak_high != WSTATS_NO_LIMIT && peak > limit->peak_high)
+	{
+		out->exceeded |= 1 << WSTATS_EVENT_PEAK;
+	}
+	if (limit->crossings_high != 255 && out->crossings > limit->crossings_high)
+	{
+		out->exceeded |= 1 << WSTATS_EVENT_CROSSINGS;
+	}
+}
+
+// Add a sample of all axes. Returns 1 when it completes a window, whose
+// summary is then in summary and the next window has started.
+uint8_t wstats_push(wstats_t * ws, uint32_t stamp, const int16_t * xyz,
+	wstats_summary_t * summary)
+{
+	uint16_t level = ws->limit.level;
+	uint8_t a;
+
+	if (!ws->started)
+	{
+		for (a = 0; a < WSTATS_AXES; a++)
+		{
+			ws->acc[a].ref = xyz[a];
+		}
+		ws->started = 1;
+	}
+	if (ws->count == 0)
+	{
+		ws->start = stamp;
+	}
+
+	for (a = 0; a < WSTATS_AXES; a++)
+	{
+		wstats_acc_t * acc = &ws->acc[a];
+		int16_t x = xyz[a];
+		int32_t d = (int32_t)x - acc->ref;
+		uint16_t m = d < 0 ? (uint16_t)-d : (uint16_t)d;
+		uint32_t sq = (uint32_t)m * m;
+
+		acc->sum += d;
+		acc->square += sq;
+		if (acc->square < sq)
+		{
+			acc->square_high++;
+		}
+		if (x < acc->min)
+		{
+			acc->min = x;
+		}
+		if (x > acc->max)
+		{
+			acc->max = x;
+		}
+
+		if (level)
+		{
+			m = x < 0 ? (uint16_t)-(int32_t)x : (uint16_t)x;
+			if (!acc->above)
+			{
+				if (m > level)
+				{
+					acc->above = 1;
+					if (acc->crossings < 255)
+					{
+						acc->crossings++;
+					}
+				}
+			}
+			else if ((uint32_t)m + ws->limit.hysteresis < level)
+			{
+				acc->above = 0;
+			}
+		}
+	}
+
+	if (++ws->count < ws->window)
+	{
+		return 0;
+	}
+
+	summary->stream = ws->stream;
+	summary->sequence = ws->sequence++;
+	summary->start = ws->start;
+	summary->end = stamp;
+	for (a = 0; a < WSTATS_AXES; a++)
+	{
+		wstats_close(ws, &ws->acc[a], &summary->axis[a]);
+		// the next window's deviations from this one's mean
+		ws->acc[a].ref = summary->axis[a].mean;
+	}
+	wstats_reset(ws);
+	return 1;
+}
+
+// Event records for the limits a window broke, at most max. Returns how
+// many were written.
+uint8_t wstats_events(const wstats_t * ws, const wstats_summary_t * summary,
+	wstats_event_t * events, uint8_t max)
+{
+	const wstats_limit_t * limit = &ws->limit;
+	uint8_t a, kind, n = 0;
+
+	for (a = 0; a < WSTATS_AXES; a++)
+	{
+		const wstats_axis_t * axis = &summary->axis[a];
+
+		for (kind = 0; kind < WSTATS_EVENTS && n < max; kind++)
+		{
+			wstats_event_t * e = &events[n];
+
+			if (!(axis->exceeded & (1 << kind)))
+			{
+				continue;
+			}
+			e->stream = summary->stream;
+			e->axis = a;
+			e->kind = kind;
+			e->sequence = summary->sequence;
+			e->start = summary->start;
+			switch (kind)
+			{
+				case WSTATS_EVENT_MEAN_LOW:
+					e->value = axis->mean;
+					e->limit = limit->mean_low;
+					break;
+				case WSTATS_EVENT_MEAN_HIGH:
+					e->value = axis->mean;
+					e->limit = limit->mean_high;
+					break;
+				case WSTATS_EVENT_RMS:
+					e->value = axis->rms;
+					e->limit = limit->rms_high;
+					break;
+				case WSTATS_EVENT_PEAK:
+					e->value = wstats_peak(axis);
+					e->limit = limit->peak_high;
+					break;
+				default:
+					e->value = axis->crossings;
+					e->limit = limit->crossings_high;
+					break;
+			}
+			n++;
+		}
+	}
+	return n;
+}
+
+#if WSTATS_BENCH_ENABLE
+
+#include "timebase.h"
+
+#define WSTATS_BENCH_WINDOW		50
+#define WSTATS_BENCH_WINDOWS	4
+
+static volatile int16_t wstats_sink;
+
+// Average cycles per wstats_push() of a three axis sample that doesn't end
+// a window, and per call that does (the summary of all axes), with the
+// crossing counter on; then per wstats_events() call with one limit broken
+// on every axis. Printed as "<function> <cycles>" lines; the timebase_now()
+// calls around each call are subtracted.
+void wstats_bench(void (*put)(char))
+{
+	static wstats_t ws;
+	const wstats_limit_t limit = {WSTATS_NO_LOW, WSTATS_NO_HIGH, 100,
+		WSTATS_NO_LIMIT, 2000, 200, 255};
+	wstats_summary_t summary;
+	wstats_event_t events[WSTATS_AXES];
+	uint32_t start, overhead, push = 0, close = 0, report = 0;
+	uint16_t pushes = 0, closes = 0, i;
+	int16_t v[3];
+
+	start = timebase_now();
+	overhead = timebase_now() - start;
+
+	wstats_init(&ws, 0, WSTATS_BENCH_WINDOW, &limit);
+	for (i = 0; i < WSTATS_BENCH_WINDOW * WSTATS_BENCH_WINDOWS; i++)
+	{
+		uint8_t done;
+
+		// gravity on z, a vibration on all axes
+		v[0] = (i & 7) * 997 - 3500;
+		v[1] = 1200 - (i & 3) * 811;
+		v[2] = 16384 + (i & 15) * 211 - 1600;
+
+		start = timebase_now();
+		done = wstats_push(&ws, i * 5000UL, v, &summary);
+		if (done)
+		{
+			close += timebase_now() - start - overhead;
+			closes++;
+			start = timebase_now();
+			wstats_sink = wstats_events(&ws, &summary, events, WSTATS_AXES);
+			report += timebase_now() - start - overhead;
+		}
+		else
+		{
+			push += timebase_now() - start - overhead;
+			pushes++;
+		}
+	}
+
+	timebase_bench_line(put, "wstats_push", push, pushes);
+	timebase_bench_line(put, "wstats_push_close", close, closes);
+	timebase_bench_line(put, "wstats_events", report, closes);
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef WSTATS_H_INCLUDED
+#define WSTATS_H_INCLUDED
+
+#include <inttypes.h>
+
+// Windowed statistics of a three axis stream (accelerometer, gyro or
+// magnetometer), so a window of samples can be sent as one summary record
+// instead of raw data. Every window of a configured number of samples gives
+// per axis the mean, variance, RMS, minimum and maximum (the peak is the
+// larger magnitude of the two) and the upward crossings of |x| through a
+// level. Windows that break one of the stream's limits also give event
+// records.
+//
+// Like Welford's method the accumulators hold deviations from a running
+// mean instead of raw sums, which avoids the cancellation of
+// sum(x^2) - sum(x)^2 / n when the mean is large (gravity on an axis). The
+// mean used is the previous window's, so a sample costs one subtraction, a
+// 16 x 16 bit multiply and a few additions, all exact in integers; the one
+// division and square root per axis are at the end of the window. Results
+// are exact up to rounding: mean and RMS to 0.5 LSB, variance to 0.5 LSB^2.
+//
+// tools/wstats_test.c checks this against double precision on the host.
+// Cycle counts on the ATmega1284P are printed by wstats_bench() (build with
+// WSTATS_BENCH_ENABLE 1); there are none without the board.
+
+#define WSTATS_AXES			3
+#define WSTATS_WINDOW_MAX	32767	// samples, keeps the sums in 32 bits
+
+#ifndef WSTATS_BENCH_ENABLE
+#define WSTATS_BENCH_ENABLE	0
+#endif
+
+// Disable a limit
+#define WSTATS_NO_LOW		INT16_MIN
+#define WSTATS_NO_HIGH		INT16_MAX
+#define WSTATS_NO_LIMIT		0xFFFF
+
+enum WSTATS_EVENT_t
+{
+	WSTATS_EVENT_MEAN_LOW,
+	WSTATS_EVENT_MEAN_HIGH,
+	WSTATS_EVENT_RMS,
+	WSTATS_EVENT_PEAK,
+	WSTATS_EVENT_CROSSINGS,
+	WSTATS_EVENTS
+};
+
+// Limits of a stream, the same for all axes, in LSB
+typedef struct
+{
+	int16_t mean_low;        // WSTATS_NO_LOW to disable
+	int16_t mean_high;       // WSTATS_NO_HIGH to disable
+	uint16_t rms_high;       // WSTATS_NO_LIMIT to disable
+	uint16_t peak_high;      // largest |x|, WSTATS_NO_LIMIT to disable
+	uint16_t level;          // |x| crossing level, 0 counts nothing
+	uint16_t hysteresis;     // |x| must fall this far below level to re-arm
+	uint8_t crossings_high;  // 255 to disable
+} wstats_limit_t;
+
+typedef struct
+{
+	int16_t ref;             // deviations are taken from this
+	int32_t sum;             // of x - ref
+	uint32_t square;         // of (x - ref)^2, low 32 bits
+	uint16_t square_high;    // and the bits above
+	int16_t min, max;
+	uint8_t crossings;
+	uint8_t above;           // |x| above level, waiting to fall back
+} wstats_acc_t;
+
+typedef struct
+{
+	uint8_t stream;          // caller's id, copied into the records
+	uint16_t window;         // samples per window
+	uint16_t count;          // samples in the current window
+	uint16_t sequence;       // windows closed
+	uint32_t start;          // stamp of the current window's first sample
+	uint8_t started;         // ref holds a mean or a first sample
+	wstats_limit_t limit;
+	wstats_acc_t acc[WSTATS_AXES];
+} wstats_t;
+
+// Summary of one window, 53 bytes
+typedef struct
+{
+	int16_t mean;
+	uint16_t rms;
+	uint32_t variance;       // LSB^2
+	int16_t min, max;
+	uint8_t crossings;       // saturates at 255
+	uint8_t exceeded;        // bit n: limit of enum WSTATS_EVENT_t n broken
+} wstats_axis_t;
+
+typedef struct
+{
+	uint8_t stream;
+	uint16_t sequence;
+	uint32_t start;          // stamps of the first and last sample
+	uint32_t end;
+	wstats_axis_t axis[WSTATS_AXES];
+} wstats_summary_t;
+
+// A broken limit, 17 bytes
+typedef struct
+{
+	uint8_t stream;
+	uint8_t axis;
+	uint8_t kind;            // enum WSTATS_EVENT_t
+	uint16_t sequence;       // window
+	uint32_t start;
+	int32_t value;
+	int32_t limit;
+} wstats_event_t;
+
+static inline uint16_t wstats_peak(const wstats_axis_t * axis)
+{
+	uint16_t low = axis->min < 0 ? (uint16_t)-(int32_t)axis->min : axis->min;
+	uint16_t high = axis->max < 0 ? (uint16_t)-(int32_t)axis->max : axis->max;
+	return low > high ? low : high;
+}
+
+void wstats_init(wstats_t * ws, uint8_t stream, uint16_t window,
+	const wstats_limit_t * limit);
+uint8_t wstats_push(wstats_t * ws, uint32_t stamp, const int16_t * xyz,
+	wstats_summary_t * summary);
+uint8_t wstats_events(const wstats_t * ws, const wstats_summary_t * summary,
+	wstats_event_t * events, uint8_t max);
+void wstats_bench(void (*put)(char));
+
+#endif